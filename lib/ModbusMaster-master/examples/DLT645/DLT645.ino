@@ -0,0 +1,88 @@
+/*
+
+  DLT645.ino - example reading a DL/T 645-2007 meter and a Modbus slave
+  on the same RS485 bus, both driven by one ModbusBusScheduler.
+
+  Meter points come from dlt645Config.json: DI strings are written DI0
+  first and converted with DLT645Master::parseDI(); Factor scales the BCD
+  value to engineering units.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+#include <ModbusMaster.h>
+#include <ModbusBusScheduler.h>
+#include <DLT645Master.h>
+
+
+ModbusMaster node;
+DLT645Master master;
+
+ModbusPoint modbusPoints[] = { { 4, 400, 1, 0, 0 } };
+ModbusReadBlock blocks[1];
+ModbusPollPlanner planner(modbusPoints, 1, blocks, 1);
+
+// DI, Factor
+DLT645Point meterPoints[] = {
+  { 0, 0.1f },     // "00010102" phase A voltage [V]
+  { 0, 0.001f },   // "00010202" phase A current [A]
+  { 0, 0.0001f },  // "00010302" phase A active power [kW]
+  { 0, 0.01f }     // "00000000" total active energy [kWh]
+};
+const char* meterDIs[] = { "00010102", "00010202", "00010302", "00000000" };
+DLT645Meter meter(master, meterPoints, 4);
+
+ModbusBusScheduler scheduler(node);
+
+
+void meterValue(DLT645Meter* m, uint8_t u8Point, double dValue)
+{
+  Serial.print(meterDIs[u8Point]);
+  Serial.print(": ");
+  Serial.println(dValue, 4);
+}
+
+
+void setup()
+{
+  uint8_t i;
+
+  Serial.begin(115200);
+  Serial2.begin(9600, SERIAL_8E1);
+
+  node.begin(1, Serial2);
+  master.begin(Serial2);
+  master.setNonBlocking(true);
+
+  for (i = 0; i < 4; i++)
+  {
+    DLT645Master::parseDI(meterDIs[i], &meterPoints[i].u32DI);
+  }
+  meter.setAddress("781062211123");
+  meter.onPoint(meterValue);
+
+  planner.plan();
+  scheduler.setBaudRate(9600);
+  scheduler.addSlave(1, planner, 1000, 3, 100);
+  scheduler.addDevice(meter, 60000, 5, 200);
+}
+
+
+void loop()
+{
+  // advances whichever transaction is on the bus; never blocks
+  scheduler.run();
+}
@@ -0,0 +1,77 @@
+/*
+
+  NonBlocking.ino - example using ModbusMaster library in non-blocking
+  mode, so that loop() keeps running while the slave is answering.
+
+  Requests are transmitted immediately; the response is collected by
+  calling poll() on every pass through loop() (or from a scheduler task)
+  and handed to the completion callback.
+
+  Library:: ModbusMaster
+
+  Copyright:: 2009-2016 Doc Walker
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+#include <ModbusMaster.h>
+
+
+// instantiate ModbusMaster object
+ModbusMaster node;
+
+uint32_t lastRequest;
+
+
+void responseReady(ModbusMaster* master, uint8_t result)
+{
+  if (result == master->ku8MBSuccess)
+  {
+    Serial.print("Voltage: ");
+    Serial.println(master->getResponseBuffer(0) / 10.0f);
+  }
+  else
+  {
+    Serial.print("Modbus error 0x");
+    Serial.println(result, HEX);
+  }
+}
+
+
+void setup()
+{
+  // use Serial (port 0); initialize Modbus communication baud rate
+  Serial.begin(9600);
+
+  // communicate with Modbus slave ID 2 over Serial (port 0)
+  node.begin(2, Serial);
+  node.setNonBlocking(true);
+  node.onComplete(responseReady);
+}
+
+
+void loop()
+{
+  // start a new request once a second, unless one is still in flight
+  if (!node.busy() && millis() - lastRequest >= 1000)
+  {
+    lastRequest = millis();
+    node.readInputRegisters(400, 1);
+  }
+
+  // collect whatever part of the response has arrived; never blocks
+  node.poll();
+
+  // ... other work (MQTT, WiFi, ...) keeps running here
+}
@@ -0,0 +1,833 @@
+/**
+@file
+DL/T 645-2007 master for electricity meters on an RS485 bus.
+*/
+/*
+
+  DLT645Master.cpp - reads DL/T 645-2007 meters with the same transaction
+  model as ModbusMaster (blocking or non-blocking with poll()), so meters
+  and Modbus slaves can share one ModbusBusScheduler.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "DLT645Master.h"
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+Creates class object; initialize it using DLT645Master::begin().
+
+@ingroup dlt645
+*/
+DLT645Master::DLT645Master(void)
+{
+  _serial = 0;
+  _transport = 0;
+  _idle = 0;
+  _preTransmission = 0;
+  _postTransmission = 0;
+  _onComplete = 0;
+  _bNonBlocking = false;
+  _u8State = ku8DLTStateIdle;
+  _u8Status = ku8DLTSuccess;
+  _u8Preamble = 4;
+  _u8DataOffset = 0;
+  _u8DataLength = 0;
+  _u8MeterError = 0;
+  _u32DI = 0;
+  _u16ResponseTimeout = ku16DLTResponseTimeout;
+}
+
+
+/**
+Initialize class object.
+
+@param &serial reference to serial port object (Serial, Serial1, ... Serial3)
+@ingroup dlt645
+*/
+void DLT645Master::begin(Stream &serial)
+{
+  _serial = &serial;
+  _transport = 0;
+  _u8State = ku8DLTStateIdle;
+  _u8Status = ku8DLTSuccess;
+}
+
+
+/**
+Initialize class object on a frame-delimiting transport.
+
+Responses are taken from the transport one frame at a time; see
+ModbusMaster::begin(uint8_t, SerialTransport&).
+
+@param &transport transport wrapping the meter's serial port
+@ingroup dlt645
+*/
+void DLT645Master::begin(SerialTransport &transport)
+{
+  begin((Stream &)transport);
+  _transport = &transport;
+}
+
+
+/**
+Set response timeout.
+
+@param u16ResponseTimeout time allowed for a complete response [ms]
+@ingroup dlt645
+*/
+void DLT645Master::setResponseTimeout(uint16_t u16ResponseTimeout)
+{
+  _u16ResponseTimeout = u16ResponseTimeout;
+}
+
+
+/**
+Set number of FE wake-up bytes sent ahead of each request (default 4).
+
+@ingroup dlt645
+*/
+void DLT645Master::setPreamble(uint8_t u8Preamble)
+{
+  _u8Preamble = u8Preamble;
+}
+
+
+/**
+Set idle time callback function (cooperative multitasking).
+
+Called while a blocking transaction waits for its response.
+
+@ingroup dlt645
+*/
+void DLT645Master::idle(void (*idle)())
+{
+  _idle = idle;
+}
+
+
+/**
+Set pre-transmission callback function, e.g. to drive the RS485 DE/RE pin.
+
+@ingroup dlt645
+*/
+void DLT645Master::preTransmission(void (*preTransmission)())
+{
+  _preTransmission = preTransmission;
+}
+
+
+/**
+Set post-transmission callback function.
+
+@ingroup dlt645
+*/
+void DLT645Master::postTransmission(void (*postTransmission)())
+{
+  _postTransmission = postTransmission;
+}
+
+
+/**
+Set transaction completion callback function.
+
+The response data is valid for the duration of the call.
+
+@see ModbusMaster::onComplete()
+@ingroup dlt645
+*/
+void DLT645Master::onComplete(void (*onComplete)(DLT645Master*, uint8_t))
+{
+  _onComplete = onComplete;
+}
+
+
+/**
+Select blocking or non-blocking transactions.
+
+@param bNonBlocking true to return ku8DLTPending right after transmitting
+@see ModbusMaster::setNonBlocking()
+@ingroup dlt645
+*/
+void DLT645Master::setNonBlocking(bool bNonBlocking)
+{
+  _bNonBlocking = bNonBlocking;
+}
+
+
+/**
+Advance the transaction in flight; never blocks.
+
+@return ku8DLTPending while receiving; otherwise status of last transaction
+@ingroup dlt645
+*/
+uint8_t DLT645Master::poll(void)
+{
+  uint8_t u8Status = ku8DLTPending;
+  uint16_t u16Count, u16Left;
+  
+  if (_u8State != ku8DLTStateReceiving)
+  {
+    return _u8Status;
+  }
+  
+  if (_transport)
+  {
+    // frame mode: the transport hands over a complete frame in one call
+    u16Count = _transport->readFrame(_u8Frame, sizeof(_u8Frame));
+    if (u16Count)
+    {
+      _u8FrameSize = 0;
+      u8Status = consumeResponse(u16Count);
+      if (u8Status == ku8DLTPending)
+      {
+        // truncated frame; discard it and wait for another until timeout
+        _u8FrameSize = 0;
+      }
+    }
+  }
+  else
+  {
+    while (u8Status == ku8DLTPending && (u16Count = _serial->available()))
+    {
+      // up to the end of the header first, then up to the end of the frame
+      u16Left = (_u8FrameSize < ku8DLTHeaderSize ? ku8DLTHeaderSize : _u16FrameLen) - _u8FrameSize;
+      if (u16Count > u16Left)
+      {
+        u16Count = u16Left;
+      }
+      u16Count = _serial->readBytes(_u8Frame + _u8FrameSize, u16Count);
+      if (!u16Count)
+      {
+        break;
+      }
+      u8Status = consumeResponse(u16Count);
+    }
+  }
+  
+  if (u8Status != ku8DLTPending)
+  {
+    return u8Status;
+  }
+  if ((millis() - _u32StartTime) > _u16ResponseTimeout)
+  {
+    return finishTransaction(ku8DLTResponseTimedOut);
+  }
+  return ku8DLTPending;
+}
+
+
+/**
+Report whether a transaction is in flight.
+
+@ingroup dlt645
+*/
+bool DLT645Master::busy(void)
+{
+  return _u8State != ku8DLTStateIdle;
+}
+
+
+/**
+Read one data item (control code 0x11).
+
+@param pu8Address meter address, 6 bytes, A0 (least significant) first
+@param u32DI data identifier, DI3 in the high byte
+@return 0 on success; exception number on failure; ku8DLTPending in
+non-blocking mode
+@ingroup dlt645
+*/
+uint8_t DLT645Master::readData(const uint8_t* pu8Address, uint32_t u32DI)
+{
+  uint8_t u8Status;
+  uint8_t u8Size = 0;
+  uint8_t u8Start, i;
+  uint8_t u8Sum = 0;
+  
+  if (_u8State != ku8DLTStateIdle)
+  {
+    return ku8DLTBusy;
+  }
+  
+  for (i = 0; i < _u8Preamble && i < 4; i++)
+  {
+    _u8Frame[u8Size++] = ku8DLTWakeUp;
+  }
+  u8Start = u8Size;
+  _u8Frame[u8Size++] = ku8DLTStart;
+  for (i = 0; i < 6; i++)
+  {
+    _u8Frame[u8Size++] = _u8Address[i] = pu8Address[i];
+  }
+  _u8Frame[u8Size++] = ku8DLTStart;
+  _u8Frame[u8Size++] = ku8DLTReadData;
+  _u8Frame[u8Size++] = 4;
+  for (i = 0; i < 4; i++)
+  {
+    // DI0 first
+    _u8Frame[u8Size++] = (uint8_t)(u32DI >> (8 * i)) + ku8DLTScramble;
+  }
+  for (i = u8Start; i < u8Size; i++)
+  {
+    u8Sum += _u8Frame[i];
+  }
+  _u8Frame[u8Size++] = u8Sum;
+  _u8Frame[u8Size++] = ku8DLTEnd;
+  
+  transmitRequest(u8Size);
+  
+  _u32DI = u32DI;
+  _u8FrameSize = 0;
+  _u16FrameLen = ku8DLTHeaderSize;
+  _u8DataLength = 0;
+  _u8MeterError = 0;
+  _u8Status = ku8DLTPending;
+  _u8State = ku8DLTStateReceiving;
+  _u32StartTime = millis();
+  
+  if (_bNonBlocking)
+  {
+    return ku8DLTPending;
+  }
+  
+  while ((u8Status = poll()) == ku8DLTPending)
+  {
+    if (_idle)
+    {
+      _idle();
+    }
+  }
+  return u8Status;
+}
+
+
+/**
+Data item of the last transaction.
+
+@ingroup dlt645
+*/
+uint32_t DLT645Master::getDI(void)
+{
+  return _u32DI;
+}
+
+
+/**
+Descrambled value bytes of the last successful response, after the DI,
+least significant byte first.
+
+@ingroup dlt645
+*/
+const uint8_t* DLT645Master::getData(void)
+{
+  return _u8Frame + _u8DataOffset;
+}
+
+
+/**
+Number of value bytes returned by DLT645Master::getData().
+
+@ingroup dlt645
+*/
+uint8_t DLT645Master::getDataLength(void)
+{
+  return _u8DataLength;
+}
+
+
+/**
+Error byte (ERR) of the last abnormal response.
+
+Bit 1: no data requested, bit 2: password error, bit 3: communication
+rate cannot be changed, ... see DL/T 645-2007 table A.1.
+
+@ingroup dlt645
+*/
+uint8_t DLT645Master::getMeterError(void)
+{
+  return _u8MeterError;
+}
+
+
+/**
+Convert the BCD value of the last response to engineering units.
+
+Current, power and power factor items carry a sign in the most
+significant bit; see DLT645Master::isSigned(). The result is a double,
+since an 8 digit energy reading does not fit the 24 bit mantissa of a
+float.
+
+@param u8Len value bytes to decode (0 for all; at most 4)
+@param dFactor scale of the least significant digit (Factor)
+@param pdValue receives the scaled value
+@return ku8DLTSuccess, or ku8DLTInvalidData
+@ingroup dlt645
+*/
+uint8_t DLT645Master::getValue(uint8_t u8Len, double dFactor, double* pdValue)
+{
+  int32_t i32Value;
+  
+  if (!u8Len)
+  {
+    u8Len = _u8DataLength;
+  }
+  if (u8Len > _u8DataLength ||
+    !bcdToInt(getData(), u8Len, isSigned(_u32DI), &i32Value))
+  {
+    return ku8DLTInvalidData;
+  }
+  *pdValue = i32Value * dFactor;
+  return ku8DLTSuccess;
+}
+
+
+/**
+Parse a meter address as printed on the meter (MeterAddress).
+
+@param szAddress 12 decimal digits, most significant first
+@param pu8Address receives 6 BCD bytes, A0 (least significant) first
+@return false if szAddress is not 12 digits
+@ingroup dlt645
+*/
+bool DLT645Master::parseAddress(const char* szAddress, uint8_t* pu8Address)
+{
+  uint8_t i, u8Hi, u8Lo;
+  
+  if (strlen(szAddress) != 12)
+  {
+    return false;
+  }
+  for (i = 0; i < 6; i++)
+  {
+    u8Hi = szAddress[2 * i] - '0';
+    u8Lo = szAddress[2 * i + 1] - '0';
+    if (u8Hi > 9 || u8Lo > 9)
+    {
+      return false;
+    }
+    pu8Address[5 - i] = (u8Hi << 4) | u8Lo;
+  }
+  return true;
+}
+
+
+/**
+Parse a data identifier as written in dlt645Config.json.
+
+The string lists DI0..DI3 in transmission order, so "00010102" is
+DI 02 01 01 00 (phase A voltage).
+
+@param szDI 8 hexadecimal digits
+@param pu32DI receives the DI, DI3 in the high byte
+@return false if szDI is not 8 hexadecimal digits
+@ingroup dlt645
+*/
+bool DLT645Master::parseDI(const char* szDI, uint32_t* pu32DI)
+{
+  uint8_t i, u8Nibble;
+  uint8_t u8Byte = 0;
+  uint32_t u32DI = 0;
+  char c;
+  
+  if (strlen(szDI) != 8)
+  {
+    return false;
+  }
+  for (i = 0; i < 8; i++)
+  {
+    c = szDI[i];
+    if (c >= '0' && c <= '9')
+    {
+      u8Nibble = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      u8Nibble = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+      u8Nibble = c - 'A' + 10;
+    }
+    else
+    {
+      return false;
+    }
+    u8Byte = (u8Byte << 4) | u8Nibble;
+    if (i & 1)
+    {
+      u32DI |= (uint32_t)u8Byte << (4 * (i - 1));
+      u8Byte = 0;
+    }
+  }
+  *pu32DI = u32DI;
+  return true;
+}
+
+
+/**
+Whether the value of a data item carries a sign bit.
+
+True for the instantaneous current, active/reactive/apparent power and
+power factor items (DI3 = 02, DI2 = 02..06).
+
+@ingroup dlt645
+*/
+bool DLT645Master::isSigned(uint32_t u32DI)
+{
+  uint8_t u8DI2 = (u32DI >> 16) & 0xFF;
+  
+  return (u32DI >> 24) == 0x02 && u8DI2 >= 0x02 && u8DI2 <= 0x06;
+}
+
+
+/**
+Convert packed BCD, least significant byte first, to an integer.
+
+@param pu8Data BCD bytes
+@param u8Len number of bytes (at most 4)
+@param bSigned most significant bit of the last byte is a sign bit
+@param pi32Value receives the value
+@return false on a digit above 9 or u8Len out of range
+@ingroup dlt645
+*/
+bool DLT645Master::bcdToInt(const uint8_t* pu8Data, uint8_t u8Len, bool bSigned,
+  int32_t* pi32Value)
+{
+  int32_t i32Value = 0;
+  uint8_t u8Byte;
+  bool bNegative = false;
+  
+  if (!u8Len || u8Len > 4)
+  {
+    return false;
+  }
+  while (u8Len--)
+  {
+    u8Byte = pu8Data[u8Len];
+    if (bSigned)
+    {
+      bNegative = u8Byte & 0x80;
+      u8Byte &= 0x7F;
+      bSigned = false;
+    }
+    if ((u8Byte >> 4) > 9 || (u8Byte & 0x0F) > 9)
+    {
+      return false;
+    }
+    i32Value = i32Value * 100 + (u8Byte >> 4) * 10 + (u8Byte & 0x0F);
+  }
+  *pi32Value = bNegative ? -i32Value : i32Value;
+  return true;
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Transmit request frame over selected serial port.
+
+@param u8Size size of request frame including preamble
+*/
+void DLT645Master::transmitRequest(uint8_t u8Size)
+{
+  // flush receive buffer before transmitting request
+  while (_serial->read() != -1);
+  
+  if (_preTransmission)
+  {
+    _preTransmission();
+  }
+  _serial->write(_u8Frame, u8Size);
+  
+  _serial->flush();    // flush transmit buffer
+  if (_postTransmission)
+  {
+    _postTransmission();
+  }
+}
+
+
+/**
+Account for response bytes stored at the end of the frame buffer.
+
+Drops wake-up bytes and noise ahead of the first 68, takes the frame
+length from L once the header is complete, and finishes the transaction
+once the frame is complete.
+
+@param u16Count bytes appended to the frame buffer
+@return ku8DLTPending while more bytes are expected; otherwise final status
+*/
+uint8_t DLT645Master::consumeResponse(uint16_t u16Count)
+{
+  const uint8_t* pu8In = _u8Frame + _u8FrameSize;
+  uint8_t u8Byte;
+  
+  while (u16Count--)
+  {
+    u8Byte = *pu8In++;
+    if (!_u8FrameSize && u8Byte != ku8DLTStart)
+    {
+      continue;
+    }
+    _u8Frame[_u8FrameSize++] = u8Byte;
+    
+    if (_u8FrameSize == 8 && u8Byte != ku8DLTStart)
+    {
+      return finishTransaction(ku8DLTInvalidFrame);
+    }
+    if (_u8FrameSize == ku8DLTHeaderSize)
+    {
+      // header + data + CS + 16
+      _u16FrameLen = ku8DLTHeaderSize + u8Byte + 2;
+      if (_u16FrameLen >= sizeof(_u8Frame))
+      {
+        return finishTransaction(ku8DLTInvalidFrame);
+      }
+    }
+    if (_u8FrameSize >= ku8DLTHeaderSize && _u8FrameSize == _u16FrameLen)
+    {
+      return finishTransaction(ku8DLTSuccess);
+    }
+  }
+  return ku8DLTPending;
+}
+
+
+/**
+Complete transaction in flight.
+
+Verifies checksum, address, control code and DI, and descrambles the
+value bytes in place.
+
+@param u8Status status determined while receiving the response
+@return final transaction status
+*/
+uint8_t DLT645Master::finishTransaction(uint8_t u8Status)
+{
+  uint8_t* pu8Frame = _u8Frame;
+  uint8_t u8Len, i;
+  uint8_t u8Sum = 0;
+  uint32_t u32DI = 0;
+  
+  if (!u8Status)
+  {
+    u8Len = pu8Frame[9];
+    for (i = 0; i < ku8DLTHeaderSize + u8Len; i++)
+    {
+      u8Sum += pu8Frame[i];
+    }
+    if (pu8Frame[ku8DLTHeaderSize + u8Len] != u8Sum ||
+      pu8Frame[ku8DLTHeaderSize + u8Len + 1] != ku8DLTEnd)
+    {
+      u8Status = ku8DLTInvalidChecksum;
+    }
+    
+    for (i = 0; !u8Status && i < 6; i++)
+    {
+      if (_u8Address[i] != 0xAA && pu8Frame[1 + i] != _u8Address[i])
+      {
+        u8Status = ku8DLTInvalidAddress;
+      }
+    }
+    
+    if (!u8Status)
+    {
+      for (i = 0; i < u8Len; i++)
+      {
+        pu8Frame[ku8DLTHeaderSize + i] -= ku8DLTScramble;
+      }
+      
+      switch (pu8Frame[8])
+      {
+        case ku8DLTReadDataReply:
+        case ku8DLTReadDataFollows:
+          if (u8Len < 4)
+          {
+            u8Status = ku8DLTInvalidFrame;
+            break;
+          }
+          for (i = 0; i < 4; i++)
+          {
+            u32DI |= (uint32_t)pu8Frame[ku8DLTHeaderSize + i] << (8 * i);
+          }
+          if (u32DI != _u32DI)
+          {
+            u8Status = ku8DLTInvalidDI;
+            break;
+          }
+          _u8DataOffset = ku8DLTHeaderSize + 4;
+          _u8DataLength = u8Len - 4;
+          break;
+        
+        case ku8DLTReadDataError:
+          _u8MeterError = u8Len ? pu8Frame[ku8DLTHeaderSize] : 0;
+          u8Status = ku8DLTMeterError;
+          break;
+        
+        default:
+          u8Status = ku8DLTInvalidControl;
+          break;
+      }
+    }
+  }
+  
+  if (u8Status)
+  {
+    _u8DataLength = 0;
+  }
+  _u8Status = u8Status;
+  _u8State = ku8DLTStateIdle;
+  
+  if (_onComplete)
+  {
+    _onComplete(this, u8Status);
+  }
+  return u8Status;
+}
+
+
+/* _____METER________________________________________________________________ */
+/**
+Constructor.
+
+@param master DLT645Master attached to the meter's bus
+@param points data items to read; u8Status and dValue are maintained here
+@param u8Points number of data items
+@ingroup dlt645
+*/
+DLT645Meter::DLT645Meter(DLT645Master& master, DLT645Point* points, uint8_t u8Points) :
+  _master(master)
+{
+  uint8_t i;
+  
+  memset(_u8Address, 0xAA, sizeof(_u8Address));
+  _points = points;
+  _u8Points = u8Points;
+  _onPoint = 0;
+  for (i = 0; i < u8Points; i++)
+  {
+    _points[i].dValue = 0;
+    _points[i].u8Status = DLT645Master::ku8DLTPending;
+  }
+}
+
+
+/**
+Set meter address from MeterAddress.
+
+@return false if szAddress is not 12 digits; the address is unchanged
+@ingroup dlt645
+*/
+bool DLT645Meter::setAddress(const char* szAddress)
+{
+  return DLT645Master::parseAddress(szAddress, _u8Address);
+}
+
+
+/**
+Set meter address, 6 bytes, A0 first.
+
+The default AA AA AA AA AA AA addresses whichever single meter is on the
+bus.
+
+@ingroup dlt645
+*/
+void DLT645Meter::setAddress(const uint8_t* pu8Address)
+{
+  memcpy(_u8Address, pu8Address, sizeof(_u8Address));
+}
+
+
+/**
+Set point handler, called with the scaled value of every point read.
+
+@ingroup dlt645
+*/
+void DLT645Meter::onPoint(DLT645PointHandler onPoint)
+{
+  _onPoint = onPoint;
+}
+
+
+/**
+Number of data items.
+
+@ingroup dlt645
+*/
+uint8_t DLT645Meter::points()
+{
+  return _u8Points;
+}
+
+
+/**
+Data item and its last value.
+
+@param u8Point point index (0..points() - 1)
+@ingroup dlt645
+*/
+const DLT645Point& DLT645Meter::point(uint8_t u8Point)
+{
+  return _points[u8Point];
+}
+
+
+/**
+One Read Data request per point.
+*/
+uint8_t DLT645Meter::requests()
+{
+  return _u8Points;
+}
+
+
+/**
+Transmit the read of one point.
+*/
+uint8_t DLT645Meter::request(uint8_t u8Point)
+{
+  return _master.readData(_u8Address, _points[u8Point].u32DI);
+}
+
+
+uint8_t DLT645Meter::poll()
+{
+  return _master.poll();
+}
+
+
+/**
+Scale the value of a point just read and hand it to the point handler.
+*/
+void DLT645Meter::complete(uint8_t u8Point, uint8_t u8Status)
+{
+  DLT645Point& point = _points[u8Point];
+  
+  if (u8Status == DLT645Master::ku8DLTSuccess)
+  {
+    u8Status = _master.getValue(point.u8Len, point.dFactor, &point.dValue);
+  }
+  point.u8Status = u8Status;
+  
+  if (u8Status == DLT645Master::ku8DLTSuccess && _onPoint)
+  {
+    _onPoint(this, u8Point, point.dValue);
+  }
+}
@@ -0,0 +1,302 @@
+/**
+@file
+DL/T 645-2007 master for electricity meters on an RS485 bus.
+
+@defgroup dlt645 DLT645Master Meter Reading
+*/
+/*
+
+  DLT645Master.h - reads DL/T 645-2007 meters with the same transaction
+  model as ModbusMaster (blocking or non-blocking with poll()), so meters
+  and Modbus slaves can share one ModbusBusScheduler.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef DLT645Master_h
+#define DLT645Master_h
+
+
+/* _____STANDARD INCLUDES____________________________________________________ */
+#include "Arduino.h"
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "SerialTransport.h"
+#include "PolledDevice.h"
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Reads data items (DI) from DL/T 645-2007 meters.
+
+Frames are 68 A0..A5 68 C L DATA CS 16, preceded on transmission by
+FE wake-up bytes; DATA is scrambled by adding 0x33 to every byte and CS
+is the sum of all bytes from the first 68. Status codes coincide with
+ModbusMaster's where the meaning is the same (success, timeout, pending,
+busy), so both masters can be driven by one ModbusBusScheduler.
+
+@ingroup dlt645
+*/
+class DLT645Master
+{
+  public:
+    DLT645Master();
+    
+    void begin(Stream &serial);
+    void begin(SerialTransport &transport);
+    void setResponseTimeout(uint16_t);
+    void setPreamble(uint8_t);
+    void idle(void (*)());
+    void preTransmission(void (*)());
+    void postTransmission(void (*)());
+    void onComplete(void (*)(DLT645Master*, uint8_t));
+    void setNonBlocking(bool);
+    uint8_t poll(void);
+    bool busy(void);
+    
+    uint8_t readData(const uint8_t*, uint32_t);
+    
+    uint32_t       getDI(void);
+    const uint8_t* getData(void);
+    uint8_t        getDataLength(void);
+    uint8_t        getMeterError(void);
+    uint8_t        getValue(uint8_t, double, double*);
+    
+    static bool    parseAddress(const char*, uint8_t*);
+    static bool    parseDI(const char*, uint32_t*);
+    static bool    isSigned(uint32_t);
+    static bool    bcdToInt(const uint8_t*, uint8_t, bool, int32_t*);
+    
+    /**
+    DLT645Master success.
+    
+    A normal response (control code 0x91) was received with valid
+    framing, checksum, meter address and DI.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTSuccess                   = 0x00;
+    
+    /**
+    DLT645Master invalid response address exception.
+    
+    The meter address in the response does not match that of the request.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidAddress            = 0xE0;
+    
+    /**
+    DLT645Master invalid response control code exception.
+    
+    The response is neither a normal nor an abnormal read response.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidControl            = 0xE1;
+    
+    /**
+    DLT645Master response timed out exception.
+    
+    Same value as ModbusMaster::ku8MBResponseTimedOut.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTResponseTimedOut          = 0xE2;
+    
+    /**
+    DLT645Master invalid response checksum exception.
+    
+    CS or the 16 end marker of the response is wrong.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidChecksum           = 0xE3;
+    
+    /**
+    DLT645Master transaction pending.
+    
+    Same value as ModbusMaster::ku8MBPending.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTPending                   = 0xE4;
+    
+    /**
+    DLT645Master busy exception.
+    
+    Same value as ModbusMaster::ku8MBBusy.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTBusy                      = 0xE5;
+    
+    /**
+    DLT645Master abnormal response exception.
+    
+    The meter answered with control code 0xD1; its error byte is
+    available from DLT645Master::getMeterError().
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTMeterError                = 0xE6;
+    
+    /**
+    DLT645Master invalid response DI exception.
+    
+    The data item in the response does not match that of the request.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidDI                 = 0xE7;
+    
+    /**
+    DLT645Master invalid frame exception.
+    
+    The second 68 start byte is missing or the frame does not fit the
+    receive buffer.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidFrame              = 0xE8;
+    
+    /**
+    DLT645Master invalid data exception.
+    
+    Returned by DLT645Master::getValue() for data that is not BCD or does
+    not hold the requested number of bytes.
+    
+    @ingroup dlt645
+    */
+    static const uint8_t ku8DLTInvalidData               = 0xE9;
+  
+  private:
+    Stream* _serial;                                             ///< reference to serial port object
+    SerialTransport* _transport;                                 ///< frame-level transport, if begun with one
+    
+    static const uint8_t ku8DLTReadData                  = 0x11; ///< control code 0x11 Read Data
+    static const uint8_t ku8DLTReadDataReply             = 0x91; ///< normal response to Read Data
+    static const uint8_t ku8DLTReadDataFollows           = 0xB1; ///< normal response, further frames follow
+    static const uint8_t ku8DLTReadDataError             = 0xD1; ///< abnormal response to Read Data
+    static const uint8_t ku8DLTStart                     = 0x68; ///< frame start byte
+    static const uint8_t ku8DLTEnd                       = 0x16; ///< frame end byte
+    static const uint8_t ku8DLTWakeUp                    = 0xFE; ///< preamble byte
+    static const uint8_t ku8DLTScramble                  = 0x33; ///< added to every data byte
+    static const uint8_t ku8DLTHeaderSize                = 10;   ///< 68 A0..A5 68 C L
+    
+    // DL/T 645 timeout [milliseconds]
+    static const uint16_t ku16DLTResponseTimeout         = 1000; ///< DL/T 645 timeout [milliseconds]
+    
+    // transaction state machine
+    static const uint8_t ku8DLTStateIdle                 = 0;    ///< no transaction in flight
+    static const uint8_t ku8DLTStateReceiving            = 1;    ///< request sent, collecting response
+    
+    uint8_t  _u8Frame[256];                                      ///< request/response frame
+    uint8_t  _u8FrameSize;                                       ///< bytes of response frame received so far
+    uint16_t _u16FrameLen;                                       ///< length of response frame once L is known
+    uint8_t  _u8Address[6];                                      ///< meter address of request, A0 first
+    uint32_t _u32DI;                                             ///< data item of request
+    uint8_t  _u8DataOffset;                                      ///< offset of descrambled value bytes in _u8Frame
+    uint8_t  _u8DataLength;                                      ///< number of value bytes
+    uint8_t  _u8MeterError;                                      ///< error byte of last abnormal response
+    uint8_t  _u8Preamble;                                        ///< FE bytes sent before a request
+    uint8_t  _u8Status;                                          ///< status of last completed transaction
+    uint8_t  _u8State;                                           ///< ku8DLTStateIdle or ku8DLTStateReceiving
+    uint32_t _u32StartTime;                                      ///< millis() when request was transmitted
+    bool     _bNonBlocking;                                      ///< return after TX instead of waiting for RX
+    uint16_t _u16ResponseTimeout;                                ///< response timeout [milliseconds]
+    
+    void    transmitRequest(uint8_t u8Size);
+    uint8_t consumeResponse(uint16_t u16Count);
+    uint8_t finishTransaction(uint8_t u8Status);
+    
+    // idle callback function; gets called during idle time between TX and RX
+    void (*_idle)();
+    // preTransmission callback function; gets called before writing a request
+    void (*_preTransmission)();
+    // postTransmission callback function; gets called after a request has been sent
+    void (*_postTransmission)();
+    // completion callback function; gets called when a transaction finishes
+    void (*_onComplete)(DLT645Master*, uint8_t);
+};
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+/**
+One data item read from a meter.
+
+@ingroup dlt645
+*/
+struct DLT645Point
+{
+  uint32_t u32DI;                                              ///< data identifier, DI3 in the high byte
+  double   dFactor;                                            ///< scale applied to the BCD integer (Factor)
+  uint8_t  u8Len;                                              ///< value bytes to decode, 0 for all (max 4)
+  double   dValue;                                             ///< last value read
+  uint8_t  u8Status;                                           ///< status of last read, ku8DLTSuccess if dValue is valid
+};
+
+class DLT645Meter;
+
+/**
+Point handler; receives the scaled value of one data item.
+
+@ingroup dlt645
+*/
+typedef void (*DLT645PointHandler)(DLT645Meter* meter, uint8_t u8Point, double dValue);
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+All data items of one meter, read as one poll cycle.
+
+DL/T 645-2007 carries one DI per Read Data frame, so a meter's points are
+batched by issuing their reads back to back within one cycle rather than
+scheduling each DI separately. Register with
+ModbusBusScheduler::addDevice() to share a bus with Modbus slaves.
+
+@ingroup dlt645
+*/
+class DLT645Meter : public PolledDevice
+{
+  public:
+    DLT645Meter(DLT645Master&, DLT645Point*, uint8_t);
+    
+    bool    setAddress(const char*);
+    void    setAddress(const uint8_t*);
+    void    onPoint(DLT645PointHandler);
+    uint8_t points();
+    const DLT645Point& point(uint8_t);
+    
+    uint8_t requests();
+    uint8_t request(uint8_t);
+    uint8_t poll();
+    void    complete(uint8_t, uint8_t);
+  
+  private:
+    DLT645Master&      _master;                                  ///< bus master
+    uint8_t            _u8Address[6];                            ///< meter address, A0 first
+    DLT645Point*       _points;                                  ///< data items of this meter
+    uint8_t            _u8Points;                                ///< number of data items
+    DLT645PointHandler _onPoint;
+};
+#endif
+
+/**
+@example examples/DLT645/DLT645.ino
+*/
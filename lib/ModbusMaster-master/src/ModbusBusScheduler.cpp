@@ -0,0 +1,493 @@
+/**
+@file
+Deadline scheduler for several Modbus slaves sharing one RS485 bus.
+*/
+/*
+
+  ModbusBusScheduler.cpp - arbitrates a shared RS485 bus between slaves
+  with per-slave polling intervals, retries and back-off.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusBusScheduler.h"
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+Switches node to non-blocking mode; the scheduler owns the bus from here
+on and node must not be used for blocking requests in parallel.
+
+@param node ModbusMaster attached to the bus's serial port
+@ingroup scheduler
+*/
+ModbusBusScheduler::ModbusBusScheduler(ModbusMaster& node) : _node(node)
+{
+  _u8Slaves = 0;
+  _u8Current = ku8NoSlave;
+  _u32SubmitTime = 0;
+  _u32IdleSince = 0;
+  _onPoint = 0;
+  _onBlock = 0;
+  _onCycle = 0;
+  setBaudRate(9600);
+  _node.setNonBlocking(true);
+}
+
+
+/**
+Set bus baud rate.
+
+Determines the RTU inter-frame gap kept between the end of one
+transaction and the next request: 3.5 character times of 11 bits, or a
+fixed 1.75 ms above 19200 baud as recommended by the Modbus over serial
+line specification.
+
+@param u32BaudRate baud rate of the bus (BaudRate in modbusConfig.json)
+@ingroup scheduler
+*/
+void ModbusBusScheduler::setBaudRate(uint32_t u32BaudRate)
+{
+  if (u32BaudRate > 19200 || u32BaudRate == 0)
+  {
+    _u32FrameGap = 1750;
+  }
+  else
+  {
+    _u32FrameGap = (38500000UL + u32BaudRate - 1) / u32BaudRate;
+  }
+}
+
+
+/**
+Register a slave.
+
+The slave is first polled on the next ModbusBusScheduler::run().
+
+@param u8Id Modbus slave ID (SlaveId)
+@param planner read blocks of the slave; ModbusPollPlanner::plan() must have succeeded
+@param u32Interval polling interval [ms] (PollingInterval)
+@param u8RetryCount retries per request before the cycle is abandoned (RetryCount)
+@param u16RetryInterval delay before a retry [ms] (RetryInterval)
+@return slave index, or ku8NoSlave if ku8MaxSlaves are registered or the
+planner has no blocks
+@ingroup scheduler
+*/
+uint8_t ModbusBusScheduler::addSlave(uint8_t u8Id, ModbusPollPlanner& planner,
+  uint32_t u32Interval, uint8_t u8RetryCount, uint16_t u16RetryInterval)
+{
+  uint8_t u8Slave;
+  
+  if (_u8Slaves == ku8MaxSlaves)
+  {
+    return ku8NoSlave;
+  }
+  
+  ModbusSlave& modbus = _modbus[_u8Slaves];
+  modbus.scheduler = this;
+  modbus.u8Slave = _u8Slaves;
+  modbus.u8Id = u8Id;
+  modbus.planner = &planner;
+  
+  u8Slave = addDevice(modbus, u32Interval, u8RetryCount, u16RetryInterval);
+  if (u8Slave != ku8NoSlave)
+  {
+    _slaves[u8Slave].u8Id = u8Id;
+  }
+  return u8Slave;
+}
+
+
+/**
+Register a device of another protocol sharing the bus.
+
+The device is first polled on the next ModbusBusScheduler::run(); each
+poll cycle issues its PolledDevice::requests() in order. The device
+delivers its own data from PolledDevice::complete(), so the point
+handler is not called for it.
+
+@param device device to poll
+@param u32Interval polling interval [ms]
+@param u8RetryCount retries per request before the cycle is abandoned
+@param u16RetryInterval delay before a retry [ms]
+@return slave index, or ku8NoSlave if ku8MaxSlaves are registered or the
+device has no requests
+@ingroup scheduler
+*/
+uint8_t ModbusBusScheduler::addDevice(PolledDevice& device,
+  uint32_t u32Interval, uint8_t u8RetryCount, uint16_t u16RetryInterval)
+{
+  if (_u8Slaves == ku8MaxSlaves || !device.requests())
+  {
+    return ku8NoSlave;
+  }
+  
+  Slave& slave = _slaves[_u8Slaves];
+  slave.device = &device;
+  slave.u8Id = 0;
+  slave.u32Interval = u32Interval;
+  slave.u8RetryCount = u8RetryCount;
+  slave.u16RetryInterval = u16RetryInterval;
+  slave.u32Due = millis();
+  slave.u32CycleStart = slave.u32Due;
+  slave.u8Block = 0;
+  slave.u8Retries = 0;
+  slave.u8Failures = 0;
+  memset(&slave.stats, 0, sizeof(slave.stats));
+  
+  return _u8Slaves++;
+}
+
+
+/**
+Set point handler, called for every point of every successfully read block.
+
+@ingroup scheduler
+*/
+void ModbusBusScheduler::onPoint(ModbusSlavePointHandler onPoint)
+{
+  _onPoint = onPoint;
+}
+
+
+/**
+Set block handler, called for every successfully read block of a Modbus
+slave before its points are handed to the point handler.
+
+@ingroup scheduler
+*/
+void ModbusBusScheduler::onBlock(ModbusSlaveBlockHandler onBlock)
+{
+  _onBlock = onBlock;
+}
+
+
+/**
+Set cycle handler, called when a slave's cycle completes or is abandoned.
+
+@ingroup scheduler
+*/
+void ModbusBusScheduler::onCycle(ModbusSlaveCycleHandler onCycle)
+{
+  _onCycle = onCycle;
+}
+
+
+/**
+Advance the bus; never blocks.
+
+Collects the response in flight and, when the bus is idle and the
+inter-frame gap has elapsed, transmits the next due request.
+
+@ingroup scheduler
+*/
+void ModbusBusScheduler::run()
+{
+  uint8_t u8Status, u8Slave;
+  uint32_t u32Now;
+  
+  if (_u8Current != ku8NoSlave)
+  {
+    u8Status = _slaves[_u8Current].device->poll();
+    if (u8Status == ModbusMaster::ku8MBPending)
+    {
+      return;
+    }
+    complete(u8Status, millis());
+  }
+  
+  if ((micros() - _u32IdleSince) < _u32FrameGap)
+  {
+    return;
+  }
+  
+  u32Now = millis();
+  u8Slave = next(u32Now);
+  if (u8Slave != ku8NoSlave)
+  {
+    submit(u8Slave, u32Now);
+  }
+}
+
+
+/**
+Number of registered slaves.
+
+@ingroup scheduler
+*/
+uint8_t ModbusBusScheduler::slaves()
+{
+  return _u8Slaves;
+}
+
+
+/**
+Modbus slave ID of a registered slave.
+
+@param u8Slave slave index (0..slaves() - 1)
+@return slave ID, or 0 for a device added by addDevice()
+@ingroup scheduler
+*/
+uint8_t ModbusBusScheduler::slaveId(uint8_t u8Slave)
+{
+  return _slaves[u8Slave].u8Id;
+}
+
+
+/**
+Latency and success counters of a registered slave.
+
+@param u8Slave slave index (0..slaves() - 1)
+@ingroup scheduler
+*/
+const ModbusSlaveStats& ModbusBusScheduler::stats(uint8_t u8Slave)
+{
+  return _slaves[u8Slave].stats;
+}
+
+
+/**
+Whether a slave completed its last poll cycle.
+
+@param u8Slave slave index (0..slaves() - 1)
+@return false while the slave is backing off
+@ingroup scheduler
+*/
+bool ModbusBusScheduler::healthy(uint8_t u8Slave)
+{
+  return _slaves[u8Slave].u8Failures == 0;
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Pick the due slave with the earliest deadline.
+
+Healthy slaves (not retrying, not backing off) take precedence over
+unhealthy ones regardless of deadline.
+
+@return slave index, or ku8NoSlave if none is due
+*/
+uint8_t ModbusBusScheduler::next(uint32_t u32Now)
+{
+  uint8_t i;
+  uint8_t u8Best = ku8NoSlave;
+  bool bBestHealthy = false;
+  bool bHealthy;
+  
+  for (i = 0; i < _u8Slaves; i++)
+  {
+    const Slave& slave = _slaves[i];
+    if ((int32_t)(slave.u32Due - u32Now) > 0)
+    {
+      continue;
+    }
+    
+    bHealthy = !slave.u8Failures && !slave.u8Retries;
+    if (u8Best == ku8NoSlave || (bHealthy && !bBestHealthy) ||
+      (bHealthy == bBestHealthy && (int32_t)(slave.u32Due - _slaves[u8Best].u32Due) < 0))
+    {
+      u8Best = i;
+      bBestHealthy = bHealthy;
+    }
+  }
+  return u8Best;
+}
+
+
+/**
+Transmit the next request of a slave's poll cycle.
+*/
+void ModbusBusScheduler::submit(uint8_t u8Slave, uint32_t u32Now)
+{
+  Slave& slave = _slaves[u8Slave];
+  uint8_t u8Status;
+  
+  _u8Current = u8Slave;
+  _u32SubmitTime = u32Now;
+  slave.stats.u32Requests++;
+  
+  u8Status = slave.device->request(slave.u8Block);
+  if (u8Status != ModbusMaster::ku8MBPending)
+  {
+    // completed (or refused) without going through poll()
+    complete(u8Status, millis());
+  }
+}
+
+
+/**
+Account for a finished transaction and schedule what comes next.
+*/
+void ModbusBusScheduler::complete(uint8_t u8Status, uint32_t u32Now)
+{
+  uint8_t u8Slave = _u8Current;
+  Slave& slave = _slaves[u8Slave];
+  ModbusSlaveStats& stats = slave.stats;
+  uint16_t u16Latency = u32Now - _u32SubmitTime;
+  
+  _u8Current = ku8NoSlave;
+  _u32IdleSince = micros();
+  
+  if (u8Status == ModbusMaster::ku8MBSuccess)
+  {
+    stats.u32Successes++;
+    stats.u16LastLatency = u16Latency;
+    if (stats.u32Successes == 1)
+    {
+      stats.u16AvgLatency = u16Latency;
+    }
+    else
+    {
+      stats.u16AvgLatency += ((int32_t)u16Latency - (int32_t)stats.u16AvgLatency) / 8;
+    }
+    if (u16Latency > stats.u16MaxLatency)
+    {
+      stats.u16MaxLatency = u16Latency;
+    }
+    
+    slave.device->complete(slave.u8Block, u8Status);
+    
+    // remaining requests of the cycle keep the cycle's deadline
+    slave.u8Retries = 0;
+    if (++slave.u8Block >= slave.device->requests())
+    {
+      endCycle(u8Slave, u8Status, u32Now);
+    }
+    return;
+  }
+  
+  slave.device->complete(slave.u8Block, u8Status);
+  stats.u32Failures++;
+  if (u8Status == ModbusMaster::ku8MBResponseTimedOut)
+  {
+    stats.u32Timeouts++;
+  }
+  
+  // a slave already known to be down gets one probe per back-off period
+  if (!slave.u8Failures && slave.u8Retries < slave.u8RetryCount)
+  {
+    slave.u8Retries++;
+    slave.u32Due = u32Now + slave.u16RetryInterval;
+    return;
+  }
+  endCycle(u8Slave, u8Status, u32Now);
+}
+
+
+/**
+Close a slave's poll cycle and set its next deadline.
+
+Deadlines advance at a fixed rate from the previous cycle's deadline;
+after an abandoned cycle the interval doubles per consecutive failure, up
+to 2^ku8MaxBackoffShift intervals.
+*/
+void ModbusBusScheduler::endCycle(uint8_t u8Slave, uint8_t u8Status, uint32_t u32Now)
+{
+  Slave& slave = _slaves[u8Slave];
+  uint8_t u8Shift = 0;
+  
+  slave.u8Block = 0;
+  slave.u8Retries = 0;
+  if (u8Status == ModbusMaster::ku8MBSuccess)
+  {
+    slave.stats.u32Cycles++;
+    slave.u8Failures = 0;
+  }
+  else
+  {
+    slave.stats.u32FailedCycles++;
+    if (slave.u8Failures < 0xFF)
+    {
+      slave.u8Failures++;
+    }
+    u8Shift = slave.u8Failures < ku8MaxBackoffShift ? slave.u8Failures : ku8MaxBackoffShift;
+  }
+  
+  slave.u32Due = slave.u32CycleStart + (slave.u32Interval << u8Shift);
+  if ((int32_t)(slave.u32Due - u32Now) < 0)
+  {
+    // overran the deadline; run again as soon as the bus allows
+    slave.u32Due = u32Now;
+  }
+  slave.u32CycleStart = slave.u32Due;
+  
+  if (_onCycle)
+  {
+    _onCycle(u8Slave, u8Status);
+  }
+}
+
+
+/* _____MODBUS SLAVE ADAPTER_________________________________________________ */
+/**
+Number of read blocks planned for the slave.
+*/
+uint8_t ModbusBusScheduler::ModbusSlave::requests()
+{
+  return planner->blocks();
+}
+
+
+/**
+Address the slave and transmit a read of one planned block.
+*/
+uint8_t ModbusBusScheduler::ModbusSlave::request(uint8_t u8Block)
+{
+  scheduler->_node.setSlave(u8Id);
+  return planner->read(scheduler->_node, u8Block);
+}
+
+
+uint8_t ModbusBusScheduler::ModbusSlave::poll()
+{
+  return scheduler->_node.poll();
+}
+
+
+/**
+Hand a successfully read block to the block and point handlers.
+*/
+void ModbusBusScheduler::ModbusSlave::complete(uint8_t u8Block, uint8_t u8Status)
+{
+  if (u8Status != ModbusMaster::ku8MBSuccess)
+  {
+    return;
+  }
+  if (scheduler->_onBlock)
+  {
+    scheduler->_onBlock(u8Slave, u8Block, scheduler->_node);
+  }
+  if (scheduler->_onPoint)
+  {
+    planner->scatter(scheduler->_node, u8Block, point, this);
+  }
+}
+
+
+/**
+Pass one point of a read block to the scheduler's point handler.
+*/
+void ModbusBusScheduler::ModbusSlave::point(void* context, uint8_t u8Point,
+  const uint16_t* pu16Registers, uint8_t u8Len)
+{
+  ModbusSlave* modbus = (ModbusSlave*)context;
+  modbus->scheduler->_onPoint(modbus->u8Slave, u8Point, pu16Registers, u8Len);
+}
@@ -0,0 +1,190 @@
+/**
+@file
+Deadline scheduler for several Modbus slaves sharing one RS485 bus.
+
+@defgroup scheduler ModbusBusScheduler Bus Arbitration
+*/
+/*
+
+  ModbusBusScheduler.h - arbitrates a shared RS485 bus between slaves
+  with per-slave polling intervals, retries and back-off.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef ModbusBusScheduler_h
+#define ModbusBusScheduler_h
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusMaster.h"
+#include "ModbusPollPlanner.h"
+#include "PolledDevice.h"
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+/**
+Per-slave counters.
+
+Latencies are measured from transmission of a request to completion of
+its response.
+
+@ingroup scheduler
+*/
+struct ModbusSlaveStats
+{
+  uint32_t u32Requests;                                        ///< transactions started
+  uint32_t u32Successes;                                       ///< transactions completed successfully
+  uint32_t u32Failures;                                        ///< transactions failed (any status)
+  uint32_t u32Timeouts;                                        ///< failures due to ku8MBResponseTimedOut
+  uint32_t u32Cycles;                                          ///< poll cycles completed successfully
+  uint32_t u32FailedCycles;                                    ///< poll cycles abandoned after retries
+  uint16_t u16LastLatency;                                     ///< latency of last successful transaction [ms]
+  uint16_t u16AvgLatency;                                      ///< moving average latency (1/8 weight) [ms]
+  uint16_t u16MaxLatency;                                      ///< worst successful latency [ms]
+};
+
+/**
+Point handler; receives the registers of one point of one slave.
+
+@ingroup scheduler
+*/
+typedef void (*ModbusSlavePointHandler)(uint8_t u8Slave, uint8_t u8Point,
+  const uint16_t* pu16Registers, uint8_t u8Len);
+
+/**
+Block handler; called once per successfully read block while the node's
+response buffer holds it, e.g. to run a ModbusPointDecoder over it.
+
+@ingroup scheduler
+*/
+typedef void (*ModbusSlaveBlockHandler)(uint8_t u8Slave, uint8_t u8Block,
+  const ModbusMaster& node);
+
+/**
+Cycle handler; called when a slave's poll cycle succeeded or was abandoned.
+
+@ingroup scheduler
+*/
+typedef void (*ModbusSlaveCycleHandler)(uint8_t u8Slave, uint8_t u8Status);
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Polls several slaves over one ModbusMaster without blocking.
+
+Each Modbus slave has a poll planner (its coalesced read blocks) and a
+polling interval; other protocols on the same bus (e.g. DLT645 meters)
+join through the PolledDevice interface. ModbusBusScheduler::run() is
+called from loop() or a scheduler task; it advances the transaction in flight and, once the bus has been
+quiet for the RTU inter-frame gap, starts the request with the earliest
+deadline. Slaves that are retrying or backing off only get the bus when no
+healthy slave is due, so a slave that times out cannot starve the others.
+*/
+class ModbusBusScheduler
+{
+  public:
+    ModbusBusScheduler(ModbusMaster&);
+    
+    void    setBaudRate(uint32_t);
+    uint8_t addSlave(uint8_t, ModbusPollPlanner&, uint32_t, uint8_t, uint16_t);
+    uint8_t addDevice(PolledDevice&, uint32_t, uint8_t, uint16_t);
+    void    onPoint(ModbusSlavePointHandler);
+    void    onBlock(ModbusSlaveBlockHandler);
+    void    onCycle(ModbusSlaveCycleHandler);
+    void    run();
+    
+    uint8_t slaves();
+    uint8_t slaveId(uint8_t);
+    const ModbusSlaveStats& stats(uint8_t);
+    bool    healthy(uint8_t);
+    
+    /**
+    Maximum number of slaves per bus.
+    
+    @ingroup scheduler
+    */
+    static const uint8_t ku8MaxSlaves                    = 16;
+    
+    /**
+    ModbusBusScheduler slave table full exception.
+    
+    Returned by ModbusBusScheduler::addSlave() and
+    ModbusBusScheduler::addDevice(), also for a slave or device without
+    requests.
+    
+    @ingroup scheduler
+    */
+    static const uint8_t ku8NoSlave                      = 0xFF;
+    
+    /**
+    Largest back-off, as a power of two of the polling interval.
+    
+    @ingroup scheduler
+    */
+    static const uint8_t ku8MaxBackoffShift              = 5;
+    
+  private:
+    class ModbusSlave : public PolledDevice
+    {
+      public:
+        uint8_t requests();
+        uint8_t request(uint8_t);
+        uint8_t poll();
+        void    complete(uint8_t, uint8_t);
+        
+        static void point(void*, uint8_t, const uint16_t*, uint8_t);
+        
+        ModbusBusScheduler* scheduler;                         ///< owner, for node and point handler
+        uint8_t             u8Slave;                           ///< slave index in owner
+        uint8_t             u8Id;                              ///< Modbus slave ID
+        ModbusPollPlanner*  planner;                           ///< read blocks of this slave
+    };
+    
+    struct Slave
+    {
+      PolledDevice*      device;                               ///< requests of this slave
+      uint8_t            u8Id;                                 ///< Modbus slave ID (0 for other devices)
+      uint32_t           u32Interval;                          ///< polling interval [ms]
+      uint8_t            u8RetryCount;                         ///< retries per request
+      uint16_t           u16RetryInterval;                     ///< delay before a retry [ms]
+      uint32_t           u32Due;                               ///< deadline of next request [millis()]
+      uint32_t           u32CycleStart;                        ///< deadline the current cycle started at
+      uint8_t            u8Block;                              ///< next request of the current cycle
+      uint8_t            u8Retries;                            ///< retries spent on current request
+      uint8_t            u8Failures;                           ///< consecutive abandoned cycles
+      ModbusSlaveStats   stats;
+    };
+    
+    ModbusMaster&           _node;                             ///< bus master
+    Slave                   _slaves[ku8MaxSlaves];             ///< registered slaves
+    ModbusSlave             _modbus[ku8MaxSlaves];             ///< adapters for slaves added by addSlave()
+    uint8_t                 _u8Slaves;                         ///< number of registered slaves
+    uint8_t                 _u8Current;                        ///< slave of transaction in flight
+    uint32_t                _u32SubmitTime;                    ///< millis() at transmission
+    uint32_t                _u32IdleSince;                     ///< micros() at end of last transaction
+    uint32_t                _u32FrameGap;                      ///< RTU inter-frame gap [us]
+    ModbusSlavePointHandler _onPoint;
+    ModbusSlaveBlockHandler _onBlock;
+    ModbusSlaveCycleHandler _onCycle;
+    
+    uint8_t next(uint32_t);
+    void    submit(uint8_t, uint32_t);
+    void    complete(uint8_t, uint32_t);
+    void    endCycle(uint8_t, uint8_t, uint32_t);
+};
+#endif
@@ -46,6 +46,11 @@ ModbusMaster::ModbusMaster(void)
   _idle = 0;
   _preTransmission = 0;
   _postTransmission = 0;
+  _onComplete = 0;
+  _bNonBlocking = false;
+  _u8State = ku8MBStateIdle;
+  _u8MBStatus = ku8MBSuccess;
+  _u16MBResponseTimeout = ku16MBResponseTimeout;
 }
 
 /**
@@ -63,8 +68,11 @@ void ModbusMaster::begin(uint8_t slave, Stream &serial)
 //  txBuffer = (uint16_t*) calloc(ku8MaxBufferSize, sizeof(uint16_t));
   _u8MBSlave = slave;
   _serial = &serial;
+  _transport = 0;
   _u8TransmitBufferIndex = 0;
   u16TransmitBufferLength = 0;
+  _u8State = ku8MBStateIdle;
+  _u8MBStatus = ku8MBSuccess;
   
 #if __MODBUSMASTER_DEBUG__
   pinMode(__MODBUSMASTER_DEBUG_PIN_A__, OUTPUT);
@@ -73,6 +81,55 @@ void ModbusMaster::begin(uint8_t slave, Stream &serial)
 }
 
 
+/**
+Initialize class object with a frame-level transport.
+
+Responses are taken from the transport as complete frames, delimited by
+the inter-character timeout (t3.5), and processed in one pass instead of
+byte by byte.
+
+@param slave Modbus slave ID (1..255)
+@param &transport SerialTransport wrapping the serial port
+@ingroup setup
+*/
+void ModbusMaster::begin(uint8_t slave, SerialTransport &transport)
+{
+  begin(slave, (Stream &)transport);
+  _transport = &transport;
+}
+
+
+/**
+Change the Modbus slave addressed by subsequent requests.
+
+Allows one ModbusMaster (one serial port) to poll several slaves sharing
+an RS485 bus. Must not be called while a non-blocking transaction is in
+flight.
+
+@param slave Modbus slave ID (1..255)
+@ingroup setup
+*/
+void ModbusMaster::setSlave(uint8_t slave)
+{
+  _u8MBSlave = slave;
+}
+
+
+/**
+Set response timeout.
+
+Time allowed between transmission of a request and reception of the last
+byte of the response. Defaults to ModbusMaster::ku16MBResponseTimeout.
+
+@param u16Timeout timeout [milliseconds]
+@ingroup setup
+*/
+void ModbusMaster::setResponseTimeout(uint16_t u16Timeout)
+{
+  _u16MBResponseTimeout = u16Timeout;
+}
+
+
 void ModbusMaster::beginTransmission(uint16_t u16Address)
 {
   _u16WriteAddress = u16Address;
@@ -216,6 +273,126 @@ void ModbusMaster::postTransmission(void (*postTransmission)())
   _postTransmission = postTransmission;
 }
 
+/**
+Set transaction completion callback function.
+
+This function gets called once a transaction has finished, successfully or
+not, with the ModbusMaster instance and the transaction status. The
+response buffer is valid for the duration of the call. In non-blocking mode
+it is invoked from within ModbusMaster::poll().
+
+@see ModbusMaster::setNonBlocking()
+@see ModbusMaster::poll()
+*/
+void ModbusMaster::onComplete(void (*onComplete)(ModbusMaster*, uint8_t))
+{
+  _onComplete = onComplete;
+}
+
+/**
+Select blocking or non-blocking transactions.
+
+In blocking mode (the default) the function code methods wait for the
+response and return the transaction status. In non-blocking mode they
+return ModbusMaster::ku8MBPending as soon as the request has been
+transmitted; the response is then collected by calling
+ModbusMaster::poll() from loop() or a scheduler task.
+
+@param bNonBlocking true to return immediately after transmitting
+@see ModbusMaster::poll()
+@ingroup setup
+*/
+void ModbusMaster::setNonBlocking(bool bNonBlocking)
+{
+  _bNonBlocking = bNonBlocking;
+}
+
+/**
+Advance the transaction in flight.
+
+Consumes whatever response bytes are available on the serial port without
+waiting for more. Never blocks; call repeatedly until it returns something
+other than ModbusMaster::ku8MBPending.
+
+@return ku8MBPending while receiving; otherwise status of last transaction
+@see ModbusMaster::setNonBlocking()
+*/
+uint8_t ModbusMaster::poll(void)
+{
+  uint8_t u8MBStatus = ku8MBPending;
+  uint16_t u16Count;
+  
+  if (_u8State != ku8MBStateReceiving)
+  {
+    return _u8MBStatus;
+  }
+  
+  if (_transport)
+  {
+    // frame mode: the transport hands over a complete ADU in one call
+    u16Count = _transport->readFrame(_u8ModbusADU, sizeof(_u8ModbusADU));
+    if (u16Count)
+    {
+      _u8ModbusADUSize = 0;
+      _u8BytesLeft = 8;
+      u8MBStatus = consumeResponse(u16Count);
+      if (u8MBStatus == ku8MBPending)
+      {
+        // truncated frame; discard it and wait for another until timeout
+        _u8ModbusADUSize = 0;
+        _u8BytesLeft = 8;
+      }
+    }
+  }
+  else
+  {
+    while (u8MBStatus == ku8MBPending && (u16Count = _serial->available()))
+    {
+      // read up to the end of the header first, then the rest of the ADU
+      if (_u8ModbusADUSize < 5 && u16Count > 5 - _u8ModbusADUSize)
+      {
+        u16Count = 5 - _u8ModbusADUSize;
+      }
+      else if (u16Count > _u8BytesLeft)
+      {
+        u16Count = _u8BytesLeft;
+      }
+#if __MODBUSMASTER_DEBUG__
+      digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, true);
+#endif
+      u16Count = _serial->readBytes(_u8ModbusADU + _u8ModbusADUSize, u16Count);
+#if __MODBUSMASTER_DEBUG__
+      digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, false);
+#endif
+      if (!u16Count)
+      {
+        break;
+      }
+      u8MBStatus = consumeResponse(u16Count);
+    }
+  }
+  
+  if (u8MBStatus != ku8MBPending)
+  {
+    return u8MBStatus;
+  }
+  if ((millis() - _u32StartTime) > _u16MBResponseTimeout)
+  {
+    return finishTransaction(ku8MBResponseTimedOut);
+  }
+  return ku8MBPending;
+}
+
+/**
+Report whether a transaction is in flight.
+
+@return true between transmission of a request and its completion
+*/
+bool ModbusMaster::busy(void)
+{
+  return _u8State != ku8MBStateIdle;
+}
+
 
 /**
 Retrieve data from response buffer.
@@ -583,7 +760,7 @@ Sequence:
   - assemble Modbus Request Application Data Unit (ADU),
     based on particular function called
   - transmit request over selected serial port
-  - wait for/retrieve response
+  - wait for/retrieve response (non-blocking mode: return, see poll())
   - evaluate/disassemble response
   - return status (success/exception)
 
@@ -592,13 +769,57 @@ Sequence:
 */
 uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
 {
-  uint8_t u8ModbusADU[256];
+  uint8_t u8MBStatus;
+  
+  if (_u8State != ku8MBStateIdle)
+  {
+    return ku8MBBusy;
+  }
+  
+  transmitRequest(buildRequest(u8MBFunction));
+  
+  _u8MBFunction = u8MBFunction;
+  _u8ModbusADUSize = 0;
+  _u8BytesLeft = 8;
+  _u8MBStatus = ku8MBPending;
+  _u8State = ku8MBStateReceiving;
+  _u32StartTime = millis();
+  
+  if (_bNonBlocking)
+  {
+    return ku8MBPending;
+  }
+  
+  // loop until we run out of time or bytes, or an error occurs
+  while ((u8MBStatus = poll()) == ku8MBPending)
+  {
+#if __MODBUSMASTER_DEBUG__
+    digitalWrite(__MODBUSMASTER_DEBUG_PIN_B__, true);
+#endif
+    if (_idle)
+    {
+      _idle();
+    }
+#if __MODBUSMASTER_DEBUG__
+    digitalWrite(__MODBUSMASTER_DEBUG_PIN_B__, false);
+#endif
+  }
+  return u8MBStatus;
+}
+
+
+/**
+Assemble Modbus Request Application Data Unit into ADU buffer.
+
+@param u8MBFunction Modbus function (0x01..0xFF)
+@return size of request ADU including CRC
+*/
+uint8_t ModbusMaster::buildRequest(uint8_t u8MBFunction)
+{
+  uint8_t* u8ModbusADU = _u8ModbusADU;
   uint8_t u8ModbusADUSize = 0;
   uint8_t i, u8Qty;
   uint16_t u16CRC;
-  uint32_t u32StartTime;
-  uint8_t u8BytesLeft = 8;
-  uint8_t u8MBStatus = ku8MBSuccess;
   
   // assemble Modbus Request Application Data Unit
   u8ModbusADU[u8ModbusADUSize++] = _u8MBSlave;
@@ -685,15 +906,22 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   }
   
   // append CRC
-  u16CRC = 0xFFFF;
-  for (i = 0; i < u8ModbusADUSize; i++)
-  {
-    u16CRC = crc16_update(u16CRC, u8ModbusADU[i]);
-  }
+  u16CRC = crc16(u8ModbusADU, u8ModbusADUSize);
   u8ModbusADU[u8ModbusADUSize++] = lowByte(u16CRC);
   u8ModbusADU[u8ModbusADUSize++] = highByte(u16CRC);
   u8ModbusADU[u8ModbusADUSize] = 0;
+  
+  return u8ModbusADUSize;
+}
+
+
+/**
+Transmit request ADU over selected serial port.
 
+@param u8ADUSize size of request ADU including CRC
+*/
+void ModbusMaster::transmitRequest(uint8_t u8ADUSize)
+{
   // flush receive buffer before transmitting request
   while (_serial->read() != -1);
 
@@ -702,69 +930,52 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   {
     _preTransmission();
   }
-  for (i = 0; i < u8ModbusADUSize; i++)
-  {
-    _serial->write(u8ModbusADU[i]);
-  }
+  _serial->write(_u8ModbusADU, u8ADUSize);
   
-  u8ModbusADUSize = 0;
   _serial->flush();    // flush transmit buffer
   if (_postTransmission)
   {
     _postTransmission();
   }
+}
+
+
+/**
+Account for response bytes stored at the end of the ADU buffer.
+Evaluates slave ID, function code and exception once the header is
+complete, and finishes the transaction once the ADU is complete.
+
+@param u16Count bytes appended to the ADU buffer
+@return ku8MBPending while more bytes are expected; otherwise final status
+*/
+uint8_t ModbusMaster::consumeResponse(uint16_t u16Count)
+{
+  uint8_t* u8ModbusADU = _u8ModbusADU;
   
-  // loop until we run out of time or bytes, or an error occurs
-  u32StartTime = millis();
-  while (u8BytesLeft && !u8MBStatus)
+  while (u16Count-- && _u8BytesLeft)
   {
-    if (_serial->available())
-    {
-#if __MODBUSMASTER_DEBUG__
-      digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, true);
-#endif
-      u8ModbusADU[u8ModbusADUSize++] = _serial->read();
-      u8BytesLeft--;
-#if __MODBUSMASTER_DEBUG__
-      digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, false);
-#endif
-    }
-    else
-    {
-#if __MODBUSMASTER_DEBUG__
-      digitalWrite(__MODBUSMASTER_DEBUG_PIN_B__, true);
-#endif
-      if (_idle)
-      {
-        _idle();
-      }
-#if __MODBUSMASTER_DEBUG__
-      digitalWrite(__MODBUSMASTER_DEBUG_PIN_B__, false);
-#endif
-    }
+    _u8ModbusADUSize++;
+    _u8BytesLeft--;
     
     // evaluate slave ID, function code once enough bytes have been read
-    if (u8ModbusADUSize == 5)
+    if (_u8ModbusADUSize == 5)
     {
       // verify response is for correct Modbus slave
       if (u8ModbusADU[0] != _u8MBSlave)
       {
-        u8MBStatus = ku8MBInvalidSlaveID;
-        break;
+        return finishTransaction(ku8MBInvalidSlaveID);
       }
       
       // verify response is for correct Modbus function code (mask exception bit 7)
-      if ((u8ModbusADU[1] & 0x7F) != u8MBFunction)
+      if ((u8ModbusADU[1] & 0x7F) != _u8MBFunction)
       {
-        u8MBStatus = ku8MBInvalidFunction;
-        break;
+        return finishTransaction(ku8MBInvalidFunction);
       }
       
       // check whether Modbus exception occurred; return Modbus Exception Code
       if (bitRead(u8ModbusADU[1], 7))
       {
-        u8MBStatus = u8ModbusADU[2];
-        break;
+        return finishTransaction(u8ModbusADU[2]);
       }
       
       // evaluate returned Modbus function code
@@ -775,36 +986,51 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
         case ku8MBReadInputRegisters:
         case ku8MBReadHoldingRegisters:
         case ku8MBReadWriteMultipleRegisters:
-          u8BytesLeft = u8ModbusADU[2];
+          _u8BytesLeft = u8ModbusADU[2];
           break;
           
         case ku8MBWriteSingleCoil:
         case ku8MBWriteMultipleCoils:
         case ku8MBWriteSingleRegister:
         case ku8MBWriteMultipleRegisters:
-          u8BytesLeft = 3;
+          _u8BytesLeft = 3;
           break;
           
         case ku8MBMaskWriteRegister:
-          u8BytesLeft = 5;
+          _u8BytesLeft = 5;
           break;
       }
     }
-    if ((millis() - u32StartTime) > ku16MBResponseTimeout)
-    {
-      u8MBStatus = ku8MBResponseTimedOut;
-    }
   }
   
+  if (!_u8BytesLeft)
+  {
+    return finishTransaction(ku8MBSuccess);
+  }
+  return ku8MBPending;
+}
+
+
+/**
+Complete transaction in flight.
+Verifies CRC, disassembles response ADU into response buffer and notifies
+the completion callback.
+
+@param u8MBStatus status determined while receiving the response
+@return final transaction status
+*/
+uint8_t ModbusMaster::finishTransaction(uint8_t u8MBStatus)
+{
+  uint8_t* u8ModbusADU = _u8ModbusADU;
+  uint8_t u8ModbusADUSize = _u8ModbusADUSize;
+  uint8_t i;
+  uint16_t u16CRC;
+  
   // verify response is large enough to inspect further
   if (!u8MBStatus && u8ModbusADUSize >= 5)
   {
     // calculate CRC
-    u16CRC = 0xFFFF;
-    for (i = 0; i < (u8ModbusADUSize - 2); i++)
-    {
-      u16CRC = crc16_update(u16CRC, u8ModbusADU[i]);
-    }
+    u16CRC = crc16(u8ModbusADU, u8ModbusADUSize - 2);
     
     // verify CRC
     if (!u8MBStatus && (lowByte(u16CRC) != u8ModbusADU[u8ModbusADUSize - 2] ||
@@ -829,8 +1055,6 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
           {
             _u16ResponseBuffer[i] = word(u8ModbusADU[2 * i + 4], u8ModbusADU[2 * i + 3]);
           }
-          
-          _u8ResponseBufferLength = i;
         }
         
         // in the event of an odd number of bytes, load last byte into zero-padded word
@@ -840,9 +1064,11 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
           {
             _u16ResponseBuffer[i] = word(0, u8ModbusADU[2 * i + 3]);
           }
-          
-          _u8ResponseBufferLength = i + 1;
+          i++;
         }
+        
+        // number of words loaded
+        _u8ResponseBufferLength = (i < ku8MaxBufferSize) ? i : ku8MaxBufferSize;
         break;
         
       case ku8MBReadInputRegisters:
@@ -855,9 +1081,10 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
           {
             _u16ResponseBuffer[i] = word(u8ModbusADU[2 * i + 3], u8ModbusADU[2 * i + 4]);
           }
-          
-          _u8ResponseBufferLength = i;
         }
+        
+        // number of registers loaded
+        _u8ResponseBufferLength = (i < ku8MaxBufferSize) ? i : ku8MaxBufferSize;
         break;
     }
   }
@@ -865,5 +1092,12 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   _u8TransmitBufferIndex = 0;
   u16TransmitBufferLength = 0;
   _u8ResponseBufferIndex = 0;
+  _u8MBStatus = u8MBStatus;
+  _u8State = ku8MBStateIdle;
+  
+  if (_onComplete)
+  {
+    _onComplete(this, u8MBStatus);
+  }
   return u8MBStatus;
 }
@@ -60,6 +60,9 @@ Set to 1 to enable debugging features within class:
 // functions to manipulate words
 #include "util/word.h"
 
+// frame-level serial reception
+#include "SerialTransport.h"
+
 
 /* _____CLASS DEFINITIONS____________________________________________________ */
 /**
@@ -68,13 +71,22 @@ RS232/485 (via RTU protocol).
 */
 class ModbusMaster
 {
+  friend class ModbusPointDecoder;
+  
   public:
     ModbusMaster();
    
     void begin(uint8_t, Stream &serial);
+    void begin(uint8_t, SerialTransport &transport);
+    void setSlave(uint8_t);
+    void setResponseTimeout(uint16_t);
     void idle(void (*)());
     void preTransmission(void (*)());
     void postTransmission(void (*)());
+    void onComplete(void (*)(ModbusMaster*, uint8_t));
+    void setNonBlocking(bool);
+    uint8_t poll(void);
+    bool busy(void);
 
     // Modbus exception codes
     /**
@@ -188,6 +200,29 @@ class ModbusMaster
     */
     static const uint8_t ku8MBInvalidCRC                 = 0xE3;
     
+    /**
+    ModbusMaster transaction pending.
+    
+    Returned in non-blocking mode by the function code methods once the
+    request has been transmitted, and by ModbusMaster::poll() for as long as
+    the response is still being received.
+    
+    @ingroup constant
+    */
+    static const uint8_t ku8MBPending                    = 0xE4;
+    
+    /**
+    ModbusMaster busy exception.
+    
+    A request was submitted while a non-blocking transaction is still in
+    flight; the request was not transmitted.
+    
+    @ingroup constant
+    */
+    static const uint8_t ku8MBBusy                       = 0xE5;
+    
+    static const uint8_t ku8MaxBufferSize                = 64;   ///< size of response/transmit buffers
+    
     uint16_t getResponseBuffer(uint8_t);
     void     clearResponseBuffer();
     uint8_t  setTransmitBuffer(uint8_t, uint16_t);
@@ -219,8 +254,8 @@ class ModbusMaster
     
   private:
     Stream* _serial;                                             ///< reference to serial port object
+    SerialTransport* _transport;                                 ///< frame-level transport, if begun with one
     uint8_t  _u8MBSlave;                                         ///< Modbus slave (1..255) initialized in begin()
-    static const uint8_t ku8MaxBufferSize                = 64;   ///< size of response/transmit buffers    
     uint16_t _u16ReadAddress;                                    ///< slave register from which to read
     uint16_t _u16ReadQty;                                        ///< quantity of words to read
     uint16_t _u16ResponseBuffer[ku8MaxBufferSize];               ///< buffer to store Modbus slave response; read via GetResponseBuffer()
@@ -251,8 +286,26 @@ class ModbusMaster
     // Modbus timeout [milliseconds]
     static const uint16_t ku16MBResponseTimeout          = 2000; ///< Modbus timeout [milliseconds]
     
+    // transaction state machine
+    static const uint8_t ku8MBStateIdle                  = 0;    ///< no transaction in flight
+    static const uint8_t ku8MBStateReceiving             = 1;    ///< request sent, collecting response
+    
+    uint8_t  _u8ModbusADU[256];                                  ///< request/response Application Data Unit
+    uint8_t  _u8ModbusADUSize;                                   ///< bytes of response ADU received so far
+    uint8_t  _u8BytesLeft;                                       ///< response bytes still expected
+    uint8_t  _u8MBFunction;                                      ///< function code of transaction in flight
+    uint8_t  _u8MBStatus;                                        ///< status of last completed transaction
+    uint8_t  _u8State;                                           ///< ku8MBStateIdle or ku8MBStateReceiving
+    uint32_t _u32StartTime;                                      ///< millis() when request was transmitted
+    bool     _bNonBlocking;                                      ///< return after TX instead of waiting for RX
+    uint16_t _u16MBResponseTimeout;                              ///< response timeout [milliseconds]
+    
     // master function that conducts Modbus transactions
     uint8_t ModbusMasterTransaction(uint8_t u8MBFunction);
+    uint8_t buildRequest(uint8_t u8MBFunction);
+    void    transmitRequest(uint8_t u8ADUSize);
+    uint8_t consumeResponse(uint16_t u16Count);
+    uint8_t finishTransaction(uint8_t u8MBStatus);
     
     // idle callback function; gets called during idle time between TX and RX
     void (*_idle)();
@@ -260,6 +313,8 @@ class ModbusMaster
     void (*_preTransmission)();
     // postTransmission callback function; gets called after a Modbus message has been sent
     void (*_postTransmission)();
+    // completion callback function; gets called when a transaction finishes
+    void (*_onComplete)(ModbusMaster*, uint8_t);
 };
 #endif
 
@@ -267,4 +322,5 @@ class ModbusMaster
 @example examples/Basic/Basic.pde
 @example examples/PhoenixContact_nanoLC/PhoenixContact_nanoLC.pde
 @example examples/RS485_HalfDuplex/RS485_HalfDuplex.ino
+@example examples/NonBlocking/NonBlocking.ino
 */
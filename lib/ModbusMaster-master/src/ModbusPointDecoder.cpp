@@ -0,0 +1,358 @@
+/**
+@file
+Compiled register-to-value decoding for planned Modbus points.
+*/
+/*
+
+  ModbusPointDecoder.cpp - turns the DataType/endian/Coefficient/Offset of
+  each point into a decoder descriptor once, then converts whole response
+  blocks to engineering values in one pass.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusPointDecoder.h"
+
+
+/* _____LOCAL DEFINITIONS____________________________________________________ */
+namespace
+{
+  // data types
+  const uint8_t ku8Int16   = 0;
+  const uint8_t ku8UInt16  = 1;
+  const uint8_t ku8Int32   = 2;
+  const uint8_t ku8UInt32  = 3;
+  const uint8_t ku8Float32 = 4;
+  const uint8_t ku8Types   = 5;
+  
+  // register/byte orders, named after the byte sequence on the wire
+  const uint8_t ku8ABCD    = 0;
+  const uint8_t ku8CDAB    = 1;
+  const uint8_t ku8BADC    = 2;
+  const uint8_t ku8DCBA    = 3;
+  const uint8_t ku8Orders  = 4;
+  
+  inline uint16_t swap16(uint16_t u16)
+  {
+    return (uint16_t)((u16 << 8) | (u16 >> 8));
+  }
+  
+  template <uint8_t Order>
+  inline uint16_t join16(const uint16_t* pu16)
+  {
+    return (Order == ku8BADC || Order == ku8DCBA) ? swap16(pu16[0]) : pu16[0];
+  }
+  
+  template <uint8_t Order>
+  inline uint32_t join32(const uint16_t* pu16)
+  {
+    switch (Order)
+    {
+      case ku8CDAB:
+        return ((uint32_t)pu16[1] << 16) | pu16[0];
+      case ku8BADC:
+        return ((uint32_t)swap16(pu16[0]) << 16) | swap16(pu16[1]);
+      case ku8DCBA:
+        return ((uint32_t)swap16(pu16[1]) << 16) | swap16(pu16[0]);
+      default:
+        return ((uint32_t)pu16[0] << 16) | pu16[1];
+    }
+  }
+  
+  template <uint8_t Type, uint8_t Order>
+  double decodeRaw(const uint16_t* pu16)
+  {
+    uint32_t u32;
+    float f;
+    
+    switch (Type)
+    {
+      case ku8Int16:
+        return (int16_t)join16<Order>(pu16);
+      case ku8UInt16:
+        return join16<Order>(pu16);
+      case ku8Int32:
+        return (int32_t)join32<Order>(pu16);
+      case ku8UInt32:
+        return join32<Order>(pu16);
+      default:
+        u32 = join32<Order>(pu16);
+        memcpy(&f, &u32, sizeof(f));
+        return f;
+    }
+  }
+  
+  template <uint8_t Type>
+  struct DecodeRow
+  {
+    static const ModbusDecodeFunction row[ku8Orders];
+  };
+  
+  template <uint8_t Type>
+  const ModbusDecodeFunction DecodeRow<Type>::row[ku8Orders] =
+  {
+    decodeRaw<Type, ku8ABCD>, decodeRaw<Type, ku8CDAB>,
+    decodeRaw<Type, ku8BADC>, decodeRaw<Type, ku8DCBA>
+  };
+  
+  const ModbusDecodeFunction* const kDecodeTable[ku8Types] =
+  {
+    DecodeRow<ku8Int16>::row, DecodeRow<ku8UInt16>::row,
+    DecodeRow<ku8Int32>::row, DecodeRow<ku8UInt32>::row,
+    DecodeRow<ku8Float32>::row
+  };
+  
+  const char* const kTypeNames[] = { "Int16", "UInt16", "Int32", "UInt32", "Float32", "Float" };
+  const uint8_t     kTypeIds[]   = { ku8Int16, ku8UInt16, ku8Int32, ku8UInt32, ku8Float32, ku8Float32 };
+  const char* const kOrderNames[] = { "ABCD", "CDAB", "BADC", "DCBA" };
+  
+  inline char lower(char c)
+  {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+  }
+  
+  bool sameName(const char* a, const char* b)
+  {
+    while (*a && lower(*a) == lower(*b))
+    {
+      a++;
+      b++;
+    }
+    return !*a && !*b;
+  }
+}
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+@param decoders caller-owned descriptor array, one entry per point
+@param u8MaxDecoders capacity of decoders
+@ingroup decoder
+*/
+ModbusPointDecoder::ModbusPointDecoder(ModbusDecoder* decoders, uint8_t u8MaxDecoders)
+{
+  _decoders = decoders;
+  _u8Decoders = 0;
+  _u8MaxDecoders = u8MaxDecoders;
+}
+
+
+/**
+Add the next point.
+
+Points must be added in the same order as the planner's points.
+
+@param szDataType DataType of the point
+@param szEndian endian of the point; "-", "" or 0 for big endian
+@param dCoefficient Coefficient of the point
+@param dOffset Offset of the point
+@return point index, or ku8InvalidPoint
+@ingroup decoder
+*/
+uint8_t ModbusPointDecoder::add(const char* szDataType, const char* szEndian,
+  double dCoefficient, double dOffset)
+{
+  uint8_t u8Type = ku8Types;
+  uint8_t u8Order = ku8ABCD;
+  uint8_t i;
+  
+  if (_u8Decoders == _u8MaxDecoders)
+  {
+    return ku8InvalidPoint;
+  }
+  
+  for (i = 0; i < sizeof(kTypeIds); i++)
+  {
+    if (sameName(szDataType, kTypeNames[i]))
+    {
+      u8Type = kTypeIds[i];
+      break;
+    }
+  }
+  if (u8Type == ku8Types)
+  {
+    return ku8InvalidPoint;
+  }
+  
+  if (szEndian && *szEndian && !sameName(szEndian, "-"))
+  {
+    u8Order = ku8Orders;
+    for (i = 0; i < ku8Orders; i++)
+    {
+      if (sameName(szEndian, kOrderNames[i]))
+      {
+        u8Order = i;
+        break;
+      }
+    }
+    if (u8Order == ku8Orders)
+    {
+      return ku8InvalidPoint;
+    }
+  }
+  
+  ModbusDecoder& d = _decoders[_u8Decoders];
+  d.decode = kDecodeTable[u8Type][u8Order];
+  d.dCoefficient = dCoefficient;
+  d.dOffset = dOffset;
+  d.u8Point = _u8Decoders;
+  d.u8Block = 0;
+  d.u8Offset = 0;
+  d.u8Len = (u8Type == ku8Int16 || u8Type == ku8UInt16) ? 1 : 2;
+  return _u8Decoders++;
+}
+
+
+/**
+Bind descriptors to the planner's blocks and order them for decoding.
+
+@param planner planner whose ModbusPollPlanner::plan() succeeded
+@return false if the number of points differs from the planner's, or a
+point has fewer registers (Len) than its data type needs
+@ingroup decoder
+*/
+bool ModbusPointDecoder::compile(ModbusPollPlanner& planner)
+{
+  ModbusDecoder d;
+  uint8_t i, j;
+  
+  if (planner.points() != _u8Decoders)
+  {
+    return false;
+  }
+  
+  for (i = 0; i < _u8Decoders; i++)
+  {
+    ModbusDecoder& e = _decoders[i];
+    const ModbusPoint& point = planner.point(e.u8Point);
+    if (point.u8Len < e.u8Len)
+    {
+      return false;
+    }
+    e.u8Block = point.u8Block;
+    e.u8Offset = point.u8Offset;
+  }
+  
+  // insertion sort by block, then offset; point counts are small
+  for (i = 1; i < _u8Decoders; i++)
+  {
+    d = _decoders[i];
+    for (j = i; j > 0 && (_decoders[j - 1].u8Block > d.u8Block ||
+      (_decoders[j - 1].u8Block == d.u8Block && _decoders[j - 1].u8Offset > d.u8Offset)); j--)
+    {
+      _decoders[j] = _decoders[j - 1];
+    }
+    _decoders[j] = d;
+  }
+  return true;
+}
+
+
+/**
+Number of descriptors.
+
+@ingroup decoder
+*/
+uint8_t ModbusPointDecoder::decoders()
+{
+  return _u8Decoders;
+}
+
+
+/**
+Descriptor in decoding order (not point order; see ModbusDecoder::u8Point).
+
+@ingroup decoder
+*/
+const ModbusDecoder& ModbusPointDecoder::decoder(uint8_t u8Decoder)
+{
+  return _decoders[u8Decoder];
+}
+
+
+/**
+Decode the points of one block.
+
+@param pu16Registers registers of the block, as read
+@param u8Block block index (0..blocks() - 1 of the planner)
+@param u8Qty registers available in pu16Registers
+@param pdValues values indexed by point; only the block's points are written
+@return number of points decoded
+@ingroup decoder
+*/
+uint8_t ModbusPointDecoder::decode(const uint16_t* pu16Registers, uint8_t u8Block,
+  uint8_t u8Qty, double* pdValues)
+{
+  const ModbusDecoder* d = _decoders + first(u8Block);
+  const ModbusDecoder* end = _decoders + _u8Decoders;
+  uint8_t u8Count = 0;
+  
+  for (; d != end && d->u8Block == u8Block; d++)
+  {
+    if (d->u8Offset + d->u8Len > u8Qty)
+    {
+      break;
+    }
+    pdValues[d->u8Point] = d->decode(pu16Registers + d->u8Offset) * d->dCoefficient + d->dOffset;
+    u8Count++;
+  }
+  return u8Count;
+}
+
+
+/**
+Decode the points of one block straight from a node's response buffer.
+
+Call when the block's read completed successfully, e.g. from the
+scheduler's block handler or ModbusMaster::onComplete(). Only the
+registers the slave returned are decoded.
+
+@ingroup decoder
+*/
+uint8_t ModbusPointDecoder::decode(const ModbusMaster& node, uint8_t u8Block, double* pdValues)
+{
+  return decode(node._u16ResponseBuffer, u8Block, node._u8ResponseBufferLength, pdValues);
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Index of the first descriptor of a block (binary search).
+*/
+uint8_t ModbusPointDecoder::first(uint8_t u8Block)
+{
+  uint8_t u8Lo = 0;
+  uint8_t u8Hi = _u8Decoders;
+  uint8_t u8Mid;
+  
+  while (u8Lo < u8Hi)
+  {
+    u8Mid = (u8Lo + u8Hi) / 2;
+    if (_decoders[u8Mid].u8Block < u8Block)
+    {
+      u8Lo = u8Mid + 1;
+    }
+    else
+    {
+      u8Hi = u8Mid;
+    }
+  }
+  return u8Lo;
+}
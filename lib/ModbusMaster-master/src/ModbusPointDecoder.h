@@ -0,0 +1,118 @@
+/**
+@file
+Compiled register-to-value decoding for planned Modbus points.
+
+@defgroup decoder ModbusPointDecoder Point Decoding
+*/
+/*
+
+  ModbusPointDecoder.h - turns the DataType/endian/Coefficient/Offset of
+  each point into a decoder descriptor once, then converts whole response
+  blocks to engineering values in one pass.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef ModbusPointDecoder_h
+#define ModbusPointDecoder_h
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusMaster.h"
+#include "ModbusPollPlanner.h"
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+/**
+Raw value of a point from its first register; one instance per data type
+and register/byte order.
+
+@ingroup decoder
+*/
+typedef double (*ModbusDecodeFunction)(const uint16_t* pu16Registers);
+
+/**
+Decoder descriptor of one point.
+
+Filled in by ModbusPointDecoder::add() and ModbusPointDecoder::compile().
+
+@ingroup decoder
+*/
+struct ModbusDecoder
+{
+  ModbusDecodeFunction decode;                                 ///< raw value from registers
+  double               dCoefficient;                           ///< scale (Coefficient)
+  double               dOffset;                                ///< added after scaling (Offset)
+  uint8_t              u8Point;                                ///< point index, i.e. output slot
+  uint8_t              u8Block;                                ///< request block of the point
+  uint8_t              u8Offset;                               ///< register offset inside the block
+  uint8_t              u8Len;                                  ///< registers consumed by decode
+};
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Decodes the points of a ModbusPollPlanner into engineering values.
+
+Points are added in the planner's point order with their `DataType`,
+`endian`, `Coefficient` and `Offset`; the strings are interpreted only
+there. ModbusPointDecoder::compile() then sorts the descriptors by block
+and register offset, so ModbusPointDecoder::decode() walks the response
+buffer of a block once, front to back, writing
+value = raw * Coefficient + Offset into the caller's array at the point
+index.
+
+Data types: Int16, UInt16, Int32, UInt32, Float32 (alias Float).
+Orders (endian): ABCD (big endian, also "-" or empty), CDAB (word swap),
+BADC (byte swap), DCBA (little endian); 16 bit types use the byte order
+only.
+
+Values are doubles so that 32 bit integer points keep every digit
+(a float holds integers exactly only up to 2^24); on AVR double is the
+same as float.
+*/
+class ModbusPointDecoder
+{
+  public:
+    ModbusPointDecoder(ModbusDecoder*, uint8_t);
+    
+    uint8_t add(const char*, const char*, double, double);
+    bool    compile(ModbusPollPlanner&);
+    uint8_t decoders();
+    const ModbusDecoder& decoder(uint8_t);
+    
+    uint8_t decode(const uint16_t*, uint8_t, uint8_t, double*);
+    uint8_t decode(const ModbusMaster&, uint8_t, double*);
+    
+    /**
+    ModbusPointDecoder invalid point exception.
+    
+    Returned by ModbusPointDecoder::add() for an unknown data type or
+    order, or when the descriptor array is full.
+    
+    @ingroup decoder
+    */
+    static const uint8_t ku8InvalidPoint                 = 0xFF;
+  
+  private:
+    ModbusDecoder* _decoders;                                  ///< caller's descriptor array
+    uint8_t        _u8Decoders;                                ///< number of descriptors
+    uint8_t        _u8MaxDecoders;                             ///< capacity of descriptor array
+    
+    uint8_t first(uint8_t);
+};
+#endif
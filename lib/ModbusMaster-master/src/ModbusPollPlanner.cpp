@@ -0,0 +1,332 @@
+/**
+@file
+Register-coalescing poll planner for ModbusMaster.
+*/
+/*
+
+  ModbusPollPlanner.cpp - merges per-slave register points into the fewest
+  Read Holding/Input Registers requests.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusPollPlanner.h"
+
+
+/* _____LOCAL DEFINITIONS____________________________________________________ */
+namespace
+{
+  // Modbus function 0x04 Read Input Registers (ModbusPoint::u8Function)
+  const uint8_t ku8ReadInputRegisters = 0x04;
+
+  void callPointHandler(void* context, uint8_t u8Point,
+    const uint16_t* pu16Registers, uint8_t u8Len)
+  {
+    (*(ModbusPointHandler*)context)(u8Point, pu16Registers, u8Len);
+  }
+}
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+Points and blocks are caller-owned arrays; nothing is allocated.
+
+@param points register points of one slave
+@param u8Points number of points (1..255)
+@param blocks storage for planned requests
+@param u8MaxBlocks capacity of blocks
+@ingroup planner
+*/
+ModbusPollPlanner::ModbusPollPlanner(ModbusPoint* points, uint8_t u8Points,
+  ModbusReadBlock* blocks, uint8_t u8MaxBlocks)
+{
+  _points = points;
+  _u8Points = u8Points;
+  _blocks = blocks;
+  _u8MaxBlocks = u8MaxBlocks;
+  _u8Blocks = 0;
+  _u8GapTolerance = 0;
+  _u8MaxQty = ModbusMaster::ku8MaxBufferSize;
+}
+
+
+/**
+Set gap tolerance.
+
+Number of unused registers that may be read between two points to merge
+them into one request. Reading a few extra registers is far cheaper than
+another round trip (~8 bytes of request, slave turnaround and 3.5
+character inter-frame gap), but some slaves reject reads that cover
+unmapped addresses; use 0 for those.
+
+@param u8GapTolerance registers (0 = only merge adjacent points)
+@ingroup planner
+*/
+void ModbusPollPlanner::setGapTolerance(uint8_t u8GapTolerance)
+{
+  _u8GapTolerance = u8GapTolerance;
+}
+
+
+/**
+Set maximum registers per request.
+
+Clamped to ModbusMaster::ku8MaxBufferSize, the size of the response buffer.
+
+@param u8MaxQty registers (1..ku8MaxBufferSize)
+@ingroup planner
+*/
+void ModbusPollPlanner::setMaxQty(uint8_t u8MaxQty)
+{
+  if (u8MaxQty == 0 || u8MaxQty > ModbusMaster::ku8MaxBufferSize)
+  {
+    u8MaxQty = ModbusMaster::ku8MaxBufferSize;
+  }
+  _u8MaxQty = u8MaxQty;
+}
+
+
+/**
+Merge points into read requests.
+
+Points are visited in (function, address) order. A point joins the current
+block when it has the same function code, starts no more than the gap
+tolerance past the block end, and the grown block still fits the maximum
+quantity; otherwise a new block is started. This also holds for a point that
+overlaps the block: if it would grow the block past the maximum quantity it
+starts a new block, which reads the shared registers again.
+
+@return number of blocks, ku8PlanOverflow if the block array is too small,
+or ku8PlanBadPoint if a point has no registers or more than the maximum
+quantity
+@ingroup planner
+*/
+uint8_t ModbusPollPlanner::plan()
+{
+  uint8_t u8Order[255];
+  uint8_t i, j, u8Point;
+  uint32_t u32End, u32PointEnd;
+  ModbusReadBlock* pBlock = 0;
+  
+  _u8Blocks = 0;
+  
+  // insertion sort of point indices; point lists are short
+  for (i = 0; i < _u8Points; i++)
+  {
+    if (_points[i].u8Len == 0 || _points[i].u8Len > _u8MaxQty)
+    {
+      return ku8PlanBadPoint;
+    }
+    u8Point = i;
+    for (j = i; j > 0 && pointBefore(u8Point, u8Order[j - 1]); j--)
+    {
+      u8Order[j] = u8Order[j - 1];
+    }
+    u8Order[j] = u8Point;
+  }
+  
+  for (i = 0; i < _u8Points; i++)
+  {
+    ModbusPoint& point = _points[u8Order[i]];
+    u32PointEnd = (uint32_t)point.u16Address + point.u8Len;
+    
+    if (pBlock && pBlock->u8Function == point.u8Function)
+    {
+      u32End = (uint32_t)pBlock->u16Address + pBlock->u8Qty;
+      if (point.u16Address <= u32End + _u8GapTolerance &&
+        u32PointEnd - pBlock->u16Address <= _u8MaxQty)
+      {
+        if (u32PointEnd > u32End)
+        {
+          pBlock->u8Qty = u32PointEnd - pBlock->u16Address;
+        }
+        point.u8Block = _u8Blocks - 1;
+        point.u8Offset = point.u16Address - pBlock->u16Address;
+        continue;
+      }
+    }
+    
+    if (_u8Blocks == _u8MaxBlocks)
+    {
+      return ku8PlanOverflow;
+    }
+    pBlock = &_blocks[_u8Blocks++];
+    pBlock->u8Function = point.u8Function;
+    pBlock->u16Address = point.u16Address;
+    pBlock->u8Qty = point.u8Len;
+    point.u8Block = _u8Blocks - 1;
+    point.u8Offset = 0;
+  }
+  
+  return _u8Blocks;
+}
+
+
+/**
+Number of planned blocks.
+
+@return blocks from the last ModbusPollPlanner::plan()
+@ingroup planner
+*/
+uint8_t ModbusPollPlanner::blocks()
+{
+  return _u8Blocks;
+}
+
+
+/**
+Retrieve a planned block.
+
+@param u8Block block index (0..blocks() - 1)
+@return block
+@ingroup planner
+*/
+const ModbusReadBlock& ModbusPollPlanner::block(uint8_t u8Block)
+{
+  return _blocks[u8Block];
+}
+
+
+/**
+Number of points.
+
+@return points passed to the constructor
+@ingroup planner
+*/
+uint8_t ModbusPollPlanner::points()
+{
+  return _u8Points;
+}
+
+
+/**
+Retrieve a point, including its planned block and offset.
+
+@param u8Point point index (0..points() - 1)
+@return point
+@ingroup planner
+*/
+const ModbusPoint& ModbusPollPlanner::point(uint8_t u8Point)
+{
+  return _points[u8Point];
+}
+
+
+/**
+Total registers read per poll cycle, including gap registers.
+
+@return sum of block quantities
+@ingroup planner
+*/
+uint16_t ModbusPollPlanner::registers()
+{
+  uint16_t u16Total = 0;
+  uint8_t i;
+  
+  for (i = 0; i < _u8Blocks; i++)
+  {
+    u16Total += _blocks[i].u8Qty;
+  }
+  return u16Total;
+}
+
+
+/**
+Issue the read request for one block.
+
+In non-blocking mode returns ModbusMaster::ku8MBPending; call
+ModbusPollPlanner::scatter() once ModbusMaster::poll() reports success.
+
+@param node ModbusMaster addressing this planner's slave
+@param u8Block block index (0..blocks() - 1)
+@return status of ModbusMaster::readHoldingRegisters()/readInputRegisters()
+@ingroup planner
+*/
+uint8_t ModbusPollPlanner::read(ModbusMaster& node, uint8_t u8Block)
+{
+  const ModbusReadBlock& b = _blocks[u8Block];
+  
+  if (b.u8Function == ku8ReadInputRegisters)
+  {
+    return node.readInputRegisters(b.u16Address, b.u8Qty);
+  }
+  return node.readHoldingRegisters(b.u16Address, b.u8Qty);
+}
+
+
+/**
+Hand the registers of every point of a successfully read block to handler.
+
+@param node ModbusMaster holding the block's response
+@param u8Block block index (0..blocks() - 1)
+@param handler called once per point of the block, in point index order
+@ingroup planner
+*/
+void ModbusPollPlanner::scatter(ModbusMaster& node, uint8_t u8Block,
+  ModbusPointHandler handler)
+{
+  scatter(node, u8Block, callPointHandler, &handler);
+}
+
+
+/**
+Hand the registers of every point of a successfully read block to handler,
+passing context through.
+
+@param node ModbusMaster holding the block's response
+@param u8Block block index (0..blocks() - 1)
+@param handler called once per point of the block, in point index order
+@param context passed to handler
+@ingroup planner
+*/
+void ModbusPollPlanner::scatter(ModbusMaster& node, uint8_t u8Block,
+  ModbusPointContextHandler handler, void* context)
+{
+  uint16_t u16Registers[ModbusMaster::ku8MaxBufferSize];
+  uint8_t i, k;
+  
+  for (i = 0; i < _u8Points; i++)
+  {
+    const ModbusPoint& point = _points[i];
+    if (point.u8Block != u8Block)
+    {
+      continue;
+    }
+    for (k = 0; k < point.u8Len; k++)
+    {
+      u16Registers[k] = node.getResponseBuffer(point.u8Offset + k);
+    }
+    handler(context, i, u16Registers, point.u8Len);
+  }
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Ordering of points by function code, then address.
+*/
+bool ModbusPollPlanner::pointBefore(uint8_t a, uint8_t b)
+{
+  if (_points[a].u8Function != _points[b].u8Function)
+  {
+    return _points[a].u8Function < _points[b].u8Function;
+  }
+  return _points[a].u16Address < _points[b].u16Address;
+}
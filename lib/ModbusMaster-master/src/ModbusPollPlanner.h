@@ -0,0 +1,142 @@
+/**
+@file
+Register-coalescing poll planner for ModbusMaster.
+
+@defgroup planner ModbusPollPlanner Register Coalescing
+*/
+/*
+
+  ModbusPollPlanner.h - merges per-slave register points into the fewest
+  Read Holding/Input Registers requests.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef ModbusPollPlanner_h
+#define ModbusPollPlanner_h
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "ModbusMaster.h"
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+/**
+Register point of one slave, e.g. one `AllinOne` entry of modbusConfig.json.
+
+u8Function, u16Address and u8Len are supplied by the caller; u8Block and
+u8Offset are filled in by ModbusPollPlanner::plan().
+
+@ingroup planner
+*/
+struct ModbusPoint
+{
+  uint8_t  u8Function;                                         ///< 0x03 holding or 0x04 input registers
+  uint16_t u16Address;                                         ///< first register of the point
+  uint8_t  u8Len;                                              ///< number of registers (1..ku8MaxBufferSize)
+  uint8_t  u8Block;                                            ///< index of request block covering the point
+  uint8_t  u8Offset;                                           ///< register offset of the point inside its block
+};
+
+/**
+One coalesced read request.
+
+@ingroup planner
+*/
+struct ModbusReadBlock
+{
+  uint8_t  u8Function;                                         ///< 0x03 holding or 0x04 input registers
+  uint16_t u16Address;                                         ///< first register to read
+  uint8_t  u8Qty;                                              ///< number of registers to read
+};
+
+/**
+Point handler; receives the registers of one point after a block was read.
+
+@ingroup planner
+*/
+typedef void (*ModbusPointHandler)(uint8_t u8Point, const uint16_t* pu16Registers, uint8_t u8Len);
+
+/**
+Point handler with the caller's context, for ModbusPollPlanner::scatter().
+
+@ingroup planner
+*/
+typedef void (*ModbusPointContextHandler)(void* context, uint8_t u8Point,
+  const uint16_t* pu16Registers, uint8_t u8Len);
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Plans the requests needed to poll a set of register points on one slave.
+
+Points with the same function code whose register ranges are adjacent, or
+separated by no more than the gap tolerance, are merged into one request
+of at most ModbusMaster::ku8MaxBufferSize registers. A point is never split
+across requests. The caller's point array is not reordered, so point
+indices keep matching the caller's names (`DisplayName`).
+*/
+class ModbusPollPlanner
+{
+  public:
+    ModbusPollPlanner(ModbusPoint*, uint8_t, ModbusReadBlock*, uint8_t);
+    
+    void    setGapTolerance(uint8_t);
+    void    setMaxQty(uint8_t);
+    uint8_t plan();
+    uint8_t blocks();
+    const ModbusReadBlock& block(uint8_t);
+    uint8_t points();
+    const ModbusPoint& point(uint8_t);
+    uint16_t registers();
+    
+    uint8_t read(ModbusMaster&, uint8_t);
+    void    scatter(ModbusMaster&, uint8_t, ModbusPointHandler);
+    void    scatter(ModbusMaster&, uint8_t, ModbusPointContextHandler, void*);
+    
+    /**
+    ModbusPollPlanner too many blocks exception.
+    
+    The points need more requests than the caller's block array can hold;
+    ModbusPollPlanner::plan() stopped at the array size.
+    
+    @ingroup planner
+    */
+    static const uint8_t ku8PlanOverflow                 = 0xFF;
+    
+    /**
+    ModbusPollPlanner invalid point exception.
+    
+    A point has no registers or more than the maximum quantity, so no
+    request can read it; ModbusPollPlanner::plan() planned no blocks.
+    
+    @ingroup planner
+    */
+    static const uint8_t ku8PlanBadPoint                 = 0xFE;
+    
+  private:
+    ModbusPoint*     _points;                                  ///< caller's points
+    uint8_t          _u8Points;                                ///< number of points
+    ModbusReadBlock* _blocks;                                  ///< caller's block array
+    uint8_t          _u8MaxBlocks;                             ///< capacity of block array
+    uint8_t          _u8Blocks;                                ///< number of planned blocks
+    uint8_t          _u8GapTolerance;                          ///< unused registers allowed between points
+    uint8_t          _u8MaxQty;                                ///< registers per request
+    
+    bool pointBefore(uint8_t, uint8_t);
+};
+#endif
@@ -0,0 +1,233 @@
+/**
+@file
+Deadband, heartbeat and rate-of-change filtering of polled point values.
+*/
+/*
+
+  PointChangeFilter.cpp - decides per sample whether a point value changed
+  enough to be published, so unchanged readings stay off the uplink.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "PointChangeFilter.h"
+
+
+/* _____LOCAL DEFINITIONS____________________________________________________ */
+namespace
+{
+  inline double magnitude(double d)
+  {
+    return (d < 0) ? -d : d;
+  }
+}
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+All triggers start disabled, so every change is sent until the points are
+configured.
+
+@param filters caller-owned array, one entry per point
+@param u8Points number of points
+@ingroup filter
+*/
+PointChangeFilter::PointChangeFilter(PointFilter* filters, uint8_t u8Points)
+{
+  _filters = filters;
+  _u8Points = u8Points;
+  _u32Sent = 0;
+  _u32Suppressed = 0;
+  for (uint8_t i = 0; i < u8Points; i++)
+  {
+    configure(i, 0, 0, 0, 0);
+    _filters[i].u32Sent = 0;
+    _filters[i].u32Suppressed = 0;
+  }
+  reset();
+}
+
+
+/**
+Set the triggers of a point.
+
+@param u8Point point index
+@param dDeadband absolute deadband (Deadband), 0 to disable
+@param dDeadbandPercent deadband in percent of the last sent value
+(DeadbandPercent), 0 to disable
+@param u32MaxSilence heartbeat interval in ms (MaxSilence), 0 to disable
+@param dRateOfChange change per second that is always sent
+(RateOfChange), 0 to disable
+@ingroup filter
+*/
+void PointChangeFilter::configure(uint8_t u8Point, double dDeadband,
+  double dDeadbandPercent, uint32_t u32MaxSilence, double dRateOfChange)
+{
+  PointFilter& f = _filters[u8Point];
+  f.dDeadband = magnitude(dDeadband);
+  f.dDeadbandPercent = magnitude(dDeadbandPercent);
+  f.u32MaxSilence = u32MaxSilence;
+  f.dRateOfChange = magnitude(dRateOfChange);
+}
+
+
+/**
+Check a sample taken now.
+
+@see PointChangeFilter::check(uint8_t, double, uint32_t)
+@ingroup filter
+*/
+bool PointChangeFilter::check(uint8_t u8Point, double dValue)
+{
+  return check(u8Point, dValue, millis());
+}
+
+
+/**
+Check a sample and record the decision.
+
+@param u8Point point index
+@param dValue sample value
+@param u32Now time of the sample (millis())
+@return true if the sample should be published
+@ingroup filter
+*/
+bool PointChangeFilter::check(uint8_t u8Point, double dValue, uint32_t u32Now)
+{
+  if (u8Point >= _u8Points)
+  {
+    return true;
+  }
+
+  PointFilter& f = _filters[u8Point];
+  bool bSend = significant(f, dValue, u32Now);
+  f.dLastSample = dValue;
+  f.u32LastSample = u32Now;
+  if (bSend)
+  {
+    f.dLastSent = dValue;
+    f.u32LastSent = u32Now;
+    f.bPrimed = true;
+    f.u32Sent++;
+    _u32Sent++;
+  }
+  else
+  {
+    f.u32Suppressed++;
+    _u32Suppressed++;
+  }
+  return bSend;
+}
+
+
+/**
+Forget the values sent so far, so the next sample of every point is sent,
+e.g. after the broker connection was re-established. Counters are kept.
+
+@ingroup filter
+*/
+void PointChangeFilter::reset()
+{
+  for (uint8_t i = 0; i < _u8Points; i++)
+  {
+    _filters[i].bPrimed = false;
+  }
+}
+
+
+/**
+Number of points.
+
+@ingroup filter
+*/
+uint8_t PointChangeFilter::points()
+{
+  return _u8Points;
+}
+
+
+/**
+Settings, state and counters of a point.
+
+@ingroup filter
+*/
+const PointFilter& PointChangeFilter::point(uint8_t u8Point)
+{
+  return _filters[u8Point];
+}
+
+
+/**
+Samples sent, all points.
+
+@ingroup filter
+*/
+uint32_t PointChangeFilter::sent()
+{
+  return _u32Sent;
+}
+
+
+/**
+Samples suppressed, all points.
+
+@ingroup filter
+*/
+uint32_t PointChangeFilter::suppressed()
+{
+  return _u32Suppressed;
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+bool PointChangeFilter::significant(const PointFilter& f, double dValue, uint32_t u32Now)
+{
+  double dChange;
+
+  if (!f.bPrimed)
+  {
+    return true;
+  }
+  if (f.u32MaxSilence && u32Now - f.u32LastSent >= f.u32MaxSilence)
+  {
+    return true;
+  }
+  if (f.dRateOfChange && u32Now != f.u32LastSample &&
+    magnitude(dValue - f.dLastSample) * 1000.0 / (u32Now - f.u32LastSample) >= f.dRateOfChange)
+  {
+    return true;
+  }
+
+  dChange = magnitude(dValue - f.dLastSent);
+  if (f.dDeadband == 0 && f.dDeadbandPercent == 0)
+  {
+    // NaN compares unequal to everything, so a NaN sample is sent too
+    return !(dValue == f.dLastSent);
+  }
+  if (f.dDeadband && dChange > f.dDeadband)
+  {
+    return true;
+  }
+  if (f.dDeadbandPercent && dChange > magnitude(f.dLastSent) * f.dDeadbandPercent / 100.0)
+  {
+    return true;
+  }
+  return false;
+}
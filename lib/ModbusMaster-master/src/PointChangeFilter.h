@@ -0,0 +1,95 @@
+/**
+@file
+Deadband, heartbeat and rate-of-change filtering of polled point values.
+
+@defgroup filter PointChangeFilter Change Detection
+*/
+/*
+
+  PointChangeFilter.h - decides per sample whether a point value changed
+  enough to be published, so unchanged readings stay off the uplink.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef PointChangeFilter_h
+#define PointChangeFilter_h
+
+
+/* _____STANDARD INCLUDES____________________________________________________ */
+#include "Arduino.h"
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+/**
+Change detection settings and state of one point.
+
+The settings come from the point's entry in modbusConfig.json or
+dlt645Config.json (`Deadband`, `DeadbandPercent`, `MaxSilence`,
+`RateOfChange`); 0 disables a trigger. The remaining fields are kept by
+PointChangeFilter.
+
+@ingroup filter
+*/
+struct PointFilter
+{
+  double   dDeadband;                                          ///< change from last sent value to send (Deadband)
+  double   dDeadbandPercent;                                   ///< same, in percent of last sent value (DeadbandPercent)
+  double   dRateOfChange;                                      ///< change per second between samples to send (RateOfChange)
+  uint32_t u32MaxSilence;                                      ///< longest time without sending, ms (MaxSilence)
+  double   dLastSent;                                          ///< value last sent
+  double   dLastSample;                                        ///< value of previous sample
+  uint32_t u32LastSent;                                        ///< time value was last sent
+  uint32_t u32LastSample;                                      ///< time of previous sample
+  uint32_t u32Sent;                                            ///< samples sent
+  uint32_t u32Suppressed;                                      ///< samples suppressed
+  bool     bPrimed;                                            ///< a value has been sent
+};
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Forwards only significant changes of point values.
+
+A sample is sent when it is the first one, when it differs from the value
+last sent by more than either deadband, when it moved faster than the
+rate of change since the previous sample, or when nothing was sent for
+MaxSilence. With no deadband configured any change is sent.
+*/
+class PointChangeFilter
+{
+  public:
+    PointChangeFilter(PointFilter*, uint8_t);
+
+    void     configure(uint8_t, double, double, uint32_t, double);
+    bool     check(uint8_t, double);
+    bool     check(uint8_t, double, uint32_t);
+    void     reset();
+    uint8_t  points();
+    const PointFilter& point(uint8_t);
+    uint32_t sent();
+    uint32_t suppressed();
+
+  private:
+    PointFilter* _filters;                                     ///< caller's per-point settings and state
+    uint8_t      _u8Points;                                    ///< number of points
+    uint32_t     _u32Sent;                                     ///< samples sent, all points
+    uint32_t     _u32Suppressed;                               ///< samples suppressed, all points
+
+    bool significant(const PointFilter&, double, uint32_t);
+};
+#endif
@@ -0,0 +1,59 @@
+/**
+@file
+Interface between ModbusBusScheduler and the devices it polls.
+*/
+/*
+
+  PolledDevice.h - protocol-independent view of a device on a shared
+  serial bus, so Modbus slaves and DLT645 meters can share one scheduler.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef PolledDevice_h
+#define PolledDevice_h
+
+
+/* _____STANDARD INCLUDES____________________________________________________ */
+#include "Arduino.h"
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+A device polled in cycles of one or more non-blocking requests.
+
+Status values follow ModbusMaster: ku8MBSuccess (0) on success,
+ku8MBPending while a request is in flight, ku8MBResponseTimedOut on
+timeout, anything else is a failure.
+
+@ingroup scheduler
+*/
+class PolledDevice
+{
+  public:
+    virtual ~PolledDevice() {}
+    
+    /// number of requests in one poll cycle
+    virtual uint8_t requests() = 0;
+    /// transmit request u8Request of the cycle; returns ku8MBPending or a final status
+    virtual uint8_t request(uint8_t u8Request) = 0;
+    /// advance the request in flight without blocking
+    virtual uint8_t poll() = 0;
+    /// request u8Request finished with u8Status; deliver its data on success
+    virtual void    complete(uint8_t u8Request, uint8_t u8Status) = 0;
+};
+#endif
@@ -0,0 +1,424 @@
+/**
+@file
+Ring-buffered serial transport with inter-character-timeout framing.
+*/
+/*
+
+  SerialTransport.cpp - lock-free single-producer/single-consumer receive
+  ring in front of a serial port, delimiting frames by line silence.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+/* _____PROJECT INCLUDES_____________________________________________________ */
+#include "SerialTransport.h"
+
+
+/* _____LOCAL DEFINITIONS____________________________________________________ */
+namespace
+{
+#if defined(__AVR__)
+  const int kRelaxed = 0;
+  const int kAcquire = 0;
+  const int kRelease = 0;
+#else
+  const std::memory_order kRelaxed = std::memory_order_relaxed;
+  const std::memory_order kAcquire = std::memory_order_acquire;
+  const std::memory_order kRelease = std::memory_order_release;
+#endif
+}
+
+
+/* _____PUBLIC FUNCTIONS_____________________________________________________ */
+/**
+Constructor.
+
+@param port serial port to receive from and transmit to
+@param pu8Buffer ring storage; only the largest power of two <= u16Size is used
+@param u16Size size of pu8Buffer (2..32768)
+@ingroup transport
+*/
+SerialTransport::SerialTransport(Stream& port, uint8_t* pu8Buffer, uint16_t u16Size)
+  : _port(port), _u16Head(0), _u16Tail(0), _u8FrameHead(0), _u8FrameTail(0)
+{
+  uint16_t u16Ring = 1;
+  
+  while ((uint16_t)(u16Ring << 1) && (uint16_t)(u16Ring << 1) <= u16Size)
+  {
+    u16Ring <<= 1;
+  }
+  _pu8Buffer = pu8Buffer;
+  _u16Mask = u16Ring - 1;
+  _u16FrameStart = 0;
+  _u32LastByte = 0;
+  _u32Overruns = 0;
+  _bAutoPump = true;
+  setBaudRate(9600);
+}
+
+
+/**
+Set line baud rate, which determines the inter-character timeout.
+
+3.5 character times of 11 bits, or a fixed 1.75 ms above 19200 baud.
+
+@param u32BaudRate baud rate of the port
+@ingroup transport
+*/
+void SerialTransport::setBaudRate(uint32_t u32BaudRate)
+{
+  if (u32BaudRate > 19200 || u32BaudRate == 0)
+  {
+    _u32CharTimeout = 1750;
+  }
+  else
+  {
+    _u32CharTimeout = (38500000UL + u32BaudRate - 1) / u32BaudRate;
+  }
+}
+
+
+/**
+Select whether consumer calls pump the port.
+
+Enabled by default, which keeps producer and consumer in one task. Disable
+when SerialTransport::pump() is called from an interrupt/event task.
+
+@param bAutoPump true to pump from available()/read()/readFrame()
+@ingroup transport
+*/
+void SerialTransport::setAutoPump(bool bAutoPump)
+{
+  _bAutoPump = bAutoPump;
+}
+
+
+#if defined(ARDUINO_ARCH_ESP32)
+/**
+Drive the producer from the UART receive timeout (ESP32).
+
+The UART signals a timeout after 4 idle symbols (t3.5 rounded up); the
+callback, which runs in the UART event task, moves the received bytes into
+the ring and closes the frame. The consumer no longer touches the port.
+
+@param port the HardwareSerial passed to the constructor
+@ingroup transport
+*/
+void SerialTransport::attach(HardwareSerial& port)
+{
+  _bAutoPump = false;
+  port.setRxTimeout(4);
+  port.onReceive([this]() {
+    pump();
+    endFrame();
+  }, true);
+}
+#endif
+
+
+/**
+Move received bytes from the port into the ring.
+
+Reads in bulk, at most two contiguous spans per call. When nothing new has
+arrived for the inter-character timeout, the open frame is closed.
+
+@ingroup transport
+*/
+void SerialTransport::pump()
+{
+  uint16_t u16Head = _u16Head.load(kRelaxed);
+  uint16_t u16Free = (_u16Mask + 1) - (uint16_t)(u16Head - _u16Tail.load(kAcquire));
+  int iAvailable = _port.available();
+  uint16_t u16Index, u16Chunk, u16Read;
+  bool bReceived = false;
+  
+  while (iAvailable > 0 && u16Free)
+  {
+    u16Index = u16Head & _u16Mask;
+    u16Chunk = _u16Mask + 1 - u16Index;
+    if (u16Chunk > u16Free)
+    {
+      u16Chunk = u16Free;
+    }
+    if (u16Chunk > iAvailable)
+    {
+      u16Chunk = iAvailable;
+    }
+    u16Read = _port.readBytes(_pu8Buffer + u16Index, u16Chunk);
+    if (!u16Read)
+    {
+      break;
+    }
+    u16Head += u16Read;
+    u16Free -= u16Read;
+    iAvailable -= u16Read;
+    bReceived = true;
+  }
+  if (iAvailable > 0 && !u16Free)
+  {
+    _u32Overruns++;
+  }
+  
+  if (bReceived)
+  {
+    _u16Head.store(u16Head, kRelease);
+    _u32LastByte = micros();
+  }
+  else if ((micros() - _u32LastByte) >= _u32CharTimeout)
+  {
+    endFrame();
+  }
+}
+
+
+/**
+Close the frame being received, if it holds any bytes.
+
+If ku8MaxFrames boundaries are already queued the boundary is dropped and
+the frame merges with the next one.
+
+@ingroup transport
+*/
+void SerialTransport::endFrame()
+{
+  uint16_t u16Head = _u16Head.load(kRelaxed);
+  uint8_t u8FrameHead = _u8FrameHead.load(kRelaxed);
+  
+  if (u16Head == _u16FrameStart)
+  {
+    return;
+  }
+  if ((uint8_t)(u8FrameHead - _u8FrameTail.load(kAcquire)) < ku8MaxFrames)
+  {
+    _u16FrameEnd[u8FrameHead % ku8MaxFrames] = u16Head;
+    _u8FrameHead.store(u8FrameHead + 1, kRelease);
+  }
+  _u16FrameStart = u16Head;
+}
+
+
+/**
+Length of the oldest complete frame.
+
+@return bytes in the frame, 0 if no complete frame has been received
+@ingroup transport
+*/
+uint16_t SerialTransport::frameAvailable()
+{
+  uint8_t u8FrameTail;
+  
+  service();
+  u8FrameTail = _u8FrameTail.load(kRelaxed);
+  if (u8FrameTail == _u8FrameHead.load(kAcquire))
+  {
+    return 0;
+  }
+  return _u16FrameEnd[u8FrameTail % ku8MaxFrames] - _u16Tail.load(kRelaxed);
+}
+
+
+/**
+Take the oldest complete frame in one call.
+
+Bytes that do not fit into pu8Frame are discarded with the frame.
+
+@param pu8Frame destination
+@param u16Size size of pu8Frame
+@return bytes copied, 0 if no complete frame has been received
+@ingroup transport
+*/
+uint16_t SerialTransport::readFrame(uint8_t* pu8Frame, uint16_t u16Size)
+{
+  uint16_t u16Frame = frameAvailable();
+  uint16_t u16Copy = u16Frame < u16Size ? u16Frame : u16Size;
+  uint16_t u16Tail = _u16Tail.load(kRelaxed);
+  uint16_t u16Index = u16Tail & _u16Mask;
+  uint16_t u16First = _u16Mask + 1 - u16Index;
+  
+  if (!u16Frame)
+  {
+    return 0;
+  }
+  if (u16First > u16Copy)
+  {
+    u16First = u16Copy;
+  }
+  memcpy(pu8Frame, _pu8Buffer + u16Index, u16First);
+  memcpy(pu8Frame + u16First, _pu8Buffer, u16Copy - u16First);
+  consume(u16Frame);
+  return u16Copy;
+}
+
+
+/**
+Zero-copy access to received bytes.
+
+Points at the contiguous run of received bytes at the read position; call
+again after SerialTransport::consume() to reach bytes past the ring's wrap
+point.
+
+@param ppu8Span receives pointer into the ring
+@return number of contiguous bytes at *ppu8Span
+@ingroup transport
+*/
+uint16_t SerialTransport::readSpan(const uint8_t** ppu8Span)
+{
+  uint16_t u16Tail, u16Index, u16Available, u16Contiguous;
+  
+  service();
+  u16Tail = _u16Tail.load(kRelaxed);
+  u16Available = _u16Head.load(kAcquire) - u16Tail;
+  u16Index = u16Tail & _u16Mask;
+  u16Contiguous = _u16Mask + 1 - u16Index;
+  *ppu8Span = _pu8Buffer + u16Index;
+  return u16Available < u16Contiguous ? u16Available : u16Contiguous;
+}
+
+
+/**
+Release bytes obtained through SerialTransport::readSpan().
+
+@param u16Count bytes to release
+@ingroup transport
+*/
+void SerialTransport::consume(uint16_t u16Count)
+{
+  _u16Tail.store(_u16Tail.load(kRelaxed) + u16Count, kRelease);
+  dropFrames();
+}
+
+
+/**
+Number of SerialTransport::pump() calls that found the ring full while
+bytes were still waiting in the port.
+
+This counts events, not bytes: the waiting bytes stay in the port and are
+only lost if its own buffer overflows before the consumer frees the ring.
+
+@ingroup transport
+*/
+uint32_t SerialTransport::overruns()
+{
+  return _u32Overruns;
+}
+
+
+int SerialTransport::available()
+{
+  service();
+  return (uint16_t)(_u16Head.load(kAcquire) - _u16Tail.load(kRelaxed));
+}
+
+
+int SerialTransport::read()
+{
+  int iByte = peek();
+  
+  if (iByte >= 0)
+  {
+    consume(1);
+  }
+  return iByte;
+}
+
+
+int SerialTransport::peek()
+{
+  uint16_t u16Tail = _u16Tail.load(kRelaxed);
+  
+  if (!available())
+  {
+    return -1;
+  }
+  return _pu8Buffer[u16Tail & _u16Mask];
+}
+
+
+void SerialTransport::flush()
+{
+  _port.flush();
+}
+
+
+size_t SerialTransport::write(uint8_t u8Byte)
+{
+  return _port.write(u8Byte);
+}
+
+
+size_t SerialTransport::write(const uint8_t* pu8Buffer, size_t size)
+{
+  return _port.write(pu8Buffer, size);
+}
+
+
+/**
+Bulk read of received bytes, ignoring frame boundaries.
+
+Unlike Stream::readBytes() this never waits for more data.
+
+@return bytes copied (at most length)
+@ingroup transport
+*/
+size_t SerialTransport::readBytes(char* buffer, size_t length)
+{
+  const uint8_t* pu8Span;
+  size_t u16Copied = 0;
+  uint16_t u16Span;
+  
+  while (u16Copied < length && (u16Span = readSpan(&pu8Span)))
+  {
+    if (u16Span > length - u16Copied)
+    {
+      u16Span = length - u16Copied;
+    }
+    memcpy(buffer + u16Copied, pu8Span, u16Span);
+    consume(u16Span);
+    u16Copied += u16Span;
+  }
+  return u16Copied;
+}
+
+
+/* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Run the producer from the consumer when auto-pump is enabled.
+*/
+void SerialTransport::service()
+{
+  if (_bAutoPump)
+  {
+    pump();
+  }
+}
+
+
+/**
+Forget frame boundaries the read position has moved past.
+*/
+void SerialTransport::dropFrames()
+{
+  uint16_t u16Tail = _u16Tail.load(kRelaxed);
+  uint8_t u8FrameTail = _u8FrameTail.load(kRelaxed);
+  
+  while (u8FrameTail != _u8FrameHead.load(kAcquire) &&
+    (int16_t)(_u16FrameEnd[u8FrameTail % ku8MaxFrames] - u16Tail) <= 0)
+  {
+    u8FrameTail++;
+  }
+  _u8FrameTail.store(u8FrameTail, kRelease);
+}
@@ -0,0 +1,166 @@
+/**
+@file
+Ring-buffered serial transport with inter-character-timeout framing.
+
+@defgroup transport SerialTransport Frame-Level Serial Reception
+*/
+/*
+
+  SerialTransport.h - lock-free single-producer/single-consumer receive
+  ring in front of a serial port, delimiting frames by line silence.
+
+  Library:: ModbusMaster
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+
+#ifndef SerialTransport_h
+#define SerialTransport_h
+
+
+/* _____STANDARD INCLUDES____________________________________________________ */
+#include "Arduino.h"
+#if defined(__AVR__)
+#include <util/atomic.h>
+#else
+#include <atomic>
+#endif
+
+
+/* _____TYPE DEFINITIONS_____________________________________________________ */
+#if defined(__AVR__)
+/**
+Ring index shared by producer and consumer on AVR.
+
+avr-libc has no <atomic>; a 16 bit index is read and written with
+interrupts disabled, so a pump() from an interrupt never sees half of it.
+The memory order argument matches std::atomic and is ignored.
+
+@ingroup transport
+*/
+template <class T>
+class SerialTransportIndex
+{
+  public:
+    SerialTransportIndex(T value) : _value(value) {}
+    
+    T load(int) const
+    {
+      T value;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        value = _value;
+      }
+      return value;
+    }
+    
+    void store(T value, int)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        _value = value;
+      }
+    }
+  
+  private:
+    volatile T _value;
+};
+#else
+template <class T>
+using SerialTransportIndex = std::atomic<T>;
+#endif
+
+
+/* _____CLASS DEFINITIONS____________________________________________________ */
+/**
+Receive ring and frame delimiter for RTU-style serial protocols.
+
+Received bytes are moved from the port into a caller-supplied ring in bulk
+by the producer, SerialTransport::pump(). A frame ends when the line has
+been silent for 3.5 character times (Modbus RTU t3.5), either detected in
+software from micros() or signalled by the UART receive timeout. The
+consumer then takes a complete frame with one SerialTransport::readFrame()
+call, or parses it in place through SerialTransport::readSpan().
+
+Producer and consumer may run in different tasks/cores: the ring indices
+are atomics written by one side only (on AVR, accessed with interrupts
+disabled). By default the consumer pumps the port itself; on ESP32,
+SerialTransport::attach() moves the producer into the UART event callback
+instead.
+
+Transmission is passed straight through to the port.
+*/
+class SerialTransport : public Stream
+{
+  public:
+    SerialTransport(Stream&, uint8_t*, uint16_t);
+    
+    void     setBaudRate(uint32_t);
+    void     setAutoPump(bool);
+#if defined(ARDUINO_ARCH_ESP32)
+    void     attach(HardwareSerial&);
+#endif
+    
+    // producer side
+    void     pump();
+    void     endFrame();
+    
+    // consumer side
+    uint16_t frameAvailable();
+    uint16_t readFrame(uint8_t*, uint16_t);
+    uint16_t readSpan(const uint8_t**);
+    void     consume(uint16_t);
+    uint32_t overruns();
+    
+    // Stream
+    virtual int    available();
+    virtual int    read();
+    virtual int    peek();
+    virtual void   flush();
+    virtual size_t write(uint8_t);
+    virtual size_t write(const uint8_t*, size_t);
+    virtual size_t readBytes(char*, size_t);
+    size_t         readBytes(uint8_t* buffer, size_t length)
+    {
+      return readBytes((char*)buffer, length);
+    }
+    
+    /**
+    Number of frame boundaries that can be queued between producer and
+    consumer.
+    
+    @ingroup transport
+    */
+    static const uint8_t ku8MaxFrames                    = 8;
+    
+  private:
+    Stream&                        _port;                      ///< underlying serial port
+    uint8_t*                       _pu8Buffer;                 ///< ring storage (power of two)
+    uint16_t                       _u16Mask;                   ///< ring size - 1
+    SerialTransportIndex<uint16_t> _u16Head;                   ///< write index, free running (producer)
+    SerialTransportIndex<uint16_t> _u16Tail;                   ///< read index, free running (consumer)
+    uint16_t                       _u16FrameEnd[ku8MaxFrames]; ///< head positions of frame boundaries
+    SerialTransportIndex<uint8_t>  _u8FrameHead;               ///< frame boundary write index (producer)
+    SerialTransportIndex<uint8_t>  _u8FrameTail;               ///< frame boundary read index (consumer)
+    uint16_t                       _u16FrameStart;             ///< head position at start of open frame (producer)
+    uint32_t                       _u32LastByte;               ///< micros() of last received byte (producer)
+    uint32_t                       _u32CharTimeout;            ///< t3.5 [us]
+    uint32_t                       _u32Overruns;               ///< pump() calls that left bytes in the port because ring was full
+    bool                           _bAutoPump;                 ///< consumer calls pump()
+    
+    void     service();
+    void     dropFrames();
+};
+#endif
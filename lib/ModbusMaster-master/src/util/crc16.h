@@ -55,6 +55,13 @@ obtain a copy.
 #ifndef _UTIL_CRC16_H_
 #define _UTIL_CRC16_H_
 
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define CRC16_TABLE_ATTR PROGMEM
+#else
+#define CRC16_TABLE_ATTR
+#endif
+
 
 /** @ingroup util_crc16
     Processor-independent CRC-16 calculation.
@@ -68,7 +75,7 @@ obtain a copy.
     @param uint8_t a (0x00..0xFF)
     @return calculated CRC (0x0000..0xFFFF)
 */
-static uint16_t crc16_update(uint16_t crc, uint8_t a)
+static inline uint16_t crc16_update(uint16_t crc, uint8_t a)
 {
   int i;
 
@@ -85,4 +92,179 @@ static uint16_t crc16_update(uint16_t crc, uint8_t a)
 }
 
 
+/** @ingroup util_crc16
+    Compile-time evaluation of crc16_update() for a single byte.
+
+    @param uint16_t crc (0x0000..0xFFFF)
+    @param uint8_t k number of bits left to process (0..8)
+    @return CRC after shifting out k bits
+*/
+constexpr uint16_t crc16_shift(uint16_t crc, uint8_t k)
+{
+  return k == 0 ? crc : crc16_shift((crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1), k - 1);
+}
+
+
+/** @ingroup util_crc16
+    Advance a CRC by one zero byte (compile-time).
+
+    @param uint16_t crc (0x0000..0xFFFF)
+    @return CRC after one more zero byte
+*/
+constexpr uint16_t crc16_zero_byte(uint16_t crc)
+{
+  return (crc >> 8) ^ crc16_shift(crc & 0xFF, 8);
+}
+
+
+/** @ingroup util_crc16
+    Compile-time CRC table entry.
+
+    Entry i of slice k is the CRC contribution of byte i followed by k zero
+    bytes, starting from a zero CRC; slice 0 is the classic byte table.
+
+    @param uint8_t k slice (0..7)
+    @param uint16_t crc entry of slice 0 (pass crc16_shift(i, 8))
+    @return table entry (0x0000..0xFFFF)
+*/
+constexpr uint16_t crc16_entry(uint8_t k, uint16_t crc)
+{
+  return k == 0 ? crc : crc16_entry(k - 1, crc16_zero_byte(crc));
+}
+
+
+/** @ingroup util_crc16
+    Index list used to expand the CRC tables at compile time. Built by
+    halving so that template nesting stays logarithmic in table size.
+*/
+template <uint16_t... I>
+struct Crc16Indices
+{
+};
+
+template <class A, class B>
+struct Crc16Concat;
+
+template <uint16_t... A, uint16_t... B>
+struct Crc16Concat<Crc16Indices<A...>, Crc16Indices<B...> >
+{
+  typedef Crc16Indices<A..., (sizeof...(A) + B)...> type;
+};
+
+template <uint16_t N>
+struct Crc16MakeIndices
+{
+  typedef typename Crc16Concat<typename Crc16MakeIndices<N / 2>::type,
+    typename Crc16MakeIndices<N - N / 2>::type>::type type;
+};
+
+template <>
+struct Crc16MakeIndices<1>
+{
+  typedef Crc16Indices<0> type;
+};
+
+
+/** @ingroup util_crc16
+    CRC lookup tables, generated by the compiler from crc16_entry().
+
+    Tables are laid out slice-major: slice k occupies entries
+    [256 * k, 256 * k + 255]. 8 slices x 256 entries x 2 bytes = 4 KiB of
+    read-only data. On AVR, where const data is copied to SRAM, only slice 0
+    is built and it is kept in flash (PROGMEM), 512 bytes.
+*/
+template <class Indices>
+struct Crc16TableOf;
+
+template <uint16_t... I>
+struct Crc16TableOf<Crc16Indices<I...> >
+{
+  static constexpr uint16_t table[sizeof...(I)] CRC16_TABLE_ATTR = { crc16_entry(I >> 8, crc16_shift(I & 0xFF, 8))... };
+};
+
+template <uint16_t... I>
+constexpr uint16_t Crc16TableOf<Crc16Indices<I...> >::table[sizeof...(I)] CRC16_TABLE_ATTR;
+
+
+/** @ingroup util_crc16
+    Number of bytes consumed per iteration of the crc16() fast path.
+*/
+#if defined(__AVR__)
+static const uint8_t ku8CRC16Slices = 1;
+#else
+static const uint8_t ku8CRC16Slices = 8;
+#endif
+
+typedef Crc16TableOf<Crc16MakeIndices<256 * ku8CRC16Slices>::type> Crc16Tables;
+
+
+/** @ingroup util_crc16
+    Entry of the CRC lookup tables, read from flash on AVR.
+
+    @param uint16_t i index (0..256 * ku8CRC16Slices - 1)
+    @return table entry (0x0000..0xFFFF)
+*/
+static inline uint16_t crc16_table_entry(uint16_t i)
+{
+#if defined(__AVR__)
+  return pgm_read_word(&Crc16Tables::table[i]);
+#else
+  return Crc16Tables::table[i];
+#endif
+}
+
+
+/** @ingroup util_crc16
+    Table-driven CRC-16 calculation for a single byte.
+
+    Produces the same result as crc16_update() with one lookup instead of
+    eight shift/xor steps.
+
+    @param uint16_t crc (0x0000..0xFFFF)
+    @param uint8_t a (0x00..0xFF)
+    @return calculated CRC (0x0000..0xFFFF)
+*/
+static inline uint16_t crc16_table_update(uint16_t crc, uint8_t a)
+{
+  return (crc >> 8) ^ crc16_table_entry((crc ^ a) & 0xFF);
+}
+
+
+/** @ingroup util_crc16
+    Table-driven CRC-16/MODBUS calculation over a buffer.
+
+    Consumes ku8CRC16Slices bytes per iteration (slicing-by-8), then
+    finishes the tail one byte at a time. On AVR every byte takes the
+    byte-wise path through the flash table.
+
+    @param const uint8_t* buf data
+    @param uint16_t len number of bytes in buf
+    @param uint16_t crc initial value (0xFFFF for a new Modbus frame)
+    @return calculated CRC (0x0000..0xFFFF)
+*/
+static inline uint16_t crc16(const uint8_t* buf, uint16_t len, uint16_t crc = 0xFFFF)
+{
+#if !defined(__AVR__)
+  const uint16_t* t = Crc16Tables::table;
+
+  while (len >= ku8CRC16Slices)
+  {
+    crc ^= buf[0] | (buf[1] << 8);
+    crc = t[7 * 256 + (crc & 0xFF)] ^ t[6 * 256 + (crc >> 8)] ^
+          t[5 * 256 + buf[2]]       ^ t[4 * 256 + buf[3]] ^
+          t[3 * 256 + buf[4]]       ^ t[2 * 256 + buf[5]] ^
+          t[1 * 256 + buf[6]]       ^ t[buf[7]];
+    buf += ku8CRC16Slices;
+    len -= ku8CRC16Slices;
+  }
+#endif
+  while (len--)
+  {
+    crc = crc16_table_update(crc, *buf++);
+  }
+
+  return crc;
+}
+
+
 #endif /* _UTIL_CRC16_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Micro-benchmark of the CRC-16/MODBUS implementations in util/crc16.h.
+ *
+ * Frames of typical Modbus RTU sizes are checksummed repeatedly with the
+ * bitwise crc16_update(), the byte table and the slicing-by-8 fast path.
+ * Results are host timings and only meaningful relative to each other.
+ */
+#include "Arduino.h"
+#include "util/crc16.h"
+#include <chrono>
+#include <cstdio>
+
+static const uint32_t kIterations = 200000;
+
+static volatile uint16_t sink;
+
+template <class F>
+static double nsPerByte(const uint8_t* buf, uint16_t len, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < kIterations; n++) {
+        sink = f(buf, len);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return (double)ns / ((double)kIterations * len);
+}
+
+static uint16_t bitwise(const uint8_t* buf, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < len; i++) {
+        crc = crc16_update(crc, buf[i]);
+    }
+    return crc;
+}
+
+static uint16_t bytewise(const uint8_t* buf, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < len; i++) {
+        crc = crc16_table_update(crc, buf[i]);
+    }
+    return crc;
+}
+
+static uint16_t sliced(const uint8_t* buf, uint16_t len) {
+    return crc16(buf, len);
+}
+
+int main() {
+    // request, short response, 64-register response, maximum ADU
+    const uint16_t sizes[] = { 6, 11, 131, 254 };
+    uint8_t buf[256];
+    for (uint16_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    printf("%6s %12s %12s %12s %9s\n", "bytes", "bitwise", "table", "slice-by-8", "speedup");
+    for (uint16_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint16_t len = sizes[s];
+        double a = nsPerByte(buf, len, bitwise);
+        double b = nsPerByte(buf, len, bytewise);
+        double c = nsPerByte(buf, len, sliced);
+        printf("%6u %9.2f ns %9.2f ns %9.2f ns %8.1fx\n", len, a, b, c, a / c);
+    }
+    return 0;
+}
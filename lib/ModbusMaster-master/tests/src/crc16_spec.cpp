@@ -0,0 +1,83 @@
+#include "Arduino.h"
+#include "util/crc16.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+uint16_t bitwise(const uint8_t* buf, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < len; i++) {
+        crc = crc16_update(crc, buf[i]);
+    }
+    return crc;
+}
+
+
+int test_known_vector() {
+    IT("matches the CRC-16/MODBUS check value");
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    IS_EQUAL(crc16(check, sizeof(check)), 0x4B37);
+    IS_EQUAL(bitwise(check, sizeof(check)), 0x4B37);
+
+    // read 10 holding registers from 0, slave 1: 01 03 00 00 00 0A | C5 CD
+    const uint8_t request[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    uint16_t crc = crc16(request, sizeof(request));
+    IS_EQUAL(lowByte(crc), 0xC5);
+    IS_EQUAL(highByte(crc), 0xCD);
+    END_IT
+}
+
+int test_table_entries() {
+    IT("builds the byte table from the bitwise update");
+    for (uint16_t i = 0; i < 256; i++) {
+        IS_EQUAL(crc16_table_entry(i), crc16_update(0, (uint8_t)i));
+    }
+    END_IT
+}
+
+int test_single_byte() {
+    IT("agrees with the bitwise update for every byte and CRC seed");
+    for (uint32_t seed = 0; seed < 0x10000; seed += 0x0101) {
+        for (uint16_t a = 0; a < 256; a++) {
+            IS_EQUAL(crc16_table_update(seed, a), crc16_update(seed, a));
+        }
+    }
+    END_IT
+}
+
+int test_all_lengths() {
+    IT("agrees with the bitwise version for every length and alignment");
+    uint8_t buf[300];
+    uint32_t x = 0x12345678;
+    for (uint16_t i = 0; i < sizeof(buf); i++) {
+        x = x * 1103515245 + 12345;
+        buf[i] = x >> 16;
+    }
+    for (uint16_t offset = 0; offset < 8; offset++) {
+        for (uint16_t len = 0; len + offset <= 260; len++) {
+            IS_EQUAL(crc16(buf + offset, len), bitwise(buf + offset, len));
+        }
+    }
+    END_IT
+}
+
+int test_chained() {
+    IT("continues from a previous CRC value");
+    const uint8_t data[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD, 0x11, 0x22, 0x33 };
+    uint16_t crc = crc16(data, 5);
+    crc = crc16(data + 5, sizeof(data) - 5, crc);
+    IS_EQUAL(crc, crc16(data, sizeof(data)));
+    END_IT
+}
+
+int main()
+{
+    SUITE("CRC16");
+    test_known_vector();
+    test_table_entries();
+    test_single_byte();
+    test_all_lengths();
+    test_chained();
+
+    FINISH
+}
@@ -0,0 +1,246 @@
+#include "ModbusPointDecoder.h"
+#include "ModbusBusScheduler.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+#include <math.h>
+
+
+bool near(double a, double b) {
+    return fabs(a - b) < 0.0001 * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+double decodeOne(const char* type, const char* endian, const uint16_t* registers,
+    double coefficient = 1) {
+    ModbusDecoder decoders[1];
+    ModbusPointDecoder decoder(decoders, 1);
+    decoder.add(type, endian, coefficient, 0);
+    double value = 0;
+    decoder.decode(registers, 0, 2, &value);
+    return value;
+}
+
+
+int test_types_and_orders() {
+    IT("decodes every data type in every register and byte order");
+    const uint16_t i16[] = { 0xFF38 };          // -200
+    const uint16_t i16Swapped[] = { 0x38FF };
+    IS_TRUE(near(decodeOne("Int16", "-", i16), -200));
+    IS_TRUE(near(decodeOne("UInt16", "ABCD", i16), 65336));
+    IS_TRUE(near(decodeOne("Int16", "BADC", i16Swapped), -200));
+    IS_TRUE(near(decodeOne("int16", "dcba", i16Swapped), -200));
+
+    // -100000 = 0xFFFE7960; bytes A B C D = FF FE 79 60
+    const uint16_t abcd[] = { 0xFFFE, 0x7960 };
+    const uint16_t cdab[] = { 0x7960, 0xFFFE };
+    const uint16_t badc[] = { 0xFEFF, 0x6079 };
+    const uint16_t dcba[] = { 0x6079, 0xFEFF };
+    IS_TRUE(near(decodeOne("Int32", "", abcd), -100000));
+    IS_TRUE(near(decodeOne("Int32", "CDAB", cdab), -100000));
+    IS_TRUE(near(decodeOne("Int32", "BADC", badc), -100000));
+    IS_TRUE(near(decodeOne("Int32", "DCBA", dcba), -100000));
+    IS_TRUE(near(decodeOne("UInt32", "ABCD", abcd), 4294867296.0));
+
+    // 230.5f = 0x43668000
+    const uint16_t f32[] = { 0x4366, 0x8000 };
+    const uint16_t f32Swapped[] = { 0x8000, 0x4366 };
+    IS_TRUE(near(decodeOne("Float32", "-", f32), 230.5f));
+    IS_TRUE(near(decodeOne("Float", "CDAB", f32Swapped), 230.5f));
+
+    END_IT
+}
+
+int test_int32_precision() {
+    IT("keeps every digit of 32 bit integer points");
+    // 123456789 = 0x075BCD15, an energy counter in 0.01 kWh
+    const uint16_t energy[] = { 0x075B, 0xCD15 };
+    IS_TRUE(fabs(decodeOne("Int32", "-", energy) - 123456789) < 1e-9);
+    IS_TRUE(fabs(decodeOne("Int32", "-", energy, 0.01) - 1234567.89) < 1e-6);
+
+    const uint16_t max[] = { 0xFFFF, 0xFFFF };
+    IS_TRUE(decodeOne("UInt32", "-", max) == 4294967295.0);
+    IS_TRUE(decodeOne("Int32", "-", max) == -1);
+
+    END_IT
+}
+
+int test_rejects_unknown() {
+    IT("rejects unknown data types, orders and short points");
+    ModbusDecoder decoders[2];
+    ModbusPointDecoder decoder(decoders, 2);
+    IS_EQUAL(decoder.add("Int64", "-", 1, 0), ModbusPointDecoder::ku8InvalidPoint);
+    IS_EQUAL(decoder.add("Int16", "AB", 1, 0), ModbusPointDecoder::ku8InvalidPoint);
+    IS_EQUAL(decoder.add("Int32", "-", 1, 0), 0);
+    IS_EQUAL(decoder.add("Int16", "-", 1, 0), 1);
+    IS_EQUAL(decoder.add("Int16", "-", 1, 0), ModbusPointDecoder::ku8InvalidPoint);
+
+    // Int32 declared with Len 1
+    ModbusPoint points[] = { { 4, 405, 1, 0, 0 }, { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocks[2];
+    ModbusPollPlanner planner(points, 2, blocks, 2);
+    planner.plan();
+    IS_FALSE(decoder.compile(planner));
+
+    END_IT
+}
+
+int test_block_pass() {
+    IT("decodes the points of a planned block in one pass, in point order");
+    // modbusConfig.json: 400 Int16 x0.1, 401 Int16 x0.01, 402 Int16 x1, 405 Int32 x0.01
+    ModbusPoint points[] = {
+        { 4, 405, 2, 0, 0 },
+        { 4, 400, 1, 0, 0 },
+        { 4, 401, 1, 0, 0 },
+        { 4, 402, 1, 0, 0 },
+        { 3, 10, 1, 0, 0 }
+    };
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(points, 5, blocks, 4);
+    planner.setGapTolerance(4);
+    IS_EQUAL(planner.plan(), 2);
+
+    ModbusDecoder decoders[5];
+    ModbusPointDecoder decoder(decoders, 5);
+    decoder.add("Int32", "-", 0.01f, 0);
+    decoder.add("Int16", "-", 0.1f, 0);
+    decoder.add("Int16", "-", 0.01f, 0);
+    decoder.add("Int16", "-", 1, -10);
+    decoder.add("UInt16", "-", 1, 0);
+    IS_TRUE(decoder.compile(planner));
+
+    // descriptors of a block are in register order
+    uint8_t b = points[1].u8Block;
+    uint8_t last = 0;
+    for (uint8_t i = 0; i < decoder.decoders(); i++) {
+        if (decoder.decoder(i).u8Block == b) {
+            IS_TRUE(decoder.decoder(i).u8Offset >= last);
+            last = decoder.decoder(i).u8Offset;
+        }
+    }
+
+    // registers 400..406 of the input block
+    const uint16_t registers[] = { 2301, 512, 1500, 0, 0, 0x0001, 0xE240 };
+    double values[5] = { 0, 0, 0, 0, -1 };
+    IS_EQUAL(decoder.decode(registers, b, 7, values), 4);
+    IS_TRUE(near(values[0], 1234.56f));
+    IS_TRUE(near(values[1], 230.1f));
+    IS_TRUE(near(values[2], 5.12f));
+    IS_TRUE(near(values[3], 1490));
+    IS_TRUE(near(values[4], -1));
+
+    // a short buffer stops at the first point that does not fit
+    IS_EQUAL(decoder.decode(registers, b, 3, values), 3);
+
+    END_IT
+}
+
+double lastValues[4];
+ModbusPointDecoder* schedulerDecoder;
+
+void onBlock(uint8_t slave, uint8_t block, const ModbusMaster& node) {
+    schedulerDecoder->decode(node, block, lastValues);
+}
+
+int test_from_scheduler() {
+    IT("decodes straight from the response buffer in the scheduler's block handler");
+    setMillis(0);
+    FakeSlave bus(1);
+    bus.setRegister(400, 2301);
+    bus.setRegister(401, 512);
+    bus.setRegister(402, 1500);
+    bus.setRegister(405, 0x0001);
+    bus.setRegister(406, 0xE240);
+
+    ModbusPoint points[] = {
+        { 4, 400, 1, 0, 0 },
+        { 4, 401, 1, 0, 0 },
+        { 4, 402, 1, 0, 0 },
+        { 4, 405, 2, 0, 0 }
+    };
+    ModbusReadBlock blocks[2];
+    ModbusPollPlanner planner(points, 4, blocks, 2);
+    planner.setGapTolerance(2);
+    IS_EQUAL(planner.plan(), 1);
+
+    ModbusDecoder decoders[4];
+    ModbusPointDecoder decoder(decoders, 4);
+    decoder.add("Int16", "-", 0.1f, 0);
+    decoder.add("Int16", "-", 0.01f, 0);
+    decoder.add("Int16", "-", 1, 0);
+    decoder.add("Int32", "-", 0.01f, 0);
+    IS_TRUE(decoder.compile(planner));
+    schedulerDecoder = &decoder;
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onBlock(onBlock);
+    scheduler.addSlave(1, planner, 1000, 0, 0);
+    for (int t = 0; t < 10; t++) {
+        scheduler.run();
+        advanceMillis(1);
+    }
+
+    IS_TRUE(near(lastValues[0], 230.1f));
+    IS_TRUE(near(lastValues[1], 5.12f));
+    IS_TRUE(near(lastValues[2], 1500));
+    IS_TRUE(near(lastValues[3], 1234.56f));
+
+    END_IT
+}
+
+int test_response_length() {
+    IT("decodes only the registers the slave returned");
+    setMillis(0);
+    FakeSlave bus(1);
+    bus.setRegister(400, 2301);
+    bus.setRegister(401, 512);
+    bus.setRegister(402, 1500);
+
+    ModbusPoint points[] = {
+        { 4, 400, 1, 0, 0 },
+        { 4, 401, 1, 0, 0 },
+        { 4, 402, 1, 0, 0 }
+    };
+    ModbusReadBlock blocks[1];
+    ModbusPollPlanner planner(points, 3, blocks, 1);
+    IS_EQUAL(planner.plan(), 1);
+
+    ModbusDecoder decoders[3];
+    ModbusPointDecoder decoder(decoders, 3);
+    decoder.add("Int16", "-", 1, 0);
+    decoder.add("Int16", "-", 1, 0);
+    decoder.add("Int16", "-", 1, 0);
+    IS_TRUE(decoder.compile(planner));
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    double values[3] = { -1, -1, -1 };
+    IS_EQUAL(node.readInputRegisters(400, 3), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(decoder.decode(node, 0, values), 3);
+    IS_TRUE(near(values[2], 1500));
+
+    // a shorter reply leaves the points past its end untouched
+    values[2] = -1;
+    IS_EQUAL(node.readInputRegisters(400, 2), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(decoder.decode(node, 0, values), 2);
+    IS_TRUE(near(values[1], 512));
+    IS_TRUE(near(values[2], -1));
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("Point decoder");
+    test_types_and_orders();
+    test_int32_precision();
+    test_rejects_unknown();
+    test_block_pass();
+    test_from_scheduler();
+    test_response_length();
+
+    FINISH
+}
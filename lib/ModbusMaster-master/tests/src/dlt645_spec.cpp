@@ -0,0 +1,274 @@
+#include "DLT645Master.h"
+#include "ModbusBusScheduler.h"
+#include "FakeMeter.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+#include <math.h>
+
+
+// MeterAddress "781062211123", A0 first
+const uint8_t address[6] = { 0x23, 0x11, 0x21, 0x62, 0x10, 0x78 };
+
+const uint32_t kVoltageA = 0x02010100;
+const uint32_t kCurrentA = 0x02020100;
+const uint32_t kPowerA = 0x02030100;
+const uint32_t kEnergy = 0x00000000;
+
+double values[8];
+int valuesSeen;
+int completions;
+
+void onValue(DLT645Meter* meter, uint8_t point, double value) {
+    values[point] = value;
+    valuesSeen++;
+}
+
+void onComplete(DLT645Master* master, uint8_t status) {
+    completions++;
+}
+
+void reset() {
+    setMillis(1000);
+    memset(values, 0, sizeof(values));
+    valuesSeen = 0;
+    completions = 0;
+}
+
+bool near(double a, double b) {
+    return fabs(a - b) < 0.0005;
+}
+
+void fillMeter(FakeMeter& meter) {
+    const uint8_t voltage[] = { 0x01, 0x22 };           // 220.1 V
+    const uint8_t current[] = { 0x40, 0x23, 0x81 };     // -12.340 A
+    const uint8_t power[] = { 0x56, 0x34, 0x12 };       // 12.3456 kW
+    const uint8_t energy[] = { 0x89, 0x67, 0x45, 0x23 }; // 234567.89 kWh
+    meter.setValue(kVoltageA, voltage, sizeof(voltage));
+    meter.setValue(kCurrentA, current, sizeof(current));
+    meter.setValue(kPowerA, power, sizeof(power));
+    meter.setValue(kEnergy, energy, sizeof(energy));
+}
+
+
+int test_parses_config() {
+    IT("parses MeterAddress and DI as written in dlt645Config.json");
+    uint8_t parsed[6];
+    IS_TRUE(DLT645Master::parseAddress("781062211123", parsed));
+    IS_TRUE(memcmp(parsed, address, 6) == 0);
+    IS_FALSE(DLT645Master::parseAddress("78106221112", parsed));
+    IS_FALSE(DLT645Master::parseAddress("78106221112A", parsed));
+
+    uint32_t di;
+    IS_TRUE(DLT645Master::parseDI("00010102", &di));
+    IS_EQUAL(di, kVoltageA);
+    IS_TRUE(DLT645Master::parseDI("00010302", &di));
+    IS_EQUAL(di, kPowerA);
+    IS_TRUE(DLT645Master::parseDI("00ff01Fe", &di));
+    IS_EQUAL(di, 0xFE01FF00);
+    IS_FALSE(DLT645Master::parseDI("0001010", &di));
+    IS_FALSE(DLT645Master::parseDI("0001010G", &di));
+
+    END_IT
+}
+
+int test_encodes_request() {
+    IT("encodes a Read Data request with wake-up preamble and checksum");
+    reset();
+    FakeMeter meter(address);
+    fillMeter(meter);
+
+    DLT645Master master;
+    master.begin(meter);
+    IS_EQUAL(master.readData(address, kVoltageA), DLT645Master::ku8DLTSuccess);
+
+    const uint8_t expected[] = {
+        0xFE, 0xFE, 0xFE, 0xFE,
+        0x68, 0x23, 0x11, 0x21, 0x62, 0x10, 0x78, 0x68,
+        0x11, 0x04, 0x33, 0x34, 0x34, 0x35, 0xF4, 0x16
+    };
+    IS_EQUAL(meter.lastRequestLength(), sizeof(expected));
+    IS_TRUE(memcmp(meter.lastRequest(), expected, sizeof(expected)) == 0);
+
+    master.setPreamble(0);
+    IS_EQUAL(master.readData(address, kVoltageA), DLT645Master::ku8DLTSuccess);
+    IS_EQUAL(meter.lastRequestLength(), sizeof(expected) - 4);
+
+    END_IT
+}
+
+int test_decodes_bcd() {
+    IT("decodes BCD values scaled by Factor, with sign for current and power");
+    reset();
+    FakeMeter meter(address);
+    fillMeter(meter);
+
+    DLT645Master master;
+    master.begin(meter);
+    double value;
+
+    IS_EQUAL(master.readData(address, kVoltageA), DLT645Master::ku8DLTSuccess);
+    IS_EQUAL(master.getDI(), kVoltageA);
+    IS_EQUAL(master.getDataLength(), 2);
+    IS_EQUAL(master.getValue(0, 0.1, &value), DLT645Master::ku8DLTSuccess);
+    IS_TRUE(near(value, 220.1));
+
+    IS_EQUAL(master.readData(address, kCurrentA), DLT645Master::ku8DLTSuccess);
+    IS_EQUAL(master.getValue(0, 0.001, &value), DLT645Master::ku8DLTSuccess);
+    IS_TRUE(near(value, -12.34));
+
+    IS_EQUAL(master.readData(address, kEnergy), DLT645Master::ku8DLTSuccess);
+    IS_EQUAL(master.getValue(0, 0.01, &value), DLT645Master::ku8DLTSuccess);
+    IS_TRUE(fabs(value - 234567.89) < 1e-6);
+    IS_EQUAL(master.getValue(5, 0.01, &value), DLT645Master::ku8DLTInvalidData);
+
+    const uint8_t bad[] = { 0x1A, 0x00 };
+    int32_t raw;
+    IS_FALSE(DLT645Master::bcdToInt(bad, 2, false, &raw));
+    IS_TRUE(DLT645Master::bcdToInt(bad + 1, 1, false, &raw));
+    IS_EQUAL(raw, 0);
+
+    END_IT
+}
+
+int test_nonblocking_fragmented() {
+    IT("collects a fragmented response with preamble in non-blocking mode");
+    reset();
+    FakeMeter meter(address);
+    fillMeter(meter);
+    meter.setPreamble(2);
+    meter.setDelay(20);
+    meter.setMsPerByte(1);
+
+    DLT645Master master;
+    master.begin(meter);
+    master.setNonBlocking(true);
+    master.onComplete(onComplete);
+
+    IS_EQUAL(master.readData(address, kPowerA), DLT645Master::ku8DLTPending);
+    IS_TRUE(master.busy());
+    IS_EQUAL(master.readData(address, kPowerA), DLT645Master::ku8DLTBusy);
+
+    int polls = 0;
+    uint8_t rc;
+    while ((rc = master.poll()) == DLT645Master::ku8DLTPending) {
+        polls++;
+        advanceMillis(1);
+    }
+    IS_EQUAL(rc, DLT645Master::ku8DLTSuccess);
+    IS_TRUE(polls > 20);
+    IS_FALSE(master.busy());
+    IS_EQUAL(completions, 1);
+
+    double value;
+    IS_EQUAL(master.getValue(0, 0.0001, &value), DLT645Master::ku8DLTSuccess);
+    IS_TRUE(near(value, 12.3456));
+
+    END_IT
+}
+
+int test_errors() {
+    IT("reports checksum errors, abnormal responses and timeouts");
+    reset();
+    FakeMeter meter(address);
+    fillMeter(meter);
+
+    DLT645Master master;
+    master.begin(meter);
+
+    meter.setCorruptChecksum(true);
+    IS_EQUAL(master.readData(address, kVoltageA), DLT645Master::ku8DLTInvalidChecksum);
+    meter.setCorruptChecksum(false);
+
+    IS_EQUAL(master.readData(address, 0x04000101), DLT645Master::ku8DLTMeterError);
+    IS_EQUAL(master.getMeterError(), 0x02);
+    IS_EQUAL(master.getDataLength(), 0);
+
+    uint8_t other[6] = { 0x24, 0x11, 0x21, 0x62, 0x10, 0x78 };
+    FakeMeter stranger(other);
+    fillMeter(stranger);
+    master.begin(stranger);
+    uint8_t wildcard[6] = { 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA };
+    IS_EQUAL(master.readData(wildcard, kVoltageA), DLT645Master::ku8DLTSuccess);
+
+    master.begin(meter);
+    meter.setSilent(true);
+    master.setNonBlocking(true);
+    master.setResponseTimeout(500);
+    IS_EQUAL(master.readData(address, kVoltageA), DLT645Master::ku8DLTPending);
+    advanceMillis(500);
+    IS_EQUAL(master.poll(), DLT645Master::ku8DLTPending);
+    advanceMillis(1);
+    IS_EQUAL(master.poll(), DLT645Master::ku8DLTResponseTimedOut);
+
+    END_IT
+}
+
+int test_shares_scheduler() {
+    IT("polls a meter and a Modbus slave from one scheduler");
+    reset();
+    FakeMeter meter(address);
+    fillMeter(meter);
+    meter.setDelay(10);
+    FakeSlave slave(1);
+    slave.setRegister(400, 2301);
+    slave.setDelay(5);
+
+    ModbusPoint modbusPoints[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocks[1];
+    ModbusPollPlanner planner(modbusPoints, 1, blocks, 1);
+    planner.plan();
+
+    DLT645Point meterPoints[] = {
+        { kVoltageA, 0.1 },
+        { kCurrentA, 0.001 },
+        { kPowerA, 0.0001 },
+        { kEnergy, 0.01 }
+    };
+
+    ModbusMaster node;
+    node.begin(1, slave);
+    DLT645Master master;
+    master.begin(meter);
+    master.setNonBlocking(true);
+    DLT645Meter dlt(master, meterPoints, 4);
+    IS_TRUE(dlt.setAddress("781062211123"));
+    dlt.onPoint(onValue);
+
+    ModbusBusScheduler scheduler(node);
+    IS_EQUAL(scheduler.addSlave(1, planner, 1000, 3, 100), 0);
+    IS_EQUAL(scheduler.addDevice(dlt, 60000, 5, 200), 1);
+    IS_EQUAL(scheduler.slaveId(1), 0);
+
+    for (int t = 0; t < 200; t++) {
+        scheduler.run();
+        advanceMillis(1);
+    }
+
+    IS_EQUAL(valuesSeen, 4);
+    IS_EQUAL(meter.requests(), 4);
+    IS_EQUAL(slave.requests(), 1);
+    IS_EQUAL(scheduler.stats(1).u32Cycles, 1);
+    IS_EQUAL(scheduler.stats(1).u32Successes, 4);
+    IS_TRUE(near(values[0], 220.1));
+    IS_TRUE(near(values[1], -12.34));
+    IS_TRUE(near(dlt.point(2).dValue, 12.3456));
+    IS_EQUAL(dlt.point(3).u8Status, DLT645Master::ku8DLTSuccess);
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("DLT645");
+    test_parses_config();
+    test_encodes_request();
+    test_decodes_bcd();
+    test_nonblocking_fragmented();
+    test_errors();
+    test_shares_scheduler();
+
+    FINISH
+}
@@ -0,0 +1,118 @@
+#include "PointChangeFilter.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+int test_first_and_unchanged() {
+    IT("sends the first sample and any change when no trigger is set");
+    PointFilter points[2];
+    PointChangeFilter filter(points, 2);
+
+    IS_TRUE(filter.check(0, 230.1, 0));
+    IS_FALSE(filter.check(0, 230.1, 1000));
+    IS_TRUE(filter.check(0, 230.2, 2000));
+    IS_TRUE(filter.check(1, 5.0, 2000));
+    IS_TRUE(filter.check(7, 1.0, 2000));
+
+    IS_EQUAL(filter.sent(), 3);
+    IS_EQUAL(filter.suppressed(), 1);
+    IS_EQUAL(filter.point(0).u32Sent, 2);
+    IS_EQUAL(filter.point(0).u32Suppressed, 1);
+
+    END_IT
+}
+
+int test_deadbands() {
+    IT("suppresses changes inside the absolute and percent deadbands");
+    PointFilter points[2];
+    PointChangeFilter filter(points, 2);
+    filter.configure(0, 0.5, 0, 0, 0);
+    filter.configure(1, 0, 1.0, 0, 0);
+
+    // absolute: measured from the value last sent, so drift adds up
+    IS_TRUE(filter.check(0, 230.0, 0));
+    IS_FALSE(filter.check(0, 230.3, 1000));
+    IS_FALSE(filter.check(0, 229.6, 2000));
+    IS_TRUE(filter.check(0, 230.6, 3000));
+    IS_FALSE(filter.check(0, 230.2, 4000));
+    IS_TRUE(filter.check(0, 230.0, 5000));
+
+    // percent of the last sent value
+    IS_TRUE(filter.check(1, 200.0, 0));
+    IS_FALSE(filter.check(1, 201.9, 1000));
+    IS_TRUE(filter.check(1, 202.1, 2000));
+    IS_FALSE(filter.check(1, 200.2, 3000));
+
+    IS_EQUAL(filter.sent(), 5);
+    IS_EQUAL(filter.suppressed(), 5);
+
+    END_IT
+}
+
+int test_heartbeat_and_rate() {
+    IT("sends on max silence and on a fast rate of change");
+    PointFilter points[1];
+    PointChangeFilter filter(points, 1);
+    filter.configure(0, 10.0, 0, 60000, 2.0);
+
+    IS_TRUE(filter.check(0, 100.0, 0));
+    IS_FALSE(filter.check(0, 101.0, 1000));
+    // 3 per second since the previous sample, though inside the deadband
+    IS_TRUE(filter.check(0, 104.0, 2000));
+    IS_FALSE(filter.check(0, 105.0, 3000));
+    IS_FALSE(filter.check(0, 105.0, 61000));
+    IS_TRUE(filter.check(0, 105.0, 62000));
+    IS_FALSE(filter.check(0, 105.0, 63000));
+
+    END_IT
+}
+
+int test_reset() {
+    IT("sends every point again after reset and keeps counters");
+    PointFilter points[2];
+    PointChangeFilter filter(points, 2);
+    filter.configure(0, 1.0, 0, 0, 0);
+
+    IS_TRUE(filter.check(0, 1.0, 0));
+    IS_FALSE(filter.check(0, 1.0, 1000));
+    filter.reset();
+    IS_TRUE(filter.check(0, 1.0, 2000));
+    IS_EQUAL(filter.sent(), 2);
+    IS_EQUAL(filter.suppressed(), 1);
+    IS_EQUAL(filter.points(), 2);
+
+    END_IT
+}
+
+
+int test_double_precision() {
+    IT("tells apart values that a float can not");
+    PointFilter points[2];
+    PointChangeFilter filter(points, 2);
+    filter.configure(0, 0.1, 0, 0, 0);
+
+    // 8-digit energy reading: the float step near 1e6 is 0.0625
+    IS_TRUE(filter.check(0, 1000000.0, 0));
+    IS_FALSE(filter.check(0, 1000000.05, 1000));
+    IS_TRUE(filter.check(0, 1000000.15, 2000));
+
+    // 32-bit counter above 2^24
+    IS_TRUE(filter.check(1, 16777216.0, 0));
+    IS_TRUE(filter.check(1, 16777217.0, 1000));
+    IS_FALSE(filter.check(1, 16777217.0, 2000));
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("PointChangeFilter");
+    test_first_and_unchanged();
+    test_deadbands();
+    test_heartbeat_and_rate();
+    test_reset();
+    test_double_precision();
+
+    FINISH
+}
@@ -0,0 +1,19 @@
+#include "Arduino.h"
+
+static uint32_t fakeMillis = 0;
+
+uint32_t millis( void ) {
+    return fakeMillis;
+}
+
+uint32_t micros( void ) {
+    return fakeMillis * 1000;
+}
+
+void setMillis( uint32_t ms ) {
+    fakeMillis = ms;
+}
+
+void advanceMillis( uint32_t ms ) {
+    fakeMillis += ms;
+}
@@ -0,0 +1,33 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Stream.h"
+
+typedef uint8_t byte ;
+typedef bool boolean ;
+
+/* time is simulated; tests move it forward explicitly */
+uint32_t millis( void );
+uint32_t micros( void );
+void setMillis( uint32_t );
+void advanceMillis( uint32_t );
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+inline uint16_t word(uint16_t w) { return w; }
+inline uint16_t word(uint8_t h, uint8_t l) { return (uint16_t) ((h << 8) | l); }
+
+#define PROGMEM
+#define pgm_read_byte_near(x) *(x)
+
+
+#endif // Arduino_h
@@ -0,0 +1,163 @@
+#include "FakeMeter.h"
+#include "trace.h"
+
+FakeMeter::FakeMeter(const uint8_t* address) {
+    memcpy(_address, address, sizeof(_address));
+    _values = 0;
+    _requestLen = 0;
+    _lastRequestLen = 0;
+    _responseLen = 0;
+    _responsePos = 0;
+    _responseAt = 0;
+    _delay = 0;
+    _msPerByte = 0;
+    _preamble = 0;
+    _silent = false;
+    _corruptChecksum = false;
+    _error = 0;
+    _requests = 0;
+}
+
+int FakeMeter::available() {
+    uint16_t ready = _responseLen;
+    if (millis() < _responseAt) {
+        return 0;
+    }
+    if (_msPerByte) {
+        uint32_t released = (millis() - _responseAt) / _msPerByte + 1;
+        if (released < ready) {
+            ready = released;
+        }
+    }
+    return ready > _responsePos ? ready - _responsePos : 0;
+}
+
+int FakeMeter::read() {
+    if (!available()) {
+        return -1;
+    }
+    TRACE("<" << std::hex << (unsigned int)_response[_responsePos] << std::dec << " ");
+    return _response[_responsePos++];
+}
+
+int FakeMeter::peek() {
+    if (!available()) {
+        return -1;
+    }
+    return _response[_responsePos];
+}
+
+size_t FakeMeter::write(uint8_t b) {
+    TRACE(">" << std::hex << (unsigned int)b << std::dec << " ");
+    if (_requestLen < sizeof(_request)) {
+        _request[_requestLen++] = b;
+    }
+    return 1;
+}
+
+void FakeMeter::flush() {
+    TRACE("\n");
+    if (!_requestLen) {
+        return;
+    }
+    memcpy(_lastRequest, _request, _requestLen);
+    _lastRequestLen = _requestLen;
+    _requests++;
+    respond();
+    _requestLen = 0;
+}
+
+void FakeMeter::setValue(uint32_t di, const uint8_t* value, uint8_t len) {
+    uint8_t i;
+    for (i = 0; i < _values && _di[i] != di; i++) {
+    }
+    if (i == _values) {
+        _values++;
+    }
+    _di[i] = di;
+    memcpy(_value[i], value, len);
+    _valueLen[i] = len;
+}
+
+void FakeMeter::setDelay(uint32_t ms) { _delay = ms; }
+void FakeMeter::setMsPerByte(uint32_t ms) { _msPerByte = ms; }
+void FakeMeter::setPreamble(uint8_t count) { _preamble = count; }
+void FakeMeter::setSilent(bool silent) { _silent = silent; }
+void FakeMeter::setCorruptChecksum(bool corrupt) { _corruptChecksum = corrupt; }
+void FakeMeter::setError(uint8_t err) { _error = err; }
+
+uint16_t FakeMeter::requests() { return _requests; }
+uint16_t FakeMeter::lastRequestLength() { return _lastRequestLen; }
+const uint8_t* FakeMeter::lastRequest() { return _lastRequest; }
+
+void FakeMeter::queue(uint8_t control, const uint8_t* data, uint8_t len) {
+    uint16_t n = 0;
+    for (uint8_t i = 0; i < _preamble; i++) {
+        _response[n++] = 0xFE;
+    }
+    uint16_t start = n;
+    _response[n++] = 0x68;
+    memcpy(_response + n, _address, 6);
+    n += 6;
+    _response[n++] = 0x68;
+    _response[n++] = control;
+    _response[n++] = len;
+    for (uint8_t i = 0; i < len; i++) {
+        _response[n++] = data[i] + 0x33;
+    }
+    uint8_t sum = 0;
+    for (uint16_t i = start; i < n; i++) {
+        sum += _response[i];
+    }
+    _response[n++] = _corruptChecksum ? sum ^ 0x55 : sum;
+    _response[n++] = 0x16;
+    _responseLen = n;
+    _responsePos = 0;
+    _responseAt = millis() + _delay;
+}
+
+void FakeMeter::respond() {
+    _responseLen = 0;
+    _responsePos = 0;
+
+    uint16_t p = 0;
+    while (p < _requestLen && _request[p] == 0xFE) {
+        p++;
+    }
+    const uint8_t* frame = _request + p;
+    if (_requestLen - p < 12 || frame[0] != 0x68 || frame[7] != 0x68) {
+        return;
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+        if (frame[1 + i] != 0xAA && frame[1 + i] != _address[i]) {
+            return;
+        }
+    }
+    if (_silent || frame[8] != 0x11 || frame[9] != 4) {
+        return;
+    }
+
+    uint32_t di = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        di |= (uint32_t)(uint8_t)(frame[10 + i] - 0x33) << (8 * i);
+    }
+
+    uint8_t out[40];
+    if (_error) {
+        queue(0xD1, &_error, 1);
+        return;
+    }
+    for (uint8_t i = 0; i < _values; i++) {
+        if (_di[i] == di) {
+            memcpy(out, frame + 10, 4);
+            for (uint8_t k = 0; k < 4; k++) {
+                out[k] -= 0x33;
+            }
+            memcpy(out + 4, _value[i], _valueLen[i]);
+            queue(0x91, out, 4 + _valueLen[i]);
+            return;
+        }
+    }
+    out[0] = 0x02;
+    queue(0xD1, out, 1);
+}
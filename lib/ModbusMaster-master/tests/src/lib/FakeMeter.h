@@ -0,0 +1,63 @@
+#ifndef fakemeter_h
+#define fakemeter_h
+
+#include "Arduino.h"
+
+/*
+ * DL/T 645-2007 meter simulated behind a Stream.
+ *
+ * Bytes written by the master are collected until flush(), which marks the
+ * end of the request frame. Read Data requests for a DI set with setValue()
+ * get a normal response; unknown DIs get an abnormal response with error
+ * byte 0x02 (no data requested). Timing follows FakeSlave: the response
+ * becomes visible `delay` ms after the request, at `msPerByte` ms per byte.
+ */
+class FakeMeter : public Stream {
+public:
+    FakeMeter(const uint8_t* address);
+
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual void flush();
+    virtual size_t write(uint8_t);
+
+    void setValue(uint32_t di, const uint8_t* value, uint8_t len);
+    void setDelay(uint32_t ms);
+    void setMsPerByte(uint32_t ms);
+    void setPreamble(uint8_t count);
+    void setSilent(bool silent);
+    void setCorruptChecksum(bool corrupt);
+    void setError(uint8_t err);
+
+    uint16_t requests();
+    uint16_t lastRequestLength();
+    const uint8_t* lastRequest();
+
+private:
+    void respond();
+    void queue(uint8_t control, const uint8_t* data, uint8_t len);
+
+    uint8_t _address[6];
+    uint32_t _di[16];
+    uint8_t _value[16][8];
+    uint8_t _valueLen[16];
+    uint8_t _values;
+    uint8_t _request[256];
+    uint16_t _requestLen;
+    uint8_t _lastRequest[256];
+    uint16_t _lastRequestLen;
+    uint8_t _response[300];
+    uint16_t _responseLen;
+    uint16_t _responsePos;
+    uint32_t _responseAt;
+    uint32_t _delay;
+    uint32_t _msPerByte;
+    uint8_t _preamble;
+    bool _silent;
+    bool _corruptChecksum;
+    uint8_t _error;
+    uint16_t _requests;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "FakeSlave.h"
+#include "trace.h"
+
+FakeSlave::FakeSlave(uint8_t id) {
+    memset(_present, 0, sizeof(_present));
+    memset(_silentId, 0, sizeof(_silentId));
+    memset(_requestsTo, 0, sizeof(_requestsTo));
+    _present[id] = true;
+    memset(_registers, 0, sizeof(_registers));
+    _requestLen = 0;
+    _lastRequestLen = 0;
+    _responseLen = 0;
+    _responsePos = 0;
+    _responseAt = 0;
+    _delay = 0;
+    _msPerByte = 0;
+    _silent = false;
+    _corruptCRC = false;
+    _exception = 0;
+    _requests = 0;
+}
+
+int FakeSlave::available() {
+    uint16_t ready = _responseLen;
+    if (_msPerByte) {
+        if (millis() < _responseAt) {
+            return 0;
+        }
+        uint32_t released = (millis() - _responseAt) / _msPerByte + 1;
+        if (released < ready) {
+            ready = released;
+        }
+    } else if (millis() < _responseAt) {
+        return 0;
+    }
+    return ready > _responsePos ? ready - _responsePos : 0;
+}
+
+int FakeSlave::read() {
+    if (!available()) {
+        return -1;
+    }
+    TRACE("<" << std::hex << (unsigned int)_response[_responsePos] << std::dec << " ");
+    return _response[_responsePos++];
+}
+
+int FakeSlave::peek() {
+    if (!available()) {
+        return -1;
+    }
+    return _response[_responsePos];
+}
+
+size_t FakeSlave::write(uint8_t b) {
+    TRACE(">" << std::hex << (unsigned int)b << std::dec << " ");
+    if (_requestLen < sizeof(_request)) {
+        _request[_requestLen++] = b;
+    }
+    return 1;
+}
+
+void FakeSlave::flush() {
+    TRACE("\n");
+    if (!_requestLen) {
+        return;
+    }
+    memcpy(_lastRequest, _request, _requestLen);
+    _lastRequestLen = _requestLen;
+    _requests++;
+    respond();
+    _requestLen = 0;
+}
+
+void FakeSlave::setRegister(uint16_t address, uint16_t value) {
+    _registers[address % 1024] = value;
+}
+
+uint16_t FakeSlave::getRegister(uint16_t address) {
+    return _registers[address % 1024];
+}
+
+void FakeSlave::setDelay(uint32_t ms) { _delay = ms; }
+void FakeSlave::setMsPerByte(uint32_t ms) { _msPerByte = ms; }
+void FakeSlave::setSilent(bool silent) { _silent = silent; }
+void FakeSlave::addSlave(uint8_t id) { _present[id] = true; }
+void FakeSlave::setSilent(uint8_t id, bool silent) { _silentId[id] = silent; }
+uint16_t FakeSlave::requestsTo(uint8_t id) { return _requestsTo[id]; }
+void FakeSlave::setCorruptCRC(bool corrupt) { _corruptCRC = corrupt; }
+void FakeSlave::setException(uint8_t code) { _exception = code; }
+
+uint16_t FakeSlave::requests() { return _requests; }
+uint16_t FakeSlave::lastRequestLength() { return _lastRequestLen; }
+const uint8_t* FakeSlave::lastRequest() { return _lastRequest; }
+
+uint16_t FakeSlave::crc(const uint8_t* buf, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+void FakeSlave::queue(const uint8_t* buf, uint16_t len) {
+    memcpy(_response, buf, len);
+    uint16_t c = crc(buf, len);
+    if (_corruptCRC) {
+        c ^= 0x5555;
+    }
+    _response[len] = lowByte(c);
+    _response[len + 1] = highByte(c);
+    _responseLen = len + 2;
+    _responsePos = 0;
+    _responseAt = millis() + _delay;
+}
+
+void FakeSlave::respond() {
+    uint8_t out[300];
+    uint16_t n = 0;
+    _responseLen = 0;
+    _responsePos = 0;
+
+    if (_requestLen < 4) {
+        return;
+    }
+    uint8_t id = _request[0];
+    _requestsTo[id]++;
+    if (_silent || !_present[id] || _silentId[id]) {
+        return;
+    }
+    if (crc(_request, _requestLen - 2) != word(_request[_requestLen - 1], _request[_requestLen - 2])) {
+        return;
+    }
+
+    uint8_t function = _request[1];
+    uint16_t address = word(_request[2], _request[3]);
+    uint16_t qty = word(_request[4], _request[5]);
+
+    out[n++] = id;
+    if (_exception) {
+        out[n++] = function | 0x80;
+        out[n++] = _exception;
+        queue(out, n);
+        return;
+    }
+    out[n++] = function;
+    switch (function) {
+        case 0x03:
+        case 0x04:
+            out[n++] = qty * 2;
+            for (uint16_t i = 0; i < qty; i++) {
+                out[n++] = highByte(getRegister(address + i));
+                out[n++] = lowByte(getRegister(address + i));
+            }
+            break;
+        case 0x06:
+            setRegister(address, qty);
+            memcpy(out + n, _request + 2, 4);
+            n += 4;
+            break;
+        case 0x10:
+            for (uint16_t i = 0; i < qty; i++) {
+                setRegister(address + i, word(_request[7 + 2 * i], _request[8 + 2 * i]));
+            }
+            memcpy(out + n, _request + 2, 4);
+            n += 4;
+            break;
+        default:
+            out[1] = function | 0x80;
+            out[n++] = 0x01;
+            break;
+    }
+    queue(out, n);
+}
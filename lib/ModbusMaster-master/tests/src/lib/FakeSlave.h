@@ -0,0 +1,69 @@
+#ifndef fakeslave_h
+#define fakeslave_h
+
+#include "Arduino.h"
+
+/*
+ * Modbus RTU slave simulated behind a Stream.
+ *
+ * Bytes written by the master are collected until flush(), which marks the
+ * end of the request frame. The slave then answers read/write register
+ * requests from its register map. The response becomes visible to
+ * available()/read() `delay` ms after the request, at `msPerByte` ms per
+ * byte, so tests can observe partially received frames.
+ *
+ * Further slave IDs can be added to simulate a multi-drop RS485 bus; they
+ * share one register map.
+ */
+class FakeSlave : public Stream {
+public:
+    FakeSlave(uint8_t id);
+
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual void flush();
+    virtual size_t write(uint8_t);
+
+    void setRegister(uint16_t address, uint16_t value);
+    uint16_t getRegister(uint16_t address);
+    void setDelay(uint32_t ms);
+    void setMsPerByte(uint32_t ms);
+    void setSilent(bool silent);
+    void addSlave(uint8_t id);
+    void setSilent(uint8_t id, bool silent);
+    uint16_t requestsTo(uint8_t id);
+    void setCorruptCRC(bool corrupt);
+    void setException(uint8_t code);
+
+    uint16_t requests();
+    uint16_t lastRequestLength();
+    const uint8_t* lastRequest();
+
+    static uint16_t crc(const uint8_t* buf, uint16_t len);
+
+private:
+    void respond();
+    void queue(const uint8_t* buf, uint16_t len);
+
+    bool _present[256];
+    bool _silentId[256];
+    uint16_t _requestsTo[256];
+    uint16_t _registers[1024];
+    uint8_t _request[256];
+    uint16_t _requestLen;
+    uint8_t _lastRequest[256];
+    uint16_t _lastRequestLen;
+    uint8_t _response[512];
+    uint16_t _responseLen;
+    uint16_t _responsePos;
+    uint32_t _responseAt;
+    uint32_t _delay;
+    uint32_t _msPerByte;
+    bool _silent;
+    bool _corruptCRC;
+    uint8_t _exception;
+    uint16_t _requests;
+};
+
+#endif
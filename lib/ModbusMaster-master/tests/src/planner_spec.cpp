@@ -0,0 +1,216 @@
+#include "ModbusPollPlanner.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+// AllinOne points of modbusConfig.json: 400, 401, 402, 405-406
+ModbusPoint meterPoints[] = {
+    { 4, 400, 1, 0, 0 },
+    { 4, 401, 1, 0, 0 },
+    { 4, 402, 1, 0, 0 },
+    { 4, 405, 2, 0, 0 },
+};
+
+uint16_t received[8][4];
+uint8_t receivedLen[8];
+int handled = 0;
+
+void handler(uint8_t point, const uint16_t* registers, uint8_t len) {
+    handled++;
+    receivedLen[point] = len;
+    for (uint8_t k = 0; k < len; k++) {
+        received[point][k] = registers[k];
+    }
+}
+
+
+int test_merge_with_gap() {
+    IT("merges the meter points into one request with a gap tolerance");
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(meterPoints, 4, blocks, 4);
+    planner.setGapTolerance(2);
+
+    IS_EQUAL(planner.plan(), 1);
+    IS_EQUAL(blocks[0].u8Function, 4);
+    IS_EQUAL(blocks[0].u16Address, 400);
+    IS_EQUAL(blocks[0].u8Qty, 7);
+    IS_EQUAL(meterPoints[3].u8Block, 0);
+    IS_EQUAL(meterPoints[3].u8Offset, 5);
+    IS_EQUAL(planner.registers(), 7);
+
+    END_IT
+}
+
+int test_adjacent_only() {
+    IT("merges only adjacent points without a gap tolerance");
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(meterPoints, 4, blocks, 4);
+
+    IS_EQUAL(planner.plan(), 2);
+    IS_EQUAL(blocks[0].u16Address, 400);
+    IS_EQUAL(blocks[0].u8Qty, 3);
+    IS_EQUAL(blocks[1].u16Address, 405);
+    IS_EQUAL(blocks[1].u8Qty, 2);
+    IS_EQUAL(meterPoints[3].u8Block, 1);
+    IS_EQUAL(meterPoints[3].u8Offset, 0);
+
+    END_IT
+}
+
+int test_unsorted_functions() {
+    IT("keeps function codes apart and accepts unsorted points");
+    ModbusPoint points[] = {
+        { 3, 10, 2, 0, 0 },
+        { 4, 11, 1, 0, 0 },
+        { 3, 8, 2, 0, 0 },
+        { 4, 10, 1, 0, 0 },
+    };
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(points, 4, blocks, 4);
+
+    IS_EQUAL(planner.plan(), 2);
+    IS_EQUAL(blocks[0].u8Function, 3);
+    IS_EQUAL(blocks[0].u16Address, 8);
+    IS_EQUAL(blocks[0].u8Qty, 4);
+    IS_EQUAL(blocks[1].u8Function, 4);
+    IS_EQUAL(blocks[1].u16Address, 10);
+    IS_EQUAL(blocks[1].u8Qty, 2);
+    IS_EQUAL(points[0].u8Offset, 2);
+    IS_EQUAL(points[1].u8Offset, 1);
+
+    END_IT
+}
+
+int test_max_qty() {
+    IT("splits at the maximum quantity without splitting a point");
+    ModbusPoint points[40];
+    for (uint8_t i = 0; i < 40; i++) {
+        points[i].u8Function = 3;
+        points[i].u16Address = i * 2;
+        points[i].u8Len = 2;
+    }
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(points, 40, blocks, 4);
+    planner.setMaxQty(25);
+
+    IS_EQUAL(planner.plan(), 4);
+    IS_EQUAL(blocks[0].u8Qty, 24);
+    IS_EQUAL(blocks[1].u16Address, 24);
+    IS_EQUAL(blocks[3].u8Qty, 8);
+    IS_EQUAL(planner.registers(), 80);
+
+    planner.setMaxQty(200);
+    IS_EQUAL(planner.plan(), 2);
+    IS_EQUAL(blocks[0].u8Qty, ModbusMaster::ku8MaxBufferSize);
+
+    END_IT
+}
+
+int test_overflow() {
+    IT("reports a block array that is too small");
+    ModbusReadBlock blocks[1];
+    ModbusPollPlanner planner(meterPoints, 4, blocks, 1);
+
+    IS_EQUAL(planner.plan(), ModbusPollPlanner::ku8PlanOverflow);
+
+    END_IT
+}
+
+int test_bad_point() {
+    IT("rejects a point that no request can read");
+    ModbusPoint points[2] = {
+        { 3, 0, 2, 0, 0 },
+        { 3, 10, 30, 0, 0 },
+    };
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(points, 2, blocks, 4);
+
+    IS_EQUAL(planner.plan(), 2);
+    planner.setMaxQty(25);
+    IS_EQUAL(planner.plan(), ModbusPollPlanner::ku8PlanBadPoint);
+    IS_EQUAL(planner.blocks(), 0);
+
+    points[1].u8Len = 0;
+    planner.setMaxQty(0);
+    IS_EQUAL(planner.plan(), ModbusPollPlanner::ku8PlanBadPoint);
+
+    END_IT
+}
+
+int test_overlap_past_max_qty() {
+    IT("starts a new block for an overlapping point that would not fit");
+    ModbusPoint points[2] = {
+        { 3, 0, 20, 0, 0 },
+        { 3, 10, 20, 0, 0 },
+    };
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(points, 2, blocks, 4);
+    planner.setMaxQty(25);
+
+    IS_EQUAL(planner.plan(), 2);
+    IS_EQUAL(blocks[0].u16Address, 0);
+    IS_EQUAL(blocks[0].u8Qty, 20);
+    IS_EQUAL(blocks[1].u16Address, 10);
+    IS_EQUAL(blocks[1].u8Qty, 20);
+    IS_EQUAL(points[1].u8Block, 1);
+    IS_EQUAL(points[1].u8Offset, 0);
+
+    planner.setMaxQty(30);
+    IS_EQUAL(planner.plan(), 1);
+    IS_EQUAL(blocks[0].u8Qty, 30);
+    IS_EQUAL(points[1].u8Offset, 10);
+
+    END_IT
+}
+
+int test_scatter() {
+    IT("reads a merged block and scatters registers to each point");
+    setMillis(0);
+    FakeSlave slave(1);
+    slave.setRegister(400, 2301);
+    slave.setRegister(401, 512);
+    slave.setRegister(402, 118);
+    slave.setRegister(403, 0xDEAD);
+    slave.setRegister(405, 0x0001);
+    slave.setRegister(406, 0x86A0);
+
+    ModbusMaster node;
+    node.begin(1, slave);
+
+    ModbusReadBlock blocks[4];
+    ModbusPollPlanner planner(meterPoints, 4, blocks, 4);
+    planner.setGapTolerance(2);
+    IS_EQUAL(planner.plan(), 1);
+
+    IS_EQUAL(planner.read(node, 0), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(slave.requests(), 1);
+    IS_EQUAL(slave.lastRequest()[1], 4);
+
+    handled = 0;
+    planner.scatter(node, 0, handler);
+    IS_EQUAL(handled, 4);
+    IS_EQUAL(received[0][0], 2301);
+    IS_EQUAL(received[1][0], 512);
+    IS_EQUAL(received[2][0], 118);
+    IS_EQUAL(receivedLen[3], 2);
+    IS_EQUAL(received[3][0], 0x0001);
+    IS_EQUAL(received[3][1], 0x86A0);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Poll planner");
+    test_merge_with_gap();
+    test_adjacent_only();
+    test_unsorted_functions();
+    test_max_qty();
+    test_overflow();
+    test_bad_point();
+    test_overlap_past_max_qty();
+    test_scatter();
+
+    FINISH
+}
@@ -0,0 +1,259 @@
+#include "ModbusBusScheduler.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+int points[4][8];
+int cycles[4];
+int failedCycles[4];
+
+void onPoint(uint8_t slave, uint8_t point, const uint16_t* registers, uint8_t len) {
+    points[slave][point] = registers[0];
+}
+
+void onCycle(uint8_t slave, uint8_t status) {
+    if (status == ModbusMaster::ku8MBSuccess) {
+        cycles[slave]++;
+    } else {
+        failedCycles[slave]++;
+    }
+}
+
+void reset() {
+    setMillis(0);
+    memset(points, 0, sizeof(points));
+    memset(cycles, 0, sizeof(cycles));
+    memset(failedCycles, 0, sizeof(failedCycles));
+}
+
+void runFor(ModbusBusScheduler& scheduler, uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t++) {
+        scheduler.run();
+        advanceMillis(1);
+    }
+}
+
+
+int test_polls_at_interval() {
+    IT("polls each slave at its own interval");
+    reset();
+    FakeSlave bus(1);
+    bus.addSlave(2);
+    bus.setRegister(400, 2301);
+    bus.setDelay(5);
+
+    ModbusPoint pointsA[] = { { 4, 400, 1, 0, 0 } };
+    ModbusPoint pointsB[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocksA[1], blocksB[1];
+    ModbusPollPlanner plannerA(pointsA, 1, blocksA, 1);
+    ModbusPollPlanner plannerB(pointsB, 1, blocksB, 1);
+    plannerA.plan();
+    plannerB.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onPoint(onPoint);
+    scheduler.onCycle(onCycle);
+    IS_EQUAL(scheduler.addSlave(1, plannerA, 1000, 3, 100), 0);
+    IS_EQUAL(scheduler.addSlave(2, plannerB, 250, 3, 100), 1);
+
+    runFor(scheduler, 2000);
+    IS_EQUAL(cycles[0], 2);
+    IS_EQUAL(cycles[1], 8);
+    IS_EQUAL(points[0][0], 2301);
+    IS_EQUAL(points[1][0], 2301);
+    IS_EQUAL(scheduler.stats(1).u32Successes, 8);
+    IS_EQUAL(scheduler.stats(1).u16LastLatency, 5);
+    IS_EQUAL(scheduler.stats(1).u16MaxLatency, 5);
+
+    END_IT
+}
+
+int test_frame_gap() {
+    IT("keeps the inter-frame gap between transactions");
+    reset();
+    FakeSlave bus(1);
+    bus.addSlave(2);
+
+    ModbusPoint pointsA[] = { { 3, 0, 1, 0, 0 }, { 3, 100, 1, 0, 0 } };
+    ModbusPoint pointsB[] = { { 3, 0, 1, 0, 0 } };
+    ModbusReadBlock blocksA[2], blocksB[1];
+    ModbusPollPlanner plannerA(pointsA, 2, blocksA, 2);
+    ModbusPollPlanner plannerB(pointsB, 1, blocksB, 1);
+    IS_EQUAL(plannerA.plan(), 2);
+    plannerB.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    ModbusBusScheduler scheduler(node);
+    scheduler.setBaudRate(9600);
+    scheduler.addSlave(1, plannerA, 1000, 0, 0);
+    scheduler.addSlave(2, plannerB, 1000, 0, 0);
+
+    // responses are immediate; only the 4.01 ms gap separates requests
+    setMillis(10);
+    scheduler.run();
+    IS_EQUAL(bus.requests(), 1);
+    scheduler.run();
+    IS_EQUAL(bus.requests(), 1);
+    advanceMillis(4);
+    scheduler.run();
+    IS_EQUAL(bus.requests(), 1);
+    advanceMillis(1);
+    scheduler.run();
+    IS_EQUAL(bus.requests(), 2);
+    runFor(scheduler, 20);
+    IS_EQUAL(bus.requests(), 3);
+    IS_EQUAL(scheduler.stats(0).u32Cycles, 1);
+    IS_EQUAL(scheduler.stats(1).u32Cycles, 1);
+
+    END_IT
+}
+
+int test_dead_slave_does_not_starve() {
+    IT("keeps polling healthy slaves while a dead slave backs off");
+    reset();
+    FakeSlave bus(1);
+    bus.addSlave(2);
+    bus.setSilent(2, true);
+
+    ModbusPoint pointsA[] = { { 4, 400, 1, 0, 0 } };
+    ModbusPoint pointsB[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocksA[1], blocksB[1];
+    ModbusPollPlanner plannerA(pointsA, 1, blocksA, 1);
+    ModbusPollPlanner plannerB(pointsB, 1, blocksB, 1);
+    plannerA.plan();
+    plannerB.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    node.setResponseTimeout(200);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onCycle(onCycle);
+    scheduler.addSlave(2, plannerB, 1000, 20, 100);
+    scheduler.addSlave(1, plannerA, 1000, 20, 100);
+
+    runFor(scheduler, 60000);
+
+    // healthy slave keeps (almost) its full rate despite the dead one
+    IS_TRUE(cycles[1] >= 58);
+    IS_EQUAL(failedCycles[1], 0);
+    IS_FALSE(scheduler.healthy(0));
+    IS_TRUE(scheduler.healthy(1));
+
+    // 21 attempts for the first cycle, then one probe per back-off period
+    const ModbusSlaveStats& dead = scheduler.stats(0);
+    IS_EQUAL(dead.u32Successes, 0);
+    IS_EQUAL(dead.u32Timeouts, dead.u32Failures);
+    IS_TRUE(dead.u32Failures < 21 + 8);
+    IS_TRUE(dead.u32FailedCycles >= 3);
+    IS_EQUAL(bus.requestsTo(2), dead.u32Requests);
+
+    END_IT
+}
+
+int test_recovers() {
+    IT("returns a recovered slave to its normal interval");
+    reset();
+    FakeSlave bus(1);
+    bus.setSilent(1, true);
+
+    ModbusPoint pointsA[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocksA[1];
+    ModbusPollPlanner plannerA(pointsA, 1, blocksA, 1);
+    plannerA.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    node.setResponseTimeout(100);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onCycle(onCycle);
+    scheduler.addSlave(1, plannerA, 500, 1, 50);
+
+    runFor(scheduler, 5000);
+    IS_FALSE(scheduler.healthy(0));
+    int failed = failedCycles[0];
+    IS_TRUE(failed >= 2);
+
+    bus.setSilent(1, false);
+    runFor(scheduler, 16000 + 5000);
+    IS_TRUE(scheduler.healthy(0));
+    IS_TRUE(cycles[0] >= 9);
+    IS_EQUAL(scheduler.stats(0).u32Cycles, (uint32_t)cycles[0]);
+
+    END_IT
+}
+
+int test_retries() {
+    IT("retries a failed request after the retry interval");
+    reset();
+    FakeSlave bus(1);
+    bus.setCorruptCRC(true);
+
+    ModbusPoint pointsA[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocksA[1];
+    ModbusPollPlanner plannerA(pointsA, 1, blocksA, 1);
+    plannerA.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onCycle(onCycle);
+    scheduler.addSlave(1, plannerA, 10000, 2, 100);
+
+    runFor(scheduler, 50);
+    IS_EQUAL(bus.requests(), 1);
+    runFor(scheduler, 100);
+    IS_EQUAL(bus.requests(), 2);
+    bus.setCorruptCRC(false);
+    runFor(scheduler, 100);
+    IS_EQUAL(bus.requests(), 3);
+    IS_EQUAL(cycles[0], 1);
+    IS_EQUAL(scheduler.stats(0).u32Failures, 2);
+    IS_TRUE(scheduler.healthy(0));
+
+    END_IT
+}
+
+int test_rejects_empty_planner() {
+    IT("rejects a slave whose planner has no blocks");
+    reset();
+    FakeSlave bus(1);
+    bus.setRegister(400, 2301);
+
+    ModbusPoint pointsA[] = { { 4, 400, 1, 0, 0 } };
+    ModbusPoint pointsB[] = { { 4, 400, 1, 0, 0 } };
+    ModbusReadBlock blocksA[1], blocksB[1];
+    ModbusPollPlanner plannerA(pointsA, 1, blocksA, 1);
+    ModbusPollPlanner plannerB(pointsB, 1, blocksB, 1);
+    plannerB.plan();
+
+    ModbusMaster node;
+    node.begin(1, bus);
+    ModbusBusScheduler scheduler(node);
+    scheduler.onPoint(onPoint);
+    IS_EQUAL(scheduler.addSlave(1, plannerA, 1000, 0, 0), ModbusBusScheduler::ku8NoSlave);
+    IS_EQUAL(scheduler.addSlave(1, plannerB, 1000, 0, 0), 0);
+    IS_EQUAL(scheduler.slaves(), 1);
+
+    runFor(scheduler, 50);
+    IS_EQUAL(bus.requests(), 1);
+    IS_EQUAL(points[0][0], 2301);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Bus scheduler");
+    test_polls_at_interval();
+    test_frame_gap();
+    test_dead_slave_does_not_starve();
+    test_recovers();
+    test_retries();
+    test_rejects_empty_planner();
+
+    FINISH
+}
@@ -0,0 +1,261 @@
+#include "ModbusMaster.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+int completions = 0;
+uint8_t lastStatus = 0xFF;
+
+void onComplete(ModbusMaster* node, uint8_t status) {
+    completions++;
+    lastStatus = status;
+}
+
+void tick() {
+    advanceMillis(1);
+}
+
+void reset() {
+    setMillis(1000);
+    completions = 0;
+    lastStatus = 0xFF;
+}
+
+
+int test_blocking_read() {
+    IT("reads holding registers in blocking mode");
+    reset();
+    FakeSlave slave(2);
+    slave.setRegister(10, 0x1234);
+    slave.setRegister(11, 0xABCD);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+
+    uint8_t rc = node.readHoldingRegisters(10, 2);
+    IS_EQUAL(rc, ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(node.getResponseBuffer(0), 0x1234);
+    IS_EQUAL(node.getResponseBuffer(1), 0xABCD);
+    IS_FALSE(node.busy());
+
+    END_IT
+}
+
+int test_blocking_timeout() {
+    IT("times out in blocking mode while calling idle");
+    reset();
+    FakeSlave slave(2);
+    slave.setSilent(true);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.idle(tick);
+
+    uint8_t rc = node.readInputRegisters(0, 1);
+    IS_EQUAL(rc, ModbusMaster::ku8MBResponseTimedOut);
+    IS_TRUE(millis() > 1000 + 2000);
+
+    END_IT
+}
+
+int test_nonblocking_returns_pending() {
+    IT("returns pending immediately in non-blocking mode");
+    reset();
+    FakeSlave slave(2);
+    slave.setDelay(50);
+    slave.setRegister(400, 2301);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+
+    uint8_t rc = node.readInputRegisters(400, 1);
+    IS_EQUAL(rc, ModbusMaster::ku8MBPending);
+    IS_TRUE(node.busy());
+    IS_EQUAL(slave.requests(), 1);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBPending);
+
+    advanceMillis(50);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBSuccess);
+    IS_FALSE(node.busy());
+    IS_EQUAL(node.getResponseBuffer(0), 2301);
+
+    END_IT
+}
+
+int test_nonblocking_fragmented() {
+    IT("assembles a response that arrives one byte per poll");
+    reset();
+    FakeSlave slave(2);
+    slave.setMsPerByte(1);
+    for (uint16_t i = 0; i < 8; i++) {
+        slave.setRegister(100 + i, 1000 + i);
+    }
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+    node.onComplete(onComplete);
+
+    IS_EQUAL(node.readHoldingRegisters(100, 8), ModbusMaster::ku8MBPending);
+
+    int polls = 0;
+    uint8_t rc;
+    while ((rc = node.poll()) == ModbusMaster::ku8MBPending) {
+        polls++;
+        advanceMillis(1);
+        IS_TRUE(polls < 100);
+    }
+    IS_EQUAL(rc, ModbusMaster::ku8MBSuccess);
+    IS_TRUE(polls >= 20);
+    IS_EQUAL(completions, 1);
+    IS_EQUAL(lastStatus, ModbusMaster::ku8MBSuccess);
+    for (uint8_t i = 0; i < 8; i++) {
+        IS_EQUAL(node.getResponseBuffer(i), 1000 + i);
+    }
+
+    END_IT
+}
+
+int test_nonblocking_busy() {
+    IT("rejects a second request while one is in flight");
+    reset();
+    FakeSlave slave(2);
+    slave.setDelay(10);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+
+    IS_EQUAL(node.readInputRegisters(0, 1), ModbusMaster::ku8MBPending);
+    IS_EQUAL(node.readInputRegisters(0, 1), ModbusMaster::ku8MBBusy);
+    IS_EQUAL(slave.requests(), 1);
+
+    advanceMillis(10);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(node.readInputRegisters(0, 1), ModbusMaster::ku8MBPending);
+    IS_EQUAL(slave.requests(), 2);
+
+    END_IT
+}
+
+int test_nonblocking_timeout() {
+    IT("times out in non-blocking mode without blocking");
+    reset();
+    FakeSlave slave(2);
+    slave.setSilent(true);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+    node.onComplete(onComplete);
+
+    IS_EQUAL(node.readInputRegisters(0, 1), ModbusMaster::ku8MBPending);
+    advanceMillis(1000);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBPending);
+    IS_EQUAL(completions, 0);
+    advanceMillis(1001);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBResponseTimedOut);
+    IS_EQUAL(completions, 1);
+    IS_EQUAL(lastStatus, ModbusMaster::ku8MBResponseTimedOut);
+    IS_FALSE(node.busy());
+
+    END_IT
+}
+
+int test_nonblocking_crc() {
+    IT("reports a corrupted response CRC");
+    reset();
+    FakeSlave slave(2);
+    slave.setCorruptCRC(true);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+
+    IS_EQUAL(node.readHoldingRegisters(0, 2), ModbusMaster::ku8MBPending);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBInvalidCRC);
+
+    END_IT
+}
+
+int test_nonblocking_exception() {
+    IT("returns the slave exception code");
+    reset();
+    FakeSlave slave(2);
+    slave.setException(ModbusMaster::ku8MBIllegalDataAddress);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+
+    IS_EQUAL(node.readHoldingRegisters(9999, 1), ModbusMaster::ku8MBPending);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBIllegalDataAddress);
+
+    END_IT
+}
+
+int test_nonblocking_write() {
+    IT("writes a single register in non-blocking mode");
+    reset();
+    FakeSlave slave(2);
+
+    ModbusMaster node;
+    node.begin(2, slave);
+    node.setNonBlocking(true);
+
+    IS_EQUAL(node.writeSingleRegister(28, 1), ModbusMaster::ku8MBPending);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(slave.getRegister(28), 1);
+
+    END_IT
+}
+
+int test_two_buses() {
+    IT("keeps requests in flight on two buses at once");
+    reset();
+    FakeSlave slaveA(1);
+    FakeSlave slaveB(2);
+    slaveA.setDelay(30);
+    slaveB.setDelay(10);
+    slaveA.setRegister(0, 11);
+    slaveB.setRegister(0, 22);
+
+    ModbusMaster busA;
+    ModbusMaster busB;
+    busA.begin(1, slaveA);
+    busB.begin(2, slaveB);
+    busA.setNonBlocking(true);
+    busB.setNonBlocking(true);
+
+    IS_EQUAL(busA.readInputRegisters(0, 1), ModbusMaster::ku8MBPending);
+    IS_EQUAL(busB.readInputRegisters(0, 1), ModbusMaster::ku8MBPending);
+
+    advanceMillis(10);
+    IS_EQUAL(busA.poll(), ModbusMaster::ku8MBPending);
+    IS_EQUAL(busB.poll(), ModbusMaster::ku8MBSuccess);
+    advanceMillis(20);
+    IS_EQUAL(busA.poll(), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(busA.getResponseBuffer(0), 11);
+    IS_EQUAL(busB.getResponseBuffer(0), 22);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Transaction");
+    test_blocking_read();
+    test_blocking_timeout();
+    test_nonblocking_returns_pending();
+    test_nonblocking_fragmented();
+    test_nonblocking_busy();
+    test_nonblocking_timeout();
+    test_nonblocking_crc();
+    test_nonblocking_exception();
+    test_nonblocking_write();
+    test_two_buses();
+
+    FINISH
+}
@@ -0,0 +1,294 @@
+#include "ModbusMaster.h"
+#include "SerialTransport.h"
+#include "FakeSlave.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <thread>
+
+
+// serial port fed by the test; counts bulk reads
+class BytePort : public Stream {
+public:
+    BytePort() : head(0), tail(0), bulkReads(0) {}
+    void push(const uint8_t* buf, size_t len) {
+        memcpy(data + head, buf, len);
+        head += len;
+    }
+    virtual int available() { return head - tail; }
+    virtual int read() { return tail < head ? data[tail++] : -1; }
+    virtual int peek() { return tail < head ? data[tail] : -1; }
+    virtual void flush() {}
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t readBytes(char* buffer, size_t length) {
+        bulkReads++;
+        size_t n = head - tail < length ? head - tail : length;
+        memcpy(buffer, data + tail, n);
+        tail += n;
+        return n;
+    }
+    uint8_t data[4096];
+    size_t head;
+    size_t tail;
+    int bulkReads;
+};
+
+// endless counting sequence, for the two-thread test
+class SequencePort : public Stream {
+public:
+    SequencePort(uint32_t total) : next(0), total(total) {}
+    virtual int available() { return total - next > 100 ? 100 : total - next; }
+    virtual int read() { return next < total ? (uint8_t)next++ : -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        while (n < length && next < total) {
+            buffer[n++] = (char)(uint8_t)next++;
+        }
+        return n;
+    }
+    uint32_t next;
+    uint32_t total;
+};
+
+
+int test_bulk_pass_through() {
+    IT("moves received bytes in bulk");
+    setMillis(0);
+    BytePort port;
+    uint8_t ring[64];
+    SerialTransport transport(port, ring, sizeof(ring));
+
+    uint8_t in[40];
+    for (uint8_t i = 0; i < sizeof(in); i++) {
+        in[i] = i;
+    }
+    port.push(in, sizeof(in));
+
+    IS_EQUAL(transport.available(), 40);
+    IS_EQUAL(port.bulkReads, 1);
+
+    uint8_t out[40];
+    IS_EQUAL(transport.readBytes(out, 25), 25);
+    IS_EQUAL(transport.read(), 25);
+    IS_EQUAL(transport.readBytes(out + 26, 20), 14);
+    out[25] = 25;
+    IS_EQUAL(memcmp(in, out, sizeof(in)), 0);
+    IS_EQUAL(transport.read(), -1);
+
+    END_IT
+}
+
+int test_wrap_around() {
+    IT("wraps around the ring without copying");
+    setMillis(0);
+    BytePort port;
+    uint8_t ring[16];
+    SerialTransport transport(port, ring, sizeof(ring));
+
+    uint8_t in[12];
+    for (uint8_t i = 0; i < sizeof(in); i++) {
+        in[i] = 100 + i;
+    }
+    port.push(in, 12);
+    uint8_t out[12];
+    IS_EQUAL(transport.readBytes(out, 12), 12);
+
+    port.push(in, 12);
+    const uint8_t* span;
+    IS_EQUAL(transport.readSpan(&span), 4);
+    IS_TRUE(span == ring + 12);
+    IS_EQUAL(span[0], 100);
+    transport.consume(4);
+    IS_EQUAL(transport.readSpan(&span), 8);
+    IS_TRUE(span == ring);
+    IS_EQUAL(span[0], 104);
+    transport.consume(8);
+    IS_EQUAL(transport.available(), 0);
+
+    END_IT
+}
+
+int test_full_ring() {
+    IT("leaves bytes in the port when the ring is full");
+    setMillis(0);
+    BytePort port;
+    uint8_t ring[20];
+    SerialTransport transport(port, ring, sizeof(ring));
+
+    uint8_t in[40];
+    for (uint8_t i = 0; i < sizeof(in); i++) {
+        in[i] = i;
+    }
+    port.push(in, sizeof(in));
+
+    // 20 bytes of storage -> 16 byte ring
+    IS_EQUAL(transport.available(), 16);
+    IS_EQUAL(transport.overruns(), 1);
+    uint8_t out[40];
+    size_t n = 0;
+    while (transport.available()) {
+        n += transport.readBytes(out + n, 10);
+    }
+    IS_EQUAL(n, 40);
+    IS_EQUAL(memcmp(in, out, sizeof(in)), 0);
+
+    END_IT
+}
+
+int test_frames_by_silence() {
+    IT("delimits frames by 3.5 character times of silence");
+    setMillis(0);
+    BytePort port;
+    uint8_t ring[64];
+    SerialTransport transport(port, ring, sizeof(ring));
+    transport.setBaudRate(9600);
+
+    uint8_t a[] = { 1, 2, 3, 4, 5 };
+    uint8_t b[] = { 6, 7, 8 };
+    uint8_t c[] = { 9, 10 };
+
+    port.push(a, 5);
+    IS_EQUAL(transport.frameAvailable(), 0);
+    advanceMillis(1);
+    port.push(b, 3);
+    IS_EQUAL(transport.frameAvailable(), 0);
+    advanceMillis(4);
+    IS_EQUAL(transport.frameAvailable(), 0);
+    advanceMillis(1);
+    IS_EQUAL(transport.frameAvailable(), 8);
+
+    port.push(c, 2);
+    advanceMillis(5);
+    IS_EQUAL(transport.frameAvailable(), 8);
+
+    // c was picked up by the last call; its silence starts there
+    uint8_t out[16];
+    IS_EQUAL(transport.readFrame(out, sizeof(out)), 8);
+    IS_EQUAL(out[7], 8);
+    IS_EQUAL(transport.readFrame(out, sizeof(out)), 0);
+    advanceMillis(5);
+    IS_EQUAL(transport.readFrame(out, sizeof(out)), 2);
+    IS_EQUAL(out[0], 9);
+    IS_EQUAL(transport.readFrame(out, sizeof(out)), 0);
+
+    END_IT
+}
+
+int test_explicit_end_of_frame() {
+    IT("closes a frame when the UART signals its receive timeout");
+    setMillis(0);
+    BytePort port;
+    uint8_t ring[64];
+    SerialTransport transport(port, ring, sizeof(ring));
+    transport.setAutoPump(false);
+
+    uint8_t a[] = { 1, 2, 3 };
+    port.push(a, 3);
+    IS_EQUAL(transport.frameAvailable(), 0);
+    transport.pump();
+    transport.endFrame();
+    IS_EQUAL(transport.frameAvailable(), 3);
+
+    END_IT
+}
+
+int test_modbus_frame_mode() {
+    IT("hands ModbusMaster a complete ADU in frame mode");
+    setMillis(0);
+    FakeSlave slave(2);
+    slave.setMsPerByte(1);
+    slave.setRegister(400, 2301);
+    slave.setRegister(401, 512);
+    uint8_t ring[256];
+    SerialTransport transport(slave, ring, sizeof(ring));
+
+    ModbusMaster node;
+    node.begin(2, transport);
+    node.setNonBlocking(true);
+
+    IS_EQUAL(node.readInputRegisters(400, 2), ModbusMaster::ku8MBPending);
+    // 9 byte response at 1 ms/byte, then t3.5 = 4.01 ms of silence
+    for (int t = 0; t < 13; t++) {
+        IS_EQUAL(node.poll(), ModbusMaster::ku8MBPending);
+        advanceMillis(1);
+    }
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBSuccess);
+    IS_EQUAL(node.getResponseBuffer(0), 2301);
+    IS_EQUAL(node.getResponseBuffer(1), 512);
+
+    END_IT
+}
+
+int test_modbus_truncated_frame() {
+    IT("discards a truncated frame and times out");
+    setMillis(0);
+    FakeSlave slave(2);
+    uint8_t ring[256];
+    SerialTransport transport(slave, ring, sizeof(ring));
+
+    ModbusMaster node;
+    node.begin(2, transport);
+    node.setNonBlocking(true);
+    node.setResponseTimeout(100);
+
+    IS_EQUAL(node.readInputRegisters(400, 2), ModbusMaster::ku8MBPending);
+    // steal the last byte of the response
+    transport.available();
+    uint8_t out[16];
+    IS_EQUAL(transport.readBytes(out, 8), 8);
+    advanceMillis(10);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBPending);
+    advanceMillis(100);
+    IS_EQUAL(node.poll(), ModbusMaster::ku8MBResponseTimedOut);
+
+    END_IT
+}
+
+int test_two_threads() {
+    IT("passes a byte stream between producer and consumer threads");
+    setMillis(0);
+    const uint32_t total = 20000;
+    SequencePort port(total);
+    uint8_t ring[128];
+    SerialTransport transport(port, ring, sizeof(ring));
+    transport.setAutoPump(false);
+
+    std::thread producer([&]() {
+        while (port.next < total) {
+            transport.pump();
+        }
+    });
+
+    uint32_t received = 0;
+    bool ordered = true;
+    uint8_t buf[64];
+    while (received < total) {
+        size_t n = transport.readBytes(buf, sizeof(buf));
+        for (size_t i = 0; i < n; i++) {
+            ordered = ordered && buf[i] == (uint8_t)(received + i);
+        }
+        received += n;
+    }
+    producer.join();
+    IS_TRUE(ordered);
+    IS_EQUAL(received, total);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Serial transport");
+    test_bulk_pass_through();
+    test_wrap_around();
+    test_full_ring();
+    test_frames_by_silence();
+    test_explicit_end_of_frame();
+    test_modbus_frame_mode();
+    test_modbus_truncated_frame();
+    test_two_threads();
+
+    FINISH
+}
@@ -44,7 +44,7 @@ class StreamBuf : public Stream {
     if (wpos >= length) {
       if (rpos == 0)
         return 0;
-      memcpy(buff, buff+rpos, wpos - rpos);
+      memmove(buff, buff+rpos, wpos - rpos);  // regions overlap
       wpos -= rpos;
       rpos = 0;
     }
@@ -1,7 +1,13 @@
 #ifndef _PAINLESS_MESH_BUFFER_HPP_
 #define _PAINLESS_MESH_BUFFER_HPP_
 
-#include <list>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <utility>
 
 #include "Arduino.h"
 #include "painlessmesh/configuration.hpp"
@@ -10,9 +16,200 @@
 #define TCP_MSS 1024
 #endif
 
+// The arenas behind the mesh buffers grow in multiples of this many bytes
+#ifndef PAINLESSMESH_BUFFER_SLAB
+#define PAINLESSMESH_BUFFER_SLAB 512
+#endif
+
+// Arenas larger than this are released once they are drained, smaller ones are
+// kept for the next message
+#ifndef PAINLESSMESH_BUFFER_KEEP
+#define PAINLESSMESH_BUFFER_KEEP 4096
+#endif
+
+// Freed SharedMessage allocations kept for reuse, per message type
+#ifndef PAINLESSMESH_MESSAGE_POOL
+#define PAINLESSMESH_MESSAGE_POOL 16
+#endif
+
+// Binary frames with a larger payload are never sent (the package is sent as
+// json instead) and are dropped when received
+#ifndef PAINLESSMESH_FRAME_MAX
+#define PAINLESSMESH_FRAME_MAX 16384
+#endif
+
 namespace painlessmesh {
 namespace buffer {
 
+/**
+ * First byte of a binary frame (see protocol::binary). It can not be the first
+ * byte of a json message
+ */
+static const uint8_t FRAME_MARKER = 0xB1;
+
+/**
+ * Size of the fixed binary frame header
+ */
+static const size_t FRAME_HEADER_SIZE = 16;
+
+/**
+ * Offset of the payload length (uint32_t, little endian) in the frame header
+ */
+static const size_t FRAME_LENGTH_OFFSET = 4;
+
+/**
+ * Whether the data starts with a binary frame header
+ */
+inline bool isFrame(const char *data, size_t length) {
+  return length >= FRAME_HEADER_SIZE &&
+         static_cast<uint8_t>(data[0]) == FRAME_MARKER;
+}
+
+/**
+ * Payload length stored in a binary frame header
+ */
+inline uint32_t frameLength(const char *header) {
+  auto p = reinterpret_cast<const uint8_t *>(header + FRAME_LENGTH_OFFSET);
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Append length bytes, which may include '\0', to a string
+ */
+inline void append(TSTRING &str, const char *data, size_t length) {
+#ifdef PAINLESSMESH_ENABLE_STD_STRING
+  str.append(data, length);
+#else
+  str.concat(data, length);
+#endif
+}
+
+/**
+ * \brief Lock for data used from the AsyncTCP task as well as from the loop
+ *
+ * A critical section on ESP32, where both run as separate tasks. Elsewhere the
+ * callbacks of the tcp stack do not preempt the loop and nothing is locked.
+ */
+class SpinLock {
+ public:
+#ifdef ESP32
+  void lock() { portENTER_CRITICAL(&mux); }
+  void unlock() { portEXIT_CRITICAL(&mux); }
+
+ private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+  void lock() {}
+  void unlock() {}
+#endif
+};
+
+/**
+ * Holds a SpinLock for the scope it is declared in
+ */
+class LockGuard {
+ public:
+  LockGuard(SpinLock &lock) : lock(lock) { lock.lock(); }
+  ~LockGuard() { lock.unlock(); }
+
+  LockGuard(const LockGuard &) = delete;
+  LockGuard &operator=(const LockGuard &) = delete;
+
+ private:
+  SpinLock &lock;
+};
+
+/**
+ * \brief Allocator that keeps freed blocks for the next message
+ *
+ * A shared message takes one allocation for its reference count and string
+ * object. Up to PAINLESSMESH_MESSAGE_POOL freed blocks are kept, so once the
+ * send queues have been busy for a while queueing a message only allocates
+ * the string data it was built with.
+ */
+template <class U>
+class MessageAllocator {
+ public:
+  typedef U value_type;
+
+  MessageAllocator() {}
+
+  template <class V>
+  MessageAllocator(const MessageAllocator<V> &) {}
+
+  U *allocate(size_t n) {
+    if (n == 1) {
+      LockGuard guard(freeLock());
+      FreeList &pool = freeList();
+      if (pool.count > 0) return static_cast<U *>(pool.blocks[--pool.count]);
+    }
+    return static_cast<U *>(::operator new(n * sizeof(U)));
+  }
+
+  void deallocate(U *p, size_t n) {
+    if (n == 1) {
+      LockGuard guard(freeLock());
+      FreeList &pool = freeList();
+      if (pool.count < PAINLESSMESH_MESSAGE_POOL) {
+        pool.blocks[pool.count++] = p;
+        return;
+      }
+    }
+    ::operator delete(p);
+  }
+
+  template <class V>
+  bool operator==(const MessageAllocator<V> &) const {
+    return true;
+  }
+
+  template <class V>
+  bool operator!=(const MessageAllocator<V> &) const {
+    return false;
+  }
+
+ private:
+  struct FreeList {
+    void *blocks[PAINLESSMESH_MESSAGE_POOL];
+    size_t count = 0;
+  };
+
+  static FreeList &freeList() {
+    static FreeList pool;
+    return pool;
+  }
+
+  // Messages are released from the AsyncTCP task as well as from the loop
+  static SpinLock &freeLock() {
+    static SpinLock lock;
+    return lock;
+  }
+};
+
+/**
+ * Immutable message that can be queued on several connections at once
+ *
+ * The message is reference counted, so a broadcast or a forwarded package is
+ * stored once however many send queues hold it.
+ */
+typedef std::shared_ptr<const TSTRING> SharedMessage;
+
+/**
+ * Create a shared message from the pool of MessageAllocator
+ */
+template <class T, class... Args>
+std::shared_ptr<const T> makeMessage(Args &&... args) {
+  return std::allocate_shared<T>(MessageAllocator<T>(),
+                                 std::forward<Args>(args)...);
+}
+
+/**
+ * Move a message into a SharedMessage, without copying its data
+ */
+inline SharedMessage share(TSTRING &&message) {
+  return makeMessage<TSTRING>(std::move(message));
+}
+
 // Temporary buffer used by ReceiveBuffer and SentBuffer
 struct temp_buffer_t {
   size_t length = TCP_MSS;
@@ -20,94 +217,491 @@ struct temp_buffer_t {
 };
 
 /**
- * \brief ReceivedBuffer handles cstrings and stores them as strings
+ * \brief Byte ring buffer that keeps message boundaries
+ *
+ * All messages live in one contiguous arena. A message is never split at the
+ * end of the arena (if it does not fit it is started at the beginning instead),
+ * so every message can be read in place through front(). The arena and the
+ * index of message boundaries only allocate when they need to grow, never per
+ * message.
+ *
+ * Bytes are appended to an open message, which becomes visible once it is
+ * closed. This lets a message arrive in several parts.
+ */
+class MessageRing {
+ public:
+  MessageRing() {}
+
+  ~MessageRing() {
+    release();
+    free(retired);
+  }
+
+  MessageRing(const MessageRing &) = delete;
+  MessageRing &operator=(const MessageRing &) = delete;
+
+  MessageRing(MessageRing &&other) { swap(other); }
+
+  MessageRing &operator=(MessageRing &&other) {
+    swap(other);
+    return *this;
+  }
+
+  void swap(MessageRing &other) {
+    std::swap(arena, other.arena);
+    std::swap(arenaCapacity, other.arenaCapacity);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(wrapped, other.wrapped);
+    std::swap(openStart, other.openStart);
+    std::swap(openLength, other.openLength);
+    std::swap(slots, other.slots);
+    std::swap(slotCapacity, other.slotCapacity);
+    std::swap(first, other.first);
+    std::swap(count, other.count);
+    std::swap(held, other.held);
+    std::swap(heldCleared, other.heldCleared);
+    std::swap(retired, other.retired);
+  }
+
+  /**
+   * Append data to the open message
+   */
+  void append(const char *data, size_t length) {
+    if (length == 0) return;
+    reserve(length);
+    memcpy(arena + openStart + openLength, data, length);
+    openLength += length;
+    tail = openStart + openLength;
+  }
+
+  /**
+   * Close the open message and make it readable
+   *
+   * \param terminator Number of trailing bytes (e.g. a '\0') stored with the
+   * message that front() should still point at, but frontLength() does not
+   * count
+   *
+   * Returns false (and drops it) if the message is empty
+   */
+  bool close(size_t terminator = 0) {
+    if (openLength <= terminator) {
+      discardOpen();
+      return false;
+    }
+    if (count == slotCapacity) growSlots();
+    Slot &slot = slots[(first + count) % slotCapacity];
+    slot.offset = openStart;
+    slot.length = openLength;
+    slot.terminator = terminator;
+    ++count;
+    openStart = tail;
+    openLength = 0;
+    return true;
+  }
+
+  /**
+   * Drop the part of the open message that has not been closed yet
+   */
+  void discardOpen() {
+    openLength = 0;
+    if (count == 0) {
+      reset();
+      return;
+    }
+    const Slot &last = slots[(first + count - 1) % slotCapacity];
+    tail = last.offset + last.length;
+    wrapped = last.offset < head;
+    openStart = tail;
+  }
+
+  /**
+   * Pointer to the oldest message. The message is contiguous, valid until the
+   * next call that changes the ring
+   */
+  const char *front() const { return arena + slots[first].offset; }
+
+  /**
+   * Length of the oldest message, without its terminator
+   */
+  size_t frontLength() const {
+    return slots[first].length - slots[first].terminator;
+  }
+
+  /**
+   * Length of the oldest message, including its terminator
+   */
+  size_t frontStored() const { return slots[first].length; }
+
+  /**
+   * Pointer to the oldest message, which stays valid until pop() even if the
+   * ring grows or is cleared in the meantime
+   */
+  const char *hold() {
+    held = true;
+    return front();
+  }
+
+  /**
+   * Remove the first length bytes of the oldest message
+   */
+  void consume(size_t length) {
+    Slot &slot = slots[first];
+    if (length >= slot.length) {
+      pop();
+      return;
+    }
+    slot.offset += length;
+    slot.length -= length;
+    head = slot.offset;
+  }
+
+  /**
+   * Remove the oldest message
+   */
+  void pop() {
+    if (held) {
+      held = false;
+      free(retired);
+      retired = NULL;
+      // clear() already removed the held message
+      if (heldCleared) {
+        heldCleared = false;
+        return;
+      }
+    }
+    if (count == 0) return;
+    first = (first + 1) % slotCapacity;
+    --count;
+    size_t next = (count > 0) ? slots[first].offset : openStart;
+    if (count == 0 && openLength == 0) {
+      reset();
+      return;
+    }
+    // The reader wrapped to the start of the arena
+    if (wrapped && next < head) wrapped = false;
+    head = next;
+  }
+
+  /**
+   * Whether there are no complete messages
+   */
+  bool empty() const { return count == 0; }
+
+  /**
+   * Number of complete messages
+   */
+  size_t size() const { return count; }
+
+  /**
+   * Remove all messages, including the open one
+   */
+  void clear() {
+    heldCleared = held;
+    first = 0;
+    count = 0;
+    openLength = 0;
+    reset();
+  }
+
+  /**
+   * Bytes currently allocated for the arena
+   */
+  size_t capacity() const { return arenaCapacity; }
+
+ private:
+  struct Slot {
+    size_t offset;
+    size_t length;
+    size_t terminator;
+  };
+
+  char *arena = NULL;
+  size_t arenaCapacity = 0;
+  // Oldest byte still in use, and the end of the newest
+  size_t head = 0;
+  size_t tail = 0;
+  // Whether the newest bytes are stored before head, at the start of the arena
+  bool wrapped = false;
+  size_t openStart = 0;
+  size_t openLength = 0;
+
+  Slot *slots = NULL;
+  size_t slotCapacity = 0;
+  size_t first = 0;
+  size_t count = 0;
+
+  // Whether the oldest message is in use through hold()
+  bool held = false;
+  // Whether the held message was removed by clear()
+  bool heldCleared = false;
+  // Arena that still stores the held message after it was replaced
+  char *retired = NULL;
+
+  void reset() {
+    head = 0;
+    tail = 0;
+    wrapped = false;
+    openStart = 0;
+    // The held message must not be overwritten by the next one
+    if (held || arenaCapacity > PAINLESSMESH_BUFFER_KEEP) release();
+  }
+
+  void release() {
+    freeArena();
+    arena = NULL;
+    arenaCapacity = 0;
+    free(slots);
+    slots = NULL;
+    slotCapacity = 0;
+    first = 0;
+  }
+
+  /**
+   * Make room to extend the open message by length bytes
+   */
+  void reserve(size_t length) {
+    if (!wrapped) {
+      if (tail + length <= arenaCapacity) return;
+      // Restart the open message at the beginning of the arena
+      size_t needed = openLength + length;
+      size_t limit = (count > 0) ? head : openStart;
+      if (needed <= limit) {
+        memmove(arena, arena + openStart, openLength);
+        openStart = 0;
+        tail = openLength;
+        wrapped = count > 0;
+        if (!wrapped) head = 0;
+        return;
+      }
+    } else if (tail + length <= head) {
+      return;
+    }
+    grow(length);
+  }
+
+  /**
+   * Move everything into a larger arena, oldest message first
+   */
+  void grow(size_t length) {
+    size_t used = openLength + length;
+    for (size_t i = 0; i < count; ++i)
+      used += slots[(first + i) % slotCapacity].length;
+    size_t newCapacity = std::max(arenaCapacity * 2, used);
+    newCapacity = (newCapacity + PAINLESSMESH_BUFFER_SLAB - 1) /
+                  PAINLESSMESH_BUFFER_SLAB * PAINLESSMESH_BUFFER_SLAB;
+
+    char *newArena = static_cast<char *>(malloc(newCapacity));
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+      Slot &slot = slots[(first + i) % slotCapacity];
+      memcpy(newArena + offset, arena + slot.offset, slot.length);
+      slot.offset = offset;
+      offset += slot.length;
+    }
+    if (openLength > 0) memcpy(newArena + offset, arena + openStart, openLength);
+    freeArena();
+
+    arena = newArena;
+    arenaCapacity = newCapacity;
+    head = 0;
+    openStart = offset;
+    tail = offset + openLength;
+    wrapped = false;
+  }
+
+  /**
+   * Free the arena, unless it stores the held message
+   */
+  void freeArena() {
+    if (held && retired == NULL)
+      retired = arena;
+    else
+      free(arena);
+  }
+
+  void growSlots() {
+    size_t newCapacity = std::max<size_t>(slotCapacity * 2, 8);
+    Slot *newSlots = static_cast<Slot *>(malloc(newCapacity * sizeof(Slot)));
+    for (size_t i = 0; i < count; ++i)
+      newSlots[i] = slots[(first + i) % slotCapacity];
+    free(slots);
+    slots = newSlots;
+    slotCapacity = newCapacity;
+    first = 0;
+  }
+};
+
+/**
+ * \brief ReceivedBuffer splits the received data into messages
+ *
+ * Json messages are delimited by a '\0'. Binary frames start with FRAME_MARKER
+ * and carry their length in the frame header. The data is copied once, into a
+ * MessageRing, and no memory is allocated per message.
+ *
+ * Data is pushed from the AsyncTCP task while the loop reads and pops it, so
+ * every call holds the lock of the buffer.
  */
 template <class T>
 class ReceiveBuffer {
  public:
-  ReceiveBuffer() { buffer = T(); }
+  ReceiveBuffer() {}
 
   /**
-   * Push a message into the buffer
+   * Push data into the buffer. Messages may be split over multiple calls
    */
-  void push(const char *cstr, size_t length, temp_buffer_t &buf) {
-    auto data_ptr = cstr;
-    do {
-      auto len = strnlen(data_ptr, length);
-      do {
-        auto read_len = std::min(len, buf.length);
-        memcpy(buf.buffer, data_ptr, read_len);
-        buf.buffer[read_len] = '\0';
-        auto newBuffer = T(buf.buffer);
-        stringAppend(buffer, newBuffer);
-        len -= newBuffer.length();
-        length -= newBuffer.length();
-        data_ptr += newBuffer.length() * sizeof(char);
-      } while (len > 0);
-      if (length > 0) {
-        // Skip/remove the '\0' between the messages
-        length -= 1;
-        data_ptr += 1 * sizeof(char);
-        if (buffer.length() > 0) {  // skip empty buffers
-          jsonStrings.push_back(buffer);
-          buffer = T();
+  void push(const char *cstr, size_t length) {
+    LockGuard guard(lock);
+    while (length > 0) {
+      size_t used;
+      if (frameSkip > 0) {
+        used = std::min(frameSkip, length);
+        frameSkip -= used;
+      } else if (framePending > 0) {
+        used = std::min(framePending, length);
+        ring.append(cstr, used);
+        framePending -= used;
+        if (framePending == 0) ring.close();
+      } else if (headerLength > 0 ||
+                 (!textOpen && static_cast<uint8_t>(cstr[0]) == FRAME_MARKER)) {
+        used = std::min(FRAME_HEADER_SIZE - headerLength, length);
+        memcpy(header + headerLength, cstr, used);
+        headerLength += used;
+        if (headerLength == FRAME_HEADER_SIZE) startFrame();
+      } else {
+        auto end = static_cast<const char *>(memchr(cstr, '\0', length));
+        if (end == NULL) {
+          ring.append(cstr, length);
+          textOpen = true;
+          return;
         }
+        // Store the '\0' so the message can be used as a cstring in place
+        used = end - cstr + 1;
+        ring.append(cstr, used);
+        ring.close(1);  // empty messages are skipped
+        textOpen = false;
       }
-    } while (length > 0);
+      cstr += used;
+      length -= used;
+    }
+  }
+
+  /**
+   * Push data into the buffer
+   *
+   * The temporary buffer is no longer needed, this overload is kept for
+   * compatibility
+   */
+  void push(const char *cstr, size_t length, temp_buffer_t &buf) {
+    push(cstr, length);
   }
 
   /**
    * Get the oldest message from the buffer
    */
   T front() {
-    if (!empty()) return (*jsonStrings.begin());
-    return T();
+    LockGuard guard(lock);
+    T str;
+    if (!ring.empty()) append(str, ring.front(), ring.frontLength());
+    return str;
+  }
+
+  /**
+   * Pointer to the oldest message, which stays valid until pop_front(), also
+   * while more data is pushed or the buffer is cleared. Json messages are '\0'
+   * terminated, binary frames are not
+   */
+  const char *frontPtr() {
+    LockGuard guard(lock);
+    return ring.hold();
+  }
+
+  /**
+   * Length of the oldest message
+   */
+  size_t frontLength() {
+    LockGuard guard(lock);
+    return ring.frontLength();
   }
 
   /**
    * Remove the oldest message from the buffer
    */
-  void pop_front() { jsonStrings.pop_front(); }
+  void pop_front() {
+    LockGuard guard(lock);
+    ring.pop();
+  }
 
   /**
    * Is the buffer empty
    */
-  bool empty() { return jsonStrings.empty(); }
+  bool empty() {
+    LockGuard guard(lock);
+    return ring.empty();
+  }
+
+  /**
+   * Number of complete messages in the buffer
+   */
+  size_t size() {
+    LockGuard guard(lock);
+    return ring.size();
+  }
 
   /**
    * Clear the buffer
    */
   void clear() {
-    jsonStrings.clear();
-    buffer = T();
+    LockGuard guard(lock);
+    ring.clear();
+    textOpen = false;
+    headerLength = 0;
+    framePending = 0;
+    frameSkip = 0;
   }
 
  private:
-  T buffer;
-  std::list<T> jsonStrings;
+  SpinLock lock;
+  MessageRing ring;
+  // Whether part of a json message has been received
+  bool textOpen = false;
+  // Header of the frame being received
+  char header[FRAME_HEADER_SIZE];
+  size_t headerLength = 0;
+  // Payload bytes of the current frame that have not been received yet
+  size_t framePending = 0;
+  // Remaining bytes of a frame that is too large to keep
+  size_t frameSkip = 0;
 
-  /**
-   * Helper function to deal with difference Arduino String
-   * and std::string
-   */
-  inline void stringAppend(T &buffer, T &newBuffer) { buffer.concat(newBuffer); };
+  void startFrame() {
+    headerLength = 0;
+    size_t length = frameLength(header);
+    if (length > PAINLESSMESH_FRAME_MAX) {
+      frameSkip = length;
+      return;
+    }
+    ring.append(header, FRAME_HEADER_SIZE);
+    framePending = length;
+    if (length == 0) ring.close();
+  }
 };
 
-#ifdef PAINLESSMESH_ENABLE_STD_STRING
-template <>
-inline void ReceiveBuffer<std::string>::stringAppend(std::string &buffer,
-                                              std::string &newBuffer) {
-  buffer.append(newBuffer);
-}
-#endif
-
 /**
  * \brief SentBuffer stores messages (strings) and allows them to be read in any
  * length
+ *
+ * Messages are queued as shared, immutable strings together with the offset
+ * this buffer has sent so far, so the same message can be queued on any number
+ * of connections without being copied. Json messages are sent with their '\0'
+ * delimiter (the terminator of c_str()), binary frames carry their own length
+ * and are sent without one. High priority messages are kept in a separate
+ * queue so they can overtake the others without moving any data.
  */
 template <class T>
 class SentBuffer {
  public:
+  typedef std::shared_ptr<const T> Message;
+
   SentBuffer(){};
 
   /**
@@ -115,16 +709,31 @@ class SentBuffer {
    *
    * \param priority Whether this is a high priority message.
    *
-   * High priority messages will be sent to the front of the buffer
+   * High priority messages will be sent to the front of the buffer, after a
+   * message that has been partly sent already
+   */
+  void push(Message message, bool priority = false) {
+    Entry entry;
+    entry.length = message->length();
+    if (!isFrame(message->c_str(), entry.length)) ++entry.length;
+    entry.message = std::move(message);
+    (priority ? urgent : normal).push_back(std::move(entry));
+  }
+
+  /**
+   * push a copy of the message into the buffer.
+   */
+  void push(const T &message, bool priority = false) {
+    push(makeMessage<T>(message), priority);
+  }
+
+  /**
+   * push a message, given as a cstring of length bytes, into the buffer.
    */
-  void push(T message, bool priority = false) {
-    if (priority) {
-      if (clean)
-        jsonStrings.push_front(message);
-      else
-        jsonStrings.insert((++jsonStrings.begin()), message);
-    } else
-      jsonStrings.push_back(message);
+  void push(const char *message, size_t length, bool priority = false) {
+    T copy;
+    append(copy, message, length);
+    push(makeMessage<T>(std::move(copy)), priority);
   }
 
   /**
@@ -133,12 +742,13 @@ class SentBuffer {
    * Returns the actual length available (<= the requested length
    */
   size_t requestLength(size_t buffer_length) {
-    if (jsonStrings.empty())
+    if (empty())
       return 0;
-    else
-      // String.toCharArray automatically turns the last character into
-      // a \0, we need the extra space to deal with that annoyance
-      return std::min(buffer_length - 1, jsonStrings.begin()->length() + 1);
+    else {
+      // read() null terminates the copied data, so leave one byte for that
+      const Entry &entry = current().front();
+      return std::min(buffer_length - 1, entry.length - entry.offset);
+    }
   }
 
   /**
@@ -146,30 +756,25 @@ class SentBuffer {
    *
    * Note the user should first make sure the requested length is available
    * using `SentBuffer.requestLength()`, otherwise this function might fail.
-   * Note that if multiple messages are read then they are separated using '\0'.
+   * The message is followed by its '\0' delimiter.
    */
   void read(size_t length, temp_buffer_t &buf) {
-    // TODO: I don't think we actually need to copy here, and/or
-    // we should add a non-copy mode, that returns a pointer directly
-    // to the data (using c_str()).
-    //
-    // Note that toCharrArray always null terminates
-    // independent of whether the whole string was read so we use one extra
-    // space
-    jsonStrings.front().toCharArray(buf.buffer, length + 1);
-    last_read_size = length;
+    memcpy(buf.buffer, readPtr(length), length);
+    buf.buffer[length] = '\0';
   }
 
   /**
-   * Returns a pointer directly to the oldest message
+   * Returns a pointer directly into the oldest message
    *
    * Note the user should first make sure the requested length is available
    * using `SentBuffer.requestLength()`, otherwise this function might fail.
-   * Note that if multiple messages are read then they are separated using '\0'.
+   * The pointer stays valid until freeRead() is called.
    */
-  const char* readPtr(size_t length) {
+  const char *readPtr(size_t length) {
+    reading = &current();
     last_read_size = length;
-    return jsonStrings.front().c_str();
+    const Entry &entry = reading->front();
+    return entry.message->c_str() + entry.offset;
   }
 
   /**
@@ -178,49 +783,46 @@ class SentBuffer {
    * Should be called after a call of read() to clear the buffer.
    */
   void freeRead() {
-    if (last_read_size == jsonStrings.begin()->length() + 1) {
-      jsonStrings.pop_front();
-      clean = true;
-    } else {
-      // jsonStrings.begin()->remove(0, last_read_size);
-      stringEraseFront((*jsonStrings.begin()), last_read_size);
-      clean = false;
+    if (reading == NULL) return;
+    Entry &entry = reading->front();
+    entry.offset += last_read_size;
+    // Finish a partly sent message before anything else
+    if (entry.offset >= entry.length) {
+      reading->pop_front();
+      reading = NULL;
     }
     last_read_size = 0;
   }
 
-  bool empty() { return jsonStrings.empty(); }
+  bool empty() { return normal.empty() && urgent.empty(); }
 
-  void clear() { jsonStrings.clear(); }
+  void clear() {
+    normal.clear();
+    urgent.clear();
+    reading = NULL;
+    last_read_size = 0;
+  }
 
-  size_t size() { return jsonStrings.size(); }
+  size_t size() { return normal.size() + urgent.size(); }
 
  private:
-  size_t last_read_size = 0;
-  bool clean = true;
-  std::list<T> jsonStrings;
+  struct Entry {
+    Message message;
+    // Bytes to send, including the delimiter, and the bytes sent so far
+    size_t length = 0;
+    size_t offset = 0;
+  };
 
-  inline void stringEraseFront(T &string, size_t length) { string.remove(0, length); };
-};
-
-#ifdef PAINLESSMESH_ENABLE_STD_STRING
-template <>
-inline void SentBuffer<std::string>::read(size_t length, temp_buffer_t &buf) {
-  jsonStrings.front().copy(buf.buffer, length);
-  // Mimic String.toCharArray behaviour, which will insert
-  // null termination at the end of original string and the last
-  // character
-  if (length == jsonStrings.front().length() + 1) buf.buffer[length - 1] = '\0';
-  buf.buffer[length] = '\0';
-  last_read_size = length;
-}
+  size_t last_read_size = 0;
+  std::deque<Entry> *reading = NULL;
+  std::deque<Entry> normal;
+  std::deque<Entry> urgent;
 
-template <>
-inline void SentBuffer<std::string>::stringEraseFront(std::string &string,
-                                               size_t length) {
-  string.erase(0, length);
+  std::deque<Entry> &current() {
+    if (reading != NULL) return *reading;
+    return urgent.empty() ? normal : urgent;
+  }
 };
-#endif
 
 }  // namespace buffer
 }  // namespace painlessmesh
@@ -65,14 +65,23 @@ class BufferedConnection
 
     readBufferTask.set(TASK_SECOND, TASK_FOREVER,
                        [self]() {
-                         if (!self->receiveBuffer.empty()) {
+                         if (self->receiveBuffer.empty()) return;
+                         if (self->receiveDataCallback) {
+                           // Handled in place. The message is held until it
+                           // is popped, data received from the AsyncTCP task
+                           // meanwhile does not move or overwrite it
+                           self->receiveDataCallback(
+                               self->receiveBuffer.frontPtr(),
+                               self->receiveBuffer.frontLength());
+                           self->receiveBuffer.pop_front();
+                         } else {
                            TSTRING frnt = self->receiveBuffer.front();
                            self->receiveBuffer.pop_front();
-                           if (!self->receiveBuffer.empty())
-                             self->readBufferTask.forceNextIteration();
                            if (self->receiveCallback)
                              self->receiveCallback(frnt);
                          }
+                         if (!self->receiveBuffer.empty())
+                           self->readBufferTask.forceNextIteration();
                        });
     scheduler->addTask(readBufferTask);
     readBufferTask.enableDelayed();
@@ -124,13 +133,21 @@ class BufferedConnection
     if (disconnectCallback) disconnectCallback();
 
     receiveCallback = NULL;
+    receiveDataCallback = NULL;
     disconnectCallback = NULL;
 
     mConnected = false;
   }
 
   bool write(TSTRING data, bool priority = false) {
-    sentBuffer.push(data, priority);
+    return write(buffer::share(std::move(data)), priority);
+  }
+
+  /**
+   * Queue a message that may be queued on other connections as well
+   */
+  bool write(buffer::SharedMessage data, bool priority = false) {
+    sentBuffer.push(std::move(data), priority);
     sentBufferTask.forceNextIteration();
     return true;
   }
@@ -143,6 +160,16 @@ class BufferedConnection
     receiveCallback = callback;
   }
 
+  /**
+   * Handle each received message in place, instead of as a copy
+   *
+   * The data is only valid during the callback. Takes precedence over
+   * onReceive
+   */
+  void onReceiveData(std::function<void(const char *, size_t)> callback) {
+    receiveDataCallback = callback;
+  }
+
   bool connected() { return mConnected; }
 
  protected:
@@ -151,6 +178,7 @@ class BufferedConnection
   AsyncClient *client;
 
   std::function<void(TSTRING)> receiveCallback;
+  std::function<void(const char *, size_t)> receiveDataCallback;
   std::function<void()> disconnectCallback;
 
   painlessmesh::buffer::ReceiveBuffer<TSTRING> receiveBuffer;
@@ -1,8 +1,10 @@
 #ifndef _PAINLESS_MESH_LAYOUT_HPP_
 #define _PAINLESS_MESH_LAYOUT_HPP_
 
+#include <algorithm>
 #include <list>
 #include <memory>
+#include <unordered_map>
 
 #include "painlessmesh/protocol.hpp"
 
@@ -33,12 +35,115 @@ inline protocol::NodeTree excludeRoute(protocol::NodeTree&& tree,
   return tree;
 }
 
+inline uint32_t size(protocol::NodeTree nodeTree);
+
+inline uint32_t mixHash(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/**
+ * Hash of the tree, used to check whether two nodes hold the same tree
+ *
+ * Does not depend on the order of the subs, and is never 0.
+ */
+inline uint32_t hash(const protocol::NodeTree& tree) {
+  uint32_t subs = 0;
+  for (auto&& s : tree.subs) subs += hash(s);
+  auto h = mixHash(tree.nodeId ^ (tree.root ? 0x9e3779b9 : 0));
+  h = mixHash(h + 0x7f4a7c15 * (subs + 1));
+  return h == 0 ? 1 : h;
+}
+
+/**
+ * The changes that turn tree from into tree to (with the same top node)
+ *
+ * The subtrees of the nodes in remove are removed first, then the subs of
+ * each tree in add are added under the node with its nodeId (see
+ * protocol::NodeSyncRequest).
+ */
+inline void diff(const protocol::NodeTree& from, const protocol::NodeTree& to,
+                 std::list<uint32_t>& remove,
+                 std::list<protocol::NodeTree>& add) {
+  protocol::NodeTree added(to.nodeId, false);
+  for (auto&& a : from.subs) {
+    auto b = std::find_if(
+        to.subs.begin(), to.subs.end(),
+        [&a](const protocol::NodeTree& s) { return s.nodeId == a.nodeId; });
+    if (b == to.subs.end()) {
+      remove.push_back(a.nodeId);
+    } else if (a.root != b->root) {
+      remove.push_back(a.nodeId);
+      added.subs.push_back(*b);
+    } else {
+      diff(a, *b, remove, add);
+    }
+  }
+  for (auto&& b : to.subs) {
+    auto a = std::find_if(
+        from.subs.begin(), from.subs.end(),
+        [&b](const protocol::NodeTree& s) { return s.nodeId == b.nodeId; });
+    if (a == from.subs.end()) added.subs.push_back(b);
+  }
+  if (added.subs.size() > 0) add.push_back(std::move(added));
+}
+
+inline protocol::NodeTree* findNode(protocol::NodeTree& tree,
+                                    uint32_t nodeId) {
+  if (tree.nodeId == nodeId) return &tree;
+  for (auto&& s : tree.subs) {
+    auto node = findNode(s, nodeId);
+    if (node) return node;
+  }
+  return NULL;
+}
+
+inline bool eraseNode(protocol::NodeTree& tree, uint32_t nodeId) {
+  for (auto s = tree.subs.begin(); s != tree.subs.end(); ++s) {
+    if (s->nodeId == nodeId) {
+      tree.subs.erase(s);
+      return true;
+    }
+    if (eraseNode(*s, nodeId)) return true;
+  }
+  return false;
+}
+
+/**
+ * Apply the changes found by diff to the tree
+ *
+ * Returns false if they refer to a node that is not in the tree
+ */
+inline bool apply(protocol::NodeTree& tree, const std::list<uint32_t>& remove,
+                  const std::list<protocol::NodeTree>& add) {
+  for (auto&& nodeId : remove) {
+    if (!eraseNode(tree, nodeId)) return false;
+  }
+  for (auto&& subTree : add) {
+    auto node = findNode(tree, subTree.nodeId);
+    if (!node) return false;
+    for (auto&& s : subTree.subs) node->subs.push_back(s);
+  }
+  return true;
+}
+
 template <class T>
 class Layout {
  public:
   size_t stability = 0;
   std::list<std::shared_ptr<T> > subs;
 
+  /**
+   * Increased whenever the tree of this node (asNodeTree()) may have changed
+   *
+   * Lets a neighbour that already holds our tree skip rebuilding it.
+   */
+  size_t version = 0;
+
   /** Return the nodeId of the node that we are running on.
    *
    * On the ESP hardware nodeId is uniquely calculated from the MAC address of
@@ -55,9 +160,74 @@ class Layout {
     return nt;
   }
 
+  /**
+   * The sub to send packages for each known node to
+   *
+   * A flat copy of the trees of the subs, so finding a route is a single
+   * lookup instead of a search through the trees. Call updateRoutes whenever
+   * the tree of a sub changes and eraseRoutes when a sub is removed.
+   */
+  std::unordered_map<uint32_t, std::shared_ptr<T> > routes;
+
+  /**
+   * Update the routes through the sub after its tree changed
+   *
+   * Only the routes through this sub are touched. A node that moved here from
+   * another sub is routed through this sub from now on.
+   */
+  void updateRoutes(std::shared_ptr<T> sub) {
+    auto lost = takeRoutes(sub);
+    addRoutes((*sub), sub);
+    reroute(lost, sub);
+  }
+
+  /**
+   * Remove all routes through the sub
+   *
+   * A node that is also in the tree of another sub is routed through that sub.
+   */
+  void eraseRoutes(std::shared_ptr<T> sub) {
+    auto lost = takeRoutes(sub);
+    reroute(lost, sub);
+  }
+
  protected:
   uint32_t nodeId = 0;
   bool root = false;
+
+  void addRoutes(const protocol::NodeTree& tree, std::shared_ptr<T>& sub) {
+    if (tree.nodeId != 0 && tree.nodeId != nodeId) routes[tree.nodeId] = sub;
+    for (auto&& s : tree.subs) addRoutes(s, sub);
+  }
+
+  std::list<uint32_t> takeRoutes(std::shared_ptr<T>& sub) {
+    ++version;
+    std::list<uint32_t> taken;
+    for (auto route = routes.begin(); route != routes.end();) {
+      if (route->second == sub) {
+        taken.push_back(route->first);
+        route = routes.erase(route);
+      } else {
+        ++route;
+      }
+    }
+    return taken;
+  }
+
+  // A node can briefly be in the trees of two subs, while only the sub that
+  // reported it last owns its route. Hand the nodes that sub no longer has to
+  // any other sub that still has them.
+  void reroute(const std::list<uint32_t>& lost, std::shared_ptr<T>& sub) {
+    for (auto&& id : lost) {
+      if (routes.count(id) > 0) continue;
+      for (auto&& s : subs) {
+        if (s != sub && layout::contains((*s), id)) {
+          routes[id] = s;
+          break;
+        }
+      }
+    }
+  }
 };
 
 template <class T>
@@ -70,6 +240,7 @@ void syncLayout(Layout<T>& layout, uint32_t changedId) {
       sub->nodeSyncTask.forceNextIteration();
     }
   }
+  ++layout.version;
   layout.stability /= 2;
 }
 
@@ -78,6 +249,14 @@ class Neighbour : public protocol::NodeTree {
   // Inherit constructors
   using protocol::NodeTree::NodeTree;
 
+  /**
+   * Encoding of the packages sent to this neighbour
+   *
+   * Switches to binary once the node sync of the neighbour shows that it can
+   * read binary frames.
+   */
+  protocol::Encoding encoding = protocol::ENCODING_JSON;
+
   /**
    * Is the passed nodesync valid
    *
@@ -109,6 +288,7 @@ class Neighbour : public protocol::NodeTree {
       nodeId = tree.nodeId;
       subs = tree.subs;
       root = tree.root;
+      treeHash = layout::hash(*this);
       return true;
     }
     return false;
@@ -131,6 +311,131 @@ class Neighbour : public protocol::NodeTree {
     return protocol::NodeSyncReply(subTree.nodeId, nodeId, subTree.subs,
                                    subTree.root);
   }
+
+  /**
+   * Create a request with the changes since the neighbour last confirmed our
+   * tree
+   *
+   * Sends the full tree if the neighbour does not sync with deltas, or does
+   * not hold a tree we sent before.
+   */
+  template <class T>
+  protocol::NodeSyncRequest request(Layout<T>& layout) {
+    return sync<protocol::NodeSyncRequest>(layout);
+  }
+
+  /**
+   * Create a reply with the changes since the neighbour last confirmed our
+   * tree
+   */
+  template <class T>
+  protocol::NodeSyncReply reply(Layout<T>& layout) {
+    return sync<protocol::NodeSyncReply>(layout);
+  }
+
+  /**
+   * Read the sync fields of a node sync package from this neighbour
+   *
+   * \return false if the neighbour does not hold the last tree we sent it
+   */
+  bool confirm(const protocol::NodeSyncRequest& pkg) {
+    deltaSync = pkg.hash != 0;
+    known = pkg.known;
+    if (pendingHash != 0 && (known == pendingHash || !deltaSync)) {
+      if (deltaSync) {
+        synced = std::move(pending);
+        syncedHash = pendingHash;
+        syncedVersion = pendingVersion;
+      }
+      pending.clear();
+      pendingHash = 0;
+    }
+    return pendingHash == 0;
+  }
+
+  /**
+   * Forget which tree the neighbour holds, so the next sync sends it in full
+   */
+  void resetSync() {
+    synced.clear();
+    syncedHash = 0;
+  }
+
+  /**
+   * Rebuild the tree of this neighbour from a delta package
+   *
+   * \return false if the delta is not based on the tree we hold for this
+   * neighbour, or does not result in the tree it describes
+   */
+  bool resolve(const protocol::NodeSyncRequest& pkg, protocol::NodeTree& tree) {
+    if (nodeId != pkg.nodeId || treeHash == 0 || treeHash != pkg.base)
+      return false;
+    tree = protocol::NodeTree(*this);
+    tree.root = pkg.root;
+    if (!layout::apply(tree, pkg.remove, pkg.add)) return false;
+    return layout::hash(tree) == pkg.hash;
+  }
+
+  /// Hash of the tree of this neighbour, as we hold it
+  uint32_t treeHash = 0;
+
+  /// Whether the neighbour syncs its tree with hashes and deltas
+  bool deltaSync = false;
+
+ protected:
+  // Hash of our tree that the neighbour says it holds
+  uint32_t known = 0;
+  // Our tree as the neighbour last confirmed it, base of the next delta
+  protocol::NodeTree synced;
+  uint32_t syncedHash = 0;
+  size_t syncedVersion = 0;
+  // Our tree as we last sent it, waiting for the neighbour to confirm it
+  protocol::NodeTree pending;
+  uint32_t pendingHash = 0;
+  size_t pendingVersion = 0;
+
+  template <class P, class T>
+  P sync(Layout<T>& layout) {
+    bool inSync = deltaSync && syncedHash != 0 && known == syncedHash;
+    if (inSync && pendingHash == 0 && syncedVersion == layout.version) {
+      // Nothing changed since the neighbour confirmed our tree
+      P pkg(synced.nodeId, nodeId, std::list<NodeTree>(), synced.root);
+      pkg.hash = syncedHash;
+      pkg.base = syncedHash;
+      pkg.known = treeHash;
+      return pkg;
+    }
+
+    auto tree = excludeRoute(layout.asNodeTree(), nodeId);
+    auto newHash = layout::hash(tree);
+    P pkg(tree.nodeId, nodeId, std::list<NodeTree>(), tree.root);
+    pkg.hash = newHash;
+    pkg.known = treeHash;
+    if (inSync && tree.nodeId == synced.nodeId) {
+      pkg.base = syncedHash;
+      if (newHash != syncedHash) diff(synced, tree, pkg.remove, pkg.add);
+      // Send the full tree if that is smaller
+      size_t changes = pkg.remove.size();
+      for (auto&& s : pkg.add) changes += size(s) - 1;
+      if (changes >= size(tree)) {
+        pkg.base = 0;
+        pkg.remove.clear();
+        pkg.add.clear();
+      }
+    }
+    if (pkg.base == 0) pkg.subs = tree.subs;
+
+    if (inSync && newHash == syncedHash) {
+      syncedVersion = layout.version;
+      pending.clear();
+      pendingHash = 0;
+    } else {
+      pending = std::move(tree);
+      pendingHash = newHash;
+      pendingVersion = layout.version;
+    }
+    return pkg;
+  }
 };
 
 /**
@@ -109,7 +109,10 @@ class Mesh : public ntp::MeshTime, public plugin::PackageHandler<T> {
    * If one node is root, then it is also recommended to call
    * painlessMesh::setContainsRoot() on all the nodes in the mesh.
    */
-  void setRoot(bool on = true) { this->root = on; };
+  void setRoot(bool on = true) {
+    this->root = on;
+    ++this->version;
+  };
 
   /**
    * The mesh should contains a root node
@@ -410,8 +413,11 @@ class Mesh : public ntp::MeshTime, public plugin::PackageHandler<T> {
   void eraseClosedConnections() {
     using namespace logger;
     Log(CONNECTION, "eraseClosedConnections():\n");
-    this->subs.remove_if(
-        [](const std::shared_ptr<T> &conn) { return !conn->connected(); });
+    this->subs.remove_if([this](const std::shared_ptr<T> &conn) {
+      if (conn->connected()) return false;
+      this->eraseRoutes(conn);
+      return true;
+    });
   }
 
   // Callback functions
@@ -492,10 +498,9 @@ class Connection : public painlessmesh::layout::Neighbour,
   void initTasks() {
     auto self = this->shared_from_this();
     auto mesh = this->mesh;
-    this->onReceive([mesh, self](TSTRING str) {
-      auto variant = painlessmesh::protocol::Variant(str);
+    this->onReceiveData([mesh, self](const char *data, size_t length) {
       router::routePackage<painlessmesh::Connection>(
-          (*self->mesh), self->shared_from_this(), str,
+          (*self->mesh), self->shared_from_this(), data, length,
           self->mesh->callbackList, self->mesh->getNodeTime());
     });
 
@@ -526,7 +531,7 @@ class Connection : public painlessmesh::layout::Neighbour,
     this->nodeSyncTask.set(TASK_MINUTE, TASK_FOREVER, [self]() {
       Log(SYNC, "nodeSyncTask(): request with %u\n", self->nodeId);
       router::send<protocol::NodeSyncRequest, Connection>(
-          self->request(self->mesh->asNodeTree()), self);
+          self->request(*self->mesh), self);
       self->timeOutTask.disable();
       self->timeOutTask.restartDelayed();
     });
@@ -542,7 +547,11 @@ class Connection : public painlessmesh::layout::Neighbour,
   }
 
   bool addMessage(TSTRING msg, bool priority = false) {
-    return this->write(msg, priority);
+    return this->write(std::move(msg), priority);
+  }
+
+  bool addMessage(buffer::SharedMessage msg, bool priority = false) {
+    return this->write(std::move(msg), priority);
   }
 
  protected:
@@ -2,9 +2,11 @@
 #define _PAINLESS_MESH_PROTOCOL_HPP_
 
 #include <cmath>
+#include <cstring>
 #include <list>
 
 #include "Arduino.h"
+#include "painlessmesh/buffer.hpp"
 #include "painlessmesh/configuration.hpp"
 
 namespace painlessmesh {
@@ -36,6 +38,14 @@ enum Type {
   SINGLE = 9      // application data for a single node
 };
 
+/**
+ * How packages are encoded on a connection
+ *
+ * Every node reads both encodings. A connection uses ENCODING_JSON until the
+ * node sync of the neighbour shows that it can read binary frames as well.
+ */
+enum Encoding { ENCODING_JSON = 0, ENCODING_BINARY };
+
 enum TimeType {
   TIME_SYNC_ERROR = -1,
   TIME_SYNC_REQUEST,
@@ -219,6 +229,25 @@ class NodeSyncRequest : public NodeTree {
   int type = NODE_SYNC_REQUEST;
   uint32_t from;
   uint32_t dest;
+  /// Whether the sending node can read binary frames (see protocol::binary)
+  bool binary = false;
+
+  /**
+   * Topology sync fields, only set by nodes that sync with deltas
+   *
+   * hash is the hash (layout::hash) of the tree of the sender and known the
+   * hash of the tree the sender holds for the receiving node. A package with
+   * a base is a delta on the tree with that hash: subs is empty and the tree
+   * is found by removing the subtrees of the nodes in remove from the base
+   * tree and then adding the subs of each tree in add under the node with its
+   * nodeId. A delta without changes (base == hash) tells the receiver that
+   * the tree did not change.
+   */
+  uint32_t hash = 0;
+  uint32_t known = 0;
+  uint32_t base = 0;
+  std::list<uint32_t> remove;
+  std::list<NodeTree> add;
 
   NodeSyncRequest() {}
   NodeSyncRequest(uint32_t fromID, uint32_t destID, std::list<NodeTree> subTree,
@@ -228,11 +257,22 @@ class NodeSyncRequest : public NodeTree {
     subs = subTree;
     nodeId = fromID;
     root = iAmRoot;
+    binary = true;
   }
 
   NodeSyncRequest(JsonObject jsonObj) : NodeTree(jsonObj) {
     dest = jsonObj["dest"].as<uint32_t>();
     from = jsonObj["from"].as<uint32_t>();
+    binary = jsonObj["binary"].as<bool>();
+    hash = jsonObj["hash"].as<uint32_t>();
+    known = jsonObj["known"].as<uint32_t>();
+    base = jsonObj["base"].as<uint32_t>();
+    auto removeArr = jsonObj["remove"].as<JsonArray>();
+    for (size_t i = 0; i < removeArr.size(); ++i)
+      remove.push_back(removeArr[i].as<uint32_t>());
+    auto addArr = jsonObj["add"].as<JsonArray>();
+    for (size_t i = 0; i < addArr.size(); ++i)
+      add.push_back(NodeTree(addArr[i].as<JsonObject>()));
   }
 
   JsonObject addTo(JsonObject&& jsonObj) const {
@@ -240,11 +280,42 @@ class NodeSyncRequest : public NodeTree {
     jsonObj["type"] = type;
     jsonObj["dest"] = dest;
     jsonObj["from"] = from;
+    if (binary) jsonObj["binary"] = binary;
+    if (hash) jsonObj["hash"] = hash;
+    if (known) jsonObj["known"] = known;
+    if (base) jsonObj["base"] = base;
+    if (remove.size() > 0) {
+#if ARDUINOJSON_VERSION_MAJOR == 7
+      JsonArray removeArr = jsonObj["remove"].to<JsonArray>();
+#else
+      JsonArray removeArr = jsonObj.createNestedArray("remove");
+#endif
+      for (auto&& id : remove) removeArr.add(id);
+    }
+    if (add.size() > 0) {
+#if ARDUINOJSON_VERSION_MAJOR == 7
+      JsonArray addArr = jsonObj["add"].to<JsonArray>();
+#else
+      JsonArray addArr = jsonObj.createNestedArray("add");
+#endif
+      for (auto&& tree : add) {
+#if ARDUINOJSON_VERSION_MAJOR == 7
+        JsonObject addObj = addArr.add<JsonObject>();
+#else
+        JsonObject addObj = addArr.createNestedObject();
+#endif
+        addObj = tree.addTo(std::move(addObj));
+      }
+    }
     return jsonObj;
   }
 
   bool operator==(const NodeSyncRequest& b) const {
     if (!(this->from == b.from && this->dest == b.dest)) return false;
+    if (!(this->hash == b.hash && this->known == b.known &&
+          this->base == b.base && this->remove == b.remove &&
+          this->add == b.add))
+      return false;
     return NodeTree::operator==(b);
   }
 
@@ -254,12 +325,21 @@ class NodeSyncRequest : public NodeTree {
 
 #if ARDUINOJSON_VERSION_MAJOR < 7
   size_t jsonObjectSize() const {
-    size_t base = 4;
-    if (root) ++base;
-    if (subs.size() > 0) ++base;
-    size_t size = JSON_OBJECT_SIZE(base);
+    size_t members = 4;
+    if (root) ++members;
+    if (binary) ++members;
+    if (hash) ++members;
+    if (known) ++members;
+    if (base) ++members;
+    if (subs.size() > 0) ++members;
+    if (remove.size() > 0) ++members;
+    if (add.size() > 0) ++members;
+    size_t size = JSON_OBJECT_SIZE(members);
     if (subs.size() > 0) size += JSON_ARRAY_SIZE(subs.size());
     for (auto&& s : subs) size += s.jsonObjectSize();
+    if (remove.size() > 0) size += JSON_ARRAY_SIZE(remove.size());
+    if (add.size() > 0) size += JSON_ARRAY_SIZE(add.size());
+    for (auto&& s : add) size += s.jsonObjectSize();
     return size;
   }
 #endif
@@ -411,11 +491,491 @@ class TimeDelay : public TimeSync {
   }
 };
 
+/**
+ * Routing information of an encoded package
+ *
+ * Can be read from a json package or binary frame without decoding the rest of
+ * it, which is all a node needs to pass on packages that are not meant for it.
+ */
+struct Header {
+  router::Type routing = router::ROUTING_ERROR;
+  int type = 0;
+  uint32_t length = 0;  // of the payload of a frame, or the whole json
+  uint32_t from = 0;
+  uint32_t dest = 0;
+  Encoding encoding = ENCODING_JSON;
+};
+
+/**
+ * Routing of a package type that does not set it explicitly
+ */
+inline router::Type routingOf(int type) {
+  if (type == SINGLE || type == TIME_DELAY) return router::SINGLE;
+  if (type == BROADCAST) return router::BROADCAST;
+  if (type == NODE_SYNC_REQUEST || type == NODE_SYNC_REPLY ||
+      type == TIME_SYNC)
+    return router::NEIGHBOUR;
+  return router::ROUTING_ERROR;
+}
+
+/**
+ * Scanning of json packages, without building a JsonDocument
+ */
+namespace json {
+
+inline const char* skipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    ++p;
+  return p;
+}
+
+/**
+ * Skip the string starting at p, returns the position after the closing quote
+ * or nullptr if the string is not terminated
+ */
+inline const char* skipString(const char* p, const char* end) {
+  for (++p; p < end; ++p) {
+    if (*p == '\\')
+      ++p;
+    else if (*p == '"')
+      return p + 1;
+  }
+  return nullptr;
+}
+
+/**
+ * Skip the value (including any nested objects and arrays) starting at p
+ */
+inline const char* skipValue(const char* p, const char* end) {
+  size_t depth = 0;
+  while (p < end) {
+    switch (*p) {
+      case '"':
+        p = skipString(p, end);
+        if (!p) return nullptr;
+        if (depth == 0) return p;
+        continue;
+      case '{':
+      case '[':
+        ++depth;
+        break;
+      case '}':
+      case ']':
+        if (depth == 0) return p;
+        if (--depth == 0) return p + 1;
+        break;
+      case ',':
+      case ' ':
+      case '\t':
+      case '\n':
+      case '\r':
+        if (depth == 0) return p;
+        break;
+    }
+    ++p;
+  }
+  return depth == 0 ? p : nullptr;
+}
+
+/**
+ * Read a plain integer, returns nullptr for any other value
+ */
+inline const char* readInt(const char* p, const char* end, int64_t& value) {
+  bool negative = p < end && *p == '-';
+  if (negative) ++p;
+  auto start = p;
+  value = 0;
+  while (p < end && *p >= '0' && *p <= '9' && p - start < 12) {
+    value = 10 * value + (*p - '0');
+    ++p;
+  }
+  if (p == start || p - start >= 12) return nullptr;
+  if (p < end && (*p == '.' || *p == 'e' || *p == 'E')) return nullptr;
+  if (negative) value = -value;
+  return p;
+}
+
+inline bool isKey(const char* key, size_t length, const char* name) {
+  return strlen(name) == length && memcmp(key, name, length) == 0;
+}
+
+/**
+ * Read the routing information from the top level members of a json package
+ *
+ * Nested objects, arrays and strings (e.g. the msg or subs) are skipped
+ * without being parsed. Returns false if the package is not valid json or any
+ * of the routing fields is not a plain integer, the caller should then fall
+ * back on parsing the package.
+ */
+inline bool readHeader(const char* data, size_t length, Header& header) {
+  auto end = data + length;
+  auto p = skipSpace(data, end);
+  if (p == end || *p != '{') return false;
+  bool hasType = false;
+  bool hasRouting = false;
+  header = Header();
+  p = skipSpace(p + 1, end);
+  if (p < end && *p == '}') return false;
+  while (p < end) {
+    if (*p != '"') return false;
+    auto key = p + 1;
+    p = skipString(p, end);
+    if (!p) return false;
+    size_t keyLength = p - 1 - key;
+    p = skipSpace(p, end);
+    if (p == end || *p != ':') return false;
+    p = skipSpace(p + 1, end);
+
+    int64_t value;
+    if (isKey(key, keyLength, "type")) {
+      p = readInt(p, end, value);
+      hasType = true;
+      header.type = value;
+    } else if (isKey(key, keyLength, "routing")) {
+      p = readInt(p, end, value);
+      hasRouting = true;
+      header.routing = static_cast<router::Type>(value);
+    } else if (isKey(key, keyLength, "dest") || isKey(key, keyLength, "from")) {
+      p = readInt(p, end, value);
+      if (p && (value < 0 || value > UINT32_MAX)) return false;
+      if (key[0] == 'd')
+        header.dest = value;
+      else
+        header.from = value;
+    } else {
+      p = skipValue(p, end);
+    }
+    if (!p) return false;
+
+    p = skipSpace(p, end);
+    if (p == end) return false;
+    if (*p == '}') break;
+    if (*p != ',') return false;
+    p = skipSpace(p + 1, end);
+  }
+  if (p == end || !hasType) return false;
+  if (!hasRouting) header.routing = routingOf(header.type);
+  header.length = length;
+  return true;
+}
+
+#if ARDUINOJSON_VERSION_MAJOR < 7
+/**
+ * Upper bound of the JsonDocument capacity needed to parse a json package
+ *
+ * Every value takes at most one slot and the copied strings never take more
+ * than the json itself.
+ */
+inline size_t capacity(const char* data, size_t length) {
+  auto end = data + length;
+  size_t values = 1;
+  for (auto p = data; p && p < end;) {
+    if (*p == '"') {
+      p = skipString(p, end);
+      continue;
+    }
+    if (*p == ',' || *p == '{' || *p == '[') ++values;
+    ++p;
+  }
+  return JSON_OBJECT_SIZE(values) + length;
+}
+#endif
+}  // namespace json
+
+/**
+ * Binary encoding of the packages
+ *
+ * A binary frame is a fixed header followed by the payload. All integers are
+ * little endian.
+ *
+ * | offset | size | field                                      |
+ * |--------|------|--------------------------------------------|
+ * | 0      | 1    | buffer::FRAME_MARKER                       |
+ * | 1      | 1    | routing (router::Type)                     |
+ * | 2      | 2    | type                                       |
+ * | 4      | 4    | length of the payload                      |
+ * | 8      | 4    | from                                       |
+ * | 12     | 4    | dest                                       |
+ *
+ * The payload is the message for Single and Broadcast packages, the time sync
+ * fields (type, t0, t1, t2) for TimeSync and TimeDelay and the node tree for
+ * NodeSyncRequest and NodeSyncReply. Each tree node is stored as its nodeId,
+ * a flags byte (1 = root) and the number of subs (uint16_t), followed by the
+ * subs. If the sync fields are set the tree is followed by hash, known and
+ * base (uint32_t each), the number of nodes to remove (uint16_t) and their
+ * nodeIds, and the number of trees to add (uint16_t) and those trees. Any
+ * other package (e.g. plugin packages) has its json as payload.
+ *
+ * The header holds everything needed to route a package, so a node only
+ * decodes the payload of the packages it handles itself.
+ */
+namespace binary {
+
+static const size_t TIME_SYNC_SIZE = 13;
+static const size_t TREE_NODE_SIZE = 7;
+static const size_t SYNC_SIZE = 16;
+static const size_t MAX_DEPTH = 255;
+
+inline void putUint(TSTRING& out, uint32_t value, size_t bytes) {
+  char data[4];
+  for (size_t i = 0; i < bytes; ++i) data[i] = (value >> (8 * i)) & 0xFF;
+  buffer::append(out, data, bytes);
+}
+
+inline uint32_t getUint(const char* data, size_t bytes) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) value |= (uint32_t)p[i] << (8 * i);
+  return value;
+}
+
+/**
+ * Read the header of a frame
+ *
+ * Returns false if data does not hold exactly one complete frame
+ */
+inline bool readHeader(const char* data, size_t length, Header& header) {
+  if (!buffer::isFrame(data, length)) return false;
+  header.routing = static_cast<router::Type>(static_cast<int8_t>(data[1]));
+  header.type = getUint(data + 2, 2);
+  header.length = buffer::frameLength(data);
+  header.from = getUint(data + 8, 4);
+  header.dest = getUint(data + 12, 4);
+  header.encoding = ENCODING_BINARY;
+  return header.length == length - buffer::FRAME_HEADER_SIZE;
+}
+
+/**
+ * Append a frame header, returns false if the payload is too large for a frame
+ */
+inline bool writeHeader(TSTRING& out, int type, router::Type routing,
+                        uint32_t from, uint32_t dest, size_t length) {
+  if (length > PAINLESSMESH_FRAME_MAX) return false;
+  out.reserve(out.length() + buffer::FRAME_HEADER_SIZE + length);
+  putUint(out, buffer::FRAME_MARKER, 1);
+  putUint(out, static_cast<uint8_t>(routing), 1);
+  putUint(out, type, 2);
+  putUint(out, length, 4);
+  putUint(out, from, 4);
+  putUint(out, dest, 4);
+  return true;
+}
+
+inline size_t treeSize(const NodeTree& tree) {
+  size_t size = TREE_NODE_SIZE;
+  for (auto&& s : tree.subs) size += treeSize(s);
+  return size;
+}
+
+inline void writeTree(TSTRING& out, const NodeTree& tree) {
+  putUint(out, tree.nodeId, 4);
+  putUint(out, tree.root ? 1 : 0, 1);
+  putUint(out, tree.subs.size(), 2);
+  for (auto&& s : tree.subs) writeTree(out, s);
+}
+
+inline bool readTree(const char*& data, const char* end, NodeTree& tree,
+                     size_t depth = 0) {
+  if (depth > MAX_DEPTH || (size_t)(end - data) < TREE_NODE_SIZE) return false;
+  tree.nodeId = getUint(data, 4);
+  tree.root = data[4] & 1;
+  size_t noSubs = getUint(data + 5, 2);
+  data += TREE_NODE_SIZE;
+  if (noSubs * TREE_NODE_SIZE > (size_t)(end - data)) return false;
+  for (size_t i = 0; i < noSubs; ++i) {
+    tree.subs.push_back(NodeTree());
+    if (!readTree(data, end, tree.subs.back(), depth + 1)) return false;
+  }
+  return true;
+}
+
+inline bool encodeMessage(const Single& pkg, int type, router::Type routing,
+                          TSTRING& out) {
+  if (!writeHeader(out, type, routing, pkg.from, pkg.dest, pkg.msg.length()))
+    return false;
+  buffer::append(out, pkg.msg.c_str(), pkg.msg.length());
+  return true;
+}
+
+inline bool encodeTime(const TimeSync& pkg, int type, router::Type routing,
+                       TSTRING& out) {
+  if (!writeHeader(out, type, routing, pkg.from, pkg.dest, TIME_SYNC_SIZE))
+    return false;
+  putUint(out, static_cast<uint8_t>(pkg.msg.type), 1);
+  putUint(out, pkg.msg.t0, 4);
+  putUint(out, pkg.msg.t1, 4);
+  putUint(out, pkg.msg.t2, 4);
+  return true;
+}
+
+inline size_t syncSize(const NodeSyncRequest& pkg) {
+  if (pkg.hash == 0) return 0;
+  size_t size = SYNC_SIZE + 4 * pkg.remove.size();
+  for (auto&& tree : pkg.add) size += treeSize(tree);
+  return size;
+}
+
+inline bool encodeTree(const NodeSyncRequest& pkg, int type, TSTRING& out) {
+  if (pkg.remove.size() > 0xFFFF || pkg.add.size() > 0xFFFF) return false;
+  if (!writeHeader(out, type, router::NEIGHBOUR, pkg.from, pkg.dest,
+                   treeSize(pkg) + syncSize(pkg)))
+    return false;
+  writeTree(out, pkg);
+  if (pkg.hash == 0) return true;
+  putUint(out, pkg.hash, 4);
+  putUint(out, pkg.known, 4);
+  putUint(out, pkg.base, 4);
+  putUint(out, pkg.remove.size(), 2);
+  for (auto&& id : pkg.remove) putUint(out, id, 4);
+  putUint(out, pkg.add.size(), 2);
+  for (auto&& tree : pkg.add) writeTree(out, tree);
+  return true;
+}
+
+inline bool readSync(const char*& data, const char* end,
+                     NodeSyncRequest& pkg) {
+  if ((size_t)(end - data) < SYNC_SIZE) return false;
+  pkg.hash = getUint(data, 4);
+  pkg.known = getUint(data + 4, 4);
+  pkg.base = getUint(data + 8, 4);
+  size_t noRemove = getUint(data + 12, 2);
+  data += 14;
+  if (noRemove * 4 + 2 > (size_t)(end - data)) return false;
+  for (size_t i = 0; i < noRemove; ++i, data += 4)
+    pkg.remove.push_back(getUint(data, 4));
+  size_t noAdd = getUint(data, 2);
+  data += 2;
+  if (noAdd * TREE_NODE_SIZE > (size_t)(end - data)) return false;
+  for (size_t i = 0; i < noAdd; ++i) {
+    pkg.add.push_back(NodeTree());
+    if (!readTree(data, end, pkg.add.back())) return false;
+  }
+  return true;
+}
+
+/**
+ * Append the package as a binary frame
+ *
+ * Returns false, without changing out, if the package is too large for a frame
+ */
+inline bool encode(const Single& pkg, TSTRING& out) {
+  return encodeMessage(pkg, pkg.type, router::SINGLE, out);
+}
+
+inline bool encode(const Broadcast& pkg, TSTRING& out) {
+  return encodeMessage(pkg, pkg.type, router::BROADCAST, out);
+}
+
+inline bool encode(const TimeSync& pkg, TSTRING& out) {
+  return encodeTime(pkg, pkg.type, router::NEIGHBOUR, out);
+}
+
+inline bool encode(const TimeDelay& pkg, TSTRING& out) {
+  return encodeTime(pkg, pkg.type, router::SINGLE, out);
+}
+
+inline bool encode(const NodeSyncRequest& pkg, TSTRING& out) {
+  return encodeTree(pkg, pkg.type, out);
+}
+
+inline bool encode(const NodeSyncReply& pkg, TSTRING& out) {
+  return encodeTree(pkg, pkg.type, out);
+}
+
+/**
+ * Append a package of any other type, with its json as payload
+ */
+inline bool encode(int type, router::Type routing, uint32_t from,
+                   uint32_t dest, const TSTRING& json, TSTRING& out) {
+  if (!writeHeader(out, type, routing, from, dest, json.length())) return false;
+  buffer::append(out, json.c_str(), json.length());
+  return true;
+}
+
+/**
+ * Decode the payload of a frame into the package
+ *
+ * Returns false if the payload is not valid for the package type
+ */
+inline bool decode(const Header& header, const char* payload, Single& pkg) {
+  pkg.from = header.from;
+  pkg.dest = header.dest;
+  pkg.msg = TSTRING();
+  buffer::append(pkg.msg, payload, header.length);
+  return true;
+}
+
+inline bool decode(const Header& header, const char* payload, TimeSync& pkg) {
+  if (header.length != TIME_SYNC_SIZE) return false;
+  pkg.from = header.from;
+  pkg.dest = header.dest;
+  pkg.msg.type = static_cast<int8_t>(payload[0]);
+  pkg.msg.t0 = getUint(payload + 1, 4);
+  pkg.msg.t1 = getUint(payload + 5, 4);
+  pkg.msg.t2 = getUint(payload + 9, 4);
+  return true;
+}
+
+inline bool decode(const Header& header, const char* payload,
+                   NodeSyncRequest& pkg) {
+  pkg.from = header.from;
+  pkg.dest = header.dest;
+  pkg.binary = true;
+  pkg.subs.clear();
+  pkg.hash = 0;
+  pkg.known = 0;
+  pkg.base = 0;
+  pkg.remove.clear();
+  pkg.add.clear();
+  auto end = payload + header.length;
+  if (!readTree(payload, end, pkg)) return false;
+  if (payload != end && !readSync(payload, end, pkg)) return false;
+  return payload == end;
+}
+}  // namespace binary
+
+/**
+ * Read the routing information of a json package or binary frame
+ */
+inline bool readHeader(const char* data, size_t length, Header& header) {
+  if (buffer::isFrame(data, length))
+    return binary::readHeader(data, length, header);
+  return json::readHeader(data, length, header);
+}
+
+#if ARDUINOJSON_VERSION_MAJOR < 7
+/**
+ * JsonDocument capacity needed to parse a json package or decode a frame
+ */
+inline size_t capacity(const char* data, size_t length) {
+  Header header;
+  if (!binary::readHeader(data, length, header))
+    return json::capacity(data, length);
+  switch (header.type) {
+    case SINGLE:
+    case BROADCAST:
+      return JSON_OBJECT_SIZE(4) + header.length + 1;
+    case TIME_SYNC:
+    case TIME_DELAY:
+      return JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(4);
+    case NODE_SYNC_REQUEST:
+    case NODE_SYNC_REPLY:
+      // Every node is an object of up to three members inside the subs array
+      return JSON_OBJECT_SIZE(
+          8 + 4 * (header.length / binary::TREE_NODE_SIZE + 1));
+    default:
+      return json::capacity(data + buffer::FRAME_HEADER_SIZE, header.length);
+  }
+}
+#endif
+
 /**
  * Can store any package variant
  *
  * Internally stores packages as a JsonObject. Main use case is to convert
- * different packages from and to Json (using ArduinoJson).
+ * different packages from and to Json (using ArduinoJson). Binary frames (see
+ * protocol::binary) are decoded straight into the JsonObject, without parsing
+ * any json for the known package types.
  */
 class Variant {
  public:
@@ -423,7 +983,7 @@ class Variant {
   /**
    * Create Variant object from a json string
    *
-   * @param json The json string containing a package
+   * @param json The json string or binary frame containing a package
    */
   Variant(std::string json)
 #if ARDUINOJSON_VERSION_MAJOR == 7
@@ -432,15 +992,13 @@ class Variant {
       : jsonBuffer(JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(4) +
                    2 * json.length()) {
 #endif
-    error = deserializeJson(jsonBuffer, json,
-                            DeserializationOption::NestingLimit(255));
-    if (!error) jsonObj = jsonBuffer.as<JsonObject>();
+    parse(json.c_str(), json.length());
   }
 
   /**
    * Create Variant object from a json string
    *
-   * @param json The json string containing a package
+   * @param json The json string or binary frame containing a package
    * @param capacity The capacity to reserve for parsing the string
    */
   Variant(std::string json, size_t capacity)
@@ -449,9 +1007,7 @@ class Variant {
 #else
       : jsonBuffer(capacity) {
 #endif
-    error = deserializeJson(jsonBuffer, json,
-                            DeserializationOption::NestingLimit(255));
-    if (!error) jsonObj = jsonBuffer.as<JsonObject>();
+    parse(json.c_str(), json.length());
   }
 #endif
 
@@ -459,7 +1015,7 @@ class Variant {
   /**
    * Create Variant object from a json string
    *
-   * @param json The json string containing a package
+   * @param json The json string or binary frame containing a package
    */
   Variant(String json)
 #if ARDUINOJSON_VERSION_MAJOR == 7
@@ -468,15 +1024,13 @@ class Variant {
       : jsonBuffer(JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(4) +
                    2 * json.length()) {
 #endif
-    error = deserializeJson(jsonBuffer, json,
-                            DeserializationOption::NestingLimit(255));
-    if (!error) jsonObj = jsonBuffer.as<JsonObject>();
+    parse(json.c_str(), json.length());
   }
 
   /**
    * Create Variant object from a json string
    *
-   * @param json The json string containing a package
+   * @param json The json string or binary frame containing a package
    * @param capacity The capacity to reserve for parsing the string
    */
   Variant(String json, size_t capacity)
@@ -485,11 +1039,25 @@ class Variant {
 #else
       : jsonBuffer(capacity) {
 #endif
-    error = deserializeJson(jsonBuffer, json,
-                            DeserializationOption::NestingLimit(255));
-    if (!error) jsonObj = jsonBuffer.as<JsonObject>();
+    parse(json.c_str(), json.length());
   }
 #endif
+
+  /**
+   * Create Variant object from a json string or binary frame in place
+   *
+   * @param data The json string or binary frame containing a package
+   * @param length Length of data
+   */
+  Variant(const char* data, size_t length)
+#if ARDUINOJSON_VERSION_MAJOR == 7
+      : jsonBuffer() {
+#else
+      : jsonBuffer(capacity(data, length)) {
+#endif
+    parse(data, length);
+  }
+
   /**
    * Create Variant object from any package implementing PackageInterface
    */
@@ -640,13 +1208,7 @@ class Variant {
 #endif
       return (router::Type)jsonObj["routing"].as<int>();
 
-    auto type = this->type();
-    if (type == SINGLE || type == TIME_DELAY) return router::SINGLE;
-    if (type == BROADCAST) return router::BROADCAST;
-    if (type == NODE_SYNC_REQUEST || type == NODE_SYNC_REPLY ||
-        type == TIME_SYNC)
-      return router::NEIGHBOUR;
-    return router::ROUTING_ERROR;
+    return routingOf(type());
   }
 
   /**
@@ -689,6 +1251,16 @@ class Variant {
   }
 #endif
 
+  /**
+   * Encode the package for a connection using the given encoding
+   *
+   * Falls back to json if the package is too large for a binary frame
+   */
+  void encodeTo(TSTRING& str, Encoding encoding) {
+    if (encoding == ENCODING_BINARY && encodeBinary(str)) return;
+    printTo(str);
+  }
+
   DeserializationError error = DeserializationError::Ok;
 
  private:
@@ -698,6 +1270,91 @@ class Variant {
   DynamicJsonDocument jsonBuffer;
 #endif
   JsonObject jsonObj;
+
+  void parse(const char* data, size_t length) {
+    if (buffer::isFrame(data, length))
+      decode(data, length);
+    else
+      error = deserializeJson(jsonBuffer, data, length,
+                              DeserializationOption::NestingLimit(255));
+    if (!error) jsonObj = jsonBuffer.as<JsonObject>();
+  }
+
+  template <class T>
+  void fill(const T& pkg) {
+    jsonObj = jsonBuffer.to<JsonObject>();
+    jsonObj = pkg.addTo(std::move(jsonObj));
+#if ARDUINOJSON_VERSION_MAJOR < 7
+    if (jsonBuffer.overflowed()) error = DeserializationError::NoMemory;
+#endif
+  }
+
+  template <class T>
+  bool decodePackage(const Header& header, const char* payload) {
+    T pkg;
+    if (!binary::decode(header, payload, pkg)) return false;
+    fill(pkg);
+    return true;
+  }
+
+  void decode(const char* data, size_t length) {
+    Header header;
+    if (!binary::readHeader(data, length, header)) {
+      error = DeserializationError::InvalidInput;
+      return;
+    }
+    auto payload = data + buffer::FRAME_HEADER_SIZE;
+    bool valid;
+    switch (header.type) {
+      case SINGLE:
+        valid = decodePackage<Single>(header, payload);
+        break;
+      case BROADCAST:
+        valid = decodePackage<Broadcast>(header, payload);
+        break;
+      case TIME_SYNC:
+        valid = decodePackage<TimeSync>(header, payload);
+        break;
+      case TIME_DELAY:
+        valid = decodePackage<TimeDelay>(header, payload);
+        break;
+      case NODE_SYNC_REQUEST:
+        valid = decodePackage<NodeSyncRequest>(header, payload);
+        break;
+      case NODE_SYNC_REPLY:
+        valid = decodePackage<NodeSyncReply>(header, payload);
+        break;
+      default:
+        error = deserializeJson(jsonBuffer, payload, header.length,
+                                DeserializationOption::NestingLimit(255));
+        return;
+    }
+    if (!valid) error = DeserializationError::InvalidInput;
+  }
+
+  bool encodeBinary(TSTRING& str) {
+    switch (type()) {
+      case SINGLE:
+        return binary::encode(to<Single>(), str);
+      case BROADCAST:
+        return binary::encode(to<Broadcast>(), str);
+      case TIME_SYNC:
+        return binary::encode(to<TimeSync>(), str);
+      case TIME_DELAY:
+        return binary::encode(to<TimeDelay>(), str);
+      case NODE_SYNC_REQUEST:
+        return binary::encode(to<NodeSyncRequest>(), str);
+      case NODE_SYNC_REPLY:
+        return binary::encode(to<NodeSyncReply>(), str);
+      default: {
+        TSTRING json;
+        printTo(json);
+        return binary::encode(type(), routing(),
+                              jsonObj["from"].as<uint32_t>(), dest(), json,
+                              str);
+      }
+    }
+  }
 };
 
 template <>
@@ -735,6 +1392,18 @@ inline JsonObject Variant::to<JsonObject>() {
   return jsonObj;
 }
 
+/**
+ * Encode a package for a connection using the given encoding
+ *
+ * Known package types are written as a binary frame directly, without building
+ * a Variant first. Falls back to json if the package is too large for a frame.
+ */
+template <class T>
+inline void encode(const T& package, TSTRING& out, Encoding encoding) {
+  if (encoding == ENCODING_BINARY && binary::encode(package, out)) return;
+  Variant(package).printTo(out);
+}
+
 inline TSTRING NodeTree::toString(bool pretty) {
   TSTRING str;
   auto variant = Variant(*this);
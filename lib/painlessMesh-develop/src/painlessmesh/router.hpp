@@ -18,64 +18,75 @@ namespace painlessmesh {
  */
 namespace router {
 template <class T>
-std::shared_ptr<T> findRoute(layout::Layout<T> tree,
+std::shared_ptr<T> findRoute(layout::Layout<T>& tree,
                              std::function<bool(std::shared_ptr<T>)> func) {
   auto route = std::find_if(tree.subs.begin(), tree.subs.end(), func);
   if (route == tree.subs.end()) return NULL;
   return (*route);
 }
 
+/**
+ * The sub to send packages for nodeId to, looked up in the routing table
+ */
 template <class T>
-std::shared_ptr<T> findRoute(layout::Layout<T> tree, uint32_t nodeId) {
-  return findRoute<T>(tree, [nodeId](std::shared_ptr<T> s) {
-    return layout::contains((*s), nodeId);
-  });
+std::shared_ptr<T> findRoute(layout::Layout<T>& tree, uint32_t nodeId) {
+  auto route = tree.routes.find(nodeId);
+  if (route == tree.routes.end()) return NULL;
+  return route->second;
 }
 
 template <class T, class U>
 bool send(T package, std::shared_ptr<U> conn, bool priority = false) {
-  auto variant = painlessmesh::protocol::Variant(package);
   TSTRING msg;
-  variant.printTo(msg);
-  return conn->addMessage(msg, priority);
+  protocol::encode(package, msg, conn->encoding);
+  return conn->addMessage(buffer::share(std::move(msg)), priority);
 }
 
 template <class U>
 bool send(protocol::Variant variant, std::shared_ptr<U> conn,
           bool priority = false) {
   TSTRING msg;
-  variant.printTo(msg);
-  return conn->addMessage(msg, priority);
+  variant.encodeTo(msg, conn->encoding);
+  return conn->addMessage(buffer::share(std::move(msg)), priority);
 }
 
 template <class T, class U>
-bool send(T package, layout::Layout<U> layout) {
-  auto variant = painlessmesh::protocol::Variant(package);
+bool send(T package, layout::Layout<U>& layout) {
+  auto conn = findRoute<U>(layout, package.dest);
+  if (!conn) return false;
   TSTRING msg;
-  variant.printTo(msg);
-  auto conn = findRoute<U>(layout, variant.dest());
-  if (conn) return conn->addMessage(msg);
-  return false;
+  protocol::encode(package, msg, conn->encoding);
+  return conn->addMessage(buffer::share(std::move(msg)));
 }
 
 template <class U>
-bool send(protocol::Variant variant, layout::Layout<U> layout) {
-  TSTRING msg;
-  variant.printTo(msg);
+bool send(protocol::Variant variant, layout::Layout<U>& layout) {
   auto conn = findRoute<U>(layout, variant.dest());
-  if (conn) return conn->addMessage(msg);
-  return false;
+  if (!conn) return false;
+  TSTRING msg;
+  variant.encodeTo(msg, conn->encoding);
+  return conn->addMessage(buffer::share(std::move(msg)));
 }
 
+/**
+ * Send the package to all neighbours, except exclude
+ *
+ * The package is encoded at most once for each encoding in use, and all
+ * neighbours using that encoding share the same message
+ */
 template <class T, class U>
-size_t broadcast(T package, layout::Layout<U> layout, uint32_t exclude) {
-  auto variant = painlessmesh::protocol::Variant(package);
-  TSTRING msg;
-  variant.printTo(msg);
+size_t broadcast(T package, layout::Layout<U>& layout, uint32_t exclude) {
+  buffer::SharedMessage msg[2];
   size_t i = 0;
   for (auto&& conn : layout.subs) {
     if (conn->nodeId != 0 && conn->nodeId != exclude) {
-      auto sent = conn->addMessage(msg);
+      auto& shared = msg[conn->encoding];
+      if (!shared) {
+        TSTRING encoded;
+        protocol::encode(package, encoded, conn->encoding);
+        shared = buffer::share(std::move(encoded));
+      }
+      auto sent = conn->addMessage(shared);
       if (sent) ++i;
     }
   }
@@ -83,58 +94,83 @@ size_t broadcast(T package, layout::Layout<U> layout, uint32_t exclude) {
 }
 
 template <class T>
-size_t broadcast(protocol::Variant variant, layout::Layout<T> layout,
+size_t broadcast(protocol::Variant variant, layout::Layout<T>& layout,
                  uint32_t exclude) {
-  TSTRING msg;
-  variant.printTo(msg);
+  buffer::SharedMessage msg[2];
   size_t i = 0;
   for (auto&& conn : layout.subs) {
     if (conn->nodeId != 0 && conn->nodeId != exclude) {
-      auto sent = conn->addMessage(msg);
+      auto& shared = msg[conn->encoding];
+      if (!shared) {
+        TSTRING encoded;
+        variant.encodeTo(encoded, conn->encoding);
+        shared = buffer::share(std::move(encoded));
+      }
+      auto sent = conn->addMessage(shared);
       if (sent) ++i;
     }
   }
   return i;
 }
 
+/**
+ * Route a package received from connection, read in place
+ *
+ * data has to stay valid, and unchanged, until routePackage returns: it is
+ * used by every callback. Only a package forwarded unchanged is copied, into the
+ * message queued on the next hop.
+ */
 template <class T>
-void routePackage(layout::Layout<T> layout, std::shared_ptr<T> connection,
-                  TSTRING pkg, callback::MeshPackageCallbackList<T> cbl, uint32_t receivedAt) {
+void routePackage(layout::Layout<T>& layout, std::shared_ptr<T> connection,
+                  const char* data, size_t length,
+                  callback::MeshPackageCallbackList<T> cbl, uint32_t receivedAt) {
   using namespace logger;
-  static size_t baseCapacity = 512;
-  Log(COMMUNICATION, "routePackage(): Recvd from %u: %s\n", connection->nodeId,
-      pkg.c_str());
-  // Using a ptr so we can overwrite it if we need to grow capacity.
-  // Bug in copy constructor with grown capacity can cause segmentation fault
-  auto variant =
-      std::make_shared<protocol::Variant>(pkg, pkg.length() + baseCapacity);
-  while (variant->error == DeserializationError::NoMemory && baseCapacity <= 20480) {
-    // Not enough memory, adapt scaling (variant::capacityScaling) and log the
-    // new value
-    Log(DEBUG,
-        "routePackage(): parsing failed. err=%u, increasing capacity: %u\n",
-        variant->error, baseCapacity);
-    baseCapacity += 256;
-    variant =
-        std::make_shared<protocol::Variant>(pkg, pkg.length() + baseCapacity);
+  if (buffer::isFrame(data, length)) {
+    Log(COMMUNICATION, "routePackage(): Recvd from %u: frame of %u bytes\n",
+        connection->nodeId, length);
+  } else {
+    Log(COMMUNICATION, "routePackage(): Recvd from %u: %s\n",
+        connection->nodeId, data);
+  }
+  protocol::Header header;
+  if (protocol::readHeader(data, length, header) &&
+      header.routing == SINGLE && header.dest != layout.getNodeId()) {
+    // Send on the original bytes if the next hop reads the same encoding
+    auto conn = findRoute<T>(layout, header.dest);
+    if (!conn) return;
+    if (conn->encoding == header.encoding) {
+      TSTRING pkg;
+      buffer::append(pkg, data, length);
+      conn->addMessage(buffer::share(std::move(pkg)));
+      return;
+    }
   }
-  if (variant->error) {
+  protocol::Variant variant(data, length);
+  if (variant.error) {
     Log(ERROR,
-        "routePackage(): parsing failed. err=%u, total_length=%d, data=%s<--\n",
-        variant->error, pkg.length(), pkg.c_str());
+        "routePackage(): parsing failed. err=%s, total_length=%d, data=%s<--\n",
+        variant.error.c_str(), length, data);
     return;
   }
 
-  if (variant->routing() == SINGLE && variant->dest() != layout.getNodeId()) {
-    // Send on without further processing
-    send<T>((*variant), layout);
+  if (variant.routing() == SINGLE && variant.dest() != layout.getNodeId()) {
+    // Header did not scan, send on after all
+    send<T>(variant, layout);
     return;
-  } else if (variant->routing() == BROADCAST) {
-    broadcast<T>((*variant), layout, connection->nodeId);
+  } else if (variant.routing() == BROADCAST) {
+    broadcast<T>(variant, layout, connection->nodeId);
   }
-  auto calls = cbl.execute(variant->type(), (*variant), connection, receivedAt);
+  // A callback may close the connection, which releases data
+  auto calls = cbl.execute(variant.type(), variant, connection, receivedAt);
   if (calls == 0)
-    Log(DEBUG, "routePackage(): No callbacks executed; %u, %s\n", variant->type(), pkg.c_str());
+    Log(DEBUG, "routePackage(): No callbacks executed; %u\n", variant.type());
+}
+
+template <class T>
+void routePackage(layout::Layout<T>& layout, std::shared_ptr<T> connection,
+                  TSTRING pkg, callback::MeshPackageCallbackList<T> cbl, uint32_t receivedAt) {
+  routePackage<T>(layout, connection, pkg.c_str(), pkg.length(), cbl,
+                  receivedAt);
 }
 
 template <class T, class U>
@@ -186,6 +222,7 @@ void handleNodeSync(T& mesh, protocol::NodeTree newTree,
   }
 
   if (conn->updateSubs(newTree)) {
+    mesh.updateRoutes(conn);
     auto nodeId = newTree.nodeId;
     mesh.addTask([&mesh, nodeId]() {
       mesh.changedConnectionCallbacks.execute(nodeId);
@@ -196,6 +233,44 @@ void handleNodeSync(T& mesh, protocol::NodeTree newTree,
   }
 }
 
+/**
+ * Handle a node sync package that can carry only the changes to the tree
+ *
+ * A package with base 0 holds the full tree. Otherwise the tree is rebuilt
+ * from the tree we hold for the connection, and if nothing changed the sync
+ * is short-circuited.
+ *
+ * \return false if the changes could not be applied
+ */
+template <class T, class U>
+bool receiveNodeSync(T& mesh, const protocol::NodeSyncRequest& pkg,
+                     std::shared_ptr<U> conn) {
+  if (pkg.base == 0) {
+    handleNodeSync<T, U>(mesh, pkg, conn);
+    return true;
+  }
+
+  if (!conn->newConnection && pkg.base == pkg.hash && pkg.remove.empty() &&
+      pkg.add.empty() && pkg.nodeId == conn->nodeId &&
+      pkg.root == conn->root && pkg.hash == conn->treeHash) {
+    Log(logger::SYNC, "receiveNodeSync(): in sync with %u\n", conn->nodeId);
+    conn->nodeSyncTask.delay();
+    mesh.stability += std::min(1000 - mesh.stability, (size_t)25);
+    return true;
+  }
+
+  protocol::NodeTree newTree;
+  if (!conn->resolve(pkg, newTree)) {
+    // Our next package tells the neighbour we hold another tree, after which
+    // it sends the full tree
+    Log(logger::SYNC, "receiveNodeSync(): unable to apply changes from %u\n",
+        conn->nodeId);
+    return false;
+  }
+  handleNodeSync<T, U>(mesh, std::move(newTree), conn);
+  return true;
+}
+
 template <class T, typename U>
 callback::MeshPackageCallbackList<U> addPackageCallback(
     callback::MeshPackageCallbackList<U>&& callbackList, T& mesh) {
@@ -205,9 +280,12 @@ callback::MeshPackageCallbackList<U> addPackageCallback(
       [&mesh](protocol::Variant variant, std::shared_ptr<U> connection,
               uint32_t receivedAt) {
         auto newTree = variant.to<protocol::NodeSyncRequest>();
-        handleNodeSync<T, U>(mesh, newTree, connection);
-        send<protocol::NodeSyncReply>(
-            connection->reply(std::move(mesh.asNodeTree())), connection, true);
+        connection->encoding = newTree.binary ? protocol::ENCODING_BINARY
+                                              : protocol::ENCODING_JSON;
+        connection->confirm(newTree);
+        receiveNodeSync<T, U>(mesh, newTree, connection);
+        send<protocol::NodeSyncReply>(connection->reply(mesh), connection,
+                                      true);
         return false;
       });
 
@@ -217,7 +295,13 @@ callback::MeshPackageCallbackList<U> addPackageCallback(
       [&mesh](protocol::Variant variant, std::shared_ptr<U> connection,
               uint32_t receivedAt) {
         auto newTree = variant.to<protocol::NodeSyncReply>();
-        handleNodeSync<T, U>(mesh, newTree, connection);
+        connection->encoding = newTree.binary ? protocol::ENCODING_BINARY
+                                              : protocol::ENCODING_JSON;
+        auto confirmed = connection->confirm(newTree);
+        // The neighbour did not take the tree we sent, send it in full
+        if (!confirmed) connection->resetSync();
+        if (!receiveNodeSync<T, U>(mesh, newTree, connection) || !confirmed)
+          connection->nodeSyncTask.forceNextIteration();
         connection->timeOutTask.disable();
         return false;
       });
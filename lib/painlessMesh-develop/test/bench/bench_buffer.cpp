@@ -0,0 +1,216 @@
+/**
+ * Throughput of the mesh connection buffers
+ *
+ * Compares the MessageRing based ReceiveBuffer and the SentBuffer of shared
+ * messages with the previous std::list<std::string> implementation, copied
+ * below, on the traffic of a busy connection: a stream of messages split over
+ * TCP_MSS sized reads and writes. The broadcast case queues every message on
+ * the send buffers of several neighbours.
+ */
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <list>
+#include <random>
+
+#include "catch2/catch.hpp"
+
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include "ArduinoJson.h"
+#undef ARDUINOJSON_ENABLE_ARDUINO_STRING
+#undef PAINLESSMESH_ENABLE_ARDUINO_STRING
+#define PAINLESSMESH_ENABLE_STD_STRING
+typedef std::string TSTRING;
+
+#include "painlessmesh/buffer.hpp"
+
+using namespace painlessmesh::buffer;
+
+namespace legacy {
+
+class ReceiveBuffer {
+ public:
+  void push(const char *cstr, size_t length, temp_buffer_t &buf) {
+    auto data_ptr = cstr;
+    do {
+      auto len = strnlen(data_ptr, length);
+      do {
+        auto read_len = std::min(len, buf.length);
+        memcpy(buf.buffer, data_ptr, read_len);
+        buf.buffer[read_len] = '\0';
+        auto newBuffer = std::string(buf.buffer);
+        buffer.append(newBuffer);
+        len -= newBuffer.length();
+        length -= newBuffer.length();
+        data_ptr += newBuffer.length() * sizeof(char);
+      } while (len > 0);
+      if (length > 0) {
+        length -= 1;
+        data_ptr += 1 * sizeof(char);
+        if (buffer.length() > 0) {
+          jsonStrings.push_back(buffer);
+          buffer = std::string();
+        }
+      }
+    } while (length > 0);
+  }
+  std::string front() { return jsonStrings.front(); }
+  void pop_front() { jsonStrings.pop_front(); }
+  bool empty() { return jsonStrings.empty(); }
+
+ private:
+  std::string buffer;
+  std::list<std::string> jsonStrings;
+};
+
+class SentBuffer {
+ public:
+  void push(std::string message) { jsonStrings.push_back(message); }
+  size_t requestLength(size_t buffer_length) {
+    if (jsonStrings.empty()) return 0;
+    return std::min(buffer_length - 1, jsonStrings.begin()->length() + 1);
+  }
+  const char *readPtr(size_t length) {
+    last_read_size = length;
+    return jsonStrings.front().c_str();
+  }
+  void freeRead() {
+    if (last_read_size == jsonStrings.begin()->length() + 1)
+      jsonStrings.pop_front();
+    else
+      jsonStrings.begin()->erase(0, last_read_size);
+    last_read_size = 0;
+  }
+  bool empty() { return jsonStrings.empty(); }
+
+ private:
+  size_t last_read_size = 0;
+  std::list<std::string> jsonStrings;
+};
+
+}  // namespace legacy
+
+static const size_t kMessages = 64;
+
+// A stream of '\0' delimited messages of mesh-typical sizes
+static std::string makeStream(std::vector<std::string> &messages) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> size(100, 1500);
+  std::string stream;
+  for (size_t i = 0; i < kMessages; ++i) {
+    std::string msg(size(gen), 'x');
+    for (auto &&c : msg) c = (char)('A' + gen() % 26);
+    messages.push_back(msg);
+    stream += msg;
+    stream += '\0';
+  }
+  return stream;
+}
+
+template <class Buffer>
+size_t receiveAll(Buffer &buffer, const std::string &stream,
+                  temp_buffer_t &tmp) {
+  size_t bytes = 0;
+  for (size_t pos = 0; pos < stream.size(); pos += TCP_MSS) {
+    auto len = std::min<size_t>(TCP_MSS, stream.size() - pos);
+    buffer.push(stream.data() + pos, len, tmp);
+    while (!buffer.empty()) {
+      bytes += buffer.front().size();
+      buffer.pop_front();
+    }
+  }
+  return bytes;
+}
+
+template <class Buffer>
+size_t sendAll(Buffer &buffer, const std::vector<std::string> &messages,
+               temp_buffer_t &tmp) {
+  size_t bytes = 0;
+  for (auto &&msg : messages) buffer.push(msg);
+  while (!buffer.empty()) {
+    auto len = buffer.requestLength(tmp.length);
+    auto ptr = buffer.readPtr(len);
+    bytes += len + (ptr[0] != 0);
+    buffer.freeRead();
+  }
+  return bytes;
+}
+
+TEST_CASE("Mesh buffer throughput") {
+  std::vector<std::string> messages;
+  auto stream = makeStream(messages);
+  temp_buffer_t tmp;
+
+  legacy::ReceiveBuffer legacyReceive;
+  ReceiveBuffer<std::string> ringReceive;
+  REQUIRE(receiveAll(legacyReceive, stream, tmp) ==
+          receiveAll(ringReceive, stream, tmp));
+
+  BENCHMARK("receive, std::list<std::string>") {
+    return receiveAll(legacyReceive, stream, tmp);
+  };
+  BENCHMARK("receive, MessageRing") {
+    return receiveAll(ringReceive, stream, tmp);
+  };
+
+  // Zero-copy: read messages in place instead of constructing strings
+  BENCHMARK("receive, MessageRing in place") {
+    size_t bytes = 0;
+    for (size_t pos = 0; pos < stream.size(); pos += TCP_MSS) {
+      auto len = std::min<size_t>(TCP_MSS, stream.size() - pos);
+      ringReceive.push(stream.data() + pos, len);
+      while (!ringReceive.empty()) {
+        bytes += ringReceive.frontLength();
+        ringReceive.pop_front();
+      }
+    }
+    return bytes;
+  };
+
+  legacy::SentBuffer legacySent;
+  SentBuffer<std::string> ringSent;
+  REQUIRE(sendAll(legacySent, messages, tmp) ==
+          sendAll(ringSent, messages, tmp));
+
+  BENCHMARK("send, std::list<std::string>") {
+    return sendAll(legacySent, messages, tmp);
+  };
+  BENCHMARK("send, SentBuffer") { return sendAll(ringSent, messages, tmp); };
+}
+
+template <class Buffer, class Message>
+size_t broadcastAll(std::vector<Buffer> &buffers,
+                    const std::vector<Message> &messages, temp_buffer_t &tmp) {
+  size_t bytes = 0;
+  for (auto &&msg : messages)
+    for (auto &&buffer : buffers) buffer.push(msg);
+  for (auto &&buffer : buffers) {
+    while (!buffer.empty()) {
+      auto len = buffer.requestLength(tmp.length);
+      buffer.readPtr(len);
+      bytes += len;
+      buffer.freeRead();
+    }
+  }
+  return bytes;
+}
+
+TEST_CASE("Broadcast to 8 neighbours") {
+  std::vector<std::string> messages;
+  makeStream(messages);
+  std::vector<SharedMessage> shared;
+  for (auto &&msg : messages) shared.push_back(share(std::string(msg)));
+  temp_buffer_t tmp;
+
+  std::vector<legacy::SentBuffer> legacySent(8);
+  std::vector<SentBuffer<std::string>> sharedSent(8);
+  REQUIRE(broadcastAll(legacySent, messages, tmp) ==
+          broadcastAll(sharedSent, shared, tmp));
+
+  BENCHMARK("broadcast, copy per neighbour") {
+    return broadcastAll(legacySent, messages, tmp);
+  };
+  BENCHMARK("broadcast, shared message") {
+    return broadcastAll(sharedSent, shared, tmp);
+  };
+}
@@ -0,0 +1,81 @@
+/**
+ * Cost of serializing and parsing mesh packages
+ *
+ * Compares the json encoding with the binary frames (protocol::binary) for the
+ * common package types, and the cost of the routing decision for a package
+ * that is only passed on (full parse versus reading just the header).
+ */
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include "catch2/catch.hpp"
+
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include "ArduinoJson.h"
+#undef ARDUINOJSON_ENABLE_ARDUINO_STRING
+typedef std::string TSTRING;
+
+#include "catch_utils.hpp"
+#include "painlessmesh/protocol.hpp"
+
+using namespace painlessmesh::protocol;
+
+template <class T>
+void benchmarkPackage(const char *name, const T &pkg) {
+  std::string json;
+  std::string frame;
+  encode(pkg, json, ENCODING_JSON);
+  encode(pkg, frame, ENCODING_BINARY);
+  REQUIRE(!Variant(json).error);
+  REQUIRE(!Variant(frame).error);
+
+  BENCHMARK(std::string(name) + ", serialize json") {
+    std::string str;
+    encode(pkg, str, ENCODING_JSON);
+    return str;
+  };
+  BENCHMARK(std::string(name) + ", serialize binary") {
+    std::string str;
+    encode(pkg, str, ENCODING_BINARY);
+    return str;
+  };
+  BENCHMARK(std::string(name) + ", parse json") {
+    return Variant(json).to<T>();
+  };
+  BENCHMARK(std::string(name) + ", parse binary") {
+    return Variant(frame).to<T>();
+  };
+}
+
+TEST_CASE("Package encoding") {
+  benchmarkPackage("Single 64B", createSingle(64));
+  benchmarkPackage("Single 1kB", createSingle(1024));
+  benchmarkPackage("TimeSync", createTimeSync(2));
+  benchmarkPackage("NodeSyncReply 50 nodes", createNodeSyncReply(50));
+}
+
+TEST_CASE("Routing decision for a package that is passed on") {
+  auto pkg = createSingle(256);
+  std::string json;
+  std::string frame;
+  encode(pkg, json, ENCODING_JSON);
+  encode(pkg, frame, ENCODING_BINARY);
+
+  BENCHMARK("json, parse package") {
+    auto variant = Variant(json);
+    return variant.routing() == painlessmesh::router::SINGLE &&
+           variant.dest() == pkg.dest;
+  };
+  BENCHMARK("json, read header") {
+    Header header;
+    readHeader(json.c_str(), json.length(), header);
+    return header.routing == painlessmesh::router::SINGLE &&
+           header.dest == pkg.dest;
+  };
+  BENCHMARK("binary, read header") {
+    Header header;
+    binary::readHeader(frame.c_str(), frame.length(), header);
+    return header.routing == painlessmesh::router::SINGLE &&
+           header.dest == pkg.dest;
+  };
+}
@@ -0,0 +1,80 @@
+/**
+ * Cost of finding the route for a package in a 100 node mesh
+ *
+ * Compares the lookup in the routing table (Layout::routes) with the previous
+ * findRoute, copied below, that searched the tree of every sub in a copy of
+ * the layout.
+ */
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include "catch2/catch.hpp"
+
+#include <Arduino.h>
+
+#include "catch_utils.hpp"
+
+#include "painlessmesh/router.hpp"
+
+using namespace painlessmesh;
+
+logger::LogClass Log;
+
+class BenchConnection : public layout::Neighbour {
+ public:
+  bool addMessage(buffer::SharedMessage msg, bool priority = false) {
+    return !msg->empty();
+  }
+};
+
+class BenchLayout : public layout::Layout<BenchConnection> {
+ public:
+  BenchLayout(uint32_t id) { nodeId = id; }
+};
+
+namespace legacy {
+template <class T>
+std::shared_ptr<T> findRoute(layout::Layout<T> tree, uint32_t nodeId) {
+  auto route = std::find_if(
+      tree.subs.begin(), tree.subs.end(),
+      [nodeId](std::shared_ptr<T> s) { return layout::contains((*s), nodeId); });
+  if (route == tree.subs.end()) return NULL;
+  return (*route);
+}
+}  // namespace legacy
+
+TEST_CASE("Routing in a 100 node mesh") {
+  // Four neighbours, each with a random tree, 100 nodes in total
+  auto mesh = BenchLayout(1);
+  std::vector<uint32_t> nodes;
+  for (auto i = 0; i < 4; ++i) {
+    auto conn = std::make_shared<BenchConnection>();
+    conn->updateSubs(createNodeTree(i < 3 ? 25 : 24, -1));
+    mesh.subs.push_back(conn);
+    mesh.updateRoutes(conn);
+    for (auto&& id : layout::asList(*conn)) nodes.push_back(id);
+  }
+  REQUIRE(nodes.size() == 99);
+  for (auto&& id : nodes)
+    REQUIRE(router::findRoute<BenchConnection>(mesh, id) ==
+            legacy::findRoute<BenchConnection>(mesh, id));
+
+  size_t i = 0;
+  BENCHMARK("legacy, findRoute") {
+    return legacy::findRoute<BenchConnection>(mesh, nodes[++i % nodes.size()]);
+  };
+  BENCHMARK("routing table, findRoute") {
+    return router::findRoute<BenchConnection>(mesh, nodes[++i % nodes.size()]);
+  };
+
+  auto pkg = createSingle(64);
+  BENCHMARK("routing table, send Single") {
+    pkg.dest = nodes[++i % nodes.size()];
+    return router::send(pkg, mesh);
+  };
+
+  BENCHMARK("update routes after a node sync") {
+    mesh.updateRoutes(mesh.subs.front());
+    return mesh.routes.size();
+  };
+}
@@ -0,0 +1,173 @@
+/**
+ * Node sync traffic until a mesh over localhost converges after a change
+ *
+ * Counts the node sync packages and the tree nodes they carry while a node
+ * joins and leaves a 20 node mesh, next to the number of tree nodes the same
+ * packages would carry if every package held the full tree.
+ */
+#define CATCH_CONFIG_MAIN
+
+#include "catch2/catch.hpp"
+
+#include "Arduino.h"
+
+#include "catch_utils.hpp"
+
+#include "boost/asynctcp.hpp"
+
+WiFiClass WiFi;
+ESPClass ESP;
+
+#include "painlessmesh/mesh.hpp"
+
+using PMesh = painlessmesh::Mesh<painlessmesh::Connection>;
+
+using namespace painlessmesh;
+painlessmesh::logger::LogClass Log;
+
+struct SyncStats {
+  size_t packages = 0;
+  size_t nodes = 0;
+  size_t fullNodes = 0;
+};
+
+class MeshTest : public PMesh {
+ public:
+  MeshTest(Scheduler *scheduler, size_t id, boost::asio::io_service &io,
+           SyncStats &stats)
+      : io_service(io) {
+    this->nodeId = id;
+    this->init(scheduler, this->nodeId);
+    pServer = std::make_shared<AsyncServer>(io_service, this->nodeId);
+    painlessmesh::tcp::initServer<painlessmesh::Connection, PMesh>(*pServer,
+                                                                   (*this));
+    count<protocol::NodeSyncRequest>(protocol::NODE_SYNC_REQUEST, stats);
+    count<protocol::NodeSyncReply>(protocol::NODE_SYNC_REPLY, stats);
+  }
+
+  void connect(MeshTest &mesh) {
+    auto pClient = new AsyncClient(io_service);
+    painlessmesh::tcp::connect<Connection, PMesh>(
+        (*pClient), boost::asio::ip::address::from_string("127.0.0.1"),
+        mesh.nodeId, (*this));
+  }
+
+  std::shared_ptr<AsyncServer> pServer;
+  boost::asio::io_service &io_service;
+
+ protected:
+  // Runs after the node sync handlers, so the connection holds the full tree
+  template <class P>
+  void count(int type, SyncStats &stats) {
+    this->callbackList.onPackage(
+        type, [&stats](protocol::Variant variant,
+                       std::shared_ptr<Connection> connection, uint32_t) {
+          auto pkg = variant.to<P>();
+          ++stats.packages;
+          if (pkg.base == 0) {
+            stats.nodes += layout::size(pkg);
+            stats.fullNodes += layout::size(pkg);
+            return false;
+          }
+          stats.nodes += 1 + pkg.remove.size();
+          for (auto &&tree : pkg.add) stats.nodes += layout::size(tree);
+          stats.fullNodes += layout::size(*connection);
+          return false;
+        });
+  }
+};
+
+class Nodes {
+ public:
+  Nodes(Scheduler *scheduler, size_t n, boost::asio::io_service &io,
+        SyncStats &stats)
+      : io_service(io) {
+    for (size_t i = 0; i < n; ++i) {
+      auto m = std::make_shared<MeshTest>(scheduler, i + baseID, io_service,
+                                          stats);
+      if (i > 0) m->connect((*nodes[runif(0, i - 1)]));
+      nodes.push_back(m);
+    }
+  }
+  void update() {
+    for (auto &&m : nodes) {
+      m->update();
+      io_service.poll();
+    }
+  }
+
+  void stop() {
+    for (auto &&m : nodes) m->stop();
+  }
+
+  bool converged(size_t n, size_t size) {
+    for (size_t i = 0; i < n; ++i) {
+      if (layout::size(nodes[i]->asNodeTree()) != size) return false;
+    }
+    return true;
+  }
+
+  size_t baseID = 6481;
+  std::vector<std::shared_ptr<MeshTest>> nodes;
+  boost::asio::io_service &io_service;
+};
+
+TEST_CASE("Node sync traffic while a node joins and leaves a 20 node mesh") {
+  using namespace logger;
+  Log.setLogLevel(ERROR);
+
+  Scheduler scheduler;
+  boost::asio::io_service io_service;
+  SyncStats stats;
+  const size_t dim = 20;
+  Nodes n(&scheduler, dim, io_service, stats);
+
+  for (auto i = 0; i < 1000 && !n.converged(dim, dim); ++i) {
+    n.update();
+    delay(10);
+  }
+  REQUIRE(n.converged(dim, dim));
+  printf("%-8s %10s %10s %12s %12s\n", "change", "updates", "packages",
+         "tree nodes", "full trees");
+  printf("%-8s %10s %10zu %12zu %12zu\n", "form", "", stats.packages,
+         stats.nodes, stats.fullNodes);
+
+  // Let the syncs that are still in flight settle
+  for (auto i = 0; i < 100; ++i) {
+    n.update();
+    delay(10);
+  }
+
+  stats = SyncStats();
+  auto joined = std::make_shared<MeshTest>(&scheduler, n.baseID + dim,
+                                           io_service, stats);
+  joined->connect((*n.nodes[runif(0, dim - 1)]));
+  n.nodes.push_back(joined);
+  size_t updates = 0;
+  for (; updates < 1000 && !n.converged(dim + 1, dim + 1); ++updates) {
+    n.update();
+    delay(10);
+  }
+  REQUIRE(n.converged(dim + 1, dim + 1));
+  printf("%-8s %10zu %10zu %12zu %12zu\n", "join", updates, stats.packages,
+         stats.nodes, stats.fullNodes);
+  REQUIRE(stats.nodes < stats.fullNodes);
+
+  for (auto i = 0; i < 100; ++i) {
+    n.update();
+    delay(10);
+  }
+
+  stats = SyncStats();
+  joined->stop();
+  for (updates = 0; updates < 1000 && !n.converged(dim, dim); ++updates) {
+    n.update();
+    delay(10);
+  }
+  REQUIRE(n.converged(dim, dim));
+  printf("%-8s %10zu %10zu %12zu %12zu\n", "leave", updates, stats.packages,
+         stats.nodes, stats.fullNodes);
+  REQUIRE(stats.nodes < stats.fullNodes);
+
+  n.stop();
+}
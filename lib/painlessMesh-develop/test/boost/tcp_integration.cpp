@@ -171,6 +171,29 @@ SCENARIO("We can send a message using our Nodes class") {
   n.stop();
 }
 
+SCENARIO("Neighbours switch to binary frames after the first node sync") {
+  delay(1000);
+  using namespace logger;
+  Log.setLogLevel(ERROR);
+
+  Scheduler scheduler;
+  boost::asio::io_service io_service;
+  Nodes n(&scheduler, 6, io_service);
+
+  for (auto i = 0; i < 1000; ++i) {
+    n.update();
+    delay(10);
+  }
+
+  REQUIRE(layout::size(n.nodes[0]->asNodeTree()) == 6);
+  for (auto &&node : n.nodes) {
+    for (auto &&conn : node->subs) {
+      REQUIRE(conn->encoding == protocol::ENCODING_BINARY);
+    }
+  }
+  n.stop();
+}
+
 SCENARIO("Time sync works") {
   using namespace logger;
   Log.setLogLevel(ERROR);
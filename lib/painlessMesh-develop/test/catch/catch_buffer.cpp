@@ -1,5 +1,7 @@
 #define CATCH_CONFIG_MAIN
 
+#include <list>
+
 #include "catch2/catch.hpp"
 
 #define ARDUINOJSON_USE_LONG_LONG 1
@@ -15,6 +17,18 @@ typedef std::string TSTRING;
 
 using namespace painlessmesh::buffer;
 
+std::string makeFrame(const std::string &payload, uint32_t length) {
+  std::string frame(FRAME_HEADER_SIZE, 'x');
+  frame[0] = (char)FRAME_MARKER;
+  for (size_t i = 0; i < 4; ++i)
+    frame[FRAME_LENGTH_OFFSET + i] = (char)((length >> (8 * i)) & 0xFF);
+  return frame + payload;
+}
+
+std::string makeFrame(const std::string &payload) {
+  return makeFrame(payload, payload.length());
+}
+
 SCENARIO("ReceiveBuffer receives strings and needs to process them") {
   temp_buffer_t tmp_buffer;
   char cstring[3 * tmp_buffer.length];
@@ -134,6 +148,100 @@ SCENARIO("ReceiveBuffer receives strings and needs to process them") {
     }
   }
 
+  GIVEN("Several messages in a single push") {
+    REQUIRE(rBuffer.empty());
+    std::string data;
+    std::list<std::string> expected;
+    for (size_t i = 0; i < 10; ++i) {
+      auto msg = randomString(runif(1, 200));
+      expected.push_back(msg);
+      data += msg;
+      data += '\0';
+      // Consecutive delimiters do not create empty messages
+      if (i % 3 == 0) data += '\0';
+    }
+    rBuffer.push(data.c_str(), data.length(), tmp_buffer);
+    THEN("Each can be read in place as a cstring") {
+      REQUIRE(rBuffer.size() == 10);
+      for (auto &&msg : expected) {
+        REQUIRE(rBuffer.frontLength() == msg.length());
+        REQUIRE(std::string(rBuffer.frontPtr()) == msg);
+        rBuffer.pop_front();
+      }
+      REQUIRE(rBuffer.empty());
+    }
+  }
+
+  GIVEN("Data pushed while a message is held through frontPtr") {
+    REQUIRE(rBuffer.empty());
+    auto msg = randomString(runif(1, 200));
+    rBuffer.push(msg.c_str(), msg.length() + 1);
+    const char *held = rBuffer.frontPtr();
+    std::list<std::string> expected;
+    for (size_t i = 0; i < 20; ++i) {
+      auto next = randomString(runif(100, 2 * tmp_buffer.length));
+      rBuffer.push(next.c_str(), next.length() + 1);
+      expected.push_back(next);
+    }
+    THEN("The held message is unchanged until it is popped") {
+      REQUIRE(std::string(held) == msg);
+      REQUIRE(rBuffer.frontLength() == msg.length());
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.size() == expected.size());
+      for (auto &&next : expected) {
+        REQUIRE(std::string(rBuffer.frontPtr()) == next);
+        rBuffer.pop_front();
+      }
+      REQUIRE(rBuffer.empty());
+    }
+    THEN("Clearing the buffer does not free it") {
+      rBuffer.clear();
+      rBuffer.push(msg.c_str(), msg.length() + 1);
+      REQUIRE(std::string(held) == msg);
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.size() == 1);
+      REQUIRE(rBuffer.front() == msg);
+    }
+  }
+
+  GIVEN("Binary frames and json messages pushed one byte at a time") {
+    REQUIRE(rBuffer.empty());
+    auto json1 = randomString(runif(1, 100));
+    auto frame1 = makeFrame(randomString(50) + std::string("\0\0{", 3) +
+                            randomString(50));
+    auto json2 = randomString(runif(1, 100));
+    auto frame2 = makeFrame("");
+    std::string data = json1 + '\0' + frame1 + json2 + '\0' + frame2;
+    for (auto &&c : data) rBuffer.push(&c, 1);
+    THEN("Frames are split by their length, json messages by the '\\0'") {
+      REQUIRE(rBuffer.size() == 4);
+      REQUIRE(rBuffer.front() == json1);
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.frontLength() == frame1.length());
+      REQUIRE(rBuffer.front() == frame1);
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.front() == json2);
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.front() == frame2);
+      rBuffer.pop_front();
+      REQUIRE(rBuffer.empty());
+    }
+  }
+
+  GIVEN("A frame that is too large to keep") {
+    REQUIRE(rBuffer.empty());
+    auto frame = makeFrame(randomString(PAINLESSMESH_FRAME_MAX + 1));
+    auto json = randomString(runif(1, 100));
+    rBuffer.push(frame.c_str(), frame.length() / 2);
+    REQUIRE(rBuffer.empty());
+    std::string data = frame.substr(frame.length() / 2) + json + '\0';
+    rBuffer.push(data.c_str(), data.length());
+    THEN("It is dropped and the next message is kept") {
+      REQUIRE(rBuffer.size() == 1);
+      REQUIRE(rBuffer.front() == json);
+    }
+  }
+
   GIVEN("A buffer with multiple messages") {
     REQUIRE(rBuffer.empty());
     for (size_t i = 0; i < 10; ++i) {
@@ -282,4 +390,220 @@ SCENARIO("SentBuffer receives strings and can be read in parts") {
       REQUIRE(sBuffer.empty());
     }
   }
+
+  GIVEN("A binary frame") {
+    auto frame = makeFrame(randomString(20) + std::string("\0", 1));
+    sBuffer.push(frame);
+    THEN("It is sent without a '\\0' delimiter") {
+      auto rlength = sBuffer.requestLength(tmp_buffer.length);
+      REQUIRE(rlength == frame.length());
+      REQUIRE(std::string(sBuffer.readPtr(rlength), rlength) == frame);
+      sBuffer.freeRead();
+      REQUIRE(sBuffer.empty());
+    }
+  }
+
+  GIVEN("Several priority messages pushed while a message is partly sent") {
+    auto msg1 = randomString(2 * tmp_buffer.length);
+    sBuffer.push(msg1);
+    auto rlength = sBuffer.requestLength(tmp_buffer.length);
+    sBuffer.readPtr(rlength);
+    sBuffer.freeRead();
+
+    auto msg2 = randomString(runif(1, 100));
+    auto msgH1 = randomString(runif(1, 100));
+    auto msgH2 = randomString(runif(1, 100));
+    sBuffer.push(msg2);
+    sBuffer.push(msgH1, true);
+    sBuffer.push(msgH2, true);
+    REQUIRE(sBuffer.size() == 4);
+
+    THEN("The partly sent message is finished first, then the priority ones") {
+      std::string sent;
+      while (!sBuffer.empty()) {
+        rlength = sBuffer.requestLength(tmp_buffer.length);
+        sent.append(sBuffer.readPtr(rlength), rlength);
+        sBuffer.freeRead();
+      }
+      REQUIRE(sent.size() == msg1.size() - (tmp_buffer.length - 1) + 1 +
+                                 msgH1.size() + msgH2.size() + msg2.size() +
+                                 3);
+      auto ptr = sent.c_str() + msg1.size() - (tmp_buffer.length - 1) + 1;
+      REQUIRE(std::string(ptr) == msgH1);
+      ptr += msgH1.size() + 1;
+      REQUIRE(std::string(ptr) == msgH2);
+      ptr += msgH2.size() + 1;
+      REQUIRE(std::string(ptr) == msg2);
+    }
+  }
+
+  GIVEN("A message queued on several SentBuffers") {
+    auto msg = share(randomString(3 * tmp_buffer.length));
+    std::vector<SentBuffer<std::string>> buffers(3);
+    for (auto&& buffer : buffers) buffer.push(msg);
+    REQUIRE(msg.use_count() == 4);
+
+    THEN("Each buffer reads it at its own pace without copying it") {
+      std::vector<std::string> sent(buffers.size());
+      for (size_t i = 0; i < buffers.size(); ++i) {
+        auto& buffer = buffers[i];
+        auto offset = 0;
+        while (!buffer.empty()) {
+          // Every buffer uses a different write size
+          auto rlength = buffer.requestLength(100 * (i + 1));
+          auto ptr = buffer.readPtr(rlength);
+          REQUIRE(ptr == msg->c_str() + offset);
+          sent[i].append(ptr, rlength);
+          offset += rlength;
+          buffer.freeRead();
+        }
+      }
+      for (auto&& str : sent)
+        REQUIRE(str == std::string(msg->c_str(), msg->size() + 1));
+      REQUIRE(msg.use_count() == 1);
+    }
+  }
+
+  GIVEN("A message that has been sent by every buffer") {
+    std::vector<SentBuffer<std::string>> buffers(3);
+    auto msg = share(randomString(50));
+    const void* block = msg.get();
+    for (auto&& buffer : buffers) buffer.push(msg);
+    msg.reset();
+    for (auto&& buffer : buffers) buffer.clear();
+
+    THEN("The next message reuses its allocation") {
+      auto next = share(randomString(50));
+      REQUIRE(static_cast<const void*>(next.get()) == block);
+    }
+  }
+}
+
+SCENARIO("MessageRing stores messages contiguously without allocating per message") {
+  MessageRing ring;
+
+  GIVEN("A ring that is filled and drained many times") {
+    std::list<std::string> expected;
+    for (int i = 0; i < 20; ++i) {
+      auto msg = randomString(runif(1, 300));
+      ring.append(msg.c_str(), msg.length());
+      ring.close();
+      expected.push_back(msg);
+    }
+    auto capacity = ring.capacity();
+
+    THEN("Every message can be read in place, across wrap arounds") {
+      for (int i = 0; i < 2000; ++i) {
+        REQUIRE(!ring.empty());
+        REQUIRE(std::string(ring.front(), ring.frontLength()) ==
+                expected.front());
+        ring.pop();
+        expected.pop_front();
+
+        // Replace it with a message of similar length
+        auto msg = randomString(runif(1, 300));
+        ring.append(msg.c_str(), msg.length());
+        ring.close();
+        expected.push_back(msg);
+      }
+      REQUIRE(ring.size() == 20);
+      // A steady stream does not keep growing the arena
+      REQUIRE(ring.capacity() <= capacity + PAINLESSMESH_BUFFER_SLAB * 8);
+    }
+  }
+
+  GIVEN("A message appended in many small parts") {
+    auto msg = randomString(3 * PAINLESSMESH_BUFFER_SLAB + 17);
+    for (size_t i = 0; i < msg.length(); i += 7)
+      ring.append(msg.c_str() + i, std::min<size_t>(7, msg.length() - i));
+    THEN("It only becomes visible when closed") {
+      REQUIRE(ring.empty());
+      REQUIRE(ring.close());
+      REQUIRE(ring.size() == 1);
+      REQUIRE(std::string(ring.front(), ring.frontLength()) == msg);
+    }
+  }
+
+  GIVEN("An open message when the ring wraps") {
+    auto old = randomString(PAINLESSMESH_BUFFER_SLAB - 50);
+    ring.append(old.c_str(), old.length());
+    ring.close();
+    auto capacity = ring.capacity();
+    auto second = randomString(40);
+    ring.append(second.c_str(), second.length());
+    ring.close();
+    ring.pop();
+
+    auto open = randomString(30);
+    ring.append(open.c_str(), open.length());
+    THEN("The open message is moved to the start and stays contiguous") {
+      ring.append(open.c_str(), open.length());
+      REQUIRE(ring.close());
+      REQUIRE(ring.capacity() == capacity);
+      REQUIRE(std::string(ring.front(), ring.frontLength()) == second);
+      ring.pop();
+      REQUIRE(std::string(ring.front(), ring.frontLength()) == open + open);
+    }
+  }
+
+  GIVEN("A partly consumed message") {
+    auto msg = randomString(100);
+    ring.append(msg.c_str(), msg.length());
+    ring.close();
+    ring.consume(40);
+    THEN("The rest of it is at the front") {
+      REQUIRE(std::string(ring.front(), ring.frontLength()) == msg.substr(40));
+      ring.consume(60);
+      REQUIRE(ring.empty());
+    }
+  }
+
+  GIVEN("A held message while the ring grows") {
+    auto msg = randomString(100);
+    ring.append(msg.c_str(), msg.length());
+    ring.close();
+    auto capacity = ring.capacity();
+    const char *held = ring.hold();
+    std::list<std::string> expected;
+    for (int i = 0; i < 50; ++i) {
+      auto next = randomString(runif(100, 300));
+      ring.append(next.c_str(), next.length());
+      ring.close();
+      expected.push_back(next);
+    }
+    REQUIRE(ring.capacity() > capacity);
+    THEN("The held message stays valid until it is popped") {
+      REQUIRE(std::string(held, msg.length()) == msg);
+      ring.pop();
+      for (auto &&next : expected) {
+        REQUIRE(std::string(ring.front(), ring.frontLength()) == next);
+        ring.pop();
+      }
+      REQUIRE(ring.empty());
+    }
+  }
+
+  GIVEN("A held message when the ring is cleared") {
+    auto msg = randomString(100);
+    ring.append(msg.c_str(), msg.length());
+    ring.close();
+    const char *held = ring.hold();
+    ring.clear();
+    auto next = randomString(100);
+    ring.append(next.c_str(), next.length());
+    ring.close();
+    THEN("It is not overwritten and popping it keeps the new message") {
+      REQUIRE(std::string(held, msg.length()) == msg);
+      ring.pop();
+      REQUIRE(ring.size() == 1);
+      REQUIRE(std::string(ring.front(), ring.frontLength()) == next);
+    }
+  }
+
+  GIVEN("Empty messages") {
+    REQUIRE(!ring.close());
+    ring.append("", 1);
+    REQUIRE(!ring.close(1));
+    THEN("They are dropped") { REQUIRE(ring.empty()); }
+  }
 }
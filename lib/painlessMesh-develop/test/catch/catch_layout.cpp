@@ -175,3 +175,153 @@ SCENARIO("A layout neighbour knows when to update its sub") {
   }
 }
 
+
+SCENARIO("The changes to a tree can be found and applied") {
+  GIVEN("A random tree and a changed copy of it") {
+    auto from = createNodeTree(runif(10, 255), -1);
+    auto to = from;
+    to.subs.pop_front();
+    to.subs.push_back(createNodeTree(runif(1, 10), -1));
+    to.subs.back().subs.push_back(createNodeTree(runif(1, 10), 0));
+    if (to.subs.front().subs.size() > 0)
+      to.subs.front().subs.front().root = true;
+
+    THEN("The hash does not depend on the order of the subs") {
+      auto reversed = to;
+      reversed.subs.reverse();
+      REQUIRE(layout::hash(reversed) == layout::hash(to));
+      REQUIRE(layout::hash(from) != layout::hash(to));
+      REQUIRE(layout::hash(protocol::NodeTree(from.nodeId, true)) !=
+              layout::hash(protocol::NodeTree(from.nodeId, false)));
+    }
+
+    THEN("Applying the changes turns one tree into the other") {
+      std::list<uint32_t> remove;
+      std::list<protocol::NodeTree> add;
+      layout::diff(from, to, remove, add);
+      REQUIRE(remove.size() > 0);
+      REQUIRE(add.size() > 0);
+      auto tree = from;
+      REQUIRE(layout::apply(tree, remove, add));
+      REQUIRE(layout::hash(tree) == layout::hash(to));
+      REQUIRE(layout::size(tree) == layout::size(to));
+      REQUIRE(layout::isRooted(tree));
+    }
+
+    THEN("Changes to nodes that are not in the tree are rejected") {
+      auto tree = from;
+      std::list<uint32_t> remove = {to.subs.back().nodeId};
+      REQUIRE(!layout::apply(tree, remove, std::list<protocol::NodeTree>()));
+    }
+  }
+}
+
+class TestLayout : public layout::Layout<layout::Neighbour> {
+ public:
+  TestLayout(uint32_t id) { nodeId = id; }
+};
+
+SCENARIO("Neighbours only send the changes to their tree") {
+  GIVEN("Two nodes that exchanged their full trees") {
+    auto a = TestLayout(1);
+    auto aToB = std::make_shared<layout::Neighbour>();
+    auto other = std::make_shared<layout::Neighbour>();
+    other->updateSubs(createNodeTree(5, -1));
+    auto stays = std::make_shared<layout::Neighbour>();
+    stays->updateSubs(createNodeTree(3, -1));
+    a.subs.push_back(aToB);
+    a.subs.push_back(other);
+    a.subs.push_back(stays);
+    a.updateRoutes(other);
+    a.updateRoutes(stays);
+
+    auto b = TestLayout(2);
+    auto bToA = std::make_shared<layout::Neighbour>();
+    b.subs.push_back(bToA);
+
+    auto request = aToB->request(a);
+    REQUIRE(request.base == 0);
+    REQUIRE(request.hash == layout::hash(a.asNodeTree()));
+    REQUIRE(layout::size(request) == 9);
+    bToA->confirm(request);
+    REQUIRE(bToA->updateSubs(request));
+    b.updateRoutes(bToA);
+
+    auto reply = bToA->reply(b);
+    REQUIRE(reply.base == 0);
+    REQUIRE(reply.known == request.hash);
+    REQUIRE(aToB->confirm(reply));
+    REQUIRE(aToB->updateSubs(reply));
+    a.updateRoutes(aToB);
+
+    WHEN("Nothing changed") {
+      request = aToB->request(a);
+      THEN("The request only tells that the tree is the same") {
+        REQUIRE(request.base == request.hash);
+        REQUIRE(request.subs.empty());
+        REQUIRE(request.remove.empty());
+        REQUIRE(request.add.empty());
+      }
+      REQUIRE(bToA->confirm(request));
+      reply = bToA->reply(b);
+      THEN("The reply only tells that the tree is the same") {
+        REQUIRE(reply.base == reply.hash);
+        REQUIRE(reply.subs.empty());
+        REQUIRE(reply.known == request.hash);
+      }
+    }
+
+    WHEN("A node joins") {
+      auto joined = std::make_shared<layout::Neighbour>();
+      joined->updateSubs(createNodeTree(4, -1));
+      a.subs.push_back(joined);
+      a.updateRoutes(joined);
+      request = aToB->request(a);
+      THEN("Only the new sub is send") {
+        REQUIRE(request.base != 0);
+        REQUIRE(request.subs.empty());
+        REQUIRE(request.remove.empty());
+        REQUIRE(request.add.size() == 1);
+        REQUIRE(request.add.front().nodeId == 1);
+        REQUIRE(layout::size(request.add.front()) == 5);
+      }
+      THEN("The neighbour rebuilds the full tree") {
+        protocol::NodeTree tree;
+        REQUIRE(bToA->resolve(request, tree));
+        REQUIRE(layout::size(tree) == 13);
+        REQUIRE(layout::hash(tree) ==
+                layout::hash(layout::excludeRoute(a.asNodeTree(), 2)));
+      }
+      THEN("Changes on another tree are rejected") {
+        request.base += 1;
+        protocol::NodeTree tree;
+        REQUIRE(!bToA->resolve(request, tree));
+      }
+    }
+
+    WHEN("A node drops") {
+      a.subs.remove(other);
+      a.eraseRoutes(other);
+      request = aToB->request(a);
+      THEN("Only its nodeId is send") {
+        REQUIRE(request.subs.empty());
+        REQUIRE(request.add.empty());
+        REQUIRE(request.remove.size() == 1);
+        REQUIRE(request.remove.front() == other->nodeId);
+        protocol::NodeTree tree;
+        REQUIRE(bToA->resolve(request, tree));
+        REQUIRE(layout::size(tree) == 4);
+      }
+    }
+
+    WHEN("The neighbour does not sync with changes") {
+      reply.hash = 0;
+      aToB->confirm(reply);
+      request = aToB->request(a);
+      THEN("It gets the full tree") {
+        REQUIRE(request.base == 0);
+        REQUIRE(layout::size(request) == 9);
+      }
+    }
+  }
+}
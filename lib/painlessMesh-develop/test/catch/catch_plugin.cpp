@@ -57,7 +57,7 @@ class BCustomPackage : public plugin::BroadcastPackage {
 
 class MockConnection : public layout::Neighbour {
  public:
-  bool addMessage(TSTRING msg) { return true; }
+  bool addMessage(buffer::SharedMessage msg) { return true; }
 };
 
 SCENARIO("We can send a custom package") {
@@ -581,3 +581,305 @@ SCENARIO("Package constructors work as expected", "[protocol]") {
     }
   }
 }
+
+SCENARIO("Packages survive a round trip through a binary frame",
+         "[Variant][protocol][binary]") {
+  GIVEN("A Single package with a message containing '\\0' bytes") {
+    auto pkg = createSingle();
+    pkg.msg += std::string("a\0b\0", 4);
+    std::string frame;
+    REQUIRE(binary::encode(pkg, frame));
+    THEN("The header holds the routing information") {
+      Header header;
+      REQUIRE(binary::readHeader(frame.c_str(), frame.length(), header));
+      REQUIRE(header.type == SINGLE);
+      REQUIRE(header.routing == painlessmesh::router::SINGLE);
+      REQUIRE(header.from == pkg.from);
+      REQUIRE(header.dest == pkg.dest);
+      REQUIRE(header.length == pkg.msg.length());
+    }
+    THEN("A Variant decodes it into the same package") {
+      auto variant = Variant(frame);
+      REQUIRE(!variant.error);
+      REQUIRE(variant.is<Single>());
+      REQUIRE(variant.routing() == painlessmesh::router::SINGLE);
+      REQUIRE(variant.dest() == pkg.dest);
+      auto newPkg = variant.to<Single>();
+      REQUIRE(newPkg.from == pkg.from);
+      REQUIRE(newPkg.dest == pkg.dest);
+      REQUIRE(newPkg.msg == pkg.msg);
+    }
+  }
+
+  GIVEN("A Broadcast package") {
+    auto pkg = createBroadcast();
+    std::string frame;
+    REQUIRE(binary::encode(pkg, frame));
+    THEN("A Variant decodes it into the same package") {
+      auto variant = Variant(frame);
+      REQUIRE(!variant.error);
+      REQUIRE(variant.is<Broadcast>());
+      REQUIRE(variant.routing() == painlessmesh::router::BROADCAST);
+      auto newPkg = variant.to<Broadcast>();
+      REQUIRE(newPkg.from == pkg.from);
+      REQUIRE(newPkg.msg == pkg.msg);
+    }
+  }
+
+  GIVEN("TimeSync and TimeDelay packages of each time sync type") {
+    for (auto type = 0; type < 3; ++type) {
+      auto pkg = createTimeSync(type);
+      auto delay = createTimeDelay(type);
+      std::string frame;
+      std::string delayFrame;
+      REQUIRE(binary::encode(pkg, frame));
+      REQUIRE(binary::encode(delay, delayFrame));
+
+      auto variant = Variant(frame);
+      REQUIRE(!variant.error);
+      REQUIRE(variant.is<TimeSync>());
+      REQUIRE(variant.routing() == painlessmesh::router::NEIGHBOUR);
+      auto newPkg = variant.to<TimeSync>();
+      REQUIRE(newPkg.from == pkg.from);
+      REQUIRE(newPkg.dest == pkg.dest);
+      REQUIRE(newPkg.msg.type == pkg.msg.type);
+      REQUIRE(newPkg.msg.t0 == pkg.msg.t0);
+      REQUIRE(newPkg.msg.t1 == pkg.msg.t1);
+      REQUIRE(newPkg.msg.t2 == pkg.msg.t2);
+
+      auto delayVariant = Variant(delayFrame);
+      REQUIRE(delayVariant.is<TimeDelay>());
+      REQUIRE(delayVariant.routing() == painlessmesh::router::SINGLE);
+      auto newDelay = delayVariant.to<TimeDelay>();
+      REQUIRE(newDelay.msg.type == delay.msg.type);
+      REQUIRE(newDelay.msg.t0 == delay.msg.t0);
+      REQUIRE(newDelay.msg.t2 == delay.msg.t2);
+    }
+  }
+
+  GIVEN("NodeSyncRequest and NodeSyncReply packages of random size") {
+    auto request = createNodeSyncRequest();
+    auto reply = createNodeSyncReply();
+    std::string requestFrame;
+    std::string replyFrame;
+    REQUIRE(binary::encode(request, requestFrame));
+    REQUIRE(binary::encode(reply, replyFrame));
+    THEN("A Variant decodes them into the same packages") {
+      auto variant = Variant(requestFrame);
+      REQUIRE(!variant.error);
+      REQUIRE(variant.is<NodeSyncRequest>());
+      auto newRequest = variant.to<NodeSyncRequest>();
+      REQUIRE(newRequest == request);
+      REQUIRE(newRequest.binary);
+
+      auto replyVariant = Variant(replyFrame);
+      REQUIRE(!replyVariant.error);
+      REQUIRE(replyVariant.is<NodeSyncReply>());
+      REQUIRE(replyVariant.to<NodeSyncReply>() == reply);
+    }
+  }
+
+  GIVEN("A NodeSyncReply carrying the changes to a tree") {
+    auto reply = createNodeSyncReply(1);
+    reply.hash = runif(1, std::numeric_limits<uint32_t>::max());
+    reply.known = runif(1, std::numeric_limits<uint32_t>::max());
+    reply.base = runif(1, std::numeric_limits<uint32_t>::max());
+    for (auto i = runif(1, 5); i > 0; --i)
+      reply.remove.push_back(runif(0, std::numeric_limits<uint32_t>::max()));
+    for (auto i = runif(1, 3); i > 0; --i)
+      reply.add.push_back(createNodeTree(runif(2, 10), -1));
+    std::string frame;
+    REQUIRE(binary::encode(reply, frame));
+    THEN("A Variant decodes it into the same package") {
+      auto variant = Variant(frame);
+      REQUIRE(!variant.error);
+      REQUIRE(variant.is<NodeSyncReply>());
+      REQUIRE(variant.to<NodeSyncReply>() == reply);
+    }
+    THEN("It survives a round trip through json") {
+      auto variant = Variant(reply);
+      REQUIRE(!variant.error);
+      auto newReply = variant.to<NodeSyncReply>();
+      REQUIRE(newReply == reply);
+      REQUIRE(newReply.subs.empty());
+    }
+  }
+
+  GIVEN("A package of another type, encoded from a Variant") {
+    std::string json =
+        "{\"type\":20,\"from\":1,\"dest\":2,\"routing\":1,\"sensor\":0.5}";
+    auto variant = Variant(json);
+    std::string frame;
+    variant.encodeTo(frame, ENCODING_BINARY);
+    THEN("It is send as a frame with its json as payload") {
+      Header header;
+      REQUIRE(binary::readHeader(frame.c_str(), frame.length(), header));
+      REQUIRE(header.type == 20);
+      REQUIRE(header.routing == painlessmesh::router::SINGLE);
+      REQUIRE(header.from == 1);
+      REQUIRE(header.dest == 2);
+
+      auto newVariant = Variant(frame);
+      REQUIRE(!newVariant.error);
+      REQUIRE(newVariant.type() == 20);
+      REQUIRE(newVariant.to<JsonObject>()["sensor"].as<double>() == 0.5);
+    }
+  }
+}
+
+SCENARIO("The binary encoding falls back to json and rejects invalid frames",
+         "[Variant][protocol][binary]") {
+  GIVEN("A package too large for a frame") {
+    auto pkg = createSingle(PAINLESSMESH_FRAME_MAX + 1);
+    std::string str;
+    REQUIRE(!binary::encode(pkg, str));
+    REQUIRE(str.empty());
+    THEN("It is encoded as json instead") {
+      encode(pkg, str, ENCODING_BINARY);
+      REQUIRE(str[0] == '{');
+      REQUIRE(Variant(str).to<Single>().msg == pkg.msg);
+    }
+  }
+
+  GIVEN("A json encoding") {
+    auto pkg = createSingle(10);
+    std::string str;
+    encode(pkg, str, ENCODING_JSON);
+    THEN("It is not mistaken for a frame") {
+      Header header;
+      REQUIRE(!binary::readHeader(str.c_str(), str.length(), header));
+      REQUIRE(Variant(str).to<Single>().msg == pkg.msg);
+    }
+  }
+
+  GIVEN("A NodeSyncRequest created by this node") {
+    auto pkg = NodeSyncRequest(1, 2, {NodeTree(3, false)});
+    THEN("It tells the neighbour that we read binary frames") {
+      REQUIRE(pkg.binary);
+      std::string str;
+      Variant(pkg).printTo(str);
+      REQUIRE(Variant(str).to<NodeSyncRequest>().binary);
+      REQUIRE(!createNodeSyncRequest().binary);
+    }
+  }
+
+  GIVEN("A truncated frame") {
+    auto pkg = createNodeSyncReply(10);
+    std::string frame;
+    binary::encode(pkg, frame);
+    frame.resize(frame.length() - 3);
+    THEN("The Variant reports an error") { REQUIRE(Variant(frame).error); }
+  }
+
+  GIVEN("A frame with an invalid node tree") {
+    auto pkg = createNodeSyncReply(3);
+    std::string frame;
+    binary::encode(pkg, frame);
+    // Claim more subs than there are
+    frame[painlessmesh::buffer::FRAME_HEADER_SIZE + 5] = (char)0xFF;
+    THEN("The Variant reports an error") { REQUIRE(Variant(frame).error); }
+  }
+
+  GIVEN("A time sync frame of the wrong length") {
+    auto pkg = createTimeSync(2);
+    std::string frame;
+    binary::encode(pkg, frame);
+    frame.resize(frame.length() - 1);
+    frame[painlessmesh::buffer::FRAME_LENGTH_OFFSET] -= 1;
+    THEN("The Variant reports an error") { REQUIRE(Variant(frame).error); }
+  }
+}
+
+SCENARIO("The routing information is read from json without parsing it",
+         "[Variant][protocol][header]") {
+  GIVEN("Json encodings of the different package types") {
+    auto single = createSingle();
+    auto broadcast = createBroadcast();
+    auto timeSync = createTimeSync();
+    auto timeDelay = createTimeDelay();
+    auto reply = createNodeSyncReply(20);
+    std::string singleJson, broadcastJson, timeSyncJson, timeDelayJson,
+        replyJson;
+    encode(single, singleJson, ENCODING_JSON);
+    encode(broadcast, broadcastJson, ENCODING_JSON);
+    encode(timeSync, timeSyncJson, ENCODING_JSON);
+    encode(timeDelay, timeDelayJson, ENCODING_JSON);
+    encode(reply, replyJson, ENCODING_JSON);
+    THEN("The header matches the parsed Variant") {
+      for (auto&& json : {singleJson, broadcastJson, timeSyncJson,
+                          timeDelayJson, replyJson}) {
+        Header header;
+        REQUIRE(readHeader(json.c_str(), json.length(), header));
+        auto variant = Variant(json);
+        REQUIRE(header.encoding == ENCODING_JSON);
+        REQUIRE(header.type == variant.type());
+        REQUIRE(header.routing == variant.routing());
+        REQUIRE(header.dest == variant.dest());
+        REQUIRE(header.length == json.length());
+      }
+    }
+  }
+
+  GIVEN("A package with routing keys inside nested values and strings") {
+    std::string json =
+        "{ \"msg\" : \"{\\\"dest\\\":5,\\\\\\\"\\\"}\", \"sub\":{\"dest\":6,"
+        "\"l\":[1,{\"routing\":2},\"]\"]},\"type\" : 9 ,\"dest\":4294967295,"
+        "\"ok\":true,\"from\":-0}";
+    REQUIRE(!Variant(json).error);
+    THEN("Only the top level members are used") {
+      Header header;
+      REQUIRE(readHeader(json.c_str(), json.length(), header));
+      REQUIRE(header.type == SINGLE);
+      REQUIRE(header.routing == painlessmesh::router::SINGLE);
+      REQUIRE(header.dest == 4294967295);
+      REQUIRE(header.from == 0);
+    }
+  }
+
+  GIVEN("A package with an explicit routing") {
+    std::string json = "{\"type\":20,\"routing\":2,\"from\":1}";
+    THEN("It overrides the routing of the type") {
+      Header header;
+      REQUIRE(readHeader(json.c_str(), json.length(), header));
+      REQUIRE(header.type == 20);
+      REQUIRE(header.routing == painlessmesh::router::BROADCAST);
+      REQUIRE(header.dest == 0);
+    }
+  }
+
+  GIVEN("Json the scan does not handle") {
+    std::vector<std::string> invalid = {
+        "",
+        "{}",
+        "[{\"type\":9}]",
+        "{\"dest\":1}",
+        "{\"type\":9,\"dest\":1",
+        "{\"type\":9,\"dest\":\"1\"}",
+        "{\"type\":9,\"dest\":1.5}",
+        "{\"type\":9,\"dest\":-1}",
+        "{\"type\":9,\"dest\":4294967296}",
+        "{\"type\":9,\"msg\":\"abc}",
+        "{\"type\":9,\"msg\":[1,2}",
+        "{\"type\" 9}",
+        "{type:9}"};
+    THEN("The scan fails, so the package is parsed instead") {
+      for (auto&& json : invalid) {
+        Header header;
+        INFO(json);
+        REQUIRE(!readHeader(json.c_str(), json.length(), header));
+      }
+    }
+  }
+
+  GIVEN("A binary frame") {
+    auto pkg = createSingle();
+    std::string frame;
+    encode(pkg, frame, ENCODING_BINARY);
+    THEN("The header is read from the frame") {
+      Header header;
+      REQUIRE(readHeader(frame.c_str(), frame.length(), header));
+      REQUIRE(header.encoding == ENCODING_BINARY);
+      REQUIRE(header.dest == pkg.dest);
+    }
+  }
+}
@@ -100,3 +100,224 @@ SCENARIO("routePackage should route the package correctly") {
   }
 }
 */
+
+class ForwardConnection : public layout::Neighbour {
+ public:
+  ForwardConnection(uint32_t id) { nodeId = id; }
+
+  bool addMessage(buffer::SharedMessage msg, bool priority = false) {
+    messages.push_back(*msg);
+    shared.push_back(msg);
+    return true;
+  }
+
+  std::vector<TSTRING> messages;
+  std::vector<buffer::SharedMessage> shared;
+};
+
+class ForwardLayout : public layout::Layout<ForwardConnection> {
+ public:
+  ForwardLayout(uint32_t id) { nodeId = id; }
+};
+
+SCENARIO("routePackage passes on packages for other nodes untouched") {
+  GIVEN("A node with a json and a binary neighbour") {
+    auto layout = ForwardLayout(1);
+    auto jsonConn = std::make_shared<ForwardConnection>(2);
+    auto binaryConn = std::make_shared<ForwardConnection>(3);
+    binaryConn->encoding = protocol::ENCODING_BINARY;
+    layout.subs.push_back(jsonConn);
+    layout.subs.push_back(binaryConn);
+    layout.updateRoutes(jsonConn);
+    layout.updateRoutes(binaryConn);
+    auto from = std::make_shared<ForwardConnection>(4);
+    callback::MeshPackageCallbackList<ForwardConnection> cbl;
+    auto calls = 0;
+    cbl.onPackage(protocol::SINGLE,
+                  [&calls](protocol::Variant, std::shared_ptr<ForwardConnection>,
+                           uint32_t) { ++calls; });
+
+    WHEN("It receives packages for each neighbour in both encodings") {
+      // Reordered and spaced json that re-serializing would not reproduce
+      TSTRING toJson =
+          "{\"msg\":\"{\\\"dest\\\":1}\", \"from\":4, \"dest\":2, \"type\":9}";
+      TSTRING toBinary = "{\"type\":9,\"dest\":3,\"from\":4,\"msg\":\"x\"}";
+      TSTRING y = "y", z = "z";
+      TSTRING frameToJson, frameToBinary;
+      protocol::encode(protocol::Single(4, 2, y), frameToJson,
+                       protocol::ENCODING_BINARY);
+      protocol::encode(protocol::Single(4, 3, z), frameToBinary,
+                       protocol::ENCODING_BINARY);
+      for (auto&& pkg : {toJson, toBinary, frameToJson, frameToBinary})
+        router::routePackage<ForwardConnection>(layout, from, pkg, cbl, 0);
+
+      THEN("Packages in the encoding of the next hop are forwarded as is") {
+        REQUIRE(calls == 0);
+        REQUIRE(jsonConn->messages.size() == 2);
+        REQUIRE(binaryConn->messages.size() == 2);
+        REQUIRE(jsonConn->messages[0] == toJson);
+        REQUIRE(binaryConn->messages[1] == frameToBinary);
+      }
+
+      THEN("Other packages are re-encoded for the next hop") {
+        REQUIRE(binaryConn->messages[0][0] != '{');
+        auto single = protocol::Variant(binaryConn->messages[0])
+                          .to<protocol::Single>();
+        REQUIRE(single.dest == 3);
+        REQUIRE(single.msg == "x");
+        REQUIRE(jsonConn->messages[1][0] == '{');
+        single =
+            protocol::Variant(jsonConn->messages[1]).to<protocol::Single>();
+        REQUIRE(single.dest == 2);
+        REQUIRE(single.msg == "y");
+      }
+    }
+
+    WHEN("It receives a package for itself") {
+      TSTRING pkg = "{\"type\":9,\"dest\":1,\"from\":4,\"msg\":\"x\"}";
+      router::routePackage<ForwardConnection>(layout, from, pkg, cbl, 0);
+      THEN("It is handled and not sent on") {
+        REQUIRE(calls == 1);
+        REQUIRE(jsonConn->messages.empty());
+        REQUIRE(binaryConn->messages.empty());
+      }
+    }
+
+    WHEN("It reads the packages in place from a receive buffer") {
+      TSTRING toJson = "{\"type\":9,\"dest\":2,\"from\":4,\"msg\":\"x\"}";
+      TSTRING toSelf = "{\"type\":9,\"dest\":1,\"from\":4,\"msg\":\"x\"}";
+      buffer::ReceiveBuffer<TSTRING> received;
+      received.push(toJson.c_str(), toJson.length() + 1);
+      received.push(toSelf.c_str(), toSelf.length() + 1);
+      while (!received.empty()) {
+        router::routePackage<ForwardConnection>(
+            layout, from, received.frontPtr(), received.frontLength(), cbl, 0);
+        received.pop_front();
+      }
+      THEN("Forwarded packages are copies of the received bytes") {
+        REQUIRE(calls == 1);
+        REQUIRE(jsonConn->messages.size() == 1);
+        REQUIRE(jsonConn->messages[0] == toJson);
+        REQUIRE(binaryConn->messages.empty());
+      }
+    }
+
+    WHEN("It receives a package for an unknown node") {
+      TSTRING pkg = "{\"type\":9,\"dest\":7,\"from\":4,\"msg\":\"x\"}";
+      router::routePackage<ForwardConnection>(layout, from, pkg, cbl, 0);
+      THEN("It is dropped") {
+        REQUIRE(calls == 0);
+        REQUIRE(jsonConn->messages.empty());
+        REQUIRE(binaryConn->messages.empty());
+      }
+    }
+  }
+}
+
+SCENARIO("findRoute looks up the sub in the routing table") {
+  GIVEN("A layout with three subs with random trees") {
+    auto layout = ForwardLayout(1);
+    for (uint32_t i = 0; i < 3; ++i) {
+      auto conn = std::make_shared<ForwardConnection>(0);
+      auto tree = createNodeTree(runif(1, 30), -1);
+      conn->updateSubs(tree);
+      layout.subs.push_back(conn);
+      layout.updateRoutes(conn);
+    }
+
+    THEN("Every node is routed through the sub that contains it") {
+      for (auto&& sub : layout.subs) {
+        for (auto&& id : layout::asList(*sub)) {
+          REQUIRE(router::findRoute<ForwardConnection>(layout, id) == sub);
+        }
+      }
+      REQUIRE(!router::findRoute<ForwardConnection>(layout, 1));
+    }
+
+    WHEN("A node moves from one sub to another") {
+      auto from = layout.subs.front();
+      auto to = layout.subs.back();
+      auto moved = createNodeTree(1, -1);
+      if (!from->subs.empty()) {
+        moved = from->subs.back();
+        from->subs.pop_back();
+      }
+      auto newTree = protocol::NodeTree(*to);
+      newTree.subs.push_back(moved);
+      // The new route is usually learned before the old one is dropped
+      to->updateSubs(newTree);
+      layout.updateRoutes(to);
+      layout.updateRoutes(from);
+      THEN("It is routed through the new sub") {
+        for (auto&& id : layout::asList(moved))
+          REQUIRE(router::findRoute<ForwardConnection>(layout, id) == to);
+        for (auto&& id : layout::asList(*from))
+          REQUIRE(router::findRoute<ForwardConnection>(layout, id) == from);
+      }
+    }
+
+    WHEN("A node is briefly in the trees of two subs") {
+      auto from = layout.subs.front();
+      auto to = layout.subs.back();
+      auto shared = from->subs.empty() ? protocol::NodeTree(*from)
+                                       : from->subs.back();
+      auto oldTree = protocol::NodeTree(*to);
+      auto newTree = oldTree;
+      newTree.subs.push_back(shared);
+      to->updateSubs(newTree);
+      layout.updateRoutes(to);
+      REQUIRE(router::findRoute<ForwardConnection>(layout, shared.nodeId) ==
+              to);
+      THEN("It is routed through the other sub once one sub drops it") {
+        to->updateSubs(oldTree);
+        layout.updateRoutes(to);
+        for (auto&& id : layout::asList(shared))
+          REQUIRE(router::findRoute<ForwardConnection>(layout, id) == from);
+      }
+      THEN("It is routed through the other sub once one sub is removed") {
+        layout.subs.remove(to);
+        layout.eraseRoutes(to);
+        for (auto&& id : layout::asList(shared))
+          REQUIRE(router::findRoute<ForwardConnection>(layout, id) == from);
+      }
+    }
+
+    WHEN("A sub is removed") {
+      auto conn = layout.subs.front();
+      layout.subs.pop_front();
+      layout.eraseRoutes(conn);
+      THEN("Its nodes are no longer routed") {
+        for (auto&& id : layout::asList(*conn))
+          REQUIRE(!router::findRoute<ForwardConnection>(layout, id));
+        size_t size = 0;
+        for (auto&& sub : layout.subs) size += layout::size(*sub);
+        REQUIRE(layout.routes.size() == size);
+      }
+    }
+  }
+}
+
+SCENARIO("broadcast queues one shared message per encoding") {
+  GIVEN("A layout with three json and one binary neighbour") {
+    auto layout = ForwardLayout(1);
+    for (uint32_t id = 2; id < 6; ++id) {
+      layout.subs.push_back(std::make_shared<ForwardConnection>(id));
+    }
+    layout.subs.back()->encoding = protocol::ENCODING_BINARY;
+    auto pkg = createBroadcast();
+
+    WHEN("A package is broadcast") {
+      REQUIRE(router::broadcast(pkg, layout, 0) == 4);
+      THEN("The json neighbours share a single message") {
+        auto json = layout.subs.front()->shared.front();
+        auto binary = layout.subs.back()->shared.front();
+        for (auto&& sub : layout.subs) REQUIRE(sub->shared.size() == 1);
+        REQUIRE(json.use_count() == 4);
+        REQUIRE(binary.use_count() == 2);
+        REQUIRE(json != binary);
+        REQUIRE(protocol::Variant(*binary).to<protocol::Broadcast>().msg ==
+                pkg.msg);
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+/*
+ QoS 1 spool example - ESP32 with LittleFS
+
+ This sketch queues a reading every 10 seconds in a file on
+ LittleFS and delivers the queue at QoS 1 whenever the broker
+ can be reached. Readings taken while the link is down, or
+ before a reboot, are sent once it comes back, a few at a time
+ through the client's in-flight window.
+
+*/
+
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <MQTTSpool.h>
+
+// Update these with values suitable for your network.
+const char* ssid = "........";
+const char* password = "........";
+const char* mqtt_server = "broker.mqtt-dashboard.com";
+
+WiFiClient espClient;
+PubSubClient client(espClient);
+MQTTFileSpoolStore store(LittleFS, "/spool.log", "/spool.head");
+MQTTSpool spool(store, 64 * 1024);
+
+long lastReconnectAttempt = 0;
+long lastReading = 0;
+
+void setup()
+{
+  LittleFS.begin(true);
+  spool.begin();
+
+  WiFi.begin(ssid, password);
+  client.setServer(mqtt_server, 1883);
+}
+
+void loop()
+{
+  long now = millis();
+  if (now - lastReading > 10000) {
+    lastReading = now;
+    char msg[32];
+    snprintf(msg, sizeof(msg), "{\"uptime\":%ld}", now / 1000);
+    spool.push("outTopic", (const uint8_t*)msg, strlen(msg), false);
+  }
+
+  if (!client.connected()) {
+    if (now - lastReconnectAttempt > 5000) {
+      lastReconnectAttempt = now;
+      client.connect("arduinoClient");
+    }
+  } else {
+    client.loop();
+    spool.drain(client);
+  }
+}
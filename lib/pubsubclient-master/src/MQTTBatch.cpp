@@ -0,0 +1,187 @@
+/*
+ MQTTBatch.cpp - Collects telemetry samples into one MQTT message per poll cycle.
+*/
+
+#include "MQTTBatch.h"
+#include <stdio.h>
+#include <math.h>
+
+MQTTBatch::MQTTBatch(PubSubClient& client, const char* topic, char* buffer, uint16_t size) {
+    this->client = &client;
+    this->spool = NULL;
+    this->topic = topic;
+    this->topicLength = strlen(topic);
+    this->buffer = buffer;
+    this->size = size;
+    this->buffer[0] = '[';
+    this->length = 1;
+    this->count = 0;
+    this->maxLatency = MQTT_BATCH_MAX_LATENCY;
+    this->firstSample = 0;
+    this->separateBytes = 0;
+    this->messagesSent = 0;
+    this->samplesSent = 0;
+    this->bytesSent = 0;
+    this->bytesSaved = 0;
+    this->samplesDropped = 0;
+}
+
+MQTTBatch& MQTTBatch::setMaxLatency(uint32_t ms) {
+    this->maxLatency = ms;
+    return *this;
+}
+
+MQTTBatch& MQTTBatch::setSpool(MQTTSpool* spool) {
+    this->spool = spool;
+    return *this;
+}
+
+boolean MQTTBatch::add(const char* id, double value, uint8_t decimals) {
+    char text[24];
+    int n = snprintf(text,sizeof(text),"%.*f",decimals,value);
+    if (n <= 0 || n >= (int)sizeof(text) || !isfinite(value)) {
+        // JSON has no NaN or infinity, and a value this long is not a reading
+        strcpy(text,"null");
+    } else if (strchr(text,'.')) {
+        // Trailing zeros carry nothing but bytes
+        while (text[n-1] == '0') {
+            text[--n] = 0;
+        }
+        if (text[n-1] == '.') {
+            text[--n] = 0;
+        }
+    }
+    return addSample(id,text,false);
+}
+
+boolean MQTTBatch::add(const char* id, const char* value) {
+    return addSample(id,value,true);
+}
+
+boolean MQTTBatch::addSample(const char* id, const char* value, boolean quoted) {
+    if (append(id,value,quoted)) {
+        return true;
+    }
+    if (this->count > 0) {
+        flush();
+        if (append(id,value,quoted)) {
+            return true;
+        }
+    }
+    // Too big for an empty buffer
+    this->samplesDropped++;
+    return false;
+}
+
+boolean MQTTBatch::endCycle() {
+    return flush();
+}
+
+boolean MQTTBatch::loop() {
+    if (this->count > 0 && millis() - this->firstSample >= this->maxLatency) {
+        return flush();
+    }
+    return true;
+}
+
+boolean MQTTBatch::flush() {
+    if (this->count == 0) {
+        return true;
+    }
+    this->buffer[this->length] = ']';
+    uint16_t plength = this->length + 1;
+    boolean rc;
+    if (this->spool) {
+        rc = this->spool->push(this->topic,(const uint8_t*)this->buffer,plength,false);
+    } else {
+        MQTTSegment segment = { (const uint8_t*)this->buffer, plength };
+        rc = this->client->publish(this->topic,&segment,1,false);
+    }
+    if (rc) {
+        uint32_t sent = packetSize(this->topicLength,plength);
+        this->messagesSent++;
+        this->samplesSent += this->count;
+        this->bytesSent += sent;
+        this->bytesSaved += this->separateBytes - sent;
+    } else {
+        // Without a spool there is nowhere to keep a batch that could not be sent
+        this->samplesDropped += this->count;
+    }
+    this->length = 1;
+    this->count = 0;
+    this->separateBytes = 0;
+    return rc;
+}
+
+uint16_t MQTTBatch::pending() {
+    return this->count;
+}
+
+uint32_t MQTTBatch::messages() {
+    return this->messagesSent;
+}
+
+uint32_t MQTTBatch::samples() {
+    return this->samplesSent;
+}
+
+uint32_t MQTTBatch::dropped() {
+    return this->samplesDropped;
+}
+
+uint32_t MQTTBatch::bytes() {
+    return this->bytesSent;
+}
+
+uint32_t MQTTBatch::saved() {
+    return this->bytesSaved;
+}
+
+boolean MQTTBatch::append(const char* id, const char* value, boolean quoted) {
+    size_t idLength = MQTTPayload::escapedLength(id);
+    size_t valueLength = quoted ? MQTTPayload::escapedLength(value) + 2 : strlen(value);
+    // {"<id>":<value>}
+    size_t element = 5 + idLength + valueLength;
+    size_t needed = element + (this->count ? 1 : 0);
+    // Leave room for the closing bracket
+    if (this->length + needed + 1 > this->size) {
+        return false;
+    }
+    char* p = this->buffer + this->length;
+    if (this->count) {
+        *p++ = ',';
+    }
+    *p++ = '{';
+    *p++ = '"';
+    p = MQTTPayload::escape(p,id);
+    *p++ = '"';
+    *p++ = ':';
+    if (quoted) {
+        *p++ = '"';
+        p = MQTTPayload::escape(p,value);
+        *p++ = '"';
+    } else {
+        memcpy(p,value,valueLength);
+        p += valueLength;
+    }
+    *p++ = '}';
+    this->length += needed;
+    if (this->count == 0) {
+        this->firstSample = millis();
+    }
+    this->count++;
+    // The same sample sent alone, as [<element>]
+    this->separateBytes += packetSize(this->topicLength,element+2);
+    return true;
+}
+
+// Size of a QoS 0 PUBLISH packet
+uint32_t MQTTBatch::packetSize(uint16_t topicLength, uint32_t payloadLength) {
+    uint32_t remaining = 2 + topicLength + payloadLength;
+    uint32_t size = 1 + 1 + remaining;
+    while (remaining >= 128) {
+        remaining >>= 7;
+        size++;
+    }
+    return size;
+}
@@ -0,0 +1,74 @@
+/*
+ MQTTBatch.h - Collects telemetry samples into one MQTT message per poll cycle.
+*/
+
+#ifndef MQTTBatch_h
+#define MQTTBatch_h
+
+#include "PubSubClient.h"
+#include "MQTTSpool.h"
+#include "MQTTPayload.h"
+
+// MQTT_BATCH_MAX_LATENCY : Default time, in milliseconds, a sample may wait before the batch is sent
+#ifndef MQTT_BATCH_MAX_LATENCY
+#define MQTT_BATCH_MAX_LATENCY 5000
+#endif
+
+// Gathers samples as a compact JSON array of one-value records, written like
+// MQTTPayload's JSON records,
+//   [{"priThreePhaseVoltage":230.1},{"breakerState":"on"},...]
+// in a caller-supplied buffer and publishes it as one message when the poll
+// cycle ends, the buffer is full or the oldest sample reaches the maximum latency.
+class MQTTBatch {
+private:
+   PubSubClient* client;
+   MQTTSpool* spool;
+   const char* topic;
+   uint16_t topicLength;
+   char* buffer;
+   uint16_t size;
+   uint16_t length;
+   uint16_t count;
+   uint32_t maxLatency;
+   unsigned long firstSample;
+   // Bytes the batched samples would have cost as separate messages
+   uint32_t separateBytes;
+   uint32_t messagesSent;
+   uint32_t samplesSent;
+   uint32_t bytesSent;
+   uint32_t bytesSaved;
+   uint32_t samplesDropped;
+   boolean addSample(const char* id, const char* value, boolean quoted);
+   boolean append(const char* id, const char* value, boolean quoted);
+   static uint32_t packetSize(uint16_t topicLength, uint32_t payloadLength);
+public:
+   MQTTBatch(PubSubClient& client, const char* topic, char* buffer, uint16_t size);
+
+   MQTTBatch& setMaxLatency(uint32_t ms);
+   // Queue batches in spool (pushed at QoS 1) instead of publishing them directly
+   MQTTBatch& setSpool(MQTTSpool* spool);
+
+   // Add a sample, sending the batch first if the sample does not fit
+   // A number is written with decimals digits after the point (null if
+   // not finite), text as a JSON string
+   // Returns false if the sample was dropped
+   boolean add(const char* id, double value, uint8_t decimals);
+   boolean add(const char* id, const char* value);
+   // Send what has been gathered at the end of a poll cycle
+   boolean endCycle();
+   // Send the batch once its oldest sample has waited the maximum latency. Call from loop()
+   boolean loop();
+   // Send the batch now. Returns true if there was nothing to send
+   boolean flush();
+
+   uint16_t pending();
+   uint32_t messages();
+   uint32_t samples();
+   uint32_t dropped();
+   // MQTT bytes (fixed header, topic and payload) of the messages sent
+   uint32_t bytes();
+   // MQTT bytes saved by sending the samples in batches rather than one message each
+   uint32_t saved();
+};
+
+#endif
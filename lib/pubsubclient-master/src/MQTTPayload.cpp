@@ -0,0 +1,289 @@
+/*
+ MQTTPayload.cpp - Encodes telemetry records as JSON, MessagePack or fixed binary.
+*/
+
+#include "MQTTPayload.h"
+#include <stdio.h>
+#include <math.h>
+
+MQTTPayload::MQTTPayload(uint8_t encoding, uint8_t schemaId) {
+    this->client = NULL;
+    this->encoding = encoding;
+    this->schemaId = schemaId;
+    this->buffer = NULL;
+    this->size = 0;
+    this->length = 0;
+    this->count = 0;
+    this->overflow = true;
+}
+
+uint8_t MQTTPayload::encodingFor(const char* name) {
+    if (name && strcmp(name,"msgpack") == 0) {
+        return MQTT_PAYLOAD_MSGPACK;
+    }
+    if (name && strcmp(name,"binary") == 0) {
+        return MQTT_PAYLOAD_BINARY;
+    }
+    return MQTT_PAYLOAD_JSON;
+}
+
+size_t MQTTPayload::escapedLength(const char* text) {
+    size_t n = 0;
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            n += 2;
+        } else if ((uint8_t)*text < 0x20) {
+            n += 6;
+        } else {
+            n++;
+        }
+    }
+    return n;
+}
+
+char* MQTTPayload::escape(char* p, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    for (; *text; text++) {
+        uint8_t c = (uint8_t)*text;
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            memcpy(p,"\\u00",4);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 0xF];
+            p += 6;
+        } else {
+            *p++ = c;
+        }
+    }
+    return p;
+}
+
+uint8_t MQTTPayload::getEncoding() {
+    return this->encoding;
+}
+
+uint8_t MQTTPayload::getSchemaId() {
+    return this->schemaId;
+}
+
+void MQTTPayload::begin(uint8_t* buffer, uint16_t size) {
+    this->buffer = buffer;
+    this->size = size;
+    this->length = 0;
+    this->count = 0;
+    this->overflow = (buffer == NULL);
+    switch (this->encoding) {
+    case MQTT_PAYLOAD_MSGPACK:
+        // fixmap, widened to map 16 by end() if there are more than 15 values
+        put(0x80);
+        break;
+    case MQTT_PAYLOAD_BINARY:
+        put(this->schemaId);
+        // value count, filled in by end()
+        put(0);
+        break;
+    default:
+        put('{');
+        break;
+    }
+}
+
+boolean MQTTPayload::begin(PubSubClient& client, const char* topic) {
+    uint16_t space = 0;
+    uint8_t* payload = client.preparePublish(topic,&space);
+    begin(payload,space);
+    this->client = payload ? &client : NULL;
+    return payload != NULL;
+}
+
+boolean MQTTPayload::add(const char* id, double value, uint8_t decimals) {
+    if (this->encoding == MQTT_PAYLOAD_BINARY) {
+        float single = (float)value;
+        uint32_t bits;
+        memcpy(&bits,&single,sizeof(bits));
+        uint8_t le[4] = { (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24) };
+        this->count++;
+        return put(le,4);
+    }
+    if (this->encoding == MQTT_PAYLOAD_MSGPACK) {
+        if (!putKey(id)) {
+            return false;
+        }
+        this->count++;
+        if (value >= -2147483648.0 && value < 2147483648.0 && value == (double)(int32_t)value) {
+            return putInt((int32_t)value);
+        }
+        return putFloat((float)value);
+    }
+    char text[24];
+    int n = snprintf(text,sizeof(text),"%.*f",decimals,value);
+    if (n <= 0 || n >= (int)sizeof(text) || !isfinite(value)) {
+        // JSON has no NaN or infinity, and a value this long is not a reading
+        strcpy(text,"null");
+        n = 4;
+    } else if (strchr(text,'.')) {
+        while (text[n-1] == '0') {
+            text[--n] = 0;
+        }
+        if (text[n-1] == '.') {
+            text[--n] = 0;
+        }
+    }
+    if (!putKey(id)) {
+        return false;
+    }
+    this->count++;
+    return put(text,n);
+}
+
+boolean MQTTPayload::addInt(const char* id, int32_t value) {
+    if (this->encoding == MQTT_PAYLOAD_BINARY) {
+        uint32_t bits = (uint32_t)value;
+        uint8_t le[4] = { (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24) };
+        this->count++;
+        return put(le,4);
+    }
+    if (!putKey(id)) {
+        return false;
+    }
+    this->count++;
+    if (this->encoding == MQTT_PAYLOAD_MSGPACK) {
+        return putInt(value);
+    }
+    char text[12];
+    int n = snprintf(text,sizeof(text),"%ld",(long)value);
+    return put(text,n);
+}
+
+uint16_t MQTTPayload::end() {
+    switch (this->encoding) {
+    case MQTT_PAYLOAD_MSGPACK:
+        if (this->count > 15 && !this->overflow) {
+            if (this->length + 2 > this->size) {
+                this->overflow = true;
+                break;
+            }
+            memmove(this->buffer+3,this->buffer+1,this->length-1);
+            this->buffer[0] = 0xde;
+            this->buffer[1] = this->count >> 8;
+            this->buffer[2] = this->count & 0xFF;
+            this->length += 2;
+        } else if (!this->overflow) {
+            this->buffer[0] = 0x80 | this->count;
+        }
+        break;
+    case MQTT_PAYLOAD_BINARY:
+        if (this->count > 255) {
+            this->overflow = true;
+        } else if (!this->overflow) {
+            this->buffer[1] = this->count;
+        }
+        break;
+    default:
+        put('}');
+        break;
+    }
+    return this->overflow ? 0 : this->length;
+}
+
+boolean MQTTPayload::publish(boolean retained) {
+    uint16_t plength = end();
+    if (this->client == NULL || plength == 0) {
+        this->client = NULL;
+        return false;
+    }
+    PubSubClient* client = this->client;
+    this->client = NULL;
+    return client->publishPrepared(plength,retained);
+}
+
+uint16_t MQTTPayload::values() {
+    return this->count;
+}
+
+boolean MQTTPayload::put(uint8_t b) {
+    if (this->overflow || this->length >= this->size) {
+        this->overflow = true;
+        return false;
+    }
+    this->buffer[this->length++] = b;
+    return true;
+}
+
+boolean MQTTPayload::put(const void* data, uint16_t n) {
+    if (this->overflow || n > this->size - this->length) {
+        this->overflow = true;
+        return false;
+    }
+    memcpy(this->buffer+this->length,data,n);
+    this->length += n;
+    return true;
+}
+
+boolean MQTTPayload::putKey(const char* id) {
+    size_t n = strlen(id);
+    if (this->encoding == MQTT_PAYLOAD_MSGPACK) {
+        if (n < 32) {
+            put(0xa0 | n);
+        } else if (n < 256) {
+            put(0xd9);
+            put(n);
+        } else {
+            this->overflow = true;
+            return false;
+        }
+        return put(id,n);
+    }
+    if (this->count) {
+        put(',');
+    }
+    put('"');
+    n = escapedLength(id);
+    if (this->overflow || n > (size_t)(this->size - this->length)) {
+        this->overflow = true;
+        return false;
+    }
+    escape((char*)this->buffer + this->length,id);
+    this->length += n;
+    put('"');
+    return put(':');
+}
+
+// Smallest MessagePack integer holding value
+boolean MQTTPayload::putInt(int32_t value) {
+    if (value >= -32 && value <= 127) {
+        return put((uint8_t)value);
+    }
+    if (value > 0) {
+        if (value <= 0xFF) {
+            put(0xcc);
+            return put((uint8_t)value);
+        }
+        if (value <= 0xFFFF) {
+            uint8_t be[3] = { 0xcd, (uint8_t)(value >> 8), (uint8_t)value };
+            return put(be,3);
+        }
+    } else {
+        if (value >= -128) {
+            put(0xd0);
+            return put((uint8_t)value);
+        }
+        if (value >= -32768) {
+            uint8_t be[3] = { 0xd1, (uint8_t)(value >> 8), (uint8_t)value };
+            return put(be,3);
+        }
+    }
+    uint32_t bits = (uint32_t)value;
+    uint8_t be[5] = { (uint8_t)(value > 0 ? 0xce : 0xd2), (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits };
+    return put(be,5);
+}
+
+// MessagePack float 32
+boolean MQTTPayload::putFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits,&value,sizeof(bits));
+    uint8_t be[5] = { 0xca, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits };
+    return put(be,5);
+}
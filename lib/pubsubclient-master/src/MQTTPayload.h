@@ -0,0 +1,98 @@
+/*
+ MQTTPayload.h - Encodes telemetry records as JSON, MessagePack or fixed binary.
+*/
+
+#ifndef MQTTPayload_h
+#define MQTTPayload_h
+
+#include "PubSubClient.h"
+
+// Payload encodings, chosen per topic
+//   MQTT_PAYLOAD_JSON    {"priThreePhaseVoltage":230.1,...}
+//   MQTT_PAYLOAD_MSGPACK the same map as MessagePack
+//   MQTT_PAYLOAD_BINARY  schema id, value count, then each value as a 4 byte
+//                        little-endian float or int32 in the order of the schema;
+//                        the ids are not sent
+// Topics publish JSON unless mqttTopics.payloadEncoding in IOTConfig.json names
+// another encoding for them, e.g.
+//   "payloadEncoding": [
+//       {"pPropertyTopic": "msgpack"},
+//       {"pMonitorTopic": "binary", "schemaId": 1}
+//   ]
+// MQTTPayload::forTopic() looks a topic up in that array.
+// The platform consumers of a topic must read the encoding before it is switched.
+#define MQTT_PAYLOAD_JSON    0
+#define MQTT_PAYLOAD_MSGPACK 1
+#define MQTT_PAYLOAD_BINARY  2
+
+// Writes one record of id/value pairs. The record is encoded straight into the
+// PubSubClient buffer behind the topic (begin(client, topic), publish()), or into
+// a caller-supplied buffer (begin(buffer, size), end()).
+class MQTTPayload {
+private:
+   PubSubClient* client;
+   uint8_t encoding;
+   uint8_t schemaId;
+   uint8_t* buffer;
+   uint16_t size;
+   uint16_t length;
+   uint16_t count;
+   boolean overflow;
+   boolean put(uint8_t b);
+   boolean put(const void* data, uint16_t n);
+   boolean putKey(const char* id);
+   boolean putInt(int32_t value);
+   boolean putFloat(float value);
+public:
+   MQTTPayload(uint8_t encoding, uint8_t schemaId = 0);
+
+   // Encoding for a name in the configuration, "json", "msgpack" or "binary".
+   // Anything else is JSON
+   static uint8_t encodingFor(const char* name);
+   // Payload for topic, the key of the topic in mqttTopics.publish, with the
+   // encoding and schema id configured for it in entries, the parsed
+   // mqttTopics.payloadEncoding array:
+   //   MQTTPayload payload = MQTTPayload::forTopic(
+   //       doc["mqttTopics"]["payloadEncoding"].as<JsonArrayConst>(), "pMonitorTopic");
+   // A topic that is not listed uses JSON
+   template <class Entries>
+   static MQTTPayload forTopic(const Entries& entries, const char* topic) {
+       for (auto entry : entries) {
+           const char* name = entry[topic];
+           if (name) {
+               return MQTTPayload(encodingFor(name),entry["schemaId"] | 0);
+           }
+       }
+       return MQTTPayload(MQTT_PAYLOAD_JSON);
+   }
+   uint8_t getEncoding();
+   uint8_t getSchemaId();
+
+   // Length of text inside a JSON string, with quotes, backslashes and control
+   // characters escaped
+   static size_t escapedLength(const char* text);
+   // Write text escaped at p, without a terminator. Returns the end of it
+   static char* escape(char* p, const char* text);
+
+   // Start a record in buffer
+   void begin(uint8_t* buffer, uint16_t size);
+   // Start a record in the client's buffer, to be sent to topic by publish()
+   // Returns false if the client is not connected or the topic does not fit
+   boolean begin(PubSubClient& client, const char* topic);
+
+   // Add a value. JSON gives it decimals digits after the point, MessagePack
+   // sends values without a fraction as integers. Binary and MessagePack
+   // send any other value as a 4 byte float
+   // Returns false once the record no longer fits
+   boolean add(const char* id, double value, uint8_t decimals);
+   boolean addInt(const char* id, int32_t value);
+
+   // Finish the record. Returns its length, or 0 if it did not fit
+   uint16_t end();
+   // Finish the record and publish it through the client given to begin()
+   boolean publish(boolean retained);
+
+   uint16_t values();
+};
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ MQTTSpool.cpp - Persistent QoS 1 outbound queue for PubSubClient.
+*/
+
+#include "MQTTSpool.h"
+
+// Record layout: magic, flags, topic length, payload length (big endian), topic, payload
+#define MQTT_SPOOL_MAGIC        0xA5
+#define MQTT_SPOOL_RETAINED     0x01
+#define MQTT_SPOOL_HEADER_SIZE  6
+
+MQTTSpool::MQTTSpool(MQTTSpoolStore& store, uint32_t limit) {
+    this->store = &store;
+    this->limit = limit;
+    this->head = 0;
+    this->tail = 0;
+    this->sendOffset = 0;
+    this->records = 0;
+    this->damaged = false;
+    this->windowUsed = 0;
+}
+
+boolean MQTTSpool::begin() {
+    uint8_t header[MQTT_SPOOL_HEADER_SIZE];
+    uint32_t size = this->store->size();
+    uint32_t offset;
+    uint32_t length;
+
+    this->head = this->store->head();
+    this->records = 0;
+    this->damaged = false;
+    this->windowUsed = 0;
+    if (this->head > size) {
+        // The log was emptied without the head being reset
+        this->head = 0;
+        size = 0;
+        this->store->clear();
+    }
+    offset = this->head;
+    while (offset < size) {
+        length = readHeader(offset,header);
+        if (length == 0 || offset + length > size) {
+            this->damaged = true;
+            break;
+        }
+        offset += length;
+        this->records++;
+    }
+    this->tail = offset;
+    this->sendOffset = this->head;
+    if (this->damaged && this->records == 0) {
+        // Nothing worth keeping before the damage
+        this->store->clear();
+        this->head = this->tail = this->sendOffset = 0;
+        this->damaged = false;
+        return false;
+    }
+    return !this->damaged;
+}
+
+boolean MQTTSpool::push(const char* topic, const uint8_t* payload, uint16_t plength, boolean retained) {
+    size_t tlen = topic ? strlen(topic) : 0;
+    if (tlen == 0 || tlen > MQTT_SPOOL_MAX_TOPIC || this->damaged) {
+        // Records appended after a damaged one could not be reached
+        return false;
+    }
+    uint32_t length = MQTT_SPOOL_HEADER_SIZE + tlen + plength;
+    if (this->tail - this->head + length > this->limit) {
+        return false;
+    }
+    if (this->tail + length > this->limit && !compact()) {
+        return false;
+    }
+    uint8_t header[MQTT_SPOOL_HEADER_SIZE];
+    header[0] = MQTT_SPOOL_MAGIC;
+    header[1] = retained ? MQTT_SPOOL_RETAINED : 0;
+    header[2] = (tlen >> 8);
+    header[3] = (tlen & 0xFF);
+    header[4] = (plength >> 8);
+    header[5] = (plength & 0xFF);
+    MQTTSegment segments[] = {
+        { header, MQTT_SPOOL_HEADER_SIZE },
+        { (const uint8_t*)topic, tlen },
+        { payload, plength }
+    };
+    if (!this->store->append(segments,3)) {
+        return false;
+    }
+    this->tail += length;
+    this->records++;
+    return true;
+}
+
+uint8_t MQTTSpool::drain(PubSubClient& client) {
+    uint8_t header[MQTT_SPOOL_HEADER_SIZE];
+    uint8_t sent = 0;
+    uint8_t i;
+    uint32_t length;
+    uint16_t msgId;
+
+    if (!client.connected()) {
+        return 0;
+    }
+    retire(client);
+
+    for (i = 0;i<this->windowUsed;i++) {
+        if (client.retransmitDue(this->window[i].msgId)) {
+            if (send(client,this->window[i].offset,this->window[i].msgId) == 0) {
+                return sent;
+            }
+            sent++;
+        }
+    }
+
+    while (this->windowUsed < MQTT_MAX_INFLIGHT && this->sendOffset < this->tail) {
+        length = readHeader(this->sendOffset,header);
+        if (length == 0) {
+            // Unreadable from here on; stop the log at this record
+            this->tail = this->sendOffset;
+            this->damaged = true;
+            break;
+        }
+        msgId = send(client,this->sendOffset,0);
+        if (msgId == 0) {
+            break;
+        }
+        Entry& entry = this->window[this->windowUsed++];
+        entry.offset = this->sendOffset;
+        entry.length = length;
+        entry.msgId = msgId;
+        this->sendOffset += length;
+        sent++;
+    }
+    return sent;
+}
+
+uint32_t MQTTSpool::pending() {
+    return this->records;
+}
+
+uint8_t MQTTSpool::inflight() {
+    return this->windowUsed;
+}
+
+uint8_t MQTTSpool::retire(PubSubClient& client) {
+    uint8_t retired = 0;
+    uint8_t i;
+
+    // Records leave the log in order, so only the oldest ones can be retired
+    while (retired < this->windowUsed && !client.inflight(this->window[retired].msgId)) {
+        retired++;
+    }
+    if (retired == 0) {
+        return 0;
+    }
+    for (i = retired;i<this->windowUsed;i++) {
+        this->window[i-retired] = this->window[i];
+    }
+    this->windowUsed -= retired;
+    this->records -= retired;
+    this->head = this->windowUsed ? this->window[0].offset : this->sendOffset;
+    if (this->head == this->tail && this->windowUsed == 0) {
+        // Everything delivered; start the log afresh
+        this->store->clear();
+        this->head = this->tail = this->sendOffset = 0;
+        this->damaged = false;
+    } else {
+        this->store->setHead(this->head);
+    }
+    return retired;
+}
+
+// Drop the delivered records in front of head from the store
+boolean MQTTSpool::compact() {
+    uint8_t i;
+    if (!this->store->compact(this->head)) {
+        return false;
+    }
+    for (i = 0;i<this->windowUsed;i++) {
+        this->window[i].offset -= this->head;
+    }
+    this->tail -= this->head;
+    this->sendOffset -= this->head;
+    this->head = 0;
+    return true;
+}
+
+uint32_t MQTTSpool::readHeader(uint32_t offset, uint8_t* header) {
+    if (this->store->read(offset,header,MQTT_SPOOL_HEADER_SIZE) != MQTT_SPOOL_HEADER_SIZE) {
+        return 0;
+    }
+    uint16_t tlen = (header[2]<<8)+header[3];
+    uint16_t plength = (header[4]<<8)+header[5];
+    if (header[0] != MQTT_SPOOL_MAGIC || tlen == 0 || tlen > MQTT_SPOOL_MAX_TOPIC) {
+        return 0;
+    }
+    return MQTT_SPOOL_HEADER_SIZE + tlen + plength;
+}
+
+uint16_t MQTTSpool::send(PubSubClient& client, uint32_t offset, uint16_t msgId) {
+    uint8_t header[MQTT_SPOOL_HEADER_SIZE];
+    char topic[MQTT_SPOOL_MAX_TOPIC+1];
+    uint8_t chunk[MQTT_SPOOL_CHUNK];
+    uint16_t tlen;
+    uint16_t plength;
+    size_t n;
+
+    if (readHeader(offset,header) == 0) {
+        return 0;
+    }
+    tlen = (header[2]<<8)+header[3];
+    plength = (header[4]<<8)+header[5];
+    offset += MQTT_SPOOL_HEADER_SIZE;
+    if (this->store->read(offset,(uint8_t*)topic,tlen) != tlen) {
+        return 0;
+    }
+    topic[tlen] = 0;
+    offset += tlen;
+
+    msgId = client.beginPublishQos1(topic,plength,header[1] & MQTT_SPOOL_RETAINED,msgId);
+    if (msgId == 0) {
+        return 0;
+    }
+    while (plength > 0) {
+        n = (plength > MQTT_SPOOL_CHUNK) ? MQTT_SPOOL_CHUNK : plength;
+        if (this->store->read(offset,chunk,n) != n) {
+            break;
+        }
+        client.write(chunk,n);
+        offset += n;
+        plength -= n;
+    }
+    // A short payload closes the connection; the message is retransmitted after reconnecting
+    client.endPublish();
+    return msgId;
+}
+
+#if defined(ESP8266) || defined(ESP32)
+
+MQTTFileSpoolStore::MQTTFileSpoolStore(fs::FS& fs, const char* logPath, const char* headPath) {
+    this->fs = &fs;
+    this->logPath = logPath;
+    this->headPath = headPath;
+}
+
+uint32_t MQTTFileSpoolStore::size() {
+    fs::File f = this->fs->open(this->logPath, "r");
+    if (!f) {
+        return 0;
+    }
+    uint32_t size = f.size();
+    f.close();
+    return size;
+}
+
+size_t MQTTFileSpoolStore::read(uint32_t pos, uint8_t* buf, size_t length) {
+    if (!this->reader) {
+        this->reader = this->fs->open(this->logPath, "r");
+        if (!this->reader) {
+            return 0;
+        }
+    }
+    if (!this->reader.seek(pos)) {
+        return 0;
+    }
+    return this->reader.read(buf,length);
+}
+
+boolean MQTTFileSpoolStore::append(const MQTTSegment* segments, uint8_t count) {
+    // The reader would not see the new record
+    this->reader.close();
+    fs::File f = this->fs->open(this->logPath, "a");
+    if (!f) {
+        return false;
+    }
+    boolean ok = true;
+    uint8_t i;
+    for (i = 0;i<count && ok;i++) {
+        ok = (f.write(segments[i].data,segments[i].length) == segments[i].length);
+    }
+    f.close();
+    return ok;
+}
+
+uint32_t MQTTFileSpoolStore::head() {
+    uint8_t buf[4];
+    fs::File f = this->fs->open(this->headPath, "r");
+    if (!f) {
+        return 0;
+    }
+    size_t n = f.read(buf,4);
+    f.close();
+    if (n != 4) {
+        return 0;
+    }
+    return ((uint32_t)buf[0]<<24) | ((uint32_t)buf[1]<<16) | ((uint32_t)buf[2]<<8) | buf[3];
+}
+
+boolean MQTTFileSpoolStore::setHead(uint32_t head) {
+    uint8_t buf[4] = { (uint8_t)(head >> 24), (uint8_t)(head >> 16), (uint8_t)(head >> 8), (uint8_t)head };
+    fs::File f = this->fs->open(this->headPath, "w");
+    if (!f) {
+        return false;
+    }
+    boolean ok = (f.write(buf,4) == 4);
+    f.close();
+    return ok;
+}
+
+boolean MQTTFileSpoolStore::clear() {
+    this->reader.close();
+    if (this->fs->exists(this->logPath)) {
+        this->fs->remove(this->logPath);
+    }
+    if (this->fs->exists(this->headPath)) {
+        this->fs->remove(this->headPath);
+    }
+    return true;
+}
+
+boolean MQTTFileSpoolStore::compact(uint32_t head) {
+    uint8_t chunk[MQTT_SPOOL_CHUNK];
+    size_t n;
+    String tmpPath = String(this->logPath) + ".tmp";
+    this->reader.close();
+    fs::File src = this->fs->open(this->logPath, "r");
+    if (!src) {
+        return false;
+    }
+    fs::File dst = this->fs->open(tmpPath, "w");
+    if (!dst) {
+        src.close();
+        return false;
+    }
+    boolean ok = src.seek(head);
+    while (ok && (n = src.read(chunk,sizeof(chunk))) > 0) {
+        ok = (dst.write(chunk,n) == n);
+    }
+    src.close();
+    dst.close();
+    // Until the rename the old log is read from 0, so delivered records are sent again
+    if (!ok || !setHead(0)) {
+        this->fs->remove(tmpPath);
+        return false;
+    }
+    return this->fs->rename(tmpPath, this->logPath);
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ MQTTSpool.h - Persistent QoS 1 outbound queue for PubSubClient.
+*/
+
+#ifndef MQTTSpool_h
+#define MQTTSpool_h
+
+#include "PubSubClient.h"
+
+// MQTT_SPOOL_MAX_TOPIC : Longest topic a spooled message may have
+#ifndef MQTT_SPOOL_MAX_TOPIC
+#define MQTT_SPOOL_MAX_TOPIC 128
+#endif
+
+// MQTT_SPOOL_CHUNK : Bytes of payload read from the store per client write
+#ifndef MQTT_SPOOL_CHUNK
+#define MQTT_SPOOL_CHUNK 64
+#endif
+
+// Append-only storage behind an MQTTSpool
+class MQTTSpoolStore {
+public:
+   virtual ~MQTTSpoolStore() {}
+   // Number of bytes in the log
+   virtual uint32_t size() = 0;
+   // Read up to length bytes at pos. Returns the number of bytes read
+   virtual size_t read(uint32_t pos, uint8_t* buf, size_t length) = 0;
+   // Append one record made up of count segments. A record must be stored whole or not at all
+   virtual boolean append(const MQTTSegment* segments, uint8_t count) = 0;
+   // Offset of the oldest record not yet acknowledged, as last saved
+   virtual uint32_t head() = 0;
+   virtual boolean setHead(uint32_t head) = 0;
+   // Empty the log and reset head to 0
+   virtual boolean clear() = 0;
+   // Drop the bytes before head, so the log starts at the oldest record still queued,
+   // and reset head to 0. A power cut may keep delivered records, which are then sent
+   // again, but must never lose queued ones
+   virtual boolean compact(uint32_t head) = 0;
+};
+
+// Queues messages in an MQTTSpoolStore and drains them at QoS 1 through a
+// PubSubClient's in-flight window. A record stays in the log until the broker
+// has acknowledged it and every record before it, so queued readings survive
+// link loss and reboots. The log is emptied once it has been fully delivered, and
+// delivered records are dropped from its front when a new one would not fit, so the
+// limit caps the queued bytes rather than the bytes written since it was last empty.
+class MQTTSpool {
+private:
+   struct Entry {
+      uint32_t offset;
+      uint32_t length;
+      uint16_t msgId;
+   };
+   MQTTSpoolStore* store;
+   uint32_t limit;
+   uint32_t head;
+   uint32_t tail;
+   uint32_t sendOffset;
+   uint32_t records;
+   boolean damaged;
+   Entry window[MQTT_MAX_INFLIGHT];
+   uint8_t windowUsed;
+   // Read and check the record header at offset. Returns the record length, 0 if invalid
+   uint32_t readHeader(uint32_t offset, uint8_t* header);
+   uint16_t send(PubSubClient& client, uint32_t offset, uint16_t msgId);
+   uint8_t retire(PubSubClient& client);
+   boolean compact();
+public:
+   // limit : largest size, in bytes, the log may grow to
+   MQTTSpool(MQTTSpoolStore& store, uint32_t limit);
+
+   // Scan the records left in the store. Call once before use
+   boolean begin();
+   // Queue a message. Returns false if it does not fit
+   boolean push(const char* topic, const uint8_t* payload, uint16_t plength, boolean retained);
+   // Retire acknowledged messages, retransmit those interrupted by a reconnect and
+   // fill the in-flight window with the next queued ones. Call from loop() after client.loop()
+   // Returns the number of messages sent
+   uint8_t drain(PubSubClient& client);
+   // Messages queued, including those in flight
+   uint32_t pending();
+   // Messages sent and awaiting PUBACK
+   uint8_t inflight();
+};
+
+#if defined(ESP8266) || defined(ESP32)
+#include <FS.h>
+
+// MQTTSpoolStore on a flash file system such as LittleFS. Each record is
+// written and closed in one go, so a power cut never leaves half a record.
+// Compacting copies the queued records to logPath with ".tmp" appended and
+// renames it over the log
+class MQTTFileSpoolStore : public MQTTSpoolStore {
+private:
+   fs::FS* fs;
+   const char* logPath;
+   const char* headPath;
+   fs::File reader;
+public:
+   MQTTFileSpoolStore(fs::FS& fs, const char* logPath, const char* headPath);
+   virtual uint32_t size();
+   virtual size_t read(uint32_t pos, uint8_t* buf, size_t length);
+   virtual boolean append(const MQTTSegment* segments, uint8_t count);
+   virtual uint32_t head();
+   virtual boolean setHead(uint32_t head);
+   virtual boolean clear();
+   virtual boolean compact(uint32_t head);
+};
+#endif
+
+#endif
@@ -8,12 +8,25 @@
 #include "PubSubClient.h"
 #include "Arduino.h"
 
+// States of the incremental packet reader
+#define MQTT_READ_IDLE      0   // waiting for the fixed header byte
+#define MQTT_READ_LENGTH    1   // reading the remaining length
+#define MQTT_READ_BODY      2   // reading the variable header and payload
+
 PubSubClient::PubSubClient() {
     this->_state = MQTT_DISCONNECTED;
     this->_client = NULL;
     this->stream = NULL;
     setCallback(NULL);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -24,6 +37,14 @@ PubSubClient::PubSubClient(Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -35,6 +56,14 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -45,6 +74,14 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -56,6 +93,14 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -67,6 +112,14 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -78,6 +131,14 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -88,6 +149,14 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& s
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -99,6 +168,14 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -110,6 +187,14 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -121,6 +206,14 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -131,6 +224,14 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, St
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -142,6 +243,14 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -153,6 +262,14 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->publishing = false;
+    this->prepared = 0;
+    this->readState = MQTT_READ_IDLE;
+    this->inflightUsed = 0;
+    this->connectionCount = 0;
+    this->routeCount = 0;
+    this->wildcardCount = 0;
+    memset(this->routeTable,0,sizeof(this->routeTable));
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -160,6 +277,7 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
 
 PubSubClient::~PubSubClient() {
   free(this->buffer);
+  free(this->readBuffer);
 }
 
 boolean PubSubClient::connect(const char *id) {
@@ -195,6 +313,7 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 
         if (result == 1) {
             nextMsgId = 1;
+            this->readState = MQTT_READ_IDLE;
             // Leave room in the buffer for header and variable length field
             uint16_t length = MQTT_MAX_HEADER_SIZE;
             unsigned int j;
@@ -266,13 +385,15 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
             uint32_t len = readPacket(&llen);
 
             if (len == 4) {
-                if (buffer[3] == 0) {
+                if (this->readBuffer[3] == 0) {
                     lastInActivity = millis();
                     pingOutstanding = false;
+                    // Messages still in flight now need retransmitting
+                    this->connectionCount++;
                     _state = MQTT_CONNECTED;
                     return true;
                 } else {
-                    _state = buffer[3];
+                    _state = this->readBuffer[3];
                 }
             }
             _client->stop();
@@ -284,87 +405,103 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
     return true;
 }
 
-// reads a byte into result
-boolean PubSubClient::readByte(uint8_t * result) {
-   uint32_t previousMillis = millis();
-   while(!_client->available()) {
-     yield();
-     uint32_t currentMillis = millis();
-     if(currentMillis - previousMillis >= ((int32_t) this->socketTimeout * 1000)){
-       return false;
-     }
-   }
-   *result = _client->read();
-   return true;
-}
-
-// reads a byte into result[*index] and increments index
-boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
-  uint16_t current_index = *index;
-  uint8_t * write_address = &(result[current_index]);
-  if(readByte(write_address)){
-    *index = current_index + 1;
-    return true;
-  }
-  return false;
-}
-
+// Blocks until a whole packet has been read, or socketTimeout passes without a byte arriving
 uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
-    uint16_t len = 0;
-    if(!readByte(this->buffer, &len)) return 0;
-    bool isPublish = (this->buffer[0]&0xF0) == MQTTPUBLISH;
-    uint32_t multiplier = 1;
-    uint32_t length = 0;
-    uint8_t digit = 0;
-    uint16_t skip = 0;
-    uint32_t start = 0;
-
-    do {
-        if (len == 5) {
-            // Invalid remaining length encoding - kill the connection
-            _state = MQTT_DISCONNECTED;
-            _client->stop();
-            return 0;
-        }
-        if(!readByte(&digit)) return 0;
-        this->buffer[len++] = digit;
-        length += (digit & 127) * multiplier;
-        multiplier <<=7; //multiplier *= 128
-    } while ((digit & 128) != 0);
-    *lengthLength = len-1;
-
-    if (isPublish) {
-        // Read in topic length to calculate bytes to skip over for Stream writing
-        if(!readByte(this->buffer, &len)) return 0;
-        if(!readByte(this->buffer, &len)) return 0;
-        skip = (this->buffer[*lengthLength+1]<<8)+this->buffer[*lengthLength+2];
-        start = 2;
-        if (this->buffer[0]&MQTTQOS1) {
-            // skip message id
-            skip += 2;
-        }
-    }
-    uint32_t idx = len;
-
-    for (uint32_t i = start;i<length;i++) {
-        if(!readByte(&digit)) return 0;
-        if (this->stream) {
-            if (isPublish && idx-*lengthLength-2>skip) {
-                this->stream->write(digit);
+    uint32_t len;
+    uint32_t previousMillis = millis();
+    this->readState = MQTT_READ_IDLE;
+    while (true) {
+        if (_client->available()) {
+            len = readAvailable(lengthLength);
+            if (this->readState == MQTT_READ_IDLE) {
+                // The packet is complete, or was dropped
+                return len;
+            }
+            previousMillis = millis();
+        } else {
+            yield();
+            if (millis() - previousMillis >= ((int32_t) this->socketTimeout * 1000)) {
+                this->readState = MQTT_READ_IDLE;
+                return 0;
             }
         }
-
-        if (len < this->bufferSize) {
-            this->buffer[len] = digit;
-            len++;
-        }
-        idx++;
     }
+}
 
-    if (!this->stream && idx > this->bufferSize) {
-        len = 0; // This will cause the packet to be ignored.
+// Feeds whatever bytes the client has into the packet being assembled, keeping state
+// between calls. Returns the number of bytes held in the buffer once a packet is complete,
+// 0 while it is still arriving or if it had to be dropped
+uint32_t PubSubClient::readAvailable(uint8_t* lengthLength) {
+    if (!_client->available()) {
+        return 0;
     }
-    return len;
+    this->lastReadActivity = millis();
+    uint8_t digit;
+    uint32_t pos;
+    while (_client->available()) {
+        digit = _client->read();
+        switch (this->readState) {
+        case MQTT_READ_IDLE:
+            this->readBuffer[0] = digit;
+            this->readLen = 1;
+            this->readIdx = 1;
+            this->readRemaining = 0;
+            this->readMultiplier = 1;
+            this->readState = MQTT_READ_LENGTH;
+            break;
+        case MQTT_READ_LENGTH:
+            this->readBuffer[this->readLen++] = digit;
+            this->readIdx++;
+            this->readRemaining += (digit & 127) * this->readMultiplier;
+            this->readMultiplier <<= 7; //multiplier *= 128
+            if ((digit & 128) != 0) {
+                if (this->readLen == 5) {
+                    // Invalid remaining length encoding - kill the connection
+                    this->readState = MQTT_READ_IDLE;
+                    _state = MQTT_DISCONNECTED;
+                    _client->stop();
+                    return 0;
+                }
+                break;
+            }
+            this->readLengthLength = this->readLen-1;
+            this->readSkip = 0;
+            this->readState = MQTT_READ_BODY;
+            break;
+        default:
+            // Position within the variable header and payload
+            pos = this->readIdx-this->readLengthLength-1;
+            if ((this->readBuffer[0]&0xF0) == MQTTPUBLISH) {
+                // The topic length gives the bytes to skip over for Stream writing
+                if (pos == 0) {
+                    this->readSkip = digit << 8;
+                } else if (pos == 1) {
+                    this->readSkip += digit;
+                    if (this->readBuffer[0]&MQTTQOS1) {
+                        // skip message id
+                        this->readSkip += 2;
+                    }
+                } else if (this->stream && pos-2 >= this->readSkip) {
+                    this->stream->write(digit);
+                }
+            }
+            if (this->readLen < this->bufferSize) {
+                this->readBuffer[this->readLen++] = digit;
+            }
+            this->readIdx++;
+            this->readRemaining--;
+            break;
+        }
+        if (this->readState == MQTT_READ_BODY && this->readRemaining == 0) {
+            this->readState = MQTT_READ_IDLE;
+            *lengthLength = this->readLengthLength;
+            if (!this->stream && this->readIdx > this->bufferSize) {
+                return 0; // The packet did not fit in the buffer and is ignored.
+            }
+            return this->readLen;
+        }
+    }
+    return 0;
 }
 
 boolean PubSubClient::loop() {
@@ -376,55 +513,64 @@ boolean PubSubClient::loop() {
                 _client->stop();
                 return false;
             } else {
-                this->buffer[0] = MQTTPINGREQ;
-                this->buffer[1] = 0;
-                _client->write(this->buffer,2);
+                uint8_t ping[2] = { MQTTPINGREQ, 0 };
+                _client->write(ping,2);
                 lastOutActivity = t;
                 lastInActivity = t;
                 pingOutstanding = true;
             }
         }
+        if (this->readState != MQTT_READ_IDLE && !_client->available() &&
+                t - this->lastReadActivity >= this->socketTimeout*1000UL) {
+            // The rest of a partly received packet never arrived
+            this->readState = MQTT_READ_IDLE;
+            this->_state = MQTT_CONNECTION_TIMEOUT;
+            _client->stop();
+            return false;
+        }
         if (_client->available()) {
             uint8_t llen;
-            uint16_t len = readPacket(&llen);
+            uint16_t len = readAvailable(&llen);
             uint16_t msgId = 0;
             uint8_t *payload;
             if (len > 0) {
                 lastInActivity = t;
-                uint8_t type = this->buffer[0]&0xF0;
+                uint8_t type = this->readBuffer[0]&0xF0;
                 if (type == MQTTPUBLISH) {
-                    if (callback) {
-                        uint16_t tl = (this->buffer[llen+1]<<8)+this->buffer[llen+2]; /* topic length in bytes */
-                        memmove(this->buffer+llen+2,this->buffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
-                        this->buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
-                        char *topic = (char*) this->buffer+llen+2;
-                        // msgId only present for QOS>0
-                        if ((this->buffer[0]&0x06) == MQTTQOS1) {
-                            msgId = (this->buffer[llen+3+tl]<<8)+this->buffer[llen+3+tl+1];
-                            payload = this->buffer+llen+3+tl+2;
-                            callback(topic,payload,len-llen-3-tl-2);
-
-                            this->buffer[0] = MQTTPUBACK;
-                            this->buffer[1] = 2;
-                            this->buffer[2] = (msgId >> 8);
-                            this->buffer[3] = (msgId & 0xFF);
-                            _client->write(this->buffer,4);
-                            lastOutActivity = t;
-
-                        } else {
-                            payload = this->buffer+llen+3+tl;
-                            callback(topic,payload,len-llen-3-tl);
-                        }
+                    uint16_t tl = (this->readBuffer[llen+1]<<8)+this->readBuffer[llen+2]; /* topic length in bytes */
+                    char *topic = (char*) this->readBuffer+llen+3;
+                    uint16_t start = llen+3+tl;
+                    // msgId only present for QOS>0
+                    boolean qos1 = (this->readBuffer[0]&0x06) == MQTTQOS1;
+                    if (qos1) {
+                        msgId = (this->readBuffer[start]<<8)+this->readBuffer[start+1];
+                        start += 2;
+                    }
+                    payload = this->readBuffer+start;
+                    int8_t r = findRoute(topic,tl);
+                    if (r >= 0) {
+                        // The topic is passed with its length, so it stays where it is
+                        this->routes[r].handler(topic,tl,payload,len-start);
+                    } else if (callback) {
+                        memmove(this->readBuffer+llen+2,this->readBuffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
+                        this->readBuffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
+                        callback(topic-1,payload,len-start);
+                    }
+                    if (qos1 && (r >= 0 || callback)) {
+                        uint8_t ack[4] = { MQTTPUBACK, 2, (uint8_t)(msgId >> 8), (uint8_t)(msgId & 0xFF) };
+                        _client->write(ack,4);
+                        lastOutActivity = t;
                     }
                 } else if (type == MQTTPINGREQ) {
-                    this->buffer[0] = MQTTPINGRESP;
-                    this->buffer[1] = 0;
-                    _client->write(this->buffer,2);
+                    uint8_t pong[2] = { MQTTPINGRESP, 0 };
+                    _client->write(pong,2);
                 } else if (type == MQTTPINGRESP) {
                     pingOutstanding = false;
+                } else if (type == MQTTPUBACK) {
+                    removeInflight((this->readBuffer[llen+1]<<8)+this->readBuffer[llen+2]);
                 }
             } else if (!connected()) {
-                // readPacket has closed the connection
+                // readAvailable has closed the connection
                 return false;
             }
         }
@@ -523,37 +669,279 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
     return (rc == expectedLength);
 }
 
+boolean PubSubClient::publish(const char* topic, const MQTTSegment* segments, uint8_t count, boolean retained) {
+    uint32_t plength = 0;
+    uint8_t i;
+    for (i = 0;i<count;i++) {
+        plength += segments[i].length;
+    }
+    if (!writePublishHeader(topic,plength,MQTTPUBLISH | (retained ? 1 : 0),0)) {
+        return false;
+    }
+    boolean result = true;
+    for (i = 0;i<count && result;i++) {
+        result = writeBytes(segments[i].data,segments[i].length);
+    }
+    lastOutActivity = millis();
+    return result;
+}
+
 boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
-    if (connected()) {
-        // Send the header and variable length field
-        uint16_t length = MQTT_MAX_HEADER_SIZE;
-        length = writeString(topic,this->buffer,length);
-        uint8_t header = MQTTPUBLISH;
-        if (retained) {
-            header |= 1;
+    if (!writePublishHeader(topic,plength,MQTTPUBLISH | (retained ? 1 : 0),0)) {
+        return false;
+    }
+    this->publishing = true;
+    this->publishOk = true;
+    this->publishRemaining = plength;
+    this->publishFill = 0;
+    lastOutActivity = millis();
+    return true;
+}
+
+uint8_t* PubSubClient::preparePublish(const char* topic, uint16_t* size) {
+    this->prepared = 0;
+    if (!connected() || this->publishing) {
+        return NULL;
+    }
+    if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, this->bufferSize)) {
+        // Too long
+        return NULL;
+    }
+    this->prepared = writeString(topic,this->buffer,MQTT_MAX_HEADER_SIZE);
+    *size = this->bufferSize - this->prepared;
+    return this->buffer + this->prepared;
+}
+
+boolean PubSubClient::publishPrepared(uint16_t plength, boolean retained) {
+    uint16_t length = this->prepared;
+    this->prepared = 0;
+    if (length == 0 || plength > this->bufferSize - length || !connected()) {
+        return false;
+    }
+    uint8_t header = MQTTPUBLISH;
+    if (retained) {
+        header |= 1;
+    }
+    return write(header,this->buffer,length+plength-MQTT_MAX_HEADER_SIZE);
+}
+
+uint16_t PubSubClient::publishQos1(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained, uint16_t msgId) {
+    boolean resend = (msgId != 0);
+    msgId = startQos1(topic,plength,retained,msgId);
+    if (msgId == 0) {
+        return 0;
+    }
+    lastOutActivity = millis();
+    if (!writeBytes(payload,plength)) {
+        if (!resend) {
+            removeInflight(msgId);
         }
-        size_t hlen = buildHeader(header, this->buffer, plength+length-MQTT_MAX_HEADER_SIZE);
-        uint16_t rc = _client->write(this->buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen));
-        lastOutActivity = millis();
-        return (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen)));
+        return 0;
     }
-    return false;
+    return msgId;
+}
+
+uint16_t PubSubClient::beginPublishQos1(const char* topic, unsigned int plength, boolean retained, uint16_t msgId) {
+    msgId = startQos1(topic,plength,retained,msgId);
+    if (msgId == 0) {
+        return 0;
+    }
+    this->publishing = true;
+    this->publishOk = true;
+    this->publishRemaining = plength;
+    this->publishFill = 0;
+    lastOutActivity = millis();
+    return msgId;
+}
+
+boolean PubSubClient::inflight(uint16_t msgId) {
+    return findInflight(msgId) >= 0;
+}
+
+uint8_t PubSubClient::inflightCount() {
+    return this->inflightUsed;
+}
+
+boolean PubSubClient::retransmitDue(uint16_t msgId) {
+    int8_t slot = findInflight(msgId);
+    return slot >= 0 && this->inflightConnection[slot] != this->connectionCount;
 }
 
 int PubSubClient::endPublish() {
- return 1;
+    if (!this->publishing) {
+        return 1;
+    }
+    boolean result = flushPayload() && this->publishOk;
+    this->publishing = false;
+    if (this->publishRemaining > 0) {
+        // The broker is still waiting for payload; the stream can't be resynchronised
+        _client->stop();
+        return 0;
+    }
+    return result;
 }
 
 size_t PubSubClient::write(uint8_t data) {
     lastOutActivity = millis();
+    if (this->publishing) {
+        if (this->publishRemaining == 0) {
+            return 0;
+        }
+        this->buffer[this->publishFill++] = data;
+        this->publishRemaining--;
+        if (this->publishFill == this->bufferSize) {
+            flushPayload();
+        }
+        return 1;
+    }
     return _client->write(data);
 }
 
 size_t PubSubClient::write(const uint8_t *buffer, size_t size) {
     lastOutActivity = millis();
+    if (this->publishing) {
+        if (size > this->publishRemaining) {
+            size = this->publishRemaining;
+        }
+        if (this->publishFill + size > this->bufferSize) {
+            flushPayload();
+        }
+        if (size >= this->bufferSize) {
+            // Too big to stage; pass it straight through
+            this->publishOk = writeBytes(buffer,size) && this->publishOk;
+        } else {
+            memcpy(this->buffer+this->publishFill,buffer,size);
+            this->publishFill += size;
+        }
+        this->publishRemaining -= size;
+        return size;
+    }
     return _client->write(buffer,size);
 }
 
+boolean PubSubClient::flushPayload() {
+    if (this->publishFill > 0) {
+        this->publishOk = writeBytes(this->buffer,this->publishFill) && this->publishOk;
+        this->publishFill = 0;
+    }
+    return this->publishOk;
+}
+
+boolean PubSubClient::writePublishHeader(const char* topic, uint32_t plength, uint8_t header, uint16_t msgId) {
+    if (!connected() || topic == NULL) {
+        return false;
+    }
+    size_t tlen = strlen(topic);
+    uint32_t len = plength + 2 + tlen + (msgId ? 2 : 0);
+    if (tlen > 0xFFFF || len > 0x0FFFFFFF) {
+        // Topic or remaining length not encodable
+        return false;
+    }
+    // Fixed header, up to four bytes of remaining length and the topic length
+    uint8_t buf[MQTT_MAX_HEADER_SIZE+2];
+    uint8_t pos = 0;
+    uint8_t digit;
+    buf[pos++] = header;
+    do {
+        digit = len & 127; //digit = len %128
+        len >>= 7; //len = len / 128
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while(len>0);
+    buf[pos++] = (tlen >> 8);
+    buf[pos++] = (tlen & 0xFF);
+    if (!writeBytes(buf,pos) || !writeBytes((const uint8_t*)topic,tlen)) {
+        return false;
+    }
+    if (msgId) {
+        buf[0] = (msgId >> 8);
+        buf[1] = (msgId & 0xFF);
+        return writeBytes(buf,2);
+    }
+    return true;
+}
+
+uint16_t PubSubClient::startQos1(const char* topic, uint32_t plength, boolean retained, uint16_t msgId) {
+    uint8_t header = MQTTPUBLISH | MQTTQOS1 | (retained ? 1 : 0);
+    int8_t slot;
+    if (!connected()) {
+        return 0;
+    }
+    if (msgId) {
+        slot = findInflight(msgId);
+        if (slot < 0) {
+            return 0;
+        }
+        header |= 0x08; // DUP
+    } else {
+        if (this->inflightUsed == MQTT_MAX_INFLIGHT) {
+            return 0;
+        }
+        // Skip ids still in flight from an earlier connection
+        do {
+            nextMsgId++;
+            if (nextMsgId == 0) {
+                nextMsgId = 1;
+            }
+        } while (findInflight(nextMsgId) >= 0);
+        msgId = nextMsgId;
+        slot = -1;
+    }
+    if (!writePublishHeader(topic,plength,header,msgId)) {
+        return 0;
+    }
+    if (slot < 0) {
+        slot = this->inflightUsed++;
+        this->inflightIds[slot] = msgId;
+    }
+    this->inflightConnection[slot] = this->connectionCount;
+    return msgId;
+}
+
+int8_t PubSubClient::findInflight(uint16_t msgId) {
+    uint8_t i;
+    for (i = 0;i<this->inflightUsed;i++) {
+        if (this->inflightIds[i] == msgId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void PubSubClient::removeInflight(uint16_t msgId) {
+    int8_t slot = findInflight(msgId);
+    if (slot >= 0) {
+        this->inflightUsed--;
+        this->inflightIds[slot] = this->inflightIds[this->inflightUsed];
+        this->inflightConnection[slot] = this->inflightConnection[this->inflightUsed];
+    }
+}
+
+boolean PubSubClient::writeBytes(const uint8_t* buf, size_t length) {
+    size_t rc;
+#ifdef MQTT_MAX_TRANSFER_SIZE
+    size_t bytesToWrite;
+    while (length > 0) {
+        bytesToWrite = (length > MQTT_MAX_TRANSFER_SIZE)?MQTT_MAX_TRANSFER_SIZE:length;
+        rc = _client->write(buf,bytesToWrite);
+        if (rc != bytesToWrite) {
+            return false;
+        }
+        length -= rc;
+        buf += rc;
+    }
+    return true;
+#else
+    if (length == 0) {
+        return true;
+    }
+    rc = _client->write(buf,length);
+    return (rc == length);
+#endif
+}
+
 size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length) {
     uint8_t lenBuf[4];
     uint8_t llen = 0;
@@ -634,11 +1022,150 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
     return false;
 }
 
+boolean PubSubClient::subscribe(const char* topic, uint8_t qos, MQTT_ROUTE_SIGNATURE) {
+    if (topic == 0 || !route(topic, handler)) {
+        return false;
+    }
+    if (!subscribe(topic, qos)) {
+        unroute(topic);
+        return false;
+    }
+    return true;
+}
+
+boolean PubSubClient::route(const char* topicFilter, MQTT_ROUTE_SIGNATURE) {
+    size_t length = topicFilter ? strlen(topicFilter) : 0;
+    if (length == 0 || length > 0xFFFF) {
+        return false;
+    }
+    uint8_t i;
+    for (i = 0;i<this->routeCount;i++) {
+        if (this->routes[i].length == length && memcmp(this->routes[i].filter,topicFilter,length) == 0) {
+            // Replace the handler of an existing route
+            this->routes[i].handler = handler;
+            return true;
+        }
+    }
+    if (this->routeCount == MQTT_MAX_ROUTES) {
+        return false;
+    }
+    MQTTRoute& r = this->routes[this->routeCount++];
+    r.filter = topicFilter;
+    r.length = length;
+    r.hash = hashTopic(topicFilter,length);
+    r.wildcard = (strpbrk(topicFilter,"+#") != NULL);
+    r.handler = handler;
+    buildRouteTable();
+    return true;
+}
+
+boolean PubSubClient::unroute(const char* topicFilter) {
+    size_t length = topicFilter ? strlen(topicFilter) : 0;
+    uint8_t i;
+    for (i = 0;i<this->routeCount;i++) {
+        if (this->routes[i].length == length && memcmp(this->routes[i].filter,topicFilter,length) == 0) {
+            this->routeCount--;
+            this->routes[i] = this->routes[this->routeCount];
+            buildRouteTable();
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a
+uint32_t PubSubClient::hashTopic(const char* topic, uint16_t length) {
+    uint32_t hash = 2166136261UL;
+    uint16_t i;
+    for (i = 0;i<length;i++) {
+        hash ^= (uint8_t)topic[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+// Wildcard routes are kept after exact ones, so they are matched in one pass at the end
+void PubSubClient::buildRouteTable() {
+    uint8_t i;
+    uint8_t slot;
+    uint8_t exact = 0;
+    MQTTRoute swap;
+    for (i = 0;i<this->routeCount;i++) {
+        if (!this->routes[i].wildcard) {
+            if (i != exact) {
+                swap = this->routes[exact];
+                this->routes[exact] = this->routes[i];
+                this->routes[i] = swap;
+            }
+            exact++;
+        }
+    }
+    this->wildcardCount = this->routeCount - exact;
+    memset(this->routeTable,0,sizeof(this->routeTable));
+    for (i = 0;i<exact;i++) {
+        // Linear probing; the table is never more than half full
+        slot = this->routes[i].hash & (MQTT_ROUTE_TABLE_SIZE-1);
+        while (this->routeTable[slot] != 0) {
+            slot = (slot+1) & (MQTT_ROUTE_TABLE_SIZE-1);
+        }
+        this->routeTable[slot] = i+1;
+    }
+}
+
+int8_t PubSubClient::findRoute(const char* topic, uint16_t length) {
+    if (this->routeCount == 0) {
+        return -1;
+    }
+    uint32_t hash = hashTopic(topic,length);
+    uint8_t slot = hash & (MQTT_ROUTE_TABLE_SIZE-1);
+    uint8_t entry;
+    while ((entry = this->routeTable[slot]) != 0) {
+        MQTTRoute& r = this->routes[entry-1];
+        if (r.hash == hash && r.length == length && memcmp(r.filter,topic,length) == 0) {
+            return entry-1;
+        }
+        slot = (slot+1) & (MQTT_ROUTE_TABLE_SIZE-1);
+    }
+    uint8_t i;
+    for (i = this->routeCount-this->wildcardCount;i<this->routeCount;i++) {
+        if (matchFilter(this->routes[i].filter,topic,length)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Match a null-terminated topic filter against a topic of the given length
+boolean PubSubClient::matchFilter(const char* filter, const char* topic, uint16_t length) {
+    uint16_t pos = 0;
+    while (*filter) {
+        if (*filter == '#') {
+            // Matches the parent level and everything below it
+            return true;
+        }
+        if (*filter == '+') {
+            while (pos < length && topic[pos] != '/') {
+                pos++;
+            }
+            filter++;
+        } else {
+            if (pos == length || topic[pos] != *filter) {
+                // "a/#" also matches "a"
+                return (pos == length && filter[0] == '/' && filter[1] == '#' && filter[2] == 0);
+            }
+            pos++;
+            filter++;
+        }
+    }
+    return pos == length;
+}
+
 boolean PubSubClient::unsubscribe(const char* topic) {
 	size_t topicLength = strnlen(topic, this->bufferSize);
     if (topic == 0) {
         return false;
     }
+    unroute(topic);
     if (this->bufferSize < 9 + topicLength) {
         // Too long
         return false;
@@ -744,6 +1271,7 @@ boolean PubSubClient::setBufferSize(uint16_t size) {
     }
     if (this->bufferSize == 0) {
         this->buffer = (uint8_t*)malloc(size);
+        this->readBuffer = (uint8_t*)malloc(size);
     } else {
         uint8_t* newBuffer = (uint8_t*)realloc(this->buffer, size);
         if (newBuffer != NULL) {
@@ -751,9 +1279,19 @@ boolean PubSubClient::setBufferSize(uint16_t size) {
         } else {
             return false;
         }
+        newBuffer = (uint8_t*)realloc(this->readBuffer, size);
+        if (newBuffer != NULL) {
+            this->readBuffer = newBuffer;
+        } else {
+            return false;
+        }
+        if (this->readLen > size) {
+            // A packet being received no longer fits, so it is dropped once complete
+            this->readLen = size;
+        }
     }
     this->bufferSize = size;
-    return (this->buffer != NULL);
+    return (this->buffer != NULL && this->readBuffer != NULL);
 }
 
 uint16_t PubSubClient::getBufferSize() {
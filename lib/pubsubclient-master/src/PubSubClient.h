@@ -36,6 +36,11 @@
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_MAX_INFLIGHT : Maximum number of QoS 1 messages awaiting PUBACK
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 4
+#endif
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
@@ -83,12 +88,59 @@
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
 #endif
 
+// MQTT_MAX_ROUTES : Maximum number of topic routes. The exact-topic hash table has at least
+// twice as many slots, rounded up to a power of two so a slot is found with a mask
+#ifndef MQTT_MAX_ROUTES
+#define MQTT_MAX_ROUTES 16
+#endif
+#if MQTT_MAX_ROUTES <= 4
+#define MQTT_ROUTE_TABLE_SIZE 8
+#elif MQTT_MAX_ROUTES <= 8
+#define MQTT_ROUTE_TABLE_SIZE 16
+#elif MQTT_MAX_ROUTES <= 16
+#define MQTT_ROUTE_TABLE_SIZE 32
+#elif MQTT_MAX_ROUTES <= 32
+#define MQTT_ROUTE_TABLE_SIZE 64
+#elif MQTT_MAX_ROUTES <= 64
+#define MQTT_ROUTE_TABLE_SIZE 128
+#elif MQTT_MAX_ROUTES <= 127
+#define MQTT_ROUTE_TABLE_SIZE 256
+#else
+#error "MQTT_MAX_ROUTES must be at most 127"
+#endif
+
+// Route handlers get the topic as it sits in the receive buffer; it is topicLength bytes long
+// and NOT null-terminated
+#if defined(ESP8266) || defined(ESP32)
+#define MQTT_ROUTE_SIGNATURE std::function<void(const char*, uint16_t, uint8_t*, unsigned int)> handler
+#else
+#define MQTT_ROUTE_SIGNATURE void (*handler)(const char*, uint16_t, uint8_t*, unsigned int)
+#endif
+
+// A topic filter and the handler its messages are dispatched to
+struct MQTTRoute {
+   const char* filter;
+   uint16_t length;
+   uint32_t hash;
+   boolean wildcard;
+   MQTT_ROUTE_SIGNATURE;
+};
+
+// A slice of a scatter/gather publish payload; see publish(topic, segments, count, retained)
+struct MQTTSegment {
+   const uint8_t* data;
+   size_t length;
+};
+
 #define CHECK_STRING_LENGTH(l,s) if (l+2+strnlen(s, this->bufferSize) > this->bufferSize) {_client->stop();return false;}
 
 class PubSubClient : public Print {
 private:
    Client* _client;
    uint8_t* buffer;
+   // Received packets are assembled here, apart from buffer, so a packet that arrives
+   // over several loop() calls is not overwritten by publishing in between
+   uint8_t* readBuffer;
    uint16_t bufferSize;
    uint16_t keepAlive;
    uint16_t socketTimeout;
@@ -98,8 +150,16 @@ private:
    bool pingOutstanding;
    MQTT_CALLBACK_SIGNATURE;
    uint32_t readPacket(uint8_t*);
-   boolean readByte(uint8_t * result);
-   boolean readByte(uint8_t * result, uint16_t * index);
+   uint32_t readAvailable(uint8_t*);
+   // Incremental packet reader state, kept across loop() calls
+   uint8_t readState;
+   uint8_t readLengthLength;
+   uint16_t readLen;
+   uint16_t readSkip;
+   uint32_t readIdx;
+   uint32_t readRemaining;
+   uint32_t readMultiplier;
+   unsigned long lastReadActivity;
    boolean write(uint8_t header, uint8_t* buf, uint16_t length);
    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
    // Build up the header ready to send
@@ -107,6 +167,37 @@ private:
    // Note: the header is built at the end of the first MQTT_MAX_HEADER_SIZE bytes, so will start
    //       (MQTT_MAX_HEADER_SIZE - <returned size>) bytes into the buffer
    size_t buildHeader(uint8_t header, uint8_t* buf, uint16_t length);
+   // Write the fixed header and topic of a PUBLISH straight to the client
+   // msgId is written after the topic when not 0
+   boolean writePublishHeader(const char* topic, uint32_t plength, uint8_t header, uint16_t msgId);
+   // Write the header of a QoS 1 publish and track its message id in the in-flight window
+   uint16_t startQos1(const char* topic, uint32_t plength, boolean retained, uint16_t msgId);
+   int8_t findInflight(uint16_t msgId);
+   void removeInflight(uint16_t msgId);
+   // Write bytes to the client, honouring MQTT_MAX_TRANSFER_SIZE
+   boolean writeBytes(const uint8_t* buf, size_t length);
+   // Send the payload bytes staged in the buffer during beginPublish/endPublish
+   boolean flushPayload();
+   boolean publishing;
+   boolean publishOk;
+   uint32_t publishRemaining;
+   uint16_t publishFill;
+   // Buffer position after the topic written by preparePublish, 0 when nothing is prepared
+   uint16_t prepared;
+   // QoS 1 messages awaiting PUBACK, and the connection each was last sent on
+   uint16_t inflightIds[MQTT_MAX_INFLIGHT];
+   uint16_t inflightConnection[MQTT_MAX_INFLIGHT];
+   uint8_t inflightUsed;
+   uint16_t connectionCount;
+   // Topic routes; exact topics are found through routeTable, wildcard filters are matched in turn
+   MQTTRoute routes[MQTT_MAX_ROUTES];
+   uint8_t routeCount;
+   uint8_t routeTable[MQTT_ROUTE_TABLE_SIZE];
+   uint8_t wildcardCount;
+   static uint32_t hashTopic(const char* topic, uint16_t length);
+   static boolean matchFilter(const char* filter, const char* topic, uint16_t length);
+   int8_t findRoute(const char* topic, uint16_t length);
+   void buildRouteTable();
    IPAddress ip;
    const char* domain;
    uint16_t port;
@@ -154,25 +245,63 @@ public:
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    boolean publish_P(const char* topic, const char* payload, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Publish a payload made up of several segments. The fixed header, topic and each
+   // segment are written straight to the client; nothing is copied into the buffer,
+   // so neither topic nor payload is limited by the buffer size
+   // Returns 1 if the whole packet was written, 0 if there was an error
+   boolean publish(const char* topic, const MQTTSegment* segments, uint8_t count, boolean retained);
    // Start to publish a message.
    // This API:
    //   beginPublish(...)
    //   one or more calls to write(...)
    //   endPublish()
    // Allows for arbitrarily large payloads to be sent without them having to be copied into
-   // a new buffer and held in memory at one time
+   // a new buffer and held in memory at one time. Payload bytes are gathered in the
+   // buffer and passed to the client a buffer at a time, so Print-based writers such as
+   // print() or serializeJson() do not cost one network write per byte
    // Returns 1 if the message was started successfully, 0 if there was an error
    boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
    // Finish off this publish message (started with beginPublish)
-   // Returns 1 if the packet was sent successfully, 0 if there was an error
+   // Returns 1 if the packet was sent successfully, 0 if there was an error. If fewer than
+   // plength bytes were written the packet cannot be completed and the connection is closed
    int endPublish();
    // Write a single byte of payload (only to be used with beginPublish/endPublish)
    virtual size_t write(uint8_t);
    // Write size bytes from buffer into the payload (only to be used with beginPublish/endPublish)
    // Returns the number of bytes written
    virtual size_t write(const uint8_t *buffer, size_t size);
+   // Publish a payload encoded in place. preparePublish writes the topic into the buffer
+   // and returns where the payload goes, with the space left in size; the caller encodes
+   // its payload there and sends it with publishPrepared. Nothing else may publish
+   // in between, as that shares the buffer.
+   // Returns NULL if not connected or the topic does not fit
+   uint8_t* preparePublish(const char* topic, uint16_t* size);
+   // Send the plength bytes encoded at the pointer returned by preparePublish
+   boolean publishPrepared(uint16_t plength, boolean retained);
+   // Publish at QoS 1. A new message (msgId 0) is given the next free message id, which is
+   // returned and held in the in-flight window until the broker's PUBACK arrives. Passing the
+   // id of a message still in flight sends it again with the DUP flag set.
+   // Returns the message id, or 0 if not connected, the window is full or msgId is not in flight
+   uint16_t publishQos1(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, uint16_t msgId = 0);
+   // As publishQos1, with the payload streamed through write(...) and endPublish()
+   uint16_t beginPublishQos1(const char* topic, unsigned int plength, boolean retained, uint16_t msgId = 0);
+   // True while msgId waits for its PUBACK
+   boolean inflight(uint16_t msgId);
+   uint8_t inflightCount();
+   // True if msgId is in flight but was last sent before the current connection
+   boolean retransmitDue(uint16_t msgId);
    boolean subscribe(const char* topic);
    boolean subscribe(const char* topic, uint8_t qos);
+   // Subscribe and route the topic's messages to handler instead of the callback
+   boolean subscribe(const char* topic, uint8_t qos, MQTT_ROUTE_SIGNATURE);
+   // Dispatch messages matching topicFilter to handler. Exact topics are looked up by hash,
+   // filters with + or # are matched after that. The filter string is not copied and must
+   // stay valid. Messages matching no route go to the callback.
+   // Returns false if all MQTT_MAX_ROUTES routes are in use
+   boolean route(const char* topicFilter, MQTT_ROUTE_SIGNATURE);
+   // Remove the route for topicFilter
+   boolean unroute(const char* topicFilter);
+   // Unsubscribe, also removing the topic's route
    boolean unsubscribe(const char* topic);
    boolean loop();
    boolean connected();
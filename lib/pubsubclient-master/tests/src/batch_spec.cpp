@@ -0,0 +1,244 @@
+#include "PubSubClient.h"
+#include "MQTTBatch.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <unistd.h>
+#include <math.h>
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Spool store held in memory, standing in for a file on LittleFS
+class MemorySpoolStore : public MQTTSpoolStore {
+public:
+    uint8_t log[1024];
+    uint32_t length;
+
+    MemorySpoolStore() : length(0) {}
+
+    uint32_t size() { return length; }
+    size_t read(uint32_t pos, uint8_t* buf, size_t n) {
+        if (pos + n > length) {
+            return 0;
+        }
+        memcpy(buf, log + pos, n);
+        return n;
+    }
+    boolean append(const MQTTSegment* segments, uint8_t count) {
+        for (int i = 0; i < count; i++) {
+            memcpy(log + length, segments[i].data, segments[i].length);
+            length += segments[i].length;
+        }
+        return true;
+    }
+    uint32_t head() { return 0; }
+    boolean setHead(uint32_t head) { return true; }
+    boolean clear() { length = 0; return true; }
+    boolean compact(uint32_t head) {
+        memmove(log, log + head, length - head);
+        length -= head;
+        return true;
+    }
+};
+
+// Expect a QoS 0 PUBLISH of payload to topic "p"
+void expectPublish(ShimClient& shimClient, const char* payload) {
+    byte publish[256];
+    uint16_t pl = strlen(payload);
+    publish[0] = 0x30;
+    publish[1] = 3 + pl;
+    publish[2] = 0;
+    publish[3] = 1;
+    publish[4] = 'p';
+    memcpy(publish+5,payload,pl);
+    shimClient.expect(publish,5+pl);
+}
+
+
+int test_batch_cycle() {
+    IT("publishes the samples of a cycle as one JSON array");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    char buffer[128];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    IS_TRUE(batch.endCycle());
+    IS_EQUAL(batch.messages(), 0);
+
+    IS_TRUE(batch.add("ua", 230.1, 1));
+    IS_TRUE(batch.add("ia", -12.340, 3));
+    IS_TRUE(batch.add("st", "on"));
+    IS_EQUAL(batch.pending(), 3);
+
+    const char* json = "[{\"ua\":230.1},{\"ia\":-12.34},{\"st\":\"on\"}]";
+    expectPublish(shimClient, json);
+    IS_TRUE(batch.endCycle());
+    IS_FALSE(shimClient.error());
+    IS_EQUAL(batch.pending(), 0);
+    IS_EQUAL(batch.messages(), 1);
+    IS_EQUAL(batch.samples(), 3);
+    IS_EQUAL(batch.bytes(), 5 + strlen(json));
+    // alone, each would be 5 bytes of header and topic plus [{...}]
+    uint32_t separate = (5 + 14) + (5 + 15) + (5 + 13);
+    IS_EQUAL(batch.saved(), separate - (5 + strlen(json)));
+
+    END_IT
+}
+
+int test_batch_full() {
+    IT("sends a full buffer early and drops samples that can never fit");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    char buffer[24];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    IS_TRUE(batch.add("a", 1.0, 2));
+    IS_TRUE(batch.add("b", 2.5, 2));
+    IS_EQUAL(batch.messages(), 0);
+
+    expectPublish(shimClient, "[{\"a\":1},{\"b\":2.5}]");
+    IS_TRUE(batch.add("c", 3.0, 0));
+    IS_EQUAL(batch.messages(), 1);
+    IS_EQUAL(batch.pending(), 1);
+    IS_FALSE(shimClient.error());
+
+    IS_FALSE(batch.add("a_point_id_much_too_long_for_the_buffer", "0123456789"));
+    IS_EQUAL(batch.dropped(), 1);
+
+    END_IT
+}
+
+int test_batch_latency() {
+    IT("sends a batch once its oldest sample reaches the maximum latency");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    char buffer[128];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    batch.setMaxLatency(1000);
+    IS_TRUE(batch.loop());
+    IS_TRUE(batch.add("a", 1.0, 1));
+    IS_TRUE(batch.loop());
+    IS_EQUAL(batch.messages(), 0);
+
+    sleep(2);
+    expectPublish(shimClient, "[{\"a\":1}]");
+    IS_TRUE(batch.loop());
+    IS_EQUAL(batch.messages(), 1);
+    IS_EQUAL(batch.saved(), 0);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_escape() {
+    IT("escapes ids and text values and writes non-finite values as null");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    char buffer[128];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    IS_TRUE(batch.add("a\"b", "c\\d"));
+    IS_TRUE(batch.add("e", "f\ng"));
+    IS_TRUE(batch.add("h", NAN, 1));
+
+    expectPublish(shimClient, "[{\"a\\\"b\":\"c\\\\d\"},{\"e\":\"f\\u000ag\"},{\"h\":null}]");
+    IS_TRUE(batch.endCycle());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_precision() {
+    IT("writes readings with the digits of a double");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    char buffer[128];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    IS_TRUE(batch.add("e", 12345678.9, 1));
+    IS_TRUE(batch.add("n", 4294967295.0, 0));
+
+    expectPublish(shimClient, "[{\"e\":12345678.9},{\"n\":4294967295}]");
+    IS_TRUE(batch.endCycle());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_offline() {
+    IT("drops batches while offline unless spooled");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+
+    char buffer[128];
+    MQTTBatch batch(client, "p", buffer, sizeof(buffer));
+    IS_TRUE(batch.add("a", 1.0, 1));
+    IS_TRUE(batch.add("b", 2.0, 1));
+    IS_FALSE(batch.endCycle());
+    IS_EQUAL(batch.dropped(), 2);
+    IS_EQUAL(batch.pending(), 0);
+
+    MemorySpoolStore store;
+    MQTTSpool spool(store, sizeof(store.log));
+    spool.begin();
+    batch.setSpool(&spool);
+    IS_TRUE(batch.add("a", 1.0, 1));
+    IS_TRUE(batch.endCycle());
+    IS_EQUAL(spool.pending(), 1);
+    IS_EQUAL(batch.messages(), 1);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Batch");
+
+    test_batch_cycle();
+    test_batch_full();
+    test_batch_latency();
+    test_batch_escape();
+    test_batch_precision();
+    test_batch_offline();
+
+    FINISH
+}
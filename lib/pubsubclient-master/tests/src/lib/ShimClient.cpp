@@ -18,6 +18,7 @@ ShimClient::ShimClient() {
     this->_error = false;
     this->expectAnything = true;
     this->_received = 0;
+    this->_writes = 0;
     this->_expectedPort = 0;
 }
 
@@ -56,6 +57,7 @@ int ShimClient::connect(const char *host, uint16_t port)  {
 }
 size_t ShimClient::write(uint8_t b)  {
     this->_received += 1;
+    this->_writes += 1;
     TRACE(std::hex << (unsigned int)b);
     if (!this->expectAnything) {
         if (this->expectBuffer->available()) {
@@ -73,6 +75,7 @@ size_t ShimClient::write(uint8_t b)  {
 }
 size_t ShimClient::write(const uint8_t *buf, size_t size)  {
     this->_received += size;
+    this->_writes += 1;
     TRACE( "[" << std::dec << (unsigned int)(size) << "] ");
     uint16_t i=0;
     for (;i<size;i++) {
@@ -142,6 +145,10 @@ uint16_t ShimClient::received() {
     return this->_received;
 }
 
+uint16_t ShimClient::writes() {
+    return this->_writes;
+}
+
 void ShimClient::expectConnect(IPAddress ip, uint16_t port) {
     this->_expectedIP = ip;
     this->_expectedPort = port;
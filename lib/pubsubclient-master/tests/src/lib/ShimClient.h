@@ -16,6 +16,7 @@ private:
     bool expectAnything;
     bool _error;
     uint16_t _received;
+    uint16_t _writes;
     IPAddress _expectedIP;
     uint16_t _expectedPort;
     const char* _expectedHost;
@@ -42,6 +43,7 @@ public:
   virtual void expectConnect(const char *host, uint16_t port);
   
   virtual uint16_t received();
+  virtual uint16_t writes();
   virtual bool error();
   
   virtual void setAllowConnect(bool b);
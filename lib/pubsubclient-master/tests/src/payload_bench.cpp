@@ -0,0 +1,76 @@
+/*
+ * Size and encode time of one property/post record of 24 meter points in
+ * each payload encoding, against the id/value JSON array built with
+ * snprintf that the firmware posts today.
+ *
+ * Results are host timings and only meaningful relative to each other.
+ */
+#include "MQTTPayload.h"
+#include <chrono>
+#include <cstdio>
+
+static const uint32_t kIterations = 200000;
+static const uint8_t kPoints = 24;
+
+static const char* ids[kPoints] = {
+    "priThreePhaseVoltageA", "priThreePhaseVoltageB", "priThreePhaseVoltageC",
+    "priThreePhaseCurrentA", "priThreePhaseCurrentB", "priThreePhaseCurrentC",
+    "priThreePhasePowerA", "priThreePhasePowerB", "priThreePhasePowerC",
+    "priThreePhasePowerTotal", "priReactivePowerTotal", "priApparentPowerTotal",
+    "priPowerFactorA", "priPowerFactorB", "priPowerFactorC",
+    "priPowerFactorTotal", "priFrequency", "priThreePhaseEnergy",
+    "priReverseEnergy", "priReactiveEnergy", "priTemperature",
+    "priDemand", "priMaxDemand", "priStatus"
+};
+
+static float values[kPoints];
+static volatile uint32_t sink;
+
+static uint16_t legacy(uint8_t* buffer, uint16_t size) {
+    int n = snprintf((char*)buffer, size, "[");
+    for (uint8_t i = 0; i < kPoints; i++) {
+        n += snprintf((char*)buffer + n, size - n, "%s{\"id\":\"%s\",\"value\":\"%.2f\"}",
+                      i ? "," : "", ids[i], values[i]);
+    }
+    n += snprintf((char*)buffer + n, size - n, "]");
+    return n;
+}
+
+static uint16_t encode(MQTTPayload& payload, uint8_t* buffer, uint16_t size) {
+    payload.begin(buffer, size);
+    for (uint8_t i = 0; i < kPoints; i++) {
+        payload.add(ids[i], values[i], 2);
+    }
+    return payload.end();
+}
+
+template <typename F>
+static void report(const char* name, F f) {
+    uint16_t length = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kIterations; i++) {
+        length = f();
+        sink += length;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("  %-24s %5u bytes %8.1f ns/record\n", name, length, ns / kIterations);
+}
+
+int main() {
+    for (uint8_t i = 0; i < kPoints; i++) {
+        values[i] = 200.0f + i * 1.37f;
+    }
+    values[kPoints - 1] = 1;
+
+    static uint8_t buffer[2048];
+    MQTTPayload json(MQTT_PAYLOAD_JSON);
+    MQTTPayload msgpack(MQTT_PAYLOAD_MSGPACK);
+    MQTTPayload binary(MQTT_PAYLOAD_BINARY, 1);
+
+    printf("%u points, %u records\n", kPoints, kIterations);
+    report("JSON id/value array", [&]() { return legacy(buffer, sizeof(buffer)); });
+    report("JSON object", [&]() { return encode(json, buffer, sizeof(buffer)); });
+    report("MessagePack", [&]() { return encode(msgpack, buffer, sizeof(buffer)); });
+    report("binary, schema id", [&]() { return encode(binary, buffer, sizeof(buffer)); });
+    return 0;
+}
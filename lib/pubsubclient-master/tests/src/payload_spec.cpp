@@ -0,0 +1,273 @@
+#include "PubSubClient.h"
+#include "MQTTPayload.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <math.h>
+#include <vector>
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+
+int test_payload_json() {
+    IT("encodes a record as a JSON object");
+    uint8_t buffer[64];
+    MQTTPayload payload(MQTT_PAYLOAD_JSON);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.add("ua", 230.1, 1));
+    IS_TRUE(payload.add("ia", -12.340, 3));
+    IS_TRUE(payload.addInt("st", 1));
+    uint16_t length = payload.end();
+
+    const char* json = "{\"ua\":230.1,\"ia\":-12.34,\"st\":1}";
+    IS_EQUAL(length, strlen(json));
+    IS_TRUE(memcmp(buffer, json, length) == 0);
+    IS_EQUAL(payload.values(), 3);
+
+    END_IT
+}
+
+int test_payload_json_not_finite() {
+    IT("encodes NaN and infinity as null in JSON");
+    uint8_t buffer[64];
+    MQTTPayload payload(MQTT_PAYLOAD_JSON);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.add("a", NAN, 1));
+    IS_TRUE(payload.add("b", INFINITY, 1));
+    IS_TRUE(payload.add("c", -INFINITY, 1));
+    uint16_t length = payload.end();
+
+    const char* json = "{\"a\":null,\"b\":null,\"c\":null}";
+    IS_EQUAL(length, strlen(json));
+    IS_TRUE(memcmp(buffer, json, length) == 0);
+
+    END_IT
+}
+
+int test_payload_json_escape() {
+    IT("escapes ids in JSON");
+    uint8_t buffer[64];
+    MQTTPayload payload(MQTT_PAYLOAD_JSON);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.addInt("a\"b", 1));
+    IS_TRUE(payload.addInt("c\\d\n", 2));
+    uint16_t length = payload.end();
+
+    const char* json = "{\"a\\\"b\":1,\"c\\\\d\\u000a\":2}";
+    IS_EQUAL(length, strlen(json));
+    IS_TRUE(memcmp(buffer, json, length) == 0);
+
+    // the escaped id no longer fits
+    payload.begin(buffer, 8);
+    IS_FALSE(payload.addInt("\"\"\"", 1));
+    IS_EQUAL(payload.end(), 0);
+
+    END_IT
+}
+
+int test_payload_precision() {
+    IT("keeps the digits of a double until a 4 byte float is written");
+    uint8_t buffer[64];
+    MQTTPayload payload(MQTT_PAYLOAD_JSON);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.add("e", 12345678.9, 1));
+    uint16_t length = payload.end();
+    const char* json = "{\"e\":12345678.9}";
+    IS_EQUAL(length, strlen(json));
+    IS_TRUE(memcmp(buffer, json, length) == 0);
+
+    // 16777217 has no float, but is an integer
+    MQTTPayload packed(MQTT_PAYLOAD_MSGPACK);
+    packed.begin(buffer, sizeof(buffer));
+    IS_TRUE(packed.add("n", 16777217.0, 0));
+    length = packed.end();
+    byte expected[] = { 0x81, 0xa1, 'n', 0xce, 0x01, 0x00, 0x00, 0x01 };
+    IS_EQUAL(length, sizeof(expected));
+    IS_TRUE(memcmp(buffer, expected, length) == 0);
+
+    END_IT
+}
+
+int test_payload_msgpack() {
+    IT("encodes a record as a MessagePack map");
+    uint8_t buffer[128];
+    MQTTPayload payload(MQTT_PAYLOAD_MSGPACK);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.add("ua", 230.5, 1));
+    IS_TRUE(payload.add("e", 1000.0, 2));
+    IS_TRUE(payload.addInt("t", -5));
+    IS_TRUE(payload.addInt("n", -200));
+    IS_TRUE(payload.addInt("c", 70000));
+    uint16_t length = payload.end();
+
+    byte expected[] = {
+        0x85,
+        0xa2, 'u', 'a', 0xca, 0x43, 0x66, 0x80, 0x00,
+        0xa1, 'e', 0xcd, 0x03, 0xe8,
+        0xa1, 't', 0xfb,
+        0xa1, 'n', 0xd1, 0xff, 0x38,
+        0xa1, 'c', 0xce, 0x00, 0x01, 0x11, 0x70
+    };
+    IS_EQUAL(length, sizeof(expected));
+    IS_TRUE(memcmp(buffer, expected, length) == 0);
+
+    // more than 15 values need a map 16 header
+    char ids[20][3];
+    payload.begin(buffer, sizeof(buffer));
+    for (int i = 0; i < 20; i++) {
+        ids[i][0] = 'a' + i;
+        ids[i][1] = 0;
+        IS_TRUE(payload.addInt(ids[i], i));
+    }
+    length = payload.end();
+    IS_EQUAL(length, 3 + 20 * 3);
+    IS_EQUAL(buffer[0], 0xde);
+    IS_EQUAL(buffer[1], 0);
+    IS_EQUAL(buffer[2], 20);
+    IS_EQUAL(buffer[3], 0xa1);
+    IS_EQUAL(buffer[4], 'a');
+    IS_EQUAL(buffer[5], 0);
+
+    END_IT
+}
+
+int test_payload_binary() {
+    IT("encodes a record as a fixed binary record with its schema id");
+    uint8_t buffer[32];
+    MQTTPayload payload(MQTT_PAYLOAD_BINARY, 7);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.add("ua", 230.5, 1));
+    IS_TRUE(payload.addInt("c", -2));
+    uint16_t length = payload.end();
+
+    byte expected[] = { 7, 2, 0x00, 0x80, 0x66, 0x43, 0xfe, 0xff, 0xff, 0xff };
+    IS_EQUAL(length, sizeof(expected));
+    IS_TRUE(memcmp(buffer, expected, length) == 0);
+
+    IS_EQUAL(MQTTPayload::encodingFor("binary"), MQTT_PAYLOAD_BINARY);
+    IS_EQUAL(MQTTPayload::encodingFor("msgpack"), MQTT_PAYLOAD_MSGPACK);
+    IS_EQUAL(MQTTPayload::encodingFor("json"), MQTT_PAYLOAD_JSON);
+    IS_EQUAL(MQTTPayload::encodingFor(NULL), MQTT_PAYLOAD_JSON);
+
+    END_IT
+}
+
+// Stands in for an entry of the parsed payloadEncoding array,
+// {"<topic>": "<encoding>", "schemaId": <schemaId>}, without schemaId if it is
+// negative
+struct EncodingValue {
+    const char* text;
+    int number;
+    operator const char*() const { return text; }
+    int operator|(int fallback) const { return number < 0 ? fallback : number; }
+};
+
+struct EncodingEntry {
+    const char* topic;
+    const char* encoding;
+    int schemaId;
+    EncodingValue operator[](const char* key) const {
+        if (strcmp(key, "schemaId") == 0) {
+            return { NULL, schemaId };
+        }
+        return { strcmp(key, topic) == 0 ? encoding : NULL, -1 };
+    }
+};
+
+int test_payload_for_topic() {
+    IT("looks up the encoding configured for a topic");
+    std::vector<EncodingEntry> entries = {
+        { "pPropertyTopic", "msgpack", -1 },
+        { "pMonitorTopic", "binary", 3 }
+    };
+
+    MQTTPayload property = MQTTPayload::forTopic(entries, "pPropertyTopic");
+    IS_EQUAL(property.getEncoding(), MQTT_PAYLOAD_MSGPACK);
+    IS_EQUAL(property.getSchemaId(), 0);
+    MQTTPayload monitor = MQTTPayload::forTopic(entries, "pMonitorTopic");
+    IS_EQUAL(monitor.getEncoding(), MQTT_PAYLOAD_BINARY);
+    IS_EQUAL(monitor.getSchemaId(), 3);
+    MQTTPayload info = MQTTPayload::forTopic(entries, "pInfoTopic");
+    IS_EQUAL(info.getEncoding(), MQTT_PAYLOAD_JSON);
+    IS_EQUAL(MQTTPayload::forTopic(std::vector<EncodingEntry>(), "pInfoTopic").getEncoding(), MQTT_PAYLOAD_JSON);
+
+    END_IT
+}
+
+int test_payload_overflow() {
+    IT("reports a record that does not fit");
+    uint8_t buffer[10];
+    MQTTPayload payload(MQTT_PAYLOAD_JSON);
+    payload.begin(buffer, sizeof(buffer));
+    IS_TRUE(payload.addInt("a", 1));
+    IS_FALSE(payload.addInt("bb", 22));
+    IS_EQUAL(payload.end(), 0);
+
+    // the closing brace no longer fits
+    payload.begin(buffer, 6);
+    IS_TRUE(payload.addInt("a", 1));
+    IS_EQUAL(payload.end(), 0);
+
+    END_IT
+}
+
+int test_payload_publish() {
+    IT("encodes in the client buffer and publishes it");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    MQTTPayload payload(MQTT_PAYLOAD_MSGPACK);
+    IS_FALSE(payload.begin(client, "p"));
+    IS_FALSE(payload.publish(false));
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_TRUE(payload.begin(client, "p"));
+    IS_TRUE(payload.addInt("a", 1));
+    IS_TRUE(payload.addInt("b", 2));
+    byte publish[] = { 0x31, 0x0a, 0x00, 0x01, 'p', 0x82, 0xa1, 'a', 0x01, 0xa1, 'b', 0x02 };
+    shimClient.expect(publish, sizeof(publish));
+    IS_TRUE(payload.publish(true));
+    IS_FALSE(shimClient.error());
+
+    // a prepared payload is sent once
+    IS_FALSE(client.publishPrepared(7, false));
+
+    // a record too big for the buffer is not sent
+    client.setBufferSize(16);
+    IS_TRUE(payload.begin(client, "p"));
+    for (int i = 0; i < 5; i++) {
+        payload.addInt("a", i);
+    }
+    IS_FALSE(payload.publish(false));
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Payload");
+
+    test_payload_json();
+    test_payload_json_not_finite();
+    test_payload_json_escape();
+    test_payload_precision();
+    test_payload_msgpack();
+    test_payload_binary();
+    test_payload_for_topic();
+    test_payload_overflow();
+    test_payload_publish();
+
+    FINISH
+}
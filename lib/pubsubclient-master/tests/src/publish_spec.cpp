@@ -173,8 +173,204 @@ int test_publish_P() {
     END_IT
 }
 
+int test_publish_segments() {
+    IT("publishes scatter/gather segments larger than the buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.setBufferSize(32));
+    uint16_t receivedBefore = shimClient.received();
+
+    const char* head = "{\"params\":{";
+    const char* body = "\"priThreePhaseVoltage\":230.1,\"priThreePhaseCurrent\":5.12";
+    const char* tail = "}}";
+    MQTTSegment segments[] = {
+        { (const uint8_t*)head, strlen(head) },
+        { (const uint8_t*)body, strlen(body) },
+        { (const uint8_t*)tail, strlen(tail) }
+    };
+    uint16_t plength = strlen(head) + strlen(body) + strlen(tail);
+    IS_TRUE(plength > 32);
+
+    byte publish[128];
+    uint16_t n = 0;
+    publish[n++] = 0x31;
+    publish[n++] = 2 + 5 + plength;
+    publish[n++] = 0;
+    publish[n++] = 5;
+    memcpy(publish + n, "topic", 5);
+    n += 5;
+    memcpy(publish + n, head, strlen(head));
+    n += strlen(head);
+    memcpy(publish + n, body, strlen(body));
+    n += strlen(body);
+    memcpy(publish + n, tail, strlen(tail));
+    n += strlen(tail);
+    shimClient.expect(publish,n);
+
+    rc = client.publish((char*)"topic",segments,3,true);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+    IS_EQUAL(shimClient.received() - receivedBefore, n);
 
+    END_IT
+}
+
+int test_publish_stream() {
+    IT("streams a payload through write() a buffer at a time");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
 
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.setBufferSize(16));
+    uint16_t receivedBefore = shimClient.received();
+
+    // topic longer than the buffer is written directly too
+    const char* topic = "/sys/product/device/thing/event/property/post";
+    uint16_t tlen = strlen(topic);
+    byte publish[128];
+    uint16_t n = 0;
+    publish[n++] = 0x30;
+    publish[n++] = 2 + tlen + 40;
+    publish[n++] = 0;
+    publish[n++] = tlen;
+    memcpy(publish + n, topic, tlen);
+    n += tlen;
+    for (int i = 0; i < 40; i++) {
+        publish[n++] = 'a' + (i % 26);
+    }
+    shimClient.expect(publish,n);
+
+    uint16_t writesBefore = shimClient.writes();
+    rc = client.beginPublish(topic,40,false);
+    IS_TRUE(rc);
+    for (int i = 0; i < 30; i++) {
+        client.write((uint8_t)('a' + (i % 26)));
+    }
+    IS_EQUAL(client.write(publish + n - 10, 20), 10);
+    IS_TRUE(client.endPublish());
+
+    IS_FALSE(shimClient.error());
+    IS_EQUAL(shimClient.received() - receivedBefore, n);
+    // header, topic and three buffer flushes instead of 40 single-byte writes
+    IS_TRUE(shimClient.writes() - writesBefore <= 5);
+
+    END_IT
+}
+
+int test_publish_stream_short() {
+    IT("closes the connection when a streamed payload ends short");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.beginPublish((char*)"topic",10,false);
+    IS_TRUE(rc);
+    client.write((const uint8_t*)"12345",5);
+    IS_FALSE(client.endPublish());
+    IS_FALSE(client.connected());
+
+    END_IT
+}
+
+
+int test_publish_qos1() {
+    IT("publishes at QoS 1 and releases the message id on PUBACK");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,'A','B','C','D','E'};
+    shimClient.expect(publish,16);
+
+    uint16_t msgId = client.publishQos1((char*)"topic",(const uint8_t*)"ABCDE",5,false);
+    IS_EQUAL(msgId, 2);
+    IS_TRUE(client.inflight(msgId));
+    IS_EQUAL(client.inflightCount(), 1);
+    IS_FALSE(client.retransmitDue(msgId));
+    IS_FALSE(shimClient.error());
+
+    byte puback[] = { 0x40, 0x02, 0x00, 0x02 };
+    shimClient.respond(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(client.inflight(msgId));
+    IS_EQUAL(client.inflightCount(), 0);
+
+    END_IT
+}
+
+int test_publish_qos1_window() {
+    IT("limits the QoS 1 window and retransmits with DUP after reconnecting");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint16_t ids[MQTT_MAX_INFLIGHT];
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        ids[i] = client.publishQos1((char*)"topic",(const uint8_t*)"ABCDE",5,false);
+        IS_TRUE(ids[i] != 0);
+    }
+    IS_EQUAL(client.publishQos1((char*)"topic",(const uint8_t*)"ABCDE",5,false), 0);
+    IS_EQUAL(client.inflightCount(), MQTT_MAX_INFLIGHT);
+
+    shimClient.setConnected(false);
+    IS_FALSE(client.connected());
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.retransmitDue(ids[0]));
+
+    byte publish[] = {0x3a,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x0,'A','B','C','D','E'};
+    publish[9] = ids[0] >> 8;
+    publish[10] = ids[0] & 0xFF;
+    shimClient.expect(publish,16);
+    IS_EQUAL(client.publishQos1((char*)"topic",(const uint8_t*)"ABCDE",5,false,ids[0]), ids[0]);
+    IS_FALSE(client.retransmitDue(ids[0]));
+    IS_TRUE(client.retransmitDue(ids[1]));
+    IS_FALSE(shimClient.error());
+
+    // new ids skip those still in flight, reusing the one just acknowledged
+    byte puback[] = { 0x40, 0x02, 0x00, 0x00 };
+    puback[3] = ids[1];
+    shimClient.respond(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(client.inflightCount(), MQTT_MAX_INFLIGHT - 1);
+    IS_EQUAL(client.publishQos1((char*)"topic",(const uint8_t*)"ABCDE",5,false,ids[1]), 0);
+    IS_EQUAL(client.beginPublishQos1((char*)"topic",5,false), ids[1]);
+
+    END_IT
+}
 
 int main()
 {
@@ -186,6 +382,11 @@ int main()
     test_publish_not_connected();
     test_publish_too_long();
     test_publish_P();
+    test_publish_segments();
+    test_publish_stream();
+    test_publish_stream_short();
+    test_publish_qos1();
+    test_publish_qos1_window();
 
     FINISH
 }
@@ -3,6 +3,7 @@
 #include "Buffer.h"
 #include "BDDTest.h"
 #include "trace.h"
+#include <unistd.h>
 
 
 byte server[] = { 172, 16, 0, 2 };
@@ -324,6 +325,173 @@ int test_receive_qos1() {
     END_IT
 }
 
+int test_receive_fragmented() {
+    IT("receives a message delivered a byte at a time across loop calls");
+    reset_callback();
+
+    Stream stream;
+    stream.expect((uint8_t*)"payload",7);
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient, stream);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (int i = 0; i < 15; i++) {
+        shimClient.respond(publish+i,1);
+        rc = client.loop();
+        IS_TRUE(rc);
+        IS_FALSE(callback_called);
+    }
+    shimClient.respond(publish+15,1);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_TRUE(lastLength == 7);
+
+    IS_FALSE(stream.error());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_split_packets() {
+    IT("receives packets split across and sharing reads");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // first read ends inside the remaining length of a 130 byte payload
+    byte publish[140];
+    publish[0] = 0x30;
+    publish[1] = 0x89;
+    publish[2] = 0x01;
+    publish[3] = 0x00;
+    publish[4] = 0x05;
+    memcpy(publish+5,"topic",5);
+    memset(publish+10,'x',130);
+    shimClient.respond(publish,2);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    // second read ends inside the topic
+    shimClient.respond(publish+2,5);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    // third read carries the rest of the publish and a whole second one
+    byte second[] = {0x30,0x9,0x0,0x3,0x61,0x2f,0x62,0x6d,0x73,0x67,0x32};
+    shimClient.respond(publish+7,133);
+    shimClient.respond(second,11);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == 130);
+    IS_TRUE(lastPayload[129] == 'x');
+
+    reset_callback();
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"a/b")==0);
+    IS_TRUE(memcmp(lastPayload,"msg2",4)==0);
+    IS_TRUE(lastLength == 4);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_stalled_packet() {
+    IT("times out a partly received packet without blocking loop");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setSocketTimeout(1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70};
+    shimClient.respond(publish,7);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    sleep(2);
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_FALSE(client.connected());
+    IS_EQUAL(client.state(), MQTT_CONNECTION_TIMEOUT);
+    IS_FALSE(callback_called);
+
+    END_IT
+}
+
+int test_receive_interleaved_publish() {
+    IT("receives a packet split around a publish");
+    reset_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,8);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    byte outgoing[] = {0x30,0x14,0x0,0xd,0x74,0x65,0x6c,0x65,0x6d,0x65,0x74,0x72,0x79,0x2f,0x61,0x62,0x63,0x68,0x65,0x6c,0x6c,0x6f};
+    shimClient.expect(outgoing,22);
+    rc = client.publish((char*)"telemetry/abc",(char*)"hello");
+    IS_TRUE(rc);
+
+    shimClient.respond(publish+8,8);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_TRUE(lastLength == 7);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Receive");
@@ -335,6 +503,10 @@ int main()
     test_resize_buffer();
     test_receive_oversized_stream_message();
     test_receive_qos1();
+    test_receive_fragmented();
+    test_receive_split_packets();
+    test_receive_stalled_packet();
+    test_receive_interleaved_publish();
 
     FINISH
 }
@@ -0,0 +1,242 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+int routed[4];
+char lastTopic[1024];
+unsigned int lastLength;
+char lastPayload[1024];
+
+void reset_routes() {
+    callback_called = false;
+    memset(routed, 0, sizeof(routed));
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+}
+
+void record(const char* topic, uint16_t topicLength, uint8_t* payload, unsigned int length) {
+    memcpy(lastTopic,topic,topicLength);
+    lastTopic[topicLength] = '\0';
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+void onInfo(const char* topic, uint16_t topicLength, uint8_t* payload, unsigned int length) {
+    routed[0]++;
+    record(topic,topicLength,payload,length);
+}
+
+void onProperty(const char* topic, uint16_t topicLength, uint8_t* payload, unsigned int length) {
+    routed[1]++;
+    record(topic,topicLength,payload,length);
+}
+
+void onAnyGet(const char* topic, uint16_t topicLength, uint8_t* payload, unsigned int length) {
+    routed[2]++;
+    record(topic,topicLength,payload,length);
+}
+
+void onDevice(const char* topic, uint16_t topicLength, uint8_t* payload, unsigned int length) {
+    routed[3]++;
+    record(topic,topicLength,payload,length);
+}
+
+// Deliver a QoS 0 PUBLISH of topic and payload
+void deliver(ShimClient& shimClient, const char* topic, const char* payload) {
+    byte publish[256];
+    uint16_t tl = strlen(topic);
+    uint16_t pl = strlen(payload);
+    publish[0] = 0x30;
+    publish[1] = 2 + tl + pl;
+    publish[2] = 0;
+    publish[3] = tl;
+    memcpy(publish+4,topic,tl);
+    memcpy(publish+4+tl,payload,pl);
+    shimClient.respond(publish,4+tl+pl);
+}
+
+
+int test_route_exact() {
+    IT("dispatches exact topics to their handlers without the callback");
+    reset_routes();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_TRUE(client.route("/153/D1UX3HYYRJ7V/info/get",onInfo));
+    IS_TRUE(client.route("/153/D1UX3HYYRJ7V/property/get",onProperty));
+
+    deliver(shimClient,"/153/D1UX3HYYRJ7V/property/get","{\"id\":1}");
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(routed[1], 1);
+    IS_EQUAL(routed[0], 0);
+    IS_FALSE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"/153/D1UX3HYYRJ7V/property/get")==0);
+    IS_TRUE(memcmp(lastPayload,"{\"id\":1}",8)==0);
+    IS_EQUAL(lastLength, 8);
+
+    deliver(shimClient,"/153/D1UX3HYYRJ7V/info/get","x");
+    rc = client.loop();
+    IS_EQUAL(routed[0], 1);
+
+    // unrouted topics still reach the callback, null-terminated
+    deliver(shimClient,"/153/D1UX3HYYRJ7V/ota/get","x");
+    rc = client.loop();
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"/153/D1UX3HYYRJ7V/ota/get")==0);
+
+    END_IT
+}
+
+int test_route_wildcards() {
+    IT("matches + and # filters after exact topics");
+    reset_routes();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_TRUE(client.route("/153/+/+/get",onAnyGet));
+    IS_TRUE(client.route("/153/D1UX3HYYRJ7V/#",onDevice));
+    IS_TRUE(client.route("/153/D1UX3HYYRJ7V/info/get",onInfo));
+
+    deliver(shimClient,"/153/D1UX3HYYRJ7V/info/get","1");
+    client.loop();
+    IS_EQUAL(routed[0], 1);
+    IS_EQUAL(routed[2], 0);
+
+    deliver(shimClient,"/153/OTHER/ntp/get","2");
+    client.loop();
+    IS_EQUAL(routed[2], 1);
+    IS_TRUE(strcmp(lastTopic,"/153/OTHER/ntp/get")==0);
+
+    deliver(shimClient,"/153/D1UX3HYYRJ7V/monitor/set","3");
+    client.loop();
+    IS_EQUAL(routed[3], 1);
+
+    deliver(shimClient,"/153/D1UX3HYYRJ7V","4");
+    client.loop();
+    IS_EQUAL(routed[3], 2);
+
+    deliver(shimClient,"/153/OTHER/ntp/get/more","5");
+    client.loop();
+    IS_EQUAL(routed[2], 1);
+    IS_TRUE(callback_called);
+
+    END_IT
+}
+
+int test_route_subscribe() {
+    IT("subscribes with a handler and drops the route on unsubscribe");
+    reset_routes();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte subscribe[] = { 0x82,0xa,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1 };
+    shimClient.expect(subscribe,12);
+    rc = client.subscribe("topic",1,onInfo);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    // a QoS 1 message is routed and acknowledged
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_EQUAL(routed[0], 1);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_EQUAL(lastLength, 7);
+    IS_FALSE(shimClient.error());
+
+    byte unsubscribe[] = { 0xa2,0x9,0x0,0x3,0x0,0x5,0x74,0x6f,0x70,0x69,0x63 };
+    shimClient.expect(unsubscribe,11);
+    rc = client.unsubscribe("topic");
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    deliver(shimClient,"topic","x");
+    client.loop();
+    IS_EQUAL(routed[0], 1);
+    IS_TRUE(callback_called);
+
+    END_IT
+}
+
+int test_route_capacity() {
+    IT("keeps at most MQTT_MAX_ROUTES routes");
+    reset_routes();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    static char topics[MQTT_MAX_ROUTES+1][16];
+    for (int i = 0; i <= MQTT_MAX_ROUTES; i++) {
+        sprintf(topics[i],"t/%d",i);
+    }
+    for (int i = 0; i < MQTT_MAX_ROUTES; i++) {
+        IS_TRUE(client.route(topics[i],onInfo));
+    }
+    IS_FALSE(client.route(topics[MQTT_MAX_ROUTES],onInfo));
+    // re-routing an existing filter replaces its handler
+    IS_TRUE(client.route(topics[3],onProperty));
+    IS_TRUE(client.unroute(topics[0]));
+    IS_FALSE(client.unroute(topics[0]));
+    IS_TRUE(client.route(topics[MQTT_MAX_ROUTES],onInfo));
+
+    for (int i = 1; i <= MQTT_MAX_ROUTES; i++) {
+        deliver(shimClient,topics[i],"x");
+        client.loop();
+    }
+    IS_EQUAL(routed[0], MQTT_MAX_ROUTES - 1);
+    IS_EQUAL(routed[1], 1);
+    IS_FALSE(callback_called);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Route");
+
+    test_route_exact();
+    test_route_wildcards();
+    test_route_subscribe();
+    test_route_capacity();
+
+    FINISH
+}
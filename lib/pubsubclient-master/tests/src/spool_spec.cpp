@@ -0,0 +1,327 @@
+#include "PubSubClient.h"
+#include "MQTTSpool.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Spool store held in memory, standing in for a file on LittleFS
+class MemorySpoolStore : public MQTTSpoolStore {
+public:
+    uint8_t log[1024];
+    uint32_t length;
+    uint32_t savedHead;
+    int appends;
+    int headWrites;
+    int clears;
+    int compacts;
+
+    MemorySpoolStore() : length(0), savedHead(0), appends(0), headWrites(0), clears(0), compacts(0) {}
+
+    uint32_t size() { return length; }
+    size_t read(uint32_t pos, uint8_t* buf, size_t n) {
+        if (pos >= length) {
+            return 0;
+        }
+        if (n > length - pos) {
+            n = length - pos;
+        }
+        memcpy(buf, log + pos, n);
+        return n;
+    }
+    boolean append(const MQTTSegment* segments, uint8_t count) {
+        uint32_t total = 0;
+        for (int i = 0; i < count; i++) {
+            total += segments[i].length;
+        }
+        if (length + total > sizeof(log)) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            memcpy(log + length, segments[i].data, segments[i].length);
+            length += segments[i].length;
+        }
+        appends++;
+        return true;
+    }
+    uint32_t head() { return savedHead; }
+    boolean setHead(uint32_t head) {
+        savedHead = head;
+        headWrites++;
+        return true;
+    }
+    boolean clear() {
+        length = 0;
+        savedHead = 0;
+        clears++;
+        return true;
+    }
+    boolean compact(uint32_t head) {
+        memmove(log, log + head, length - head);
+        length -= head;
+        savedHead = 0;
+        compacts++;
+        return true;
+    }
+};
+
+// QoS 1 PUBLISH of topic "t" with a one byte payload
+void expectPublish(ShimClient& shimClient, uint8_t header, uint16_t msgId, char payload) {
+    byte publish[] = { header, 0x6, 0x0, 0x1, 't', (byte)(msgId >> 8), (byte)(msgId & 0xFF), (byte)payload };
+    shimClient.expect(publish, 8);
+}
+
+void puback(ShimClient& shimClient, uint16_t msgId) {
+    byte ack[] = { 0x40, 0x02, (byte)(msgId >> 8), (byte)(msgId & 0xFF) };
+    shimClient.respond(ack, 4);
+}
+
+void pushAll(MQTTSpool& spool, const char* payloads) {
+    for (; *payloads; payloads++) {
+        spool.push("t", (const uint8_t*)payloads, 1, false);
+    }
+}
+
+
+int test_spool_drain_window() {
+    IT("drains queued messages through the in-flight window");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    MemorySpoolStore store;
+    MQTTSpool spool(store, sizeof(store.log));
+    IS_TRUE(spool.begin());
+
+    pushAll(spool, "abcdef");
+    IS_EQUAL(spool.pending(), 6);
+    IS_EQUAL(store.appends, 6);
+
+    // nothing goes out while the link is down
+    IS_EQUAL(spool.drain(client), 0);
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    expectPublish(shimClient, 0x32, 2, 'a');
+    expectPublish(shimClient, 0x32, 3, 'b');
+    expectPublish(shimClient, 0x32, 4, 'c');
+    expectPublish(shimClient, 0x32, 5, 'd');
+    IS_EQUAL(spool.drain(client), MQTT_MAX_INFLIGHT);
+    IS_EQUAL(spool.inflight(), MQTT_MAX_INFLIGHT);
+    IS_EQUAL(spool.drain(client), 0);
+    IS_FALSE(shimClient.error());
+
+    // acknowledging the first two frees the window and moves the head
+    puback(shimClient, 2);
+    puback(shimClient, 3);
+    client.loop();
+    client.loop();
+    expectPublish(shimClient, 0x32, 6, 'e');
+    expectPublish(shimClient, 0x32, 7, 'f');
+    IS_EQUAL(spool.drain(client), 2);
+    IS_EQUAL(spool.pending(), 4);
+    IS_EQUAL(store.savedHead, 16);
+    IS_FALSE(shimClient.error());
+
+    // an out of order ack leaves the head alone
+    puback(shimClient, 5);
+    client.loop();
+    IS_EQUAL(spool.drain(client), 0);
+    IS_EQUAL(spool.pending(), 4);
+    IS_EQUAL(store.headWrites, 1);
+
+    puback(shimClient, 4);
+    puback(shimClient, 6);
+    puback(shimClient, 7);
+    client.loop();
+    client.loop();
+    client.loop();
+    IS_EQUAL(spool.drain(client), 0);
+    IS_EQUAL(spool.pending(), 0);
+    IS_EQUAL(spool.inflight(), 0);
+    IS_EQUAL(store.clears, 1);
+    IS_EQUAL(store.length, 0);
+
+    END_IT
+}
+
+int test_spool_reconnect() {
+    IT("retransmits in-flight messages with DUP after reconnecting");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    MemorySpoolStore store;
+    MQTTSpool spool(store, sizeof(store.log));
+    IS_TRUE(spool.begin());
+    pushAll(spool, "ab");
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_EQUAL(spool.drain(client), 2);
+
+    shimClient.setConnected(false);
+    IS_EQUAL(spool.drain(client), 0);
+    pushAll(spool, "c");
+
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    expectPublish(shimClient, 0x3a, 2, 'a');
+    expectPublish(shimClient, 0x3a, 3, 'b');
+    expectPublish(shimClient, 0x32, 2 + 2, 'c');
+    IS_EQUAL(spool.drain(client), 3);
+    IS_FALSE(shimClient.error());
+    IS_EQUAL(spool.drain(client), 0);
+
+    END_IT
+}
+
+int test_spool_survives_reboot() {
+    IT("resumes from the saved head after a reboot");
+    MemorySpoolStore store;
+    {
+        ShimClient shimClient;
+        shimClient.setAllowConnect(true);
+        byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+        shimClient.respond(connack,4);
+        PubSubClient client(server, 1883, callback, shimClient);
+        MQTTSpool spool(store, sizeof(store.log));
+        IS_TRUE(spool.begin());
+        pushAll(spool, "abcde");
+        int rc = client.connect((char*)"client_test1");
+        IS_TRUE(rc);
+        IS_EQUAL(spool.drain(client), MQTT_MAX_INFLIGHT);
+        puback(shimClient, 2);
+        client.loop();
+        IS_EQUAL(spool.drain(client), 1);
+    }
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    PubSubClient client(server, 1883, callback, shimClient);
+    MQTTSpool spool(store, sizeof(store.log));
+    IS_TRUE(spool.begin());
+    IS_EQUAL(spool.pending(), 4);
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    expectPublish(shimClient, 0x32, 2, 'b');
+    expectPublish(shimClient, 0x32, 3, 'c');
+    expectPublish(shimClient, 0x32, 4, 'd');
+    expectPublish(shimClient, 0x32, 5, 'e');
+    IS_EQUAL(spool.drain(client), 4);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_spool_limits() {
+    IT("refuses messages beyond its limit and drops a damaged tail");
+    MemorySpoolStore store;
+    MQTTSpool spool(store, 24);
+    IS_TRUE(spool.begin());
+
+    IS_TRUE(spool.push("t", (const uint8_t*)"a", 1, false));
+    IS_TRUE(spool.push("t", (const uint8_t*)"b", 1, true));
+    IS_TRUE(spool.push("t", (const uint8_t*)"c", 1, false));
+    IS_FALSE(spool.push("t", (const uint8_t*)"d", 1, false));
+    IS_FALSE(spool.push("", (const uint8_t*)"d", 1, false));
+    IS_EQUAL(spool.pending(), 3);
+
+    // half a record at the end of the log
+    store.log[store.length++] = 0xA5;
+    store.log[store.length++] = 0x00;
+    MQTTSpool reopened(store, 1024);
+    IS_FALSE(reopened.begin());
+    IS_EQUAL(reopened.pending(), 3);
+    IS_FALSE(reopened.push("t", (const uint8_t*)"d", 1, false));
+
+    // nothing but damage
+    MemorySpoolStore garbage;
+    garbage.log[0] = 0x00;
+    garbage.length = 10;
+    MQTTSpool empty(garbage, 1024);
+    IS_FALSE(empty.begin());
+    IS_EQUAL(empty.pending(), 0);
+    IS_EQUAL(garbage.length, 0);
+    IS_TRUE(empty.push("t", (const uint8_t*)"d", 1, false));
+
+    END_IT
+}
+
+int test_spool_continuous_traffic() {
+    IT("keeps accepting messages while one is always unacknowledged");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    MemorySpoolStore store;
+    // room for three 8 byte records
+    MQTTSpool spool(store, 24);
+    IS_TRUE(spool.begin());
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_TRUE(spool.push("t", (const uint8_t*)"a", 1, false));
+    IS_EQUAL(spool.drain(client), 1);
+    for (int i = 0; i < 50; i++) {
+        char c = 'b' + (i % 25);
+        IS_TRUE(spool.push("t", (const uint8_t*)&c, 1, false));
+        IS_EQUAL(spool.drain(client), 1);
+        IS_EQUAL(spool.inflight(), 2);
+        // the older message is acknowledged, the newer one stays in flight
+        puback(shimClient, 2 + i);
+        client.loop();
+        IS_EQUAL(spool.drain(client), 0);
+        IS_EQUAL(spool.pending(), 1);
+        IS_TRUE(store.length <= 24);
+    }
+    IS_EQUAL(store.clears, 0);
+    IS_TRUE(store.compacts > 0);
+
+    // the backlog itself is still capped
+    IS_TRUE(spool.push("t", (const uint8_t*)"y", 1, false));
+    IS_TRUE(spool.push("t", (const uint8_t*)"z", 1, false));
+    IS_FALSE(spool.push("t", (const uint8_t*)"!", 1, false));
+    IS_EQUAL(spool.pending(), 3);
+
+    // what is left is delivered from the compacted log
+    puback(shimClient, 52);
+    client.loop();
+    expectPublish(shimClient, 0x32, 53, 'y');
+    expectPublish(shimClient, 0x32, 54, 'z');
+    IS_EQUAL(spool.drain(client), 2);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Spool");
+
+    test_spool_drain_window();
+    test_spool_reconnect();
+    test_spool_survives_reboot();
+    test_spool_limits();
+    test_spool_continuous_traffic();
+
+    FINISH
+}
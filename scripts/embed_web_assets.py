@@ -0,0 +1,151 @@
+# embed_web_assets.py
+#
+# 把 data/web 下的网页资源压缩成 PROGMEM 字节数组,生成 src/Network/webAssets.h。
+# 每个文件先做简单的空白/注释精简(已是 .min. 的文件和图片除外),再 gzip,
+# 并以压缩后内容的哈希作为 ETag。配网门户直接从 flash 发送这些数组
+# (Content-Encoding: gzip),浏览器带 If-None-Match 再次请求时返回 304。
+#
+# PlatformIO 编译前自动运行 (extra_scripts = pre:scripts/embed_web_assets.py),
+# 也可以单独运行: python scripts/embed_web_assets.py
+
+import gzip
+import hashlib
+import os
+import re
+
+WEB_DIR = os.path.join("data", "web")
+OUTPUT = os.path.join("src", "Network", "webAssets.h")
+
+# 不嵌入固件的文件
+EXCLUDE = (".map",)
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".gif": "image/gif",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+    ".svg": "image/svg+xml",
+}
+
+
+def minify_lines(text):
+    # 去掉每行首尾空白、空行和整行的 // 注释;保留换行,JS 的自动分号不受影响
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};:,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    text = re.sub(r"<style>(.*?)</style>",
+                  lambda m: "<style>" + minify_css(m.group(1)) + "</style>", text, flags=re.S)
+    text = minify_lines(text)
+    return re.sub(r">\n<", "><", text)
+
+
+def minify(name, data):
+    if ".min." in name:
+        return data
+    ext = os.path.splitext(name)[1]
+    if ext == ".html":
+        return minify_html(data.decode("utf-8")).encode("utf-8")
+    if ext == ".css":
+        return minify_css(data.decode("utf-8")).encode("utf-8")
+    if ext == ".js":
+        return minify_lines(data.decode("utf-8")).encode("utf-8")
+    return data
+
+
+def identifier(path):
+    return "WEB_" + re.sub(r"[^0-9A-Za-z]", "_", path.strip("/")).upper()
+
+
+def collect(root):
+    assets = []
+    for folder, _, files in os.walk(root):
+        for name in sorted(files):
+            if name.endswith(EXCLUDE):
+                continue
+            ext = os.path.splitext(name)[1].lower()
+            if ext not in CONTENT_TYPES:
+                continue
+            full = os.path.join(folder, name)
+            path = "/" + os.path.relpath(full, root).replace(os.sep, "/")
+            assets.append((path, full, CONTENT_TYPES[ext]))
+    return sorted(assets)
+
+
+def generate(project_dir):
+    root = os.path.join(project_dir, WEB_DIR)
+    out = []
+    out.append("// webAssets.h")
+    out.append("// 由 scripts/embed_web_assets.py 根据 data/web 生成,请勿手工修改")
+    out.append("#ifndef WEB_ASSETS_H")
+    out.append("#define WEB_ASSETS_H")
+    out.append("")
+    out.append("#include \"webAsset.h\"")
+    out.append("")
+
+    table = []
+    raw_total = 0
+    gz_total = 0
+    for path, full, content_type in collect(root):
+        with open(full, "rb") as f:
+            raw = f.read()
+        # mtime=0: 内容不变时输出不变,ETag 也不变
+        packed = gzip.compress(minify(path, raw), 9, mtime=0)
+        etag = '"%s"' % hashlib.sha1(packed).hexdigest()[:16]
+        name = identifier(path)
+        raw_total += len(raw)
+        gz_total += len(packed)
+
+        out.append("// %s: %d -> %d bytes" % (path, len(raw), len(packed)))
+        out.append("static const uint8_t %s[] PROGMEM = {" % name)
+        for i in range(0, len(packed), 20):
+            out.append("    " + ",".join("0x%02x" % b for b in packed[i:i + 20]) + ",")
+        out.append("};")
+        out.append("")
+        table.append('    { "%s", "%s", %s, sizeof(%s), "%s" },' %
+                     (path, content_type, name, name, etag.replace('"', '\\"')))
+
+    out.append("static const WebAsset WEB_ASSETS[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("")
+    out.append("#define WEB_ASSET_COUNT (sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]))")
+    out.append("")
+    out.append("#endif // WEB_ASSETS_H")
+    text = "\n".join(out) + "\n"
+
+    target = os.path.join(project_dir, OUTPUT)
+    old = None
+    if os.path.exists(target):
+        with open(target, "r") as f:
+            old = f.read()
+    # 内容未变时不重写,避免触发重新编译
+    if old != text:
+        with open(target, "w") as f:
+            f.write(text)
+    print("[web] %d assets, %d -> %d bytes gzip" % (len(table), raw_total, gz_total))
+
+
+try:
+    Import("env")  # noqa: F821  PlatformIO extra_script
+    generate(env["PROJECT_DIR"])  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,185 @@
+// linkManager.cpp
+#include "linkManager.h"
+#include <string.h>
+
+LinkManager::LinkManager(UplinkDriver& wifi, UplinkDriver& ppp) {
+    drivers[UPLINK_WIFI] = &wifi;
+    drivers[UPLINK_PPP] = &ppp;
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        memset(&health[i], 0, sizeof(health[i]));
+    }
+    active = UPLINK_NONE;
+    previous = UPLINK_NONE;
+    switches = 0;
+}
+
+UplinkEvent_t LinkManager::update(unsigned long now) {
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        Uplink_t link = (Uplink_t)i;
+        bool up = drivers[i]->linkUp();
+        if (!up) {
+            if (health[i].up) {
+                reset(link);
+            }
+            continue;
+        }
+        health[i].up = true;
+        updateProbe(link, now);
+    }
+    return select(now);
+}
+
+Uplink_t LinkManager::getActive() {
+    return active;
+}
+
+Uplink_t LinkManager::getPrevious() {
+    return previous;
+}
+
+const UplinkHealth& LinkManager::getHealth(Uplink_t link) {
+    return health[link];
+}
+
+unsigned long LinkManager::getSwitches() {
+    return switches;
+}
+
+const char* LinkManager::name(Uplink_t link) {
+    switch (link) {
+    case UPLINK_WIFI:
+        return "WiFi";
+    case UPLINK_PPP:
+        return "4G";
+    default:
+        return "none";
+    }
+}
+
+// ============ 私有函数实现 ============
+
+// 链路断开: 丢弃之前的探测结果,重新建立后立即探测
+void LinkManager::reset(Uplink_t link) {
+    if (health[link].probing) {
+        drivers[link]->cancelProbe();
+    }
+    unsigned long probes = health[link].probes;
+    memset(&health[link], 0, sizeof(health[link]));
+    health[link].probes = probes;
+}
+
+void LinkManager::updateProbe(Uplink_t link, unsigned long now) {
+    UplinkHealth& h = health[link];
+
+    if (h.probing) {
+        unsigned long rtt = 0;
+        UplinkProbe_t result = drivers[link]->pollProbe(rtt);
+        if (result == UPLINK_PROBE_OK) {
+            h.probing = false;
+            record(link, true, rtt, now);
+        } else if (result == UPLINK_PROBE_FAILED) {
+            h.probing = false;
+            record(link, false, 0, now);
+        } else if (now - h.probeTime >= LINK_PROBE_TIMEOUT) {
+            drivers[link]->cancelProbe();
+            h.probing = false;
+            record(link, false, 0, now);
+        }
+        return;
+    }
+
+    // 费用更高的备用链路探测得少一些;优先链路按正常间隔探测,以便尽快切回
+    unsigned long interval = (active != UPLINK_NONE && link > active) ?
+                             LINK_STANDBY_PROBE_INTERVAL : LINK_PROBE_INTERVAL;
+    if (h.probed && now - h.probeTime < interval) {
+        return;
+    }
+    h.probeTime = now;
+    h.probed = true;
+    h.probes++;
+    if (drivers[link]->startProbe()) {
+        h.probing = true;
+    } else {
+        record(link, false, 0, now);
+    }
+}
+
+void LinkManager::record(Uplink_t link, bool ok, unsigned long rtt, unsigned long now) {
+    UplinkHealth& h = health[link];
+
+    h.history = (uint16_t)((h.history << 1) | (ok ? 0 : 1));
+    if (h.samples < LINK_PROBE_WINDOW) {
+        h.samples++;
+    }
+    int failures = 0;
+    for (int i = 0; i < h.samples; i++) {
+        if (h.history & (1u << i)) {
+            failures++;
+        }
+    }
+    h.loss = (uint8_t)(failures * 100 / h.samples);
+
+    if (ok) {
+        h.failStreak = 0;
+        // 平滑往返时间,避免单次抖动引起切换
+        h.rtt = (h.rtt == 0) ? rtt : (h.rtt * 3 + rtt) / 4;
+        if (h.rtt == 0) {
+            h.rtt = 1;
+        }
+    } else if (h.failStreak < 255) {
+        h.failStreak++;
+    }
+
+    if (h.healthy) {
+        bool lossy = h.samples >= LINK_LOSS_MIN_SAMPLES && h.loss > LINK_MAX_LOSS;
+        if (h.failStreak >= LINK_FAIL_PROBES || lossy || h.rtt > LINK_MAX_RTT) {
+            h.healthy = false;
+        }
+    } else if (ok && h.loss <= LINK_RECOVER_LOSS && h.rtt <= LINK_RECOVER_RTT) {
+        h.healthy = true;
+        h.healthySince = now;
+    }
+}
+
+UplinkEvent_t LinkManager::select(unsigned long now) {
+    // 优先级最高的健康链路
+    Uplink_t best = UPLINK_NONE;
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        if (health[i].healthy) {
+            best = (Uplink_t)i;
+            break;
+        }
+    }
+
+    if (active == UPLINK_NONE) {
+        return (best != UPLINK_NONE) ? switchTo(best) : UPLINK_EVENT_NONE;
+    }
+
+    // 当前链路断开或不健康: 立即切换到另一条健康的链路
+    if (!health[active].healthy) {
+        if (best != UPLINK_NONE) {
+            return switchTo(best);
+        }
+        if (!health[active].up) {
+            previous = active;
+            active = UPLINK_NONE;
+            return UPLINK_EVENT_LOST;
+        }
+        // 没有更好的选择,继续使用不健康但仍连着的链路
+        return UPLINK_EVENT_NONE;
+    }
+
+    // 切回优先链路需等它持续健康一段时间
+    if (best != UPLINK_NONE && best < active &&
+        now - health[best].healthySince >= LINK_FAILBACK_HOLD) {
+        return switchTo(best);
+    }
+    return UPLINK_EVENT_NONE;
+}
+
+UplinkEvent_t LinkManager::switchTo(Uplink_t link) {
+    previous = active;
+    active = link;
+    switches++;
+    return UPLINK_EVENT_SWITCHED;
+}
@@ -0,0 +1,107 @@
+// linkManager.h
+#ifndef LINK_MANAGER_H
+#define LINK_MANAGER_H
+
+#include <stdint.h>
+#include "uplinkDriver.h"
+
+// 健康探测参数
+#ifndef LINK_PROBE_INTERVAL
+#define LINK_PROBE_INTERVAL 5000               // 当前链路和优先链路的探测间隔(ms)
+#endif
+#ifndef LINK_STANDBY_PROBE_INTERVAL
+#define LINK_STANDBY_PROBE_INTERVAL 30000      // 优先级更低的备用链路的探测间隔(ms),减少4G流量
+#endif
+#ifndef LINK_PROBE_TIMEOUT
+#define LINK_PROBE_TIMEOUT 3000                // 探测超时,超时记为丢包(ms)
+#endif
+#ifndef LINK_PROBE_WINDOW
+#define LINK_PROBE_WINDOW 10                   // 计算丢包率的最近探测次数(最多16)
+#endif
+
+// 健康判定,带回差: 变为不健康和恢复健康使用不同的门限
+#ifndef LINK_FAIL_PROBES
+#define LINK_FAIL_PROBES 3                     // 连续失败次数达到后判为不健康
+#endif
+#ifndef LINK_LOSS_MIN_SAMPLES
+#define LINK_LOSS_MIN_SAMPLES 5                // 窗口内至少有这么多次探测才按丢包率判定
+#endif
+#ifndef LINK_MAX_LOSS
+#define LINK_MAX_LOSS 30                       // 丢包率超过该值(%)判为不健康
+#endif
+#ifndef LINK_MAX_RTT
+#define LINK_MAX_RTT 1500                      // 平均往返时间超过该值(ms)判为不健康
+#endif
+#ifndef LINK_RECOVER_LOSS
+#define LINK_RECOVER_LOSS 10                   // 丢包率不超过该值(%)才恢复健康
+#endif
+#ifndef LINK_RECOVER_RTT
+#define LINK_RECOVER_RTT 800                   // 平均往返时间不超过该值(ms)才恢复健康
+#endif
+#ifndef LINK_FAILBACK_HOLD
+#define LINK_FAILBACK_HOLD 60000               // 优先链路需持续健康这么久才切回(ms)
+#endif
+
+// update()报告的变化
+enum UplinkEvent_t {
+    UPLINK_EVENT_NONE = 0,          // 无变化
+    UPLINK_EVENT_SWITCHED,          // 切换到了getActive()指示的链路
+    UPLINK_EVENT_LOST               // 没有可用链路
+};
+
+// 单条链路的健康状态
+struct UplinkHealth {
+    bool up;                        // 链路已建立
+    bool healthy;                   // 探测结果满足门限
+    unsigned long rtt;              // 成功探测的平滑往返时间(ms),0表示还没有
+    uint8_t loss;                   // 最近LINK_PROBE_WINDOW次探测的丢包率(%)
+    uint8_t failStreak;             // 连续失败次数
+    uint8_t samples;                // 窗口内的探测次数
+    uint16_t history;               // 探测结果,bit0为最近一次,1表示失败
+    unsigned long healthySince;     // 变为健康的时间
+    unsigned long probeTime;        // 上次发起探测的时间
+    bool probing;
+    bool probed;                    // 本次链路建立后是否探测过
+    unsigned long probes;           // 累计发起的探测次数
+};
+
+// 管理WiFi和4G两条上行链路
+// 定期经由每条链路探测MQTT服务器(往返时间和丢包率),当前链路不健康时
+// 立即切换到另一条健康的链路;费用更低的优先链路需持续健康LINK_FAILBACK_HOLD
+// 才切回,避免在两条链路间来回切换。不依赖Arduino,可在主机上测试。
+class LinkManager {
+public:
+    // drivers按Uplink_t的顺序排列,共UPLINK_COUNT个
+    LinkManager(UplinkDriver& wifi, UplinkDriver& ppp);
+
+    // 推进探测和切换,需在loop中调用;返回本次发生的变化
+    UplinkEvent_t update(unsigned long now);
+
+    // 当前使用的链路,UPLINK_NONE表示没有
+    Uplink_t getActive();
+
+    // 切换前使用的链路
+    Uplink_t getPrevious();
+
+    const UplinkHealth& getHealth(Uplink_t link);
+
+    // 累计切换次数
+    unsigned long getSwitches();
+
+    static const char* name(Uplink_t link);
+
+private:
+    UplinkDriver* drivers[UPLINK_COUNT];
+    UplinkHealth health[UPLINK_COUNT];
+    Uplink_t active;
+    Uplink_t previous;
+    unsigned long switches;
+
+    void reset(Uplink_t link);
+    void updateProbe(Uplink_t link, unsigned long now);
+    void record(Uplink_t link, bool ok, unsigned long rtt, unsigned long now);
+    UplinkEvent_t select(unsigned long now);
+    UplinkEvent_t switchTo(Uplink_t link);
+};
+
+#endif // LINK_MANAGER_H
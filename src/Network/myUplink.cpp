@@ -0,0 +1,342 @@
+// myUplink.cpp
+#include "myUplink.h"
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <errno.h>
+#include <esp_netif.h>
+#include <lwip/sockets.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#if MY_UPLINK_HAS_PPP
+#include <PPP.h>
+#endif
+
+// 全局上行链路管理对象实例
+MyUplink myUplink;
+
+// ============ EspUplink ============
+
+EspUplink::EspUplink(Uplink_t link) {
+    this->link = link;
+    targetPort = 0;
+    sock = -1;
+    probeStart = 0;
+}
+
+void EspUplink::setTarget(const IPAddress& ip, uint16_t port) {
+    targetIP = ip;
+    targetPort = port;
+}
+
+IPAddress EspUplink::localIP() {
+    if (link == UPLINK_WIFI) {
+        return WiFi.localIP();
+    }
+#if MY_UPLINK_HAS_PPP
+    return PPP.localIP();
+#else
+    return IPAddress();
+#endif
+}
+
+bool EspUplink::linkUp() {
+    if (link == UPLINK_WIFI) {
+        return WiFi.status() == WL_CONNECTED;
+    }
+#if MY_UPLINK_HAS_PPP
+    return PPP.connected();
+#else
+    return false;
+#endif
+}
+
+bool EspUplink::startProbe() {
+    uint32_t local = (uint32_t)localIP();
+    if (local == 0 || targetPort == 0 || (uint32_t)targetIP == 0) {
+        return false;
+    }
+
+    sock = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return false;
+    }
+    lwip_fcntl(sock, F_SETFL, lwip_fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    // 绑定本链路的地址,报文经由该链路发出,与当前默认路由无关
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = local;
+    struct sockaddr_in target;
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_addr.s_addr = (uint32_t)targetIP;
+    target.sin_port = htons(targetPort);
+
+    probeStart = millis();
+    if (lwip_bind(sock, (struct sockaddr*)&source, sizeof(source)) != 0 ||
+        (lwip_connect(sock, (struct sockaddr*)&target, sizeof(target)) != 0 && errno != EINPROGRESS)) {
+        cancelProbe();
+        return false;
+    }
+    return true;
+}
+
+UplinkProbe_t EspUplink::pollProbe(unsigned long& rtt) {
+    if (sock < 0) {
+        return UPLINK_PROBE_FAILED;
+    }
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(sock, &writable);
+    struct timeval timeout = {0, 0};
+    if (lwip_select(sock + 1, nullptr, &writable, nullptr, &timeout) <= 0) {
+        return UPLINK_PROBE_PENDING;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    lwip_getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length);
+    rtt = millis() - probeStart;
+    cancelProbe();
+    return (error == 0) ? UPLINK_PROBE_OK : UPLINK_PROBE_FAILED;
+}
+
+void EspUplink::cancelProbe() {
+    if (sock >= 0) {
+        lwip_close(sock);
+        sock = -1;
+    }
+}
+
+// ============ MyUplink ============
+
+MyUplink::MyUplink() : wifiUplink(UPLINK_WIFI), pppUplink(UPLINK_PPP),
+                       manager(wifiUplink, pppUplink) {
+    mqtt = nullptr;
+    targetPort = 0;
+    targetResolved = false;
+    dns.host = nullptr;
+    dns.state = 0;
+    dns.ip = 0;
+    dnsTime = 0;
+    dnsBackoff = 0;
+    pppStarted = false;
+    pppDialed = false;
+    pppCheckTime = 0;
+}
+
+bool MyUplink::begin() {
+    Serial.println("[Uplink] Initializing uplinks...");
+
+    if (!loadConfig()) {
+        Serial.println("[Uplink] No MQTT server configured, health probes disabled");
+    }
+    startPPP();
+    return true;
+}
+
+void MyUplink::handle() {
+    unsigned long now = millis();
+
+    handlePPP(now);
+    if (!targetResolved) {
+        resolveTarget(now);
+    }
+
+    switch (manager.update(now)) {
+    case UPLINK_EVENT_SWITCHED: {
+        Uplink_t active = manager.getActive();
+        const UplinkHealth& health = manager.getHealth(active);
+        Serial.printf("[Uplink] Switched %s -> %s (rtt %lu ms, loss %u%%)\n",
+                      LinkManager::name(manager.getPrevious()), LinkManager::name(active),
+                      health.rtt, health.loss);
+        useUplink(active);
+        break;
+    }
+
+    case UPLINK_EVENT_LOST:
+        Serial.println("[Uplink] No uplink available");
+        break;
+
+    default:
+        break;
+    }
+}
+
+void MyUplink::attach(PubSubClient& client) {
+    mqtt = &client;
+}
+
+Uplink_t MyUplink::getActive() {
+    return manager.getActive();
+}
+
+const UplinkHealth& MyUplink::getHealth(Uplink_t link) {
+    return manager.getHealth(link);
+}
+
+unsigned long MyUplink::getSwitches() {
+    return manager.getSwitches();
+}
+
+// ============ 私有函数实现 ============
+
+bool MyUplink::loadConfig() {
+    if (!LittleFS.begin(false)) {
+        return false;
+    }
+    File file = LittleFS.open(IOT_CONFIG_FILE, "r");
+    if (!file) {
+        return false;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+        Serial.printf("[Uplink] Failed to parse %s: %s\n", IOT_CONFIG_FILE, error.c_str());
+        return false;
+    }
+
+    targetHost = doc["serverConfig"]["mqttHost"] | "";
+    targetPort = doc["serverConfig"]["mqttPort"] | 1883;
+    return targetHost.length() > 0;
+}
+
+// 异步解析的状态
+enum {
+    UPLINK_DNS_IDLE = 0,
+    UPLINK_DNS_PENDING,
+    UPLINK_DNS_DONE,
+    UPLINK_DNS_FAILED
+};
+
+// 在lwIP线程中调用
+static void dnsFound(const char* name, const ip_addr_t* addr, void* arg) {
+    UplinkDnsQuery* query = (UplinkDnsQuery*)arg;
+    if (addr != nullptr && IP_IS_V4(addr)) {
+        query->ip = ip4_addr_get_u32(ip_2_ip4(addr));
+        query->state = UPLINK_DNS_DONE;
+    } else {
+        query->state = UPLINK_DNS_FAILED;
+    }
+}
+
+// 在lwIP线程中调用;有缓存时直接得到结果,否则等待dnsFound回调
+static void dnsStart(void* arg) {
+    UplinkDnsQuery* query = (UplinkDnsQuery*)arg;
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(query->host, &addr, dnsFound, query);
+    if (err == ERR_OK) {
+        dnsFound(query->host, &addr, query);
+    } else if (err != ERR_INPROGRESS) {
+        query->state = UPLINK_DNS_FAILED;
+    }
+}
+
+// 服务器地址是域名时,在第一条链路建立后异步解析,handle()不会阻塞;
+// 解析失败或超时后保留域名,按逐次加倍的间隔重试
+void MyUplink::resolveTarget(unsigned long now) {
+    if (targetHost.length() == 0) {
+        return;
+    }
+
+    IPAddress ip;
+    if (!ip.fromString(targetHost)) {
+        switch (dns.state) {
+        case UPLINK_DNS_IDLE:
+            if (now - dnsTime < dnsBackoff) {
+                return;
+            }
+            if (!wifiUplink.linkUp() && !pppUplink.linkUp()) {
+                return;
+            }
+            dns.host = targetHost.c_str();
+            dns.state = UPLINK_DNS_PENDING;
+            dnsTime = now;
+            if (tcpip_callback(dnsStart, &dns) != ERR_OK) {
+                dns.state = UPLINK_DNS_FAILED;
+            }
+            return;
+        case UPLINK_DNS_PENDING:
+            if (now - dnsTime < UPLINK_DNS_TIMEOUT) {
+                return;
+            }
+            // 超时后迟到的结果仍然有效,下一轮会直接使用
+            break;
+        case UPLINK_DNS_DONE:
+            ip = IPAddress(dns.ip);
+            break;
+        }
+
+        if (dns.state != UPLINK_DNS_DONE) {
+            dnsBackoff = dnsBackoff == 0 ? UPLINK_DNS_RETRY_MIN
+                                         : min(dnsBackoff * 2, (unsigned long)UPLINK_DNS_RETRY_MAX);
+            Serial.printf("[Uplink] Failed to resolve %s, retry in %lus\n",
+                          targetHost.c_str(), dnsBackoff / 1000);
+            dns.state = UPLINK_DNS_IDLE;
+            dnsTime = now;
+            return;
+        }
+    }
+
+    wifiUplink.setTarget(ip, targetPort);
+    pppUplink.setTarget(ip, targetPort);
+    targetResolved = true;
+    Serial.printf("[Uplink] Probing %s:%u\n", ip.toString().c_str(), targetPort);
+}
+
+void MyUplink::startPPP() {
+#if MY_UPLINK_HAS_PPP && defined(PPP_RX) && defined(PPP_TX)
+    Serial.println("[Uplink] Starting A7680C modem...");
+    PPP.setApn(PPP_APN);
+#ifdef PPP_POWERKEY
+    PPP.setResetPin(PPP_POWERKEY, PPP_POWERKEY_ACTIVE_LOW);
+#endif
+    PPP.setPins(PPP_TX, PPP_RX);
+    pppStarted = PPP.begin(PPP_MODEM_SIM7600);
+    if (!pppStarted) {
+        Serial.println("[Uplink] Modem did not respond, 4G uplink disabled");
+    }
+#else
+    Serial.println("[Uplink] PPP not supported by this core, WiFi only");
+#endif
+}
+
+// 模块注册到网络后切换到数据模式(CMUX,拨号的同时仍可发AT命令)
+void MyUplink::handlePPP(unsigned long now) {
+#if MY_UPLINK_HAS_PPP
+    if (!pppStarted || pppDialed || now - pppCheckTime < PPP_ATTACH_CHECK_INTERVAL) {
+        return;
+    }
+    pppCheckTime = now;
+    if (PPP.attached()) {
+        Serial.printf("[Uplink] 4G attached, operator %s, RSSI %d\n",
+                      PPP.operatorName().c_str(), PPP.RSSI());
+        pppDialed = PPP.mode(ESP_MODEM_MODE_CMUX);
+    }
+#endif
+}
+
+// 把默认路由切到新链路,并让MQTT客户端经新链路重新连接
+void MyUplink::useUplink(Uplink_t link) {
+    esp_netif_t* netif = nullptr;
+    if (link == UPLINK_WIFI) {
+        netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    }
+#if MY_UPLINK_HAS_PPP
+    else if (link == UPLINK_PPP) {
+        netif = PPP.netif();
+    }
+#endif
+    if (netif) {
+        esp_netif_set_default_netif(netif);
+    }
+
+    // 旧连接仍绑定在原来的链路上,断开后由应用照常重连;
+    // 未确认的QoS 1消息和排队的数据保存在MQTTSpool中,重连后继续发送,不会丢失
+    if (mqtt && mqtt->connected()) {
+        mqtt->disconnect();
+    }
+}
@@ -0,0 +1,114 @@
+// myUplink.h
+#ifndef MY_UPLINK_H
+#define MY_UPLINK_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <PubSubClient.h>
+#include "linkManager.h"
+
+// 4G模块(A7680C)参数,引脚见platformio.ini中的PPP_POWERKEY/PPP_RX/PPP_TX
+#ifndef PPP_APN
+#define PPP_APN "cmnet"                        // 接入点名称
+#endif
+#ifndef PPP_POWERKEY_ACTIVE_LOW
+#define PPP_POWERKEY_ACTIVE_LOW true
+#endif
+#define PPP_ATTACH_CHECK_INTERVAL 5000         // 等待注册网络时查询的间隔(ms)
+
+// MQTT服务器地址,用于健康探测
+#define IOT_CONFIG_FILE "/config/IOTConfig.json"
+
+// 服务器地址是域名时的异步解析参数
+#define UPLINK_DNS_TIMEOUT 15000               // 等待解析结果的上限(ms)
+#define UPLINK_DNS_RETRY_MIN 5000              // 解析失败后首次重试的间隔(ms)
+#define UPLINK_DNS_RETRY_MAX 300000            // 重试间隔逐次加倍的上限(ms)
+
+// arduino-esp32 3.x提供PPP库;旧版本只有WiFi链路
+#if defined(__has_include)
+#if __has_include(<PPP.h>)
+#define MY_UPLINK_HAS_PPP 1
+#endif
+#endif
+#ifndef MY_UPLINK_HAS_PPP
+#define MY_UPLINK_HAS_PPP 0
+#endif
+
+// UplinkDriver的设备实现
+// 探测方式是经由本链路的地址向MQTT服务器端口发起非阻塞TCP连接,
+// 以SYN到SYN-ACK的时间作为往返时间,连接建立后立即关闭。
+class EspUplink : public UplinkDriver {
+public:
+    explicit EspUplink(Uplink_t link);
+
+    void setTarget(const IPAddress& ip, uint16_t port);
+    IPAddress localIP();
+
+    bool linkUp() override;
+    bool startProbe() override;
+    UplinkProbe_t pollProbe(unsigned long& rtt) override;
+    void cancelProbe() override;
+
+private:
+    Uplink_t link;
+    IPAddress targetIP;
+    uint16_t targetPort;
+    int sock;
+    unsigned long probeStart;
+};
+
+// 异步域名解析的请求,结果由lwIP线程写入,在handle()中读取
+struct UplinkDnsQuery {
+    const char* host;
+    volatile uint8_t state;
+    volatile uint32_t ip;
+};
+
+class MyUplink {
+public:
+    MyUplink();
+
+    // 读取服务器地址并启动4G模块,WiFi由myWiFi管理
+    bool begin();
+
+    // 循环处理函数,需要在loop中调用
+    void handle();
+
+    // 切换链路时迁移该MQTT客户端的会话
+    void attach(PubSubClient& client);
+
+    // 当前使用的链路
+    Uplink_t getActive();
+
+    const UplinkHealth& getHealth(Uplink_t link);
+
+    unsigned long getSwitches();
+
+private:
+    EspUplink wifiUplink;
+    EspUplink pppUplink;
+    LinkManager manager;
+    PubSubClient* mqtt;
+
+    String targetHost;
+    uint16_t targetPort;
+    bool targetResolved;
+    UplinkDnsQuery dns;
+    unsigned long dnsTime;
+    unsigned long dnsBackoff;
+
+    bool pppStarted;
+    bool pppDialed;
+    unsigned long pppCheckTime;
+
+    bool loadConfig();
+    void resolveTarget(unsigned long now);
+    void startPPP();
+    void handlePPP(unsigned long now);
+    void useUplink(Uplink_t link);
+};
+
+// 全局上行链路管理对象
+extern MyUplink myUplink;
+
+#endif // MY_UPLINK_H
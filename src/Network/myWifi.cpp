@@ -1,18 +1,73 @@
 // myWifi.cpp
 #include "myWifi.h"
+#include "webAssets.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
 
 // 全局WiFi管理对象实例
 MyWiFi myWiFi;
 
-MyWiFi::MyWiFi() {
+// ============ EspWiFiDriver ============
+
+void EspWiFiDriver::attach(WiFiConnector& connector) {
+    if (attachedTo == &connector) {
+        return;
+    }
+    attachedTo = &connector;
+    
+    // 重连由状态机按自己的间隔进行,关闭库的自动重连以免两者冲突
+    WiFi.setAutoReconnect(false);
+    
+    // 事件回调在WiFi事件任务中执行,只通知状态机,由handle()处理
+    WiFiConnector* target = &connector;
+    WiFi.onEvent([target](WiFiEvent_t event, WiFiEventInfo_t info) {
+        target->notifyConnected();
+    }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.onEvent([target](WiFiEvent_t event, WiFiEventInfo_t info) {
+        target->notifyDisconnected();
+    }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
+
+void EspWiFiDriver::begin(const char* ssid, const char* password, const WiFiLinkParams& params) {
+    // ip为0时全部传0,恢复DHCP
+    WiFi.config(IPAddress(params.ip), IPAddress(params.gateway),
+                IPAddress(params.mask), IPAddress(params.dns));
+    
+    // 指定信道和BSSID时直接关联该AP,跳过全信道扫描
+    WiFi.begin(ssid, password, params.channel, params.bssid);
+}
+
+void EspWiFiDriver::disconnect() {
+    WiFi.disconnect(false);  // 只断开STA,保留当前模式和AP
+}
+
+bool EspWiFiDriver::connected() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+bool EspWiFiDriver::linkInfo(WiFiFastConnect& info) {
+    uint8_t* bssid = WiFi.BSSID();
+    if (!connected() || bssid == nullptr) {
+        return false;
+    }
+    memcpy(info.bssid, bssid, sizeof(info.bssid));
+    info.channel = WiFi.channel();
+    info.ip = (uint32_t)WiFi.localIP();
+    info.mask = (uint32_t)WiFi.subnetMask();
+    info.gateway = (uint32_t)WiFi.gatewayIP();
+    info.dns = (uint32_t)WiFi.dnsIP();
+    return true;
+}
+
+// ============ MyWiFi ============
+
+MyWiFi::MyWiFi() : connector(wifiDriver) {
     webServer = nullptr;
     dnsServer = nullptr;
     currentStatus = WIFI_STATUS_IDLE;
     currentMode = WIFI_MODE_NULL;
-    lastCheckTime = 0;
-    lastReconnectTime = 0;
-    reconnectAttempts = 0;
     configPortalActive = false;
+    scanRunning = false;
     apModeStartTime = 0;
     shouldStopPortal = false;
     portalStopTime = 0;
@@ -37,27 +92,23 @@ bool MyWiFi::begin() {
     WiFi.mode(WIFI_OFF);
     delay(100);
     
+    // 接收WiFi事件
+    wifiDriver.attach(connector);
+    
     // 加载配置
     if (!loadConfig()) {
         Serial.println("[WiFi] Failed to load config, using defaults");
     }
+    loadStaticIP();
     
     Serial.printf("[WiFi] STA SSID: %s", staSSID.c_str());
     Serial.printf("[WiFi] AP SSID: %s", apSSID.c_str());
     
-    // 如果有STA配置,尝试连接
+    // 如果有STA配置,发起连接;连接在后台进行,失败时由handle()启动配网门户
     if (staSSID.length() > 0) {
         startSTA();
-        if (connectToWiFi()) {
-            Serial.println("[WiFi] Successfully connected to WiFi");
-            currentStatus = WIFI_STATUS_CONNECTED;
-            currentMode = WIFI_MODE_STA;
-            return true;
-        } else {
-            Serial.println("[WiFi] Failed to connect, starting AP mode");
-            startConfigPortal();
-            return false;
-        }
+        connectToWiFi();
+        return true;
     } else {
         // 没有STA配置,直接进入AP配网模式
         Serial.println("[WiFi] No STA config found, starting config portal");
@@ -73,49 +124,21 @@ void MyWiFi::handle() {
     if (shouldStopPortal && currentTime >= portalStopTime) {
         shouldStopPortal = false;
         
-        // 尝试连接新的WiFi
+        // 使用新凭据连接,失败时由状态机事件重新启动配网门户
         stopConfigPortal();
-        WiFi.mode(WIFI_STA);
-        if (connectToWiFi()) {
-            currentStatus = WIFI_STATUS_CONNECTED;
-            currentMode = WIFI_MODE_STA;
-            Serial.println("[WiFi] Successfully connected with new credentials");
-        } else {
-            Serial.println("[WiFi] Failed to connect with new credentials");
-            startConfigPortal();
-        }
+        startSTA();
+        connectToWiFi();
         return;
     }
     
     // 处理配网门户
     if (configPortalActive && !shouldStopPortal) {
         handleConfigPortal();
-        
-        // 在AP/AP+STA模式下,周期性尝试连接STA
-        if (currentTime - lastReconnectTime >= AP_CHECK_STA_INTERVAL) {
-            lastReconnectTime = currentTime;
-            if (staSSID.length() > 0 && currentStatus != WIFI_STATUS_CONNECTED) {
-                checkAPMode();
-            }
-        }
-    }
-    
-    // 检查STA连接状态
-    if ((currentMode == WIFI_MODE_STA || currentMode == WIFI_MODE_APSTA) && 
-        currentStatus == WIFI_STATUS_CONNECTED) {
-        if (currentTime - lastCheckTime >= WIFI_CHECK_INTERVAL) {
-            lastCheckTime = currentTime;
-            checkSTAConnection();
-        }
+        updateScan(currentTime);
     }
     
-    // 在断线状态下尝试重连
-    if (currentStatus == WIFI_STATUS_DISCONNECTED && !configPortalActive) {
-        if (currentTime - lastReconnectTime >= WIFI_RECONNECT_INTERVAL) {
-            lastReconnectTime = currentTime;
-            handleReconnect();
-        }
-    }
+    // 推进连接状态机,连接、超时和重连都不会阻塞
+    handleLinkEvent(connector.update(currentTime));
 }
 
 WiFiStatus_t MyWiFi::getStatus() {
@@ -165,7 +188,16 @@ int MyWiFi::getConnectedClients() {
     return 0;
 }
 
+unsigned long MyWiFi::getTimeToIP() {
+    return connector.getTimeToIP();
+}
+
 bool MyWiFi::setSTACredentials(const String& ssid, const String& password) {
+    if (ssid != staSSID) {
+        // 换了网络,上次的AP和租约不再有效
+        connector.clearFastConnect();
+        saveFastConnect();
+    }
     staSSID = ssid;
     staPassword = password;
     return saveConfig();
@@ -187,6 +219,9 @@ void MyWiFi::clearConfig() {
     preferences.clear();
     preferences.end();
     
+    connector.clearFastConnect();
+    connector.takeFastConnectChanged();  // NVS已清空,无需再保存
+    
     staSSID = DEFAULT_STA_SSID;
     staPassword = DEFAULT_STA_PASSWORD;
     apSSID = DEFAULT_AP_SSID;
@@ -222,6 +257,7 @@ void MyWiFi::disconnect() {
     Serial.println("[WiFi] Disconnecting WiFi...");
     
     stopConfigPortal();
+    connector.stop();
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
     
@@ -239,8 +275,25 @@ bool MyWiFi::loadConfig() {
     apSSID = preferences.getString(NVS_KEY_AP_SSID, DEFAULT_AP_SSID);
     apPassword = preferences.getString(NVS_KEY_AP_PASSWORD, DEFAULT_AP_PASSWORD);
     
+    // 快速连接信息,没有保存过时channel为0
+    WiFiFastConnect fast;
+    memset(&fast, 0, sizeof(fast));
+    if (preferences.getBytes(NVS_KEY_FC_BSSID, fast.bssid, sizeof(fast.bssid)) == sizeof(fast.bssid)) {
+        fast.channel = preferences.getInt(NVS_KEY_FC_CHANNEL, 0);
+        fast.ip = preferences.getUInt(NVS_KEY_FC_IP, 0);
+        fast.mask = preferences.getUInt(NVS_KEY_FC_MASK, 0);
+        fast.gateway = preferences.getUInt(NVS_KEY_FC_GATEWAY, 0);
+        fast.dns = preferences.getUInt(NVS_KEY_FC_DNS, 0);
+    }
+    
     preferences.end();
     
+    connector.setFastConnect(fast);
+    if (fast.channel != 0) {
+        Serial.printf("[WiFi] Fast connect: channel %d, last IP %s\n",
+                      (int)fast.channel, IPAddress(fast.ip).toString().c_str());
+    }
+    
     // 验证AP密码长度
     if (apPassword.length() < 8) {
         apPassword = DEFAULT_AP_PASSWORD;
@@ -306,11 +359,66 @@ bool MyWiFi::saveConfig() {
     return success;
 }
 
+void MyWiFi::loadStaticIP() {
+    if (!LittleFS.begin(false)) {
+        return;
+    }
+    File file = LittleFS.open(WIFI_CONFIG_FILE, "r");
+    if (!file) {
+        return;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+        Serial.printf("[WiFi] Failed to parse %s: %s\n", WIFI_CONFIG_FILE, error.c_str());
+        return;
+    }
+    
+    // ip为空时使用DHCP;mask/gw无效时同样放弃静态IP
+    IPAddress ip, mask, gateway;
+    if (!ip.fromString(doc["ip"] | "")) {
+        return;
+    }
+    if (!mask.fromString(doc["mask"] | "") || !gateway.fromString(doc["gw"] | "")) {
+        Serial.println("[WiFi] Static IP ignored: mask/gw missing");
+        return;
+    }
+    connector.setStaticIP((uint32_t)ip, (uint32_t)mask, (uint32_t)gateway, 0);
+    Serial.printf("[WiFi] Static IP: %s\n", ip.toString().c_str());
+}
+
+void MyWiFi::saveFastConnect() {
+    WiFiFastConnect fast;
+    bool valid = connector.getFastConnect(fast);
+    
+    preferences.end();
+    if (!preferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("[WiFi] ERROR: Failed to open NVS namespace");
+        return;
+    }
+    if (valid) {
+        preferences.putBytes(NVS_KEY_FC_BSSID, fast.bssid, sizeof(fast.bssid));
+        preferences.putInt(NVS_KEY_FC_CHANNEL, fast.channel);
+        preferences.putUInt(NVS_KEY_FC_IP, fast.ip);
+        preferences.putUInt(NVS_KEY_FC_MASK, fast.mask);
+        preferences.putUInt(NVS_KEY_FC_GATEWAY, fast.gateway);
+        preferences.putUInt(NVS_KEY_FC_DNS, fast.dns);
+    } else {
+        preferences.remove(NVS_KEY_FC_BSSID);
+        preferences.remove(NVS_KEY_FC_CHANNEL);
+        preferences.remove(NVS_KEY_FC_IP);
+        preferences.remove(NVS_KEY_FC_MASK);
+        preferences.remove(NVS_KEY_FC_GATEWAY);
+        preferences.remove(NVS_KEY_FC_DNS);
+    }
+    preferences.end();
+}
+
 void MyWiFi::startSTA() {
     Serial.println("[WiFi] Starting STA mode...");
     WiFi.mode(WIFI_STA);
     currentMode = WIFI_MODE_STA;
-    delay(100);
 }
 
 void MyWiFi::startAP() {
@@ -335,181 +443,93 @@ void MyWiFi::startAPSTA() {
     
     currentMode = WIFI_MODE_APSTA;
     currentStatus = WIFI_STATUS_AP_STA_STARTED;
-    
-    delay(100);
 }
 
-bool MyWiFi::connectToWiFi() {
+void MyWiFi::connectToWiFi() {
     if (staSSID.length() == 0) {
         Serial.println("[WiFi] No SSID configured");
-        return false;
+        return;
     }
     
     Serial.printf("[WiFi] Connecting to %s...", staSSID.c_str());
     
     currentStatus = WIFI_STATUS_CONNECTING;
-    WiFi.begin(staSSID.c_str(), staPassword.c_str());
-    
-    unsigned long startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startTime < WIFI_CONNECT_TIMEOUT) {
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.println();
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.printf("[WiFi] Connected! IP: %s", WiFi.localIP().toString().c_str());
-        Serial.printf("[WiFi] RSSI: %d dBm", WiFi.RSSI());
-        reconnectAttempts = 0;
-        return true;
-    } else {
-        Serial.println("[WiFi] Connection failed");
-        return false;
-    }
+    connector.start(staSSID.c_str(), staPassword.c_str(), millis());
 }
 
-void MyWiFi::handleReconnect() {
-    reconnectAttempts++;
-    Serial.printf("[WiFi] [AP+STA Mode] Reconnecting (attempt %d)...", reconnectAttempts);
-    
-    currentStatus = WIFI_STATUS_RECONNECTING;
-    
-    // 在AP+STA模式下尝试连接
-    if (currentMode != WIFI_MODE_APSTA) {
-        WiFi.mode(WIFI_AP_STA);
-        WiFi.softAP(apSSID.c_str(), apPassword.c_str());
-        currentMode = WIFI_MODE_APSTA;
-    }
-    
-    // 尝试连接STA
-    WiFi.begin(staSSID.c_str(), staPassword.c_str());
-    
-    unsigned long startTime = millis();
-    bool connected = false;
-    while (millis() - startTime < WIFI_CONNECT_TIMEOUT) {
-        if (WiFi.status() == WL_CONNECTED) {
-            connected = true;
-            break;
+void MyWiFi::handleLinkEvent(WiFiLinkEvent_t event) {
+    switch (event) {
+    case WIFI_LINK_EVENT_UP:
+        Serial.printf("[WiFi] Connected! IP: %s", WiFi.localIP().toString().c_str());
+        Serial.printf("[WiFi] RSSI: %d dBm", WiFi.RSSI());
+        Serial.printf("[WiFi] Time to IP: %lu ms (%s)\n", connector.getTimeToIP(),
+                      connector.lastConnectWasFast() ? "fast" : "full scan");
+        
+        // AP、信道或租约有变化时才写NVS,减少flash写入
+        if (connector.takeFastConnectChanged()) {
+            saveFastConnect();
         }
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.println();
-    
-    if (connected) {
-        Serial.printf("[WiFi] Reconnected successfully! IP: %s", WiFi.localIP().toString().c_str());
-        currentStatus = WIFI_STATUS_CONNECTED;
-        reconnectAttempts = 0;
         
         // 成功连接后,关闭AP模式,切换到纯STA
-        Serial.println("[WiFi] Switching to STA mode...");
-        stopConfigPortal();
-        delay(100);
-        WiFi.mode(WIFI_STA);
-        currentMode = WIFI_MODE_STA;
-    } else {
-        Serial.println("[WiFi] Reconnection failed, staying in AP+STA mode");
-        currentStatus = WIFI_STATUS_DISCONNECTED;
-        
-        // 保持AP+STA模式,继续提供配网服务
-        if (currentMode != WIFI_MODE_APSTA) {
-            WiFi.mode(WIFI_AP_STA);
-            WiFi.softAP(apSSID.c_str(), apPassword.c_str());
-            currentMode = WIFI_MODE_APSTA;
+        if (configPortalActive || currentMode != WIFI_MODE_STA) {
+            Serial.println("[WiFi] Switching to STA mode...");
+            stopConfigPortal();
+            WiFi.mode(WIFI_STA);
+            currentMode = WIFI_MODE_STA;
         }
-    }
-}
-
-void MyWiFi::checkSTAConnection() {
-    if (WiFi.status() != WL_CONNECTED && currentStatus == WIFI_STATUS_CONNECTED) {
-        Serial.println("[WiFi] Connection lost!");
-        currentStatus = WIFI_STATUS_DISCONNECTED;
-        lastReconnectTime = millis();
-        reconnectAttempts = 0;  // 重置重连计数，启用快速重连
+        currentStatus = WIFI_STATUS_CONNECTED;
+        break;
         
-        // 立即启动AP+STA模式,提供配网服务的同时尝试重连
-        Serial.println("[WiFi] Starting AP+STA mode for reconnection...");
-        startAPSTA();
+    case WIFI_LINK_EVENT_DOWN:
+        // 立即启动AP+STA模式,提供配网服务的同时重连(状态机已发起第一次重连)
+        Serial.println("[WiFi] Connection lost!");
+        startReconnectPortal();
+        currentStatus = WIFI_STATUS_RECONNECTING;
+        break;
         
-        // 启动配网门户
+    case WIFI_LINK_EVENT_FAILED:
+        Serial.printf("[WiFi] Connection failed (attempt %d)", connector.getAttempts());
         if (!configPortalActive) {
-            // 设置DNS服务器用于强制门户
-            if (!dnsServer) {
-                dnsServer = new DNSServer();
-            }
-            dnsServer->start(DNS_PORT, "*", WiFi.softAPIP());
-            
-            // 设置Web服务器
-            setupWebServer();
-            
-            configPortalActive = true;
-            Serial.println("[WiFi] Config portal started for reconfiguration");
+            startReconnectPortal();
         }
+        currentStatus = WIFI_STATUS_DISCONNECTED;
+        break;
         
-        // 立即尝试第一次重连，不等待间隔
-        Serial.println("[WiFi] Attempting immediate reconnection...");
-        handleReconnect();
-    }
-    
-    // 如果仍在断线状态，继续尝试重连
-    if (currentStatus == WIFI_STATUS_DISCONNECTED) {
-        unsigned long currentTime = millis();
+    case WIFI_LINK_EVENT_FALLBACK:
+        // 保存的AP/信道/租约已失效,删除NVS中的副本,状态机已改为全信道扫描连接
+        Serial.println("[WiFi] Fast connect failed, falling back to full scan");
+        if (connector.takeFastConnectChanged()) {
+            saveFastConnect();
+        }
+        break;
         
-        // 智能重连间隔：前3次每5秒，之后每30秒
-        unsigned long reconnectInterval = (reconnectAttempts < 3) ? 
-                                          WIFI_RECONNECT_INTERVAL : 
-                                          WIFI_RECONNECT_INTERVAL_SLOW;
+    case WIFI_LINK_EVENT_RETRY:
+        Serial.printf("[WiFi] [AP+STA Mode] Reconnecting (attempt %d)...", connector.getAttempts() + 1);
+        currentStatus = WIFI_STATUS_RECONNECTING;
+        break;
         
-        if (currentTime - lastReconnectTime >= reconnectInterval) {
-            lastReconnectTime = currentTime;
-            handleReconnect();
-        }
+    default:
+        break;
     }
 }
 
-void MyWiFi::checkAPMode() {
-    // 在AP或AP+STA模式下尝试连接STA
-    if (staSSID.length() > 0) {
-        wl_status_t status = WiFi.status();
-        
-        // 先检查是否已连接成功
-        if (status == WL_CONNECTED) {
-            // 已连接成功
-            Serial.printf("[WiFi] STA connected! IP: %s", WiFi.localIP().toString().c_str());
-            Serial.println("[WiFi] Stopping AP and switching to STA mode");
-            
-            stopConfigPortal();
-            currentStatus = WIFI_STATUS_CONNECTED;
-            reconnectAttempts = 0;
-            
-            delay(100);
-            WiFi.mode(WIFI_STA);
-            currentMode = WIFI_MODE_STA;
-            return;
+void MyWiFi::startReconnectPortal() {
+    Serial.println("[WiFi] Starting AP+STA mode for reconnection...");
+    startAPSTA();
+    
+    // 启动配网门户
+    if (!configPortalActive) {
+        // 设置DNS服务器用于强制门户
+        if (!dnsServer) {
+            dnsServer = new DNSServer();
         }
+        dnsServer->start(DNS_PORT, "*", WiFi.softAPIP());
         
-        // 只有在空闲或断开状态时才尝试连接，避免频繁调用WiFi.begin()
-        if (status == WL_IDLE_STATUS || status == WL_DISCONNECTED || status == WL_NO_SSID_AVAIL) {
-            // 使用静态变量避免过于频繁的连接尝试
-            static unsigned long lastAttempt = 0;
-            if (millis() - lastAttempt < 3000) {  // 间隔3秒，更快响应
-                return;
-            }
-            lastAttempt = millis();
-            
-            Serial.println("[WiFi] [AP/AP+STA Mode] Attempting STA connection...");
-            
-            // 确保在AP+STA模式
-            if (currentMode == WIFI_MODE_AP) {
-                WiFi.mode(WIFI_AP_STA);
-                currentMode = WIFI_MODE_APSTA;
-                delay(100);
-            }
-            
-            // 发起连接（非阻塞）
-            WiFi.begin(staSSID.c_str(), staPassword.c_str());
-        }
-        // 如果是 WL_CONNECT_FAILED 等其他状态，等待下一个周期
+        // 设置Web服务器
+        setupWebServer();
+        
+        configPortalActive = true;
+        Serial.println("[WiFi] Config portal started for reconfiguration");
     }
 }
 
@@ -532,7 +552,11 @@ void MyWiFi::setupWebServer() {
     webServer->on("/save", HTTP_POST, [this]() { this->handleSave(); });
     webServer->on("/scan", [this]() { this->handleScan(); });
     webServer->on("/status", [this]() { this->handleStatus(); });
-    webServer->onNotFound([this]() { this->handleRoot(); }); // 强制门户
+    webServer->onNotFound([this]() { this->handleNotFound(); }); // 强制门户
+    
+    // 读取浏览器缓存校验头,用于返回304
+    const char* headerKeys[] = { "If-None-Match" };
+    webServer->collectHeaders(headerKeys, 1);
     
     webServer->begin();
     Serial.println("[WiFi] Web server started");
@@ -540,7 +564,41 @@ void MyWiFi::setupWebServer() {
 
 void MyWiFi::handleRoot() {
     if (!webServer) return;
-    webServer->send(200, "text/html", getConfigPortalHTML());
+    sendAsset("/portal.html");
+}
+
+void MyWiFi::handleNotFound() {
+    if (!webServer) return;
+    // 嵌入的网页资源按路径返回,其他请求都指向配网页面
+    if (!sendAsset(webServer->uri().c_str())) {
+        sendAsset("/portal.html");
+    }
+}
+
+bool MyWiFi::sendAsset(const char* path) {
+    const WebAsset* asset = nullptr;
+    for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+        if (strcmp(WEB_ASSETS[i].path, path) == 0) {
+            asset = &WEB_ASSETS[i];
+            break;
+        }
+    }
+    if (!asset) {
+        return false;
+    }
+    
+    // 每次都向服务器校验,内容未变时只返回304
+    webServer->sendHeader("ETag", asset->etag);
+    webServer->sendHeader("Cache-Control", "no-cache");
+    if (webServer->header("If-None-Match") == asset->etag) {
+        webServer->send(304);
+        return true;
+    }
+    
+    // 直接从flash发送已压缩的数据,不复制到RAM
+    webServer->sendHeader("Content-Encoding", "gzip");
+    webServer->send_P(200, asset->contentType, (const char*)asset->data, asset->length);
+    return true;
 }
 
 void MyWiFi::handleSave() {
@@ -552,6 +610,11 @@ void MyWiFi::handleSave() {
     Serial.printf("[WiFi] Received new credentials - SSID: %s\n", newSSID.c_str());
     
     if (newSSID.length() > 0) {
+        if (newSSID != staSSID) {
+            // 换了网络,上次的AP和租约不再有效
+            connector.clearFastConnect();
+            saveFastConnect();
+        }
         staSSID = newSSID;
         staPassword = newPassword;
         
@@ -578,62 +641,65 @@ void MyWiFi::handleSave() {
 void MyWiFi::handleScan() {
     if (!webServer) return;
     
-    Serial.println("[WiFi] Scanning networks...");
-    
-    // 确保WiFi在支持扫描的模式下
-    wifi_mode_t currentWiFiMode = WiFi.getMode();
-    Serial.printf("[WiFi] Current mode before scan: %d", currentWiFiMode);
+    // 结果过期时尽快重新扫描,本次请求仍立即返回缓存结果
+    if (!scanCache.isFresh(millis())) {
+        scanCache.requestScan();
+    }
     
-    // 如果是纯AP模式，临时切换到AP+STA以支持扫描
-    bool needRestoreMode = false;
-    if (currentWiFiMode == WIFI_MODE_AP) {
-        Serial.println("[WiFi] Switching to AP+STA mode for scanning...");
-        WiFi.mode(WIFI_AP_STA);
-        delay(100);
-        needRestoreMode = true;
-    }
-    
-    // 在AP+STA模式下，先停止STA连接以避免扫描冲突
-    bool wasDisconnected = false;
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[WiFi] Stopping STA connection for scan...");
-        WiFi.disconnect();
-        delay(200);
-        wasDisconnected = true;
-    }
-    
-    // 执行扫描（阻塞式，但添加超时保护）
-    int n = WiFi.scanNetworks(false, true);  // false=同步扫描, true=显示隐藏网络
-    Serial.printf("[WiFi] Found %d networks", n);
-    
-    String json = "[";
-    if (n > 0) {
-        for (int i = 0; i < n; i++) {
-            if (i > 0) json += ",";
-            json += "{";
-            json += "\"ssid\":\"" + WiFi.SSID(i) + "\",";
-            json += "\"rssi\":" + String(WiFi.RSSI(i)) + ",";
-            json += "\"encryption\":" + String(WiFi.encryptionType(i));
-            json += "}";
+    // 通过固定缓冲区分块发送JSON,不拼接String
+    char buffer[WIFI_SCAN_JSON_CHUNK];
+    int cursor = 0;
+    size_t length;
+    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer->send(200, "application/json", "");
+    while ((length = scanCache.writeJSON(buffer, sizeof(buffer), cursor)) > 0) {
+        webServer->sendContent(buffer, length);
+    }
+    webServer->sendContent("");
+}
+
+void MyWiFi::updateScan(unsigned long now) {
+    // 收取已完成的异步扫描
+    if (scanRunning) {
+        int n = WiFi.scanComplete();
+        if (n == WIFI_SCAN_RUNNING) {
+            return;
         }
-    } else if (n == 0) {
-        Serial.println("[WiFi] No networks found");
-    } else {
-        Serial.printf("[WiFi] Scan failed with error code: %d", n);
+        scanRunning = false;
+        if (n >= 0) {
+            scanCache.clear();
+            for (int i = 0; i < n; i++) {
+                scanCache.add(WiFi.SSID(i).c_str(), WiFi.RSSI(i), WiFi.encryptionType(i));
+            }
+            scanCache.commit(now);
+            Serial.printf("[WiFi] Found %d networks", n);
+        } else {
+            Serial.printf("[WiFi] Scan failed with error code: %d", n);
+        }
+        WiFi.scanDelete();
+        return;
+    }
+    
+    if (!scanCache.scanDue(now)) {
+        return;
     }
-    json += "]";
     
-    WiFi.scanDelete();
+    // 扫描会打断正在进行的连接尝试,等这次尝试结束
+    if (connector.getState() == WIFI_LINK_CONNECTING) {
+        return;
+    }
     
-    // 恢复原来的模式
-    if (needRestoreMode) {
-        Serial.println("[WiFi] Restoring AP mode...");
-        WiFi.mode(WIFI_MODE_AP);
-        delay(100);
+    // 扫描需要STA接口,纯AP模式切换到AP+STA(AP保持不变)
+    if (currentMode == WIFI_MODE_AP) {
+        WiFi.mode(WIFI_AP_STA);
+        currentMode = WIFI_MODE_APSTA;
     }
     
-    webServer->send(200, "application/json", json);
-    Serial.println("[WiFi] Scan response sent");
+    // 异步扫描,立即返回; true=显示隐藏网络
+    scanCache.scanStarted(now);
+    if (WiFi.scanNetworks(true, true) == WIFI_SCAN_RUNNING) {
+        scanRunning = true;
+    }
 }
 
 void MyWiFi::handleStatus() {
@@ -654,9 +720,6 @@ void MyWiFi::stopConfigPortal() {
             webServer->stop();
         }
         
-        // 小延迟确保所有处理完成
-        delay(100);
-        
         // 释放内存
         if (webServer) {
             delete webServer;
@@ -673,73 +736,6 @@ void MyWiFi::stopConfigPortal() {
     }
 }
 
-String MyWiFi::getConfigPortalHTML() {
-    String html = "<!DOCTYPE html><html><head><meta charset=\"UTF-8\">";
-    html += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">";
-    html += "<title>ESP32 WiFi Setup</title><style>";
-    html += "*{margin:0;padding:0;box-sizing:border-box}";
-    html += "body{font-family:Arial,sans-serif;background:linear-gradient(135deg,#667eea 0%,#764ba2 100%);";
-    html += "min-height:100vh;display:flex;justify-content:center;align-items:center;padding:20px}";
-    html += ".container{background:white;border-radius:10px;padding:30px;max-width:500px;width:100%;";
-    html += "box-shadow:0 10px 40px rgba(0,0,0,0.2)}";
-    html += "h1{color:#333;margin-bottom:10px;text-align:center}";
-    html += ".subtitle{color:#666;text-align:center;margin-bottom:30px;font-size:14px}";
-    html += ".form-group{margin-bottom:20px}";
-    html += "label{display:block;margin-bottom:5px;color:#555;font-weight:bold}";
-    html += "input,select{width:100%;padding:12px;border:2px solid #ddd;border-radius:5px;";
-    html += "font-size:16px;transition:border-color 0.3s}";
-    html += "input:focus,select:focus{outline:none;border-color:#667eea}";
-    html += "button{width:100%;padding:12px;background:linear-gradient(135deg,#667eea 0%,#764ba2 100%);";
-    html += "color:white;border:none;border-radius:5px;font-size:16px;font-weight:bold;";
-    html += "cursor:pointer;transition:transform 0.2s}";
-    html += "button:hover{transform:translateY(-2px)}";
-    html += "button:active{transform:translateY(0)}";
-    html += ".scan-btn{background:linear-gradient(135deg,#f093fb 0%,#f5576c 100%);margin-bottom:15px}";
-    html += ".network-list{max-height:200px;overflow-y:auto;border:2px solid #ddd;border-radius:5px;margin-top:10px}";
-    html += ".network-item{padding:10px;border-bottom:1px solid #eee;cursor:pointer;transition:background 0.2s}";
-    html += ".network-item:hover{background:#f5f5f5}";
-    html += ".network-item:last-child{border-bottom:none}";
-    html += ".signal{float:right;color:#888}";
-    html += ".loading{text-align:center;color:#666;padding:20px}";
-    html += ".info{background:#e3f2fd;padding:15px;border-radius:5px;margin-bottom:20px;font-size:14px;color:#1976d2}";
-    html += "</style></head><body><div class=\"container\">";
-    html += "<h1>WiFi Configuration</h1>";
-    html += "<p class=\"subtitle\">ESP32 Gateway Setup</p>";
-    html += "<div class=\"info\"><strong>Current AP:</strong> " + apSSID + "<br>";
-    html += "<strong>IP Address:</strong> " + WiFi.softAPIP().toString() + "</div>";
-    html += "<button class=\"scan-btn\" onclick=\"scanNetworks()\">Scan Networks</button>";
-    html += "<div id=\"networkList\"></div>";
-    html += "<form action=\"/save\" method=\"POST\">";
-    html += "<div class=\"form-group\"><label for=\"ssid\">WiFi Network (SSID):</label>";
-    html += "<input type=\"text\" id=\"ssid\" name=\"ssid\" placeholder=\"Enter WiFi SSID\" required></div>";
-    html += "<div class=\"form-group\"><label for=\"password\">Password:</label>";
-    html += "<input type=\"password\" id=\"password\" name=\"password\" placeholder=\"Enter WiFi Password\"></div>";
-    html += "<button type=\"submit\">Save &amp; Connect</button></form></div>";
-    html += "<script>";
-    html += "function scanNetworks(){";
-    html += "document.getElementById('networkList').innerHTML='<div class=\"loading\">Scanning...</div>';";
-    html += "fetch('/scan').then(response=>response.json()).then(networks=>{";
-    html += "let html='<div class=\"network-list\">';";
-    html += "networks.forEach(network=>{";
-    html += "let signal=network.rssi;";
-    html += "let bars=signal>-50?'[****]':signal>-70?'[***]':'[**]';";
-    html += "let lock=network.encryption>0?'[Lock] ':'';";
-    html += "html+='<div class=\"network-item\" onclick=\"selectNetwork(\\''+network.ssid+'\\')\">';";
-    html += "html+=lock+network.ssid+'<span class=\"signal\">'+bars+' '+signal+'dBm</span></div>';";
-    html += "});";
-    html += "html+='</div>';";
-    html += "document.getElementById('networkList').innerHTML=html;";
-    html += "}).catch(error=>{";
-    html += "document.getElementById('networkList').innerHTML='<div class=\"loading\">Scan failed</div>';";
-    html += "});}";
-    html += "function selectNetwork(ssid){";
-    html += "document.getElementById('ssid').value=ssid;";
-    html += "document.getElementById('password').focus();}";
-    html += "window.onload=function(){scanNetworks();};";
-    html += "</script></body></html>";
-    return html;
-}
-
 String MyWiFi::getStatusJSON() {
     String json = "{";
     json += "\"mode\":\"" + String(currentMode) + "\",";
@@ -749,7 +745,8 @@ String MyWiFi::getStatusJSON() {
     json += "\"sta_rssi\":" + String(getRSSI()) + ",";
     json += "\"ap_ssid\":\"" + apSSID + "\",";
     json += "\"ap_ip\":\"" + getAPIP() + "\",";
-    json += "\"ap_clients\":" + String(getConnectedClients());
+    json += "\"ap_clients\":" + String(getConnectedClients()) + ",";
+    json += "\"time_to_ip\":" + String(getTimeToIP());
     json += "}";
     return json;
 }
@@ -8,6 +8,8 @@
 #include <WebServer.h>
 #include <Preferences.h>
 #include <DNSServer.h>
+#include "wifiConnector.h"
+#include "wifiScanCache.h"
 
 // 默认配置值
 #define DEFAULT_AP_SSID "ESP32-Gateway"        // 默认AP热点名称
@@ -21,14 +23,18 @@
 #define NVS_KEY_STA_PASSWORD "sta_pwd"
 #define NVS_KEY_AP_SSID "ap_ssid"
 #define NVS_KEY_AP_PASSWORD "ap_pwd"
+#define NVS_KEY_FC_BSSID "fc_bssid"            // 快速连接: 上次连接的AP
+#define NVS_KEY_FC_CHANNEL "fc_channel"        // 快速连接: 上次连接的信道
+#define NVS_KEY_FC_IP "fc_ip"                  // 快速连接: 上次的DHCP租约
+#define NVS_KEY_FC_MASK "fc_mask"
+#define NVS_KEY_FC_GATEWAY "fc_gw"
+#define NVS_KEY_FC_DNS "fc_dns"
 
-// WiFi连接参数
-#define WIFI_CONNECT_TIMEOUT 10000             // WiFi连接超时时间(ms)
-#define WIFI_RECONNECT_INTERVAL 5000           // 快速重连间隔(5秒)
-#define WIFI_RECONNECT_INTERVAL_SLOW 30000     // 慢速重连间隔(30秒,失败3次后)
+// 可选的静态IP配置(ip/mask/gw,为空时使用DHCP)
+#define WIFI_CONFIG_FILE "/config/WifiConfig.json"
+
+// WiFi连接参数(超时和重连间隔见wifiConnector.h)
 #define WIFI_MAX_RETRY_TIMES 999               // 最大重试次数(设置很大,持续重连)
-#define WIFI_CHECK_INTERVAL 5000               // WiFi状态检查间隔(ms)
-#define AP_CHECK_STA_INTERVAL 3000             // AP模式下检查STA连接的间隔(3秒,快速检测)
 
 // DNS服务器配置
 #define DNS_PORT 53
@@ -46,12 +52,27 @@ enum WiFiStatus_t {
     WIFI_STATUS_CONFIG_PORTAL       // 配网模式
 };
 
+// WiFiDriver的设备实现,转发给ESP32 WiFi库,并把WiFi事件交给WiFiConnector
+class EspWiFiDriver : public WiFiDriver {
+public:
+    // 注册WiFi事件回调并关闭库自带的自动重连(重连由WiFiConnector负责)
+    void attach(WiFiConnector& connector);
+
+    void begin(const char* ssid, const char* password, const WiFiLinkParams& params) override;
+    void disconnect() override;
+    bool connected() override;
+    bool linkInfo(WiFiFastConnect& info) override;
+
+private:
+    WiFiConnector* attachedTo = nullptr;
+};
+
 class MyWiFi {
 public:
     MyWiFi();
     ~MyWiFi();
 
-    // 初始化WiFi
+    // 初始化WiFi;有STA配置时发起连接并返回true,连接在后台进行
     bool begin();
     
     // 循环处理函数,需要在loop中调用
@@ -95,11 +116,22 @@ public:
     
     // 获取连接的客户端数量(AP模式)
     int getConnectedClients();
+    
+    // 最近一次从开始连接到获得IP的时间(ms)
+    unsigned long getTimeToIP();
 
 private:
     // NVS偏好设置对象
     Preferences preferences;
     
+    // 非阻塞连接状态机及其驱动
+    EspWiFiDriver wifiDriver;
+    WiFiConnector connector;
+    
+    // 后台扫描结果缓存
+    WiFiScanCache scanCache;
+    bool scanRunning;
+    
     // Web服务器(用于配网)
     WebServer* webServer;
     
@@ -115,9 +147,6 @@ private:
     // 状态变量
     WiFiStatus_t currentStatus;
     wifi_mode_t currentMode;
-    unsigned long lastCheckTime;
-    unsigned long lastReconnectTime;
-    int reconnectAttempts;
     bool configPortalActive;
     unsigned long apModeStartTime;
     bool shouldStopPortal;
@@ -126,22 +155,25 @@ private:
     // 内部功能函数
     bool loadConfig();                          // 从NVS加载配置
     bool saveConfig();                          // 保存配置到NVS
+    void loadStaticIP();                        // 从WifiConfig.json读取可选的静态IP
+    void saveFastConnect();                     // 保存或清除NVS中的快速连接信息
     void startSTA();                            // 启动STA模式
     void startAP();                             // 启动AP模式
     void startAPSTA();                          // 启动AP+STA模式
-    bool connectToWiFi();                       // 连接到WiFi
-    void handleReconnect();                     // 处理重连逻辑
+    void connectToWiFi();                       // 发起WiFi连接(非阻塞)
+    void handleLinkEvent(WiFiLinkEvent_t event); // 处理连接状态机报告的变化
+    void startReconnectPortal();                // 启动AP+STA配网门户,同时后台重连
     void handleConfigPortal();                  // 处理配网门户
     void setupWebServer();                      // 设置Web服务器
     void handleRoot();                          // 处理根页面请求
+    void handleNotFound();                      // 返回网页资源或配网页面(强制门户)
+    bool sendAsset(const char* path);           // 发送嵌入的gzip网页资源,支持304
     void handleSave();                          // 处理保存配置请求
-    void handleScan();                          // 处理WiFi扫描请求
+    void handleScan();                          // 处理WiFi扫描请求(返回缓存结果)
+    void updateScan(unsigned long now);         // 发起和收取后台扫描
     void handleStatus();                        // 处理状态查询请求
     void stopConfigPortal();                    // 停止配网门户
-    String getConfigPortalHTML();               // 获取配网页面HTML
     String getStatusJSON();                     // 获取状态JSON
-    void checkSTAConnection();                  // 检查STA连接状态
-    void checkAPMode();                         // 在AP模式下检查是否可以连接STA
 };
 
 // 全局WiFi管理对象(外部声明,需在cpp中定义)
@@ -0,0 +1,81 @@
+// simUplink.cpp
+#include "simUplink.h"
+
+SimUplink::SimUplink(const unsigned long& clock, uint32_t seed) : clock(clock) {
+    random = seed ? seed : 1;
+    up = false;
+    refused = false;
+    rtt = 50;
+    loss = 0;
+    probes = 0;
+    probing = false;
+    answered = false;
+    probeStart = 0;
+    probeRTT = 0;
+}
+
+void SimUplink::setUp(bool newUp) {
+    up = newUp;
+}
+
+void SimUplink::setRTT(unsigned long newRTT) {
+    rtt = newRTT;
+}
+
+void SimUplink::setLoss(uint8_t percent) {
+    loss = percent;
+}
+
+void SimUplink::setRefused(bool newRefused) {
+    refused = newRefused;
+}
+
+unsigned long SimUplink::getProbes() {
+    return probes;
+}
+
+bool SimUplink::linkUp() {
+    return up;
+}
+
+bool SimUplink::startProbe() {
+    if (!up) {
+        return false;
+    }
+    probes++;
+    probing = true;
+    probeStart = clock;
+    probeRTT = rtt;
+    answered = (nextRandom() % 100) >= loss;
+    return true;
+}
+
+UplinkProbe_t SimUplink::pollProbe(unsigned long& result) {
+    if (!probing) {
+        return UPLINK_PROBE_FAILED;
+    }
+    if (!up || refused) {
+        probing = false;
+        return UPLINK_PROBE_FAILED;
+    }
+    if (answered && clock - probeStart >= probeRTT) {
+        probing = false;
+        result = clock - probeStart;
+        return UPLINK_PROBE_OK;
+    }
+    return UPLINK_PROBE_PENDING;
+}
+
+void SimUplink::cancelProbe() {
+    probing = false;
+}
+
+// ============ 私有函数实现 ============
+
+// xorshift32
+uint32_t SimUplink::nextRandom() {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
@@ -0,0 +1,45 @@
+// simUplink.h
+#ifndef SIM_UPLINK_H
+#define SIM_UPLINK_H
+
+#include <stdint.h>
+#include "uplinkDriver.h"
+
+// 模拟的上行链路,用于在主机上测试切换策略
+// 链路状态、往返时间和丢包率由测试随时设置;时间取自外部的模拟时钟,
+// 丢包由固定种子的伪随机数决定,每次运行结果相同。
+class SimUplink : public UplinkDriver {
+public:
+    // clock: 模拟时钟(ms),由测试推进
+    SimUplink(const unsigned long& clock, uint32_t seed);
+
+    void setUp(bool up);
+    void setRTT(unsigned long rtt);
+    void setLoss(uint8_t percent);          // 探测无应答的概率(%)
+    void setRefused(bool refused);          // 探测立即失败(如服务器端口不通)
+
+    unsigned long getProbes();              // 发起的探测次数
+
+    bool linkUp() override;
+    bool startProbe() override;
+    UplinkProbe_t pollProbe(unsigned long& rtt) override;
+    void cancelProbe() override;
+
+private:
+    const unsigned long& clock;
+    uint32_t random;
+    bool up;
+    bool refused;
+    unsigned long rtt;
+    uint8_t loss;
+    unsigned long probes;
+
+    bool probing;
+    bool answered;                          // 本次探测会不会有应答
+    unsigned long probeStart;
+    unsigned long probeRTT;
+
+    uint32_t nextRandom();
+};
+
+#endif // SIM_UPLINK_H
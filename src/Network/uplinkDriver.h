@@ -0,0 +1,39 @@
+// uplinkDriver.h
+#ifndef UPLINK_DRIVER_H
+#define UPLINK_DRIVER_H
+
+// 上行链路,按优先级排列: 序号小的费用低,健康时优先使用
+enum Uplink_t {
+    UPLINK_NONE = -1,
+    UPLINK_WIFI = 0,                // WiFi STA
+    UPLINK_PPP,                     // A7680C 4G PPP拨号
+    UPLINK_COUNT
+};
+
+// 一次健康探测的结果
+enum UplinkProbe_t {
+    UPLINK_PROBE_PENDING = 0,       // 探测进行中
+    UPLINK_PROBE_OK,                // 收到应答,rtt有效
+    UPLINK_PROBE_FAILED             // 连接被拒绝或出错
+};
+
+// 上行链路驱动抽象: LinkManager只通过这几个调用检查链路,
+// 设备上由EspUplink(myUplink.h)实现,主机测试中由SimUplink(simUplink.h)实现
+class UplinkDriver {
+public:
+    virtual ~UplinkDriver() {}
+
+    // 链路是否已建立(WiFi获得IP / PPP拨号成功)
+    virtual bool linkUp() = 0;
+
+    // 经由本链路向MQTT服务器发起一次探测,必须立即返回;无法发起时返回false
+    virtual bool startProbe() = 0;
+
+    // 查询进行中的探测;完成时填写往返时间(ms)
+    virtual UplinkProbe_t pollProbe(unsigned long& rtt) = 0;
+
+    // 放弃进行中的探测(超时或链路断开)
+    virtual void cancelProbe() = 0;
+};
+
+#endif // UPLINK_DRIVER_H
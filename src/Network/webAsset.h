@@ -0,0 +1,17 @@
+// webAsset.h
+#ifndef WEB_ASSET_H
+#define WEB_ASSET_H
+
+#include <stdint.h>
+
+// 嵌入固件的网页资源,内容为gzip压缩后的数据,存放在flash中
+// 资源表由 scripts/embed_web_assets.py 生成到 webAssets.h
+struct WebAsset {
+    const char* path;               // 请求路径,如 "/portal.html"
+    const char* contentType;
+    const uint8_t* data;            // gzip数据(PROGMEM)
+    uint32_t length;
+    const char* etag;               // 带引号的ETag,内容变化时改变
+};
+
+#endif // WEB_ASSET_H
@@ -0,0 +1,228 @@
+// wifiConnector.cpp
+#include "wifiConnector.h"
+#include <string.h>
+
+WiFiConnector::WiFiConnector(WiFiDriver& driver) : driver(driver) {
+    ssid[0] = '\0';
+    password[0] = '\0';
+    state = WIFI_LINK_IDLE;
+    stateSince = 0;
+    lastCheckTime = 0;
+    attempts = 0;
+    eventUp = false;
+    eventDown = false;
+    memset(&fast, 0, sizeof(fast));
+    fastChanged = false;
+    fastAttempt = false;
+    leaseReused = false;
+    memset(&staticIP, 0, sizeof(staticIP));
+    sequenceStart = 0;
+    timeToIP = 0;
+    connectedFast = false;
+}
+
+void WiFiConnector::start(const char* newSSID, const char* newPassword, unsigned long now) {
+    strncpy(ssid, newSSID ? newSSID : "", sizeof(ssid) - 1);
+    ssid[sizeof(ssid) - 1] = '\0';
+    strncpy(password, newPassword ? newPassword : "", sizeof(password) - 1);
+    password[sizeof(password) - 1] = '\0';
+
+    attempts = 0;
+    if (ssid[0] == '\0') {
+        stop();
+        return;
+    }
+    beginSequence(now);
+}
+
+void WiFiConnector::stop() {
+    if (state != WIFI_LINK_IDLE) {
+        driver.disconnect();
+    }
+    state = WIFI_LINK_IDLE;
+    attempts = 0;
+}
+
+void WiFiConnector::setStaticIP(uint32_t ip, uint32_t mask, uint32_t gateway, uint32_t dns) {
+    staticIP.ip = ip;
+    staticIP.mask = mask;
+    staticIP.gateway = gateway;
+    staticIP.dns = dns ? dns : gateway;
+}
+
+void WiFiConnector::setFastConnect(const WiFiFastConnect& info) {
+    fast = info;
+    fastChanged = false;
+}
+
+bool WiFiConnector::getFastConnect(WiFiFastConnect& info) {
+    info = fast;
+    return fast.channel != 0;
+}
+
+bool WiFiConnector::takeFastConnectChanged() {
+    bool changed = fastChanged;
+    fastChanged = false;
+    return changed;
+}
+
+void WiFiConnector::clearFastConnect() {
+    if (fast.channel != 0) {
+        fastChanged = true;
+    }
+    memset(&fast, 0, sizeof(fast));
+}
+
+void WiFiConnector::notifyConnected() {
+    eventUp = true;
+}
+
+void WiFiConnector::notifyDisconnected() {
+    eventDown = true;
+}
+
+WiFiLinkEvent_t WiFiConnector::update(unsigned long now) {
+    // 事件只是提示,以驱动报告的实际状态为准,避免过期事件导致误判
+    bool up = eventUp;
+    bool down = eventDown;
+    eventUp = false;
+    eventDown = false;
+
+    switch (state) {
+    case WIFI_LINK_CONNECTING:
+        if (driver.connected()) {
+            linkUp(now);
+            return WIFI_LINK_EVENT_UP;
+        }
+        if (fastAttempt && now - stateSince >= WIFI_FAST_CONNECT_TIMEOUT) {
+            // AP换了信道、换了设备或租约失效: 丢弃快速连接信息,立即普通连接
+            driver.disconnect();
+            clearFastConnect();
+            beginAttempt(now, false);
+            return WIFI_LINK_EVENT_FALLBACK;
+        }
+        if (now - stateSince >= WIFI_CONNECT_TIMEOUT) {
+            attempts++;
+            driver.disconnect();
+            enter(WIFI_LINK_WAITING, now);
+            return WIFI_LINK_EVENT_FAILED;
+        }
+        break;
+
+    case WIFI_LINK_CONNECTED: {
+        bool check = down;
+        if (now - lastCheckTime >= WIFI_CHECK_INTERVAL) {
+            lastCheckTime = now;
+            check = true;
+        }
+        if (check && !driver.connected()) {
+            // 断线后立即重连,不等待重连间隔
+            attempts = 0;
+            beginSequence(now);
+            return WIFI_LINK_EVENT_DOWN;
+        }
+        break;
+    }
+
+    case WIFI_LINK_WAITING: {
+        if (up && driver.connected()) {
+            linkUp(now);
+            return WIFI_LINK_EVENT_UP;
+        }
+        // 智能重连间隔: 前几次快速重连,之后慢速重连
+        unsigned long interval = (attempts < WIFI_FAST_RETRY_TIMES) ?
+                                 WIFI_RECONNECT_INTERVAL :
+                                 WIFI_RECONNECT_INTERVAL_SLOW;
+        if (now - stateSince >= interval) {
+            beginAttempt(now, false);
+            return WIFI_LINK_EVENT_RETRY;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+    return WIFI_LINK_EVENT_NONE;
+}
+
+WiFiLinkState_t WiFiConnector::getState() {
+    return state;
+}
+
+int WiFiConnector::getAttempts() {
+    return attempts;
+}
+
+unsigned long WiFiConnector::getTimeToIP() {
+    return timeToIP;
+}
+
+bool WiFiConnector::lastConnectWasFast() {
+    return connectedFast;
+}
+
+// ============ 私有函数实现 ============
+
+// 启动或断线后的第一次尝试,有快速连接信息时使用
+void WiFiConnector::beginSequence(unsigned long now) {
+    sequenceStart = now;
+    beginAttempt(now, fast.channel != 0);
+}
+
+void WiFiConnector::beginAttempt(unsigned long now, bool useFast) {
+    // 丢弃上一次尝试遗留的事件
+    eventUp = false;
+    eventDown = false;
+    fastAttempt = useFast;
+    leaseReused = false;
+    enter(WIFI_LINK_CONNECTING, now);
+
+    WiFiLinkParams params = staticIP;
+    if (useFast) {
+        params.bssid = fast.bssid;
+        params.channel = fast.channel;
+#if WIFI_FAST_CONNECT_REUSE_LEASE
+        if (params.ip == 0 && fast.ip != 0) {
+            params.ip = fast.ip;
+            params.mask = fast.mask;
+            params.gateway = fast.gateway;
+            params.dns = fast.dns ? fast.dns : fast.gateway;
+            leaseReused = true;
+        }
+#endif
+    }
+    driver.begin(ssid, password, params);
+}
+
+void WiFiConnector::linkUp(unsigned long now) {
+    attempts = 0;
+    timeToIP = now - sequenceStart;
+    connectedFast = fastAttempt;
+    enter(WIFI_LINK_CONNECTED, now);
+
+    // 记下这次连接的AP、信道和IP,供下次快速连接
+    WiFiFastConnect info;
+    memset(&info, 0, sizeof(info));
+    if (driver.linkInfo(info) && info.channel != 0) {
+        if (leaseReused) {
+            // 沿用的租约没有经过DHCP续租,不再保存,下次连接重新走DHCP
+            info.ip = 0;
+            info.mask = 0;
+            info.gateway = 0;
+            info.dns = 0;
+        }
+        if (memcmp(info.bssid, fast.bssid, sizeof(info.bssid)) != 0 ||
+            info.channel != fast.channel || info.ip != fast.ip || info.mask != fast.mask ||
+            info.gateway != fast.gateway || info.dns != fast.dns) {
+            fast = info;
+            fastChanged = true;
+        }
+    }
+}
+
+void WiFiConnector::enter(WiFiLinkState_t newState, unsigned long now) {
+    state = newState;
+    stateSince = now;
+    lastCheckTime = now;
+}
@@ -0,0 +1,126 @@
+// wifiConnector.h
+#ifndef WIFI_CONNECTOR_H
+#define WIFI_CONNECTOR_H
+
+#include <stdint.h>
+#include "wifiDriver.h"
+
+// WiFi连接参数
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT 10000             // 单次连接尝试超时时间(ms)
+#endif
+#ifndef WIFI_FAST_CONNECT_TIMEOUT
+#define WIFI_FAST_CONNECT_TIMEOUT 3000         // 使用上次AP/信道的快速连接超时,超时后改为全信道扫描连接(ms)
+#endif
+#ifndef WIFI_FAST_CONNECT_REUSE_LEASE
+#define WIFI_FAST_CONNECT_REUSE_LEASE 0        // 快速连接时把上次的DHCP租约当作静态IP沿用一次,省去DHCP过程
+#endif                                         // 该次连接不会续租,默认关闭,只沿用BSSID/信道
+#ifndef WIFI_RECONNECT_INTERVAL
+#define WIFI_RECONNECT_INTERVAL 5000           // 快速重连间隔(5秒)
+#endif
+#ifndef WIFI_RECONNECT_INTERVAL_SLOW
+#define WIFI_RECONNECT_INTERVAL_SLOW 30000     // 慢速重连间隔(30秒)
+#endif
+#ifndef WIFI_FAST_RETRY_TIMES
+#define WIFI_FAST_RETRY_TIMES 3                // 快速重连次数,之后使用慢速间隔
+#endif
+#ifndef WIFI_CHECK_INTERVAL
+#define WIFI_CHECK_INTERVAL 5000               // 已连接时主动检查连接状态的间隔(ms)
+#endif
+
+// 连接状态机的状态
+enum WiFiLinkState_t {
+    WIFI_LINK_IDLE = 0,             // 未启动
+    WIFI_LINK_CONNECTING,           // 连接尝试进行中
+    WIFI_LINK_CONNECTED,            // 已连接
+    WIFI_LINK_WAITING               // 尝试失败,等待下次重连
+};
+
+// update()报告的状态变化
+enum WiFiLinkEvent_t {
+    WIFI_LINK_EVENT_NONE = 0,       // 无变化
+    WIFI_LINK_EVENT_UP,             // 连接成功
+    WIFI_LINK_EVENT_DOWN,           // 已建立的连接断开,已立即发起重连
+    WIFI_LINK_EVENT_FAILED,         // 一次连接尝试超时
+    WIFI_LINK_EVENT_RETRY,          // 等待结束,发起新一次连接尝试
+    WIFI_LINK_EVENT_FALLBACK        // 快速连接失败,已改为全信道扫描连接
+};
+
+// 非阻塞的STA连接状态机
+// 所有调用立即返回: 连接在后台进行,由update()根据时间和驱动事件推进,
+// 替代原先 while(...) delay(500) 的等待循环。不依赖Arduino,可在主机上测试。
+//
+// 启动和断线后的第一次尝试使用上次连接的BSSID/信道直接连接,省去扫描;
+// 失败时清除这些信息,立即改为普通连接。
+// 定义WIFI_FAST_CONNECT_REUSE_LEASE=1时还沿用上次DHCP获得的IP,省去DHCP。
+// 沿用的IP不会续租,所以只用一次: 下次连接重新走DHCP,取得新的租约。
+class WiFiConnector {
+public:
+    explicit WiFiConnector(WiFiDriver& driver);
+
+    // 保存凭据并立即发起第一次连接
+    void start(const char* ssid, const char* password, unsigned long now);
+
+    // 断开并停止重连
+    void stop();
+
+    // 静态IP配置,ip为0表示使用DHCP;dns为0时使用网关
+    void setStaticIP(uint32_t ip, uint32_t mask, uint32_t gateway, uint32_t dns);
+
+    // 载入保存的快速连接信息(channel为0表示没有)
+    void setFastConnect(const WiFiFastConnect& info);
+
+    // 读取当前的快速连接信息,无效时返回false
+    bool getFastConnect(WiFiFastConnect& info);
+
+    // 快速连接信息是否有变化需要保存,调用后清除标志
+    bool takeFastConnectChanged();
+
+    // 清除快速连接信息(例如更换了SSID)
+    void clearFastConnect();
+
+    // 在驱动事件回调中调用(可能在WiFi事件任务中执行,只设置标志)
+    void notifyConnected();
+    void notifyDisconnected();
+
+    // 推进状态机,需在loop中调用;返回本次发生的状态变化
+    WiFiLinkEvent_t update(unsigned long now);
+
+    WiFiLinkState_t getState();
+
+    // 当前这轮重连已失败的次数(连接成功后清零)
+    int getAttempts();
+
+    // 最近一次从开始连接(启动或断线)到获得IP的时间(ms)
+    unsigned long getTimeToIP();
+
+    // 最近一次连接是否由快速连接完成
+    bool lastConnectWasFast();
+
+private:
+    WiFiDriver& driver;
+    char ssid[33];
+    char password[65];
+    WiFiLinkState_t state;
+    unsigned long stateSince;       // 进入当前状态的时间
+    unsigned long lastCheckTime;    // 上次主动检查连接的时间
+    int attempts;
+    volatile bool eventUp;
+    volatile bool eventDown;
+
+    WiFiFastConnect fast;           // 快速连接信息,channel为0表示无效
+    bool fastChanged;
+    bool fastAttempt;               // 当前尝试是否为快速连接
+    bool leaseReused;               // 当前尝试是否沿用了保存的租约
+    WiFiLinkParams staticIP;        // 静态IP配置(bssid/channel不用)
+    unsigned long sequenceStart;    // 本轮连接开始的时间(启动或断线)
+    unsigned long timeToIP;
+    bool connectedFast;
+
+    void beginSequence(unsigned long now);
+    void beginAttempt(unsigned long now, bool useFast);
+    void linkUp(unsigned long now);
+    void enter(WiFiLinkState_t newState, unsigned long now);
+};
+
+#endif // WIFI_CONNECTOR_H
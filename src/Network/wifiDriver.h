@@ -0,0 +1,46 @@
+// wifiDriver.h
+#ifndef WIFI_DRIVER_H
+#define WIFI_DRIVER_H
+
+#include <stdint.h>
+
+// 快速连接所需的上次连接信息,连接成功后由驱动读出,保存在NVS中
+struct WiFiFastConnect {
+    uint8_t bssid[6];               // 上次连接的AP
+    int32_t channel;                // 上次连接的信道,0表示无效
+    uint32_t ip;                    // 上次获得的IP地址租约
+    uint32_t mask;
+    uint32_t gateway;
+    uint32_t dns;
+};
+
+// 一次连接尝试的参数
+struct WiFiLinkParams {
+    const uint8_t* bssid;           // 指定AP,nullptr表示扫描全部信道
+    int32_t channel;                // 指定信道,0表示全部信道
+    uint32_t ip;                    // 静态IP,0表示使用DHCP
+    uint32_t mask;
+    uint32_t gateway;
+    uint32_t dns;
+};
+
+// WiFi驱动抽象: WiFiConnector只通过这几个调用操作STA连接,
+// 设备上由EspWiFiDriver(myWifi.h)转发给WiFi库,主机测试中由模拟驱动实现
+class WiFiDriver {
+public:
+    virtual ~WiFiDriver() {}
+
+    // 发起STA连接,必须立即返回;结果通过事件或connected()得知
+    virtual void begin(const char* ssid, const char* password, const WiFiLinkParams& params) = 0;
+
+    // 放弃当前连接/连接尝试
+    virtual void disconnect() = 0;
+
+    // STA是否已连接并获得IP
+    virtual bool connected() = 0;
+
+    // 读取当前连接的AP、信道和IP配置,未连接时返回false
+    virtual bool linkInfo(WiFiFastConnect& info) = 0;
+};
+
+#endif // WIFI_DRIVER_H
@@ -0,0 +1,162 @@
+// wifiScanCache.cpp
+#include "wifiScanCache.h"
+#include <stdio.h>
+#include <string.h>
+
+WiFiScanCache::WiFiScanCache() {
+    resultCount = 0;
+    hasResults = false;
+    hasScanned = false;
+    updatedTime = 0;
+    scanTime = 0;
+}
+
+void WiFiScanCache::clear() {
+    resultCount = 0;
+}
+
+void WiFiScanCache::add(const char* ssid, int rssi, uint8_t encryption) {
+    if (ssid == nullptr || ssid[0] == '\0') {
+        return;
+    }
+    if (rssi < -128) {
+        rssi = -128;
+    } else if (rssi > 0) {
+        rssi = 0;
+    }
+
+    // 同名网络(多个AP)只保留信号最强的
+    int pos = resultCount;
+    for (int i = 0; i < resultCount; i++) {
+        if (strncmp(results[i].ssid, ssid, sizeof(results[i].ssid) - 1) == 0) {
+            if (results[i].rssi >= rssi) {
+                return;
+            }
+            pos = i;
+            break;
+        }
+    }
+    if (pos == resultCount) {
+        if (resultCount < WIFI_SCAN_MAX_RESULTS) {
+            resultCount++;
+        } else if (results[resultCount - 1].rssi >= rssi) {
+            // 已满且比最弱的还弱
+            return;
+        } else {
+            pos = resultCount - 1;
+        }
+    }
+
+    // 按信号强度从强到弱插入
+    while (pos > 0 && results[pos - 1].rssi < rssi) {
+        results[pos] = results[pos - 1];
+        pos--;
+    }
+    strncpy(results[pos].ssid, ssid, sizeof(results[pos].ssid) - 1);
+    results[pos].ssid[sizeof(results[pos].ssid) - 1] = '\0';
+    results[pos].rssi = (int8_t)rssi;
+    results[pos].encryption = encryption;
+}
+
+void WiFiScanCache::commit(unsigned long now) {
+    hasResults = true;
+    updatedTime = now;
+}
+
+void WiFiScanCache::scanStarted(unsigned long now) {
+    hasScanned = true;
+    scanTime = now;
+}
+
+bool WiFiScanCache::scanDue(unsigned long now) {
+    return !hasScanned || now - scanTime >= WIFI_SCAN_INTERVAL;
+}
+
+bool WiFiScanCache::isFresh(unsigned long now) {
+    return hasResults && now - updatedTime < WIFI_SCAN_TTL;
+}
+
+void WiFiScanCache::requestScan() {
+    hasScanned = false;
+}
+
+int WiFiScanCache::count() {
+    return resultCount;
+}
+
+const WiFiScanResult& WiFiScanCache::get(int index) {
+    return results[index];
+}
+
+size_t WiFiScanCache::writeJSON(char* buffer, size_t size, int& cursor) {
+    size_t length = 0;
+
+    // cursor: 0 未开始, 1..resultCount 下一条结果的序号, resultCount+1 待写']', 之后结束
+    if (cursor == 0) {
+        if (size < 1) {
+            return 0;
+        }
+        buffer[length++] = '[';
+        cursor = 1;
+    }
+    while (cursor <= resultCount) {
+        size_t n = writeEntry(results[cursor - 1], cursor == 1, buffer + length, size - length);
+        if (n == 0) {
+            return length;
+        }
+        length += n;
+        cursor++;
+    }
+    if (cursor == resultCount + 1 && length < size) {
+        buffer[length++] = ']';
+        cursor++;
+    }
+    return length;
+}
+
+// ============ 私有函数实现 ============
+
+// 写入一条结果,空间不足时返回0且不写入
+size_t WiFiScanCache::writeEntry(const WiFiScanResult& result, bool first, char* buffer, size_t size) {
+    char tail[40];
+    int tailLength = snprintf(tail, sizeof(tail), "\",\"rssi\":%d,\"encryption\":%u}",
+                              result.rssi, result.encryption);
+
+    size_t length = 0;
+    const char* head = first ? "{\"ssid\":\"" : ",{\"ssid\":\"";
+    size_t headLength = strlen(head);
+    if (headLength > size) {
+        return 0;
+    }
+    memcpy(buffer, head, headLength);
+    length = headLength;
+
+    // SSID中的引号、反斜杠和控制字符需要转义
+    for (const char* p = result.ssid; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        char escaped[7];
+        size_t n;
+        if (c == '"' || c == '\\') {
+            escaped[0] = '\\';
+            escaped[1] = (char)c;
+            n = 2;
+        } else if (c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            n = 6;
+        } else {
+            escaped[0] = (char)c;
+            n = 1;
+        }
+        if (length + n > size) {
+            return 0;
+        }
+        memcpy(buffer + length, escaped, n);
+        length += n;
+    }
+
+    if (length + tailLength > size) {
+        return 0;
+    }
+    memcpy(buffer + length, tail, tailLength);
+    return length + tailLength;
+}
@@ -0,0 +1,75 @@
+// wifiScanCache.h
+#ifndef WIFI_SCAN_CACHE_H
+#define WIFI_SCAN_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// WiFi扫描参数
+#ifndef WIFI_SCAN_MAX_RESULTS
+#define WIFI_SCAN_MAX_RESULTS 20               // 缓存的网络数量上限(保留信号最强的)
+#endif
+#ifndef WIFI_SCAN_INTERVAL
+#define WIFI_SCAN_INTERVAL 30000               // 配网门户运行时后台扫描间隔(ms)
+#endif
+#ifndef WIFI_SCAN_TTL
+#define WIFI_SCAN_TTL 60000                    // 扫描结果有效期(ms),过期后请求时立即重新扫描
+#endif
+#define WIFI_SCAN_JSON_CHUNK 256               // writeJSON缓冲区的最小长度,可容纳任意一条结果
+
+// 单个扫描到的网络
+struct WiFiScanResult {
+    char ssid[33];
+    int8_t rssi;
+    uint8_t encryption;
+};
+
+// 后台扫描结果缓存
+// 结果按信号强度排序、同名网络只保留最强的一个,存放在固定数组中;
+// writeJSON()把结果分段写入调用者的固定缓冲区,生成JSON时不分配堆内存。
+// 不依赖Arduino,可在主机上测试。
+class WiFiScanCache {
+public:
+    WiFiScanCache();
+
+    // 开始写入新一轮结果
+    void clear();
+
+    // 添加一个网络;隐藏网络(空SSID)被忽略
+    void add(const char* ssid, int rssi, uint8_t encryption);
+
+    // 一轮结果写入完成
+    void commit(unsigned long now);
+
+    // 记录发起扫描的时间
+    void scanStarted(unsigned long now);
+
+    // 是否应发起后台扫描
+    bool scanDue(unsigned long now);
+
+    // 结果是否在有效期内
+    bool isFresh(unsigned long now);
+
+    // 让下一次scanDue()返回true
+    void requestScan();
+
+    int count();
+    const WiFiScanResult& get(int index);
+
+    // 把结果以JSON数组 [{"ssid":"..","rssi":-45,"encryption":3},...] 写入buffer,
+    // 每次写入尽可能多的完整条目,返回写入的字节数,全部写完后返回0。
+    // cursor记录进度,首次调用前置0;size至少为WIFI_SCAN_JSON_CHUNK
+    size_t writeJSON(char* buffer, size_t size, int& cursor);
+
+private:
+    WiFiScanResult results[WIFI_SCAN_MAX_RESULTS];
+    int resultCount;
+    bool hasResults;
+    bool hasScanned;
+    unsigned long updatedTime;      // 上次结果更新的时间
+    unsigned long scanTime;         // 上次发起扫描的时间
+
+    size_t writeEntry(const WiFiScanResult& result, bool first, char* buffer, size_t size);
+};
+
+#endif // WIFI_SCAN_CACHE_H
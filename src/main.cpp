@@ -1,5 +1,6 @@
 #include "main.h"
 #include "Network/myWifi.h"
+#include "Network/myUplink.h"
 
 void setup()
 {
@@ -14,6 +15,10 @@ void setup()
   Serial.println("\n[SETUP] Initializing WiFi...");
   myWiFi.begin();
 
+  // 初始化上行链路管理(WiFi/4G切换)
+  Serial.println("\n[SETUP] Initializing uplinks...");
+  myUplink.begin();
+
   Serial.println("\n[SETUP] Setup completed.");
 }
 
@@ -22,6 +27,9 @@ void loop()
   // 处理WiFi状态和自动重连
   myWiFi.handle();
 
+  // 探测链路健康状况,必要时在WiFi和4G之间切换
+  myUplink.handle();
+
   // 每10秒打印一次WiFi状态信息
   static unsigned long lastPrint = 0;
   if (millis() - lastPrint > 10000) {
@@ -35,6 +43,7 @@ void loop()
       Serial.printf("Connected to: %s\n", myWiFi.getConnectedSSID().c_str());
       Serial.printf("IP Address: %s\n", myWiFi.getLocalIP().c_str());
       Serial.printf("Signal: %d dBm\n", myWiFi.getRSSI());
+      Serial.printf("Time to IP: %lu ms\n", myWiFi.getTimeToIP());
     } else {
       Serial.println("Not connected to WiFi");
       wifi_mode_t mode = myWiFi.getCurrentMode();
@@ -43,6 +52,13 @@ void loop()
         Serial.printf("AP Clients: %d\n", myWiFi.getConnectedClients());
       }
     }
+    Uplink_t uplink = myUplink.getActive();
+    Serial.printf("Uplink: %s", LinkManager::name(uplink));
+    if (uplink != UPLINK_NONE) {
+      Serial.printf(" (rtt %lu ms, loss %u%%)", myUplink.getHealth(uplink).rtt,
+                    myUplink.getHealth(uplink).loss);
+    }
+    Serial.printf(", switches: %lu\n", myUplink.getSwitches());
     Serial.println("=================================\n");
   }
 
@@ -0,0 +1,201 @@
+// LinkManager切换策略的主机测试: pio test -e native
+#include <unity.h>
+#include "Network/linkManager.h"
+#include "Network/simUplink.h"
+
+static unsigned long now;
+static SimUplink* wifi;
+static SimUplink* ppp;
+static LinkManager* manager;
+static int switchEvents;
+static int lostEvents;
+
+void setUp() {
+    now = 0;
+    wifi = new SimUplink(now, 1);
+    ppp = new SimUplink(now, 2);
+    manager = new LinkManager(*wifi, *ppp);
+    switchEvents = 0;
+    lostEvents = 0;
+}
+
+void tearDown() {
+    delete manager;
+    delete ppp;
+    delete wifi;
+}
+
+// 以10ms为步长运行到指定时间,统计事件
+static void runUntil(unsigned long until) {
+    while (now < until) {
+        now += 10;
+        UplinkEvent_t event = manager->update(now);
+        if (event == UPLINK_EVENT_SWITCHED) {
+            switchEvents++;
+        } else if (event == UPLINK_EVENT_LOST) {
+            lostEvents++;
+        }
+    }
+}
+
+void test_starts_on_first_healthy_link() {
+    wifi->setUp(true);
+    wifi->setRTT(40);
+    ppp->setUp(true);
+    ppp->setRTT(200);
+    runUntil(1000);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+    TEST_ASSERT_EQUAL(1, switchEvents);
+    TEST_ASSERT_EQUAL(40, manager->getHealth(UPLINK_WIFI).rtt);
+    TEST_ASSERT_EQUAL(0, manager->getHealth(UPLINK_WIFI).loss);
+}
+
+void test_link_down_fails_over_immediately() {
+    wifi->setUp(true);
+    ppp->setUp(true);
+    runUntil(1000);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+
+    wifi->setUp(false);
+    runUntil(1010);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getPrevious());
+    TEST_ASSERT_FALSE(manager->getHealth(UPLINK_WIFI).up);
+}
+
+void test_probe_loss_fails_over_after_consecutive_failures() {
+    wifi->setUp(true);
+    ppp->setUp(true);
+    runUntil(1000);
+
+    // WiFi已连接但服务器不可达(例如路由器没有外网)
+    wifi->setLoss(100);
+    unsigned long lossStart = now;
+    runUntil(lossStart + (LINK_FAIL_PROBES - 1) * LINK_PROBE_INTERVAL);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+    runUntil(lossStart + LINK_FAIL_PROBES * LINK_PROBE_INTERVAL + LINK_PROBE_TIMEOUT);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    TEST_ASSERT_EQUAL(2, switchEvents);
+}
+
+void test_high_rtt_fails_over() {
+    wifi->setUp(true);
+    wifi->setRTT(100);
+    ppp->setUp(true);
+    ppp->setRTT(300);
+    runUntil(1000);
+
+    wifi->setRTT(2500);
+    runUntil(1000 + 10 * LINK_PROBE_INTERVAL);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    TEST_ASSERT_FALSE(manager->getHealth(UPLINK_WIFI).healthy);
+}
+
+void test_fails_back_after_hold() {
+    ppp->setUp(true);
+    runUntil(1000);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+
+    wifi->setUp(true);
+    unsigned long wifiUp = now;
+    runUntil(wifiUp + LINK_FAILBACK_HOLD - 100);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    runUntil(wifiUp + LINK_FAILBACK_HOLD + 1000);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+    TEST_ASSERT_EQUAL(2, switchEvents);
+}
+
+void test_flapping_wifi_does_not_flap_uplink() {
+    wifi->setUp(true);
+    ppp->setUp(true);
+    runUntil(1000);
+
+    // WiFi每20秒断开5秒: 只切换到4G一次,不会来回切换
+    for (int i = 0; i < 20; i++) {
+        wifi->setUp(false);
+        runUntil(now + 5000);
+        wifi->setUp(true);
+        runUntil(now + 20000);
+    }
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    TEST_ASSERT_EQUAL(2, switchEvents);
+}
+
+void test_recovery_needs_lower_thresholds() {
+    wifi->setUp(true);
+    wifi->setRTT(100);
+    ppp->setUp(true);
+    runUntil(1000);
+
+    // 往返时间回到两个门限之间时,不恢复健康
+    wifi->setRTT(2500);
+    runUntil(now + 10 * LINK_PROBE_INTERVAL);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+    wifi->setRTT((LINK_MAX_RTT + LINK_RECOVER_RTT) / 2);
+    runUntil(now + 20 * LINK_PROBE_INTERVAL);
+    TEST_ASSERT_FALSE(manager->getHealth(UPLINK_WIFI).healthy);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+
+    wifi->setRTT(100);
+    runUntil(now + 20 * LINK_PROBE_INTERVAL + LINK_FAILBACK_HOLD);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+}
+
+void test_standby_link_probed_less_often() {
+    wifi->setUp(true);
+    ppp->setUp(true);
+    runUntil(600000);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+    TEST_ASSERT_TRUE(wifi->getProbes() >= 600000 / LINK_PROBE_INTERVAL);
+    TEST_ASSERT_TRUE(ppp->getProbes() <= 600000 / LINK_STANDBY_PROBE_INTERVAL + 1);
+}
+
+void test_both_links_down_reports_lost() {
+    wifi->setUp(true);
+    runUntil(1000);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+
+    wifi->setUp(false);
+    runUntil(2000);
+    TEST_ASSERT_EQUAL(UPLINK_NONE, manager->getActive());
+    TEST_ASSERT_EQUAL(1, lostEvents);
+
+    ppp->setUp(true);
+    runUntil(3000);
+    TEST_ASSERT_EQUAL(UPLINK_PPP, manager->getActive());
+}
+
+void test_stays_on_degraded_link_without_alternative() {
+    wifi->setUp(true);
+    runUntil(1000);
+    wifi->setLoss(100);
+    runUntil(60000);
+    TEST_ASSERT_FALSE(manager->getHealth(UPLINK_WIFI).healthy);
+    TEST_ASSERT_EQUAL(UPLINK_WIFI, manager->getActive());
+    TEST_ASSERT_EQUAL(0, lostEvents);
+}
+
+void test_partial_loss_measured() {
+    wifi->setUp(true);
+    wifi->setLoss(50);
+    runUntil(LINK_PROBE_WINDOW * LINK_PROBE_INTERVAL * 4);
+    const UplinkHealth& health = manager->getHealth(UPLINK_WIFI);
+    TEST_ASSERT_EQUAL(LINK_PROBE_WINDOW, health.samples);
+    TEST_ASSERT_TRUE(health.loss >= 10 && health.loss <= 90);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_starts_on_first_healthy_link);
+    RUN_TEST(test_link_down_fails_over_immediately);
+    RUN_TEST(test_probe_loss_fails_over_after_consecutive_failures);
+    RUN_TEST(test_high_rtt_fails_over);
+    RUN_TEST(test_fails_back_after_hold);
+    RUN_TEST(test_flapping_wifi_does_not_flap_uplink);
+    RUN_TEST(test_recovery_needs_lower_thresholds);
+    RUN_TEST(test_standby_link_probed_less_often);
+    RUN_TEST(test_both_links_down_reports_lost);
+    RUN_TEST(test_stays_on_degraded_link_without_alternative);
+    RUN_TEST(test_partial_loss_measured);
+    return UNITY_END();
+}
@@ -0,0 +1,309 @@
+// WiFiConnector状态机的主机测试: pio test -e native
+#include <unity.h>
+#include <string.h>
+#include "Network/wifiConnector.h"
+
+// 模拟WiFi驱动: 记录调用,连接结果由测试设置
+class FakeWiFiDriver : public WiFiDriver {
+public:
+    int begins = 0;
+    int disconnects = 0;
+    bool link = false;
+    char lastSSID[33] = "";
+    WiFiLinkParams lastParams = {};
+    bool lastHadBSSID = false;
+    bool hasInfo = false;           // 连接后linkInfo()是否报告信息
+    WiFiFastConnect info = {};
+
+    void begin(const char* ssid, const char* password, const WiFiLinkParams& params) override {
+        begins++;
+        strncpy(lastSSID, ssid, sizeof(lastSSID) - 1);
+        lastParams = params;
+        lastHadBSSID = params.bssid != nullptr;
+    }
+    void disconnect() override {
+        disconnects++;
+        link = false;
+    }
+    bool connected() override {
+        return link;
+    }
+    bool linkInfo(WiFiFastConnect& out) override {
+        if (!link || !hasInfo) {
+            return false;
+        }
+        out = info;
+        return true;
+    }
+};
+
+static WiFiFastConnect makeFastConnect(int32_t channel, uint32_t ip) {
+    WiFiFastConnect info = {};
+    const uint8_t bssid[6] = {0x24, 0x0a, 0xc4, 0x11, 0x22, 0x33};
+    memcpy(info.bssid, bssid, sizeof(bssid));
+    info.channel = channel;
+    info.ip = ip;
+    info.mask = 0xffffff00;
+    info.gateway = 0xc0a80101;
+    info.dns = 0xc0a80101;
+    return info;
+}
+
+static FakeWiFiDriver* driver;
+static WiFiConnector* connector;
+
+void setUp() {
+    driver = new FakeWiFiDriver();
+    connector = new WiFiConnector(*driver);
+}
+
+void tearDown() {
+    delete connector;
+    delete driver;
+}
+
+void test_start_begins_connection_without_waiting() {
+    connector->start("office", "secret", 1000);
+    TEST_ASSERT_EQUAL(1, driver->begins);
+    TEST_ASSERT_EQUAL_STRING("office", driver->lastSSID);
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(1500));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+}
+
+void test_got_ip_event_connects() {
+    connector->start("office", "secret", 0);
+    driver->link = true;
+    connector->notifyConnected();
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(3000));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTED, connector->getState());
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(3010));
+}
+
+void test_timeout_fails_and_backs_off() {
+    connector->start("office", "secret", 0);
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(WIFI_CONNECT_TIMEOUT - 1));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FAILED, connector->update(WIFI_CONNECT_TIMEOUT));
+    TEST_ASSERT_EQUAL(WIFI_LINK_WAITING, connector->getState());
+    TEST_ASSERT_EQUAL(1, connector->getAttempts());
+    TEST_ASSERT_EQUAL(1, driver->disconnects);
+
+    unsigned long failedAt = WIFI_CONNECT_TIMEOUT;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(failedAt + WIFI_RECONNECT_INTERVAL - 1));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_RETRY, connector->update(failedAt + WIFI_RECONNECT_INTERVAL));
+    TEST_ASSERT_EQUAL(2, driver->begins);
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+}
+
+void test_slow_interval_after_fast_retries() {
+    unsigned long now = 0;
+    connector->start("office", "secret", now);
+    for (int i = 0; i < WIFI_FAST_RETRY_TIMES; i++) {
+        now += WIFI_CONNECT_TIMEOUT;
+        TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FAILED, connector->update(now));
+        if (i < WIFI_FAST_RETRY_TIMES - 1) {
+            now += WIFI_RECONNECT_INTERVAL;
+            TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_RETRY, connector->update(now));
+        }
+    }
+
+    // 快速重连用完后使用慢速间隔
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(now + WIFI_RECONNECT_INTERVAL));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_RETRY, connector->update(now + WIFI_RECONNECT_INTERVAL_SLOW));
+    TEST_ASSERT_EQUAL(WIFI_FAST_RETRY_TIMES + 1, driver->begins);
+}
+
+void test_disconnect_event_reconnects_immediately() {
+    connector->start("office", "secret", 0);
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(100));
+
+    driver->link = false;
+    connector->notifyDisconnected();
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_DOWN, connector->update(200));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+    TEST_ASSERT_EQUAL(2, driver->begins);
+    TEST_ASSERT_EQUAL(0, connector->getAttempts());
+}
+
+void test_stale_disconnect_event_is_ignored() {
+    connector->start("office", "secret", 0);
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(100));
+
+    connector->notifyDisconnected();
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(200));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTED, connector->getState());
+}
+
+void test_stale_connect_event_is_ignored() {
+    connector->start("office", "secret", 0);
+    // 上一次关联迟到的GOT_IP事件,驱动报告未连接
+    connector->notifyConnected();
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(100));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FAILED, connector->update(WIFI_CONNECT_TIMEOUT));
+}
+
+void test_lost_link_found_by_periodic_check() {
+    connector->start("office", "secret", 0);
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(100));
+
+    // 丢失的断线事件由周期检查发现
+    driver->link = false;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(100 + WIFI_CHECK_INTERVAL - 1));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_DOWN, connector->update(100 + WIFI_CHECK_INTERVAL));
+}
+
+void test_stop_and_empty_ssid() {
+    connector->start("office", "secret", 0);
+    connector->stop();
+    TEST_ASSERT_EQUAL(WIFI_LINK_IDLE, connector->getState());
+    TEST_ASSERT_EQUAL(1, driver->disconnects);
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(100000));
+    TEST_ASSERT_EQUAL(1, driver->begins);
+
+    connector->start("", "", 0);
+    TEST_ASSERT_EQUAL(WIFI_LINK_IDLE, connector->getState());
+    TEST_ASSERT_EQUAL(1, driver->begins);
+}
+
+void test_millis_wraparound() {
+    unsigned long start = (unsigned long)-1000;
+    connector->start("office", "secret", start);
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(start + 500));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FAILED, connector->update(start + WIFI_CONNECT_TIMEOUT));
+}
+
+void test_first_connect_scans_and_learns_link() {
+    driver->hasInfo = true;
+    driver->info = makeFastConnect(6, 0xc0a80164);
+    connector->start("office", "secret", 0);
+    TEST_ASSERT_FALSE(driver->lastHadBSSID);
+    TEST_ASSERT_EQUAL(0, driver->lastParams.channel);
+    TEST_ASSERT_EQUAL(0, driver->lastParams.ip);
+
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(4200));
+    TEST_ASSERT_EQUAL(4200, connector->getTimeToIP());
+    TEST_ASSERT_FALSE(connector->lastConnectWasFast());
+    TEST_ASSERT_TRUE(connector->takeFastConnectChanged());
+    TEST_ASSERT_FALSE(connector->takeFastConnectChanged());
+
+    WiFiFastConnect learned;
+    TEST_ASSERT_TRUE(connector->getFastConnect(learned));
+    TEST_ASSERT_EQUAL(6, learned.channel);
+    TEST_ASSERT_EQUAL(0xc0a80164, learned.ip);
+}
+
+void test_saved_link_connects_fast() {
+    WiFiFastConnect saved = makeFastConnect(11, 0xc0a80164);
+    connector->setFastConnect(saved);
+    connector->start("office", "secret", 0);
+    TEST_ASSERT_TRUE(driver->lastHadBSSID);
+    TEST_ASSERT_EQUAL(11, driver->lastParams.channel);
+    TEST_ASSERT_TRUE(memcmp(saved.bssid, driver->lastParams.bssid, 6) == 0);
+#if WIFI_FAST_CONNECT_REUSE_LEASE
+    TEST_ASSERT_EQUAL(0xc0a80164, driver->lastParams.ip);
+    TEST_ASSERT_EQUAL(0xc0a80101, driver->lastParams.gateway);
+#else
+    // 默认仍通过DHCP获得IP
+    TEST_ASSERT_EQUAL(0, driver->lastParams.ip);
+#endif
+
+    driver->hasInfo = true;
+    driver->info = saved;
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(350));
+    TEST_ASSERT_EQUAL(350, connector->getTimeToIP());
+    TEST_ASSERT_TRUE(connector->lastConnectWasFast());
+#if WIFI_FAST_CONNECT_REUSE_LEASE
+    // 沿用的租约没有续租,只用一次: 清除保存的IP,保留AP和信道
+    TEST_ASSERT_TRUE(connector->takeFastConnectChanged());
+    WiFiFastConnect kept;
+    TEST_ASSERT_TRUE(connector->getFastConnect(kept));
+    TEST_ASSERT_EQUAL(11, kept.channel);
+    TEST_ASSERT_EQUAL(0, kept.ip);
+#else
+    // 信息未变化时不需要重新保存
+    TEST_ASSERT_FALSE(connector->takeFastConnectChanged());
+#endif
+}
+
+void test_fast_connect_falls_back_to_scan() {
+    connector->setFastConnect(makeFastConnect(11, 0xc0a80164));
+    connector->start("office", "secret", 0);
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(WIFI_FAST_CONNECT_TIMEOUT - 1));
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FALLBACK, connector->update(WIFI_FAST_CONNECT_TIMEOUT));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, connector->getState());
+    TEST_ASSERT_EQUAL(2, driver->begins);
+    TEST_ASSERT_FALSE(driver->lastHadBSSID);
+    TEST_ASSERT_EQUAL(0, driver->lastParams.channel);
+    TEST_ASSERT_EQUAL(0, driver->lastParams.ip);
+
+    // 失效的信息被清除,需要同步清除保存的副本
+    WiFiFastConnect cleared;
+    TEST_ASSERT_FALSE(connector->getFastConnect(cleared));
+    TEST_ASSERT_TRUE(connector->takeFastConnectChanged());
+
+    // 普通连接仍使用完整的超时时间
+    unsigned long fellBackAt = WIFI_FAST_CONNECT_TIMEOUT;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_NONE, connector->update(fellBackAt + WIFI_CONNECT_TIMEOUT - 1));
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(fellBackAt + 2000));
+    TEST_ASSERT_EQUAL(fellBackAt + 2000, connector->getTimeToIP());
+    TEST_ASSERT_FALSE(connector->lastConnectWasFast());
+}
+
+void test_reconnect_after_drop_uses_fast_connect() {
+    driver->hasInfo = true;
+    driver->info = makeFastConnect(1, 0xc0a80164);
+    connector->start("office", "secret", 0);
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(3000));
+
+    driver->link = false;
+    connector->notifyDisconnected();
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_DOWN, connector->update(10000));
+    TEST_ASSERT_TRUE(driver->lastHadBSSID);
+    TEST_ASSERT_EQUAL(1, driver->lastParams.channel);
+
+    driver->link = true;
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_UP, connector->update(10400));
+    TEST_ASSERT_EQUAL(400, connector->getTimeToIP());
+    TEST_ASSERT_TRUE(connector->lastConnectWasFast());
+}
+
+void test_static_ip_passed_to_every_attempt() {
+    connector->setStaticIP(0xc0a8010a, 0xffffff00, 0xc0a80101, 0);
+    connector->setFastConnect(makeFastConnect(6, 0xc0a80164));
+    connector->start("office", "secret", 0);
+    // 静态IP优先于保存的租约,dns默认使用网关
+    TEST_ASSERT_EQUAL(0xc0a8010a, driver->lastParams.ip);
+    TEST_ASSERT_EQUAL(0xc0a80101, driver->lastParams.dns);
+
+    TEST_ASSERT_EQUAL(WIFI_LINK_EVENT_FALLBACK, connector->update(WIFI_FAST_CONNECT_TIMEOUT));
+    TEST_ASSERT_EQUAL(0xc0a8010a, driver->lastParams.ip);
+    TEST_ASSERT_EQUAL(0xffffff00, driver->lastParams.mask);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_start_begins_connection_without_waiting);
+    RUN_TEST(test_got_ip_event_connects);
+    RUN_TEST(test_timeout_fails_and_backs_off);
+    RUN_TEST(test_slow_interval_after_fast_retries);
+    RUN_TEST(test_disconnect_event_reconnects_immediately);
+    RUN_TEST(test_stale_disconnect_event_is_ignored);
+    RUN_TEST(test_stale_connect_event_is_ignored);
+    RUN_TEST(test_lost_link_found_by_periodic_check);
+    RUN_TEST(test_stop_and_empty_ssid);
+    RUN_TEST(test_millis_wraparound);
+    RUN_TEST(test_first_connect_scans_and_learns_link);
+    RUN_TEST(test_saved_link_connects_fast);
+    RUN_TEST(test_fast_connect_falls_back_to_scan);
+    RUN_TEST(test_reconnect_after_drop_uses_fast_connect);
+    RUN_TEST(test_static_ip_passed_to_every_attempt);
+    return UNITY_END();
+}
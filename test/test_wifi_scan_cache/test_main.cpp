@@ -0,0 +1,120 @@
+// WiFiScanCache的主机测试: pio test -e native
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "Network/wifiScanCache.h"
+
+static WiFiScanCache* cache;
+
+void setUp() {
+    cache = new WiFiScanCache();
+}
+
+void tearDown() {
+    delete cache;
+}
+
+// 用给定大小的缓冲区分段生成完整JSON
+static void render(char* out, size_t bufferSize) {
+    char buffer[512];
+    int cursor = 0;
+    size_t length;
+    out[0] = '\0';
+    while ((length = cache->writeJSON(buffer, bufferSize, cursor)) > 0) {
+        strncat(out, buffer, length);
+    }
+}
+
+void test_results_sorted_and_deduplicated() {
+    cache->clear();
+    cache->add("office", -70, 3);
+    cache->add("lab", -40, 4);
+    cache->add("office", -50, 3);
+    cache->add("office", -80, 3);
+    cache->add("", -30, 0);
+    cache->commit(0);
+
+    TEST_ASSERT_EQUAL(2, cache->count());
+    TEST_ASSERT_EQUAL_STRING("lab", cache->get(0).ssid);
+    TEST_ASSERT_EQUAL_STRING("office", cache->get(1).ssid);
+    TEST_ASSERT_EQUAL(-50, cache->get(1).rssi);
+}
+
+void test_keeps_strongest_when_full() {
+    char ssid[8];
+    cache->clear();
+    for (int i = 0; i < WIFI_SCAN_MAX_RESULTS + 5; i++) {
+        snprintf(ssid, sizeof(ssid), "n%d", i);
+        cache->add(ssid, -90 + i, 0);
+    }
+    TEST_ASSERT_EQUAL(WIFI_SCAN_MAX_RESULTS, cache->count());
+    TEST_ASSERT_EQUAL(-90 + WIFI_SCAN_MAX_RESULTS + 4, cache->get(0).rssi);
+    TEST_ASSERT_EQUAL(-85, cache->get(WIFI_SCAN_MAX_RESULTS - 1).rssi);
+}
+
+void test_json_streamed_through_small_buffer() {
+    char whole[1024];
+    char chunked[1024];
+    cache->clear();
+    cache->add("office", -50, 3);
+    cache->add("lab", -40, 4);
+    cache->add("guest", -60, 0);
+    cache->commit(0);
+
+    render(whole, 512);
+    TEST_ASSERT_EQUAL_STRING(
+        "[{\"ssid\":\"lab\",\"rssi\":-40,\"encryption\":4},"
+        "{\"ssid\":\"office\",\"rssi\":-50,\"encryption\":3},"
+        "{\"ssid\":\"guest\",\"rssi\":-60,\"encryption\":0}]", whole);
+
+    // 每次只能容纳一条结果时输出相同
+    render(chunked, 48);
+    TEST_ASSERT_EQUAL_STRING(whole, chunked);
+}
+
+void test_json_empty_and_escaped() {
+    char out[1024];
+    render(out, WIFI_SCAN_JSON_CHUNK);
+    TEST_ASSERT_EQUAL_STRING("[]", out);
+
+    cache->add("a\"b\\c\x01", -50, 3);
+    render(out, WIFI_SCAN_JSON_CHUNK);
+    TEST_ASSERT_EQUAL_STRING("[{\"ssid\":\"a\\\"b\\\\c\\u0001\",\"rssi\":-50,\"encryption\":3}]", out);
+
+    // 最长的转义SSID也能放入最小缓冲区
+    char worst[33];
+    memset(worst, 0x01, 32);
+    worst[32] = '\0';
+    cache->clear();
+    cache->add(worst, -100, 255);
+    char buffer[WIFI_SCAN_JSON_CHUNK];
+    int cursor = 0;
+    TEST_ASSERT_TRUE(cache->writeJSON(buffer, sizeof(buffer), cursor) > 200);
+    TEST_ASSERT_EQUAL(3, cursor);
+}
+
+void test_scan_schedule_and_ttl() {
+    TEST_ASSERT_TRUE(cache->scanDue(0));
+    TEST_ASSERT_FALSE(cache->isFresh(0));
+
+    cache->scanStarted(1000);
+    TEST_ASSERT_FALSE(cache->scanDue(1000 + WIFI_SCAN_INTERVAL - 1));
+    TEST_ASSERT_TRUE(cache->scanDue(1000 + WIFI_SCAN_INTERVAL));
+
+    cache->commit(4000);
+    TEST_ASSERT_TRUE(cache->isFresh(4000 + WIFI_SCAN_TTL - 1));
+    TEST_ASSERT_FALSE(cache->isFresh(4000 + WIFI_SCAN_TTL));
+
+    cache->requestScan();
+    TEST_ASSERT_TRUE(cache->scanDue(5000));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_results_sorted_and_deduplicated);
+    RUN_TEST(test_keeps_strongest_when_full);
+    RUN_TEST(test_json_streamed_through_small_buffer);
+    RUN_TEST(test_json_empty_and_escaped);
+    RUN_TEST(test_scan_schedule_and_ttl);
+    return UNITY_END();
+}